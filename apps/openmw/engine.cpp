@@ -2,8 +2,11 @@
 
 #include <stdexcept>
 #include <iomanip>
+#include <algorithm>
+#include <sstream>
 
 #include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
 
 #include <osgViewer/ViewerEventHandlers>
 #include <osgDB/ReadFile>
@@ -21,6 +24,9 @@
 
 #include <components/resource/resourcesystem.hpp>
 #include <components/resource/texturemanager.hpp>
+#include <components/resource/scenemanager.hpp>
+
+#include <components/sceneutil/workqueue.hpp>
 
 #include <components/compiler/extensions0.hpp>
 
@@ -62,20 +68,48 @@ namespace
         if (ret != 0)
             std::cerr << "SDL error: " << SDL_GetError() << std::endl;
     }
+
+    /// Identify the content files by path, size and modification time.
+    std::string getContentKey(const Files::Collections& fileCollections, const std::vector<std::string>& content)
+    {
+        std::ostringstream key;
+        for (std::vector<std::string>::const_iterator it = content.begin(); it != content.end(); ++it)
+        {
+            boost::filesystem::path filename(*it);
+            const Files::MultiDirCollection& col = fileCollections.getCollection(filename.extension().string());
+            if (!col.doesExist(*it))
+                continue;
+
+            boost::filesystem::path path = col.getPath(*it);
+            key << path.string() << ' ' << boost::filesystem::file_size(path) << ' '
+                << boost::filesystem::last_write_time(path) << '\n';
+        }
+        return key.str();
+    }
+
+    /// Identifies the build for the script cache, so that it is not used by a build that compiles scripts differently
+    std::string getBuildVersion(const boost::filesystem::path& resDir)
+    {
+        Version::Version version = Version::getOpenmwVersion(resDir.string());
+        return version.mVersion + " " + version.mCommitHash;
+    }
 }
 
 void OMW::Engine::executeLocalScripts()
 {
     MWWorld::LocalScripts& localScripts = mEnvironment.getWorld()->getLocalScripts();
 
-    localScripts.startIteration();
+    MWWorld::Ptr player = mEnvironment.getWorld()->getPlayerPtr();
+    localScripts.startIteration (mEnvironment.getFrameDuration(), player.getRefData().getPosition().asVec3());
 
     while (!localScripts.isFinished())
     {
-        std::pair<std::string, MWWorld::Ptr> script = localScripts.getNext();
+        float secondsPassed;
+        std::pair<std::string, MWWorld::Ptr> script = localScripts.getNext (secondsPassed);
 
         MWScript::InterpreterContext interpreterContext (
             &script.second.getRefData().getLocals(), script.second);
+        interpreterContext.setSecondsPassed (secondsPassed);
         mEnvironment.getScriptManager()->run (script.first, interpreterContext);
     }
 
@@ -89,6 +123,11 @@ void OMW::Engine::frame(float frametime)
         mStartTick = mViewer->getStartTick();
         mEnvironment.setFrameDuration (frametime);
 
+        // the physics simulation may have run during the last frame's rendering, finish it before anything else
+        osg::Timer_t beforePhysicsWaitTick = osg::Timer::instance()->tick();
+        mEnvironment.getWorld()->finishPhysics();
+        osg::Timer_t afterPhysicsWaitTick = osg::Timer::instance()->tick();
+
         // update input
         mEnvironment.getInputManager()->update(frametime, false);
 
@@ -163,6 +202,9 @@ void OMW::Engine::frame(float frametime)
         }
         osg::Timer_t afterPhysicsTick = osg::Timer::instance()->tick();
 
+        // drop resources that are no longer used from the caches
+        mResourceSystem->updateCache(osg::Timer::instance()->time_s());
+
         // update GUI
         mEnvironment.getWindowManager()->onFrame(frametime);
         if (mEnvironment.getStateManager()->getState()!=
@@ -179,6 +221,8 @@ void OMW::Engine::frame(float frametime)
         stats->setAttribute(frameNumber, "script_time_begin", osg::Timer::instance()->delta_s(mStartTick, beforeScriptTick));
         stats->setAttribute(frameNumber, "script_time_taken", osg::Timer::instance()->delta_s(beforeScriptTick, afterScriptTick));
         stats->setAttribute(frameNumber, "script_time_end", osg::Timer::instance()->delta_s(mStartTick, afterScriptTick));
+        stats->setAttribute(frameNumber, "script_local_run", mEnvironment.getWorld()->getLocalScripts().getNumRun());
+        stats->setAttribute(frameNumber, "script_local_deferred", mEnvironment.getWorld()->getLocalScripts().getNumDeferred());
 
         stats->setAttribute(frameNumber, "mechanics_time_begin", osg::Timer::instance()->delta_s(mStartTick, beforeMechanicsTick));
         stats->setAttribute(frameNumber, "mechanics_time_taken", osg::Timer::instance()->delta_s(beforeMechanicsTick, afterMechanicsTick));
@@ -188,6 +232,12 @@ void OMW::Engine::frame(float frametime)
         stats->setAttribute(frameNumber, "physics_time_taken", osg::Timer::instance()->delta_s(beforePhysicsTick, afterPhysicsTick));
         stats->setAttribute(frameNumber, "physics_time_end", osg::Timer::instance()->delta_s(mStartTick, afterPhysicsTick));
 
+        stats->setAttribute(frameNumber, "physics_finish_time_begin", osg::Timer::instance()->delta_s(mStartTick, beforePhysicsWaitTick));
+        stats->setAttribute(frameNumber, "physics_finish_time_taken", osg::Timer::instance()->delta_s(beforePhysicsWaitTick, afterPhysicsWaitTick));
+        stats->setAttribute(frameNumber, "physics_finish_time_end", osg::Timer::instance()->delta_s(mStartTick, afterPhysicsWaitTick));
+
+        mEnvironment.getWorld()->reportStats(frameNumber, *stats);
+
     }
     catch (const std::exception& e)
     {
@@ -238,6 +288,9 @@ OMW::Engine::~Engine()
     delete mScriptContext;
     mScriptContext = NULL;
 
+    // Work still in the queue may use resources
+    mWorkQueue.reset();
+
     mResourceSystem.reset();
 
     mViewer = NULL;
@@ -461,6 +514,14 @@ void OMW::Engine::prepareEngine (Settings::Manager & settings)
     int maxAnisotropy = Settings::Manager::getInt("anisotropy", "General");
     mResourceSystem->getTextureManager()->setFilterSettings(min, mag, maxAnisotropy);
 
+    mResourceSystem->setExpiryDelay(Settings::Manager::getFloat("cache expiry delay", "Cells"));
+    mResourceSystem->getSceneManager()->setMemoryBudget(
+                static_cast<size_t>(std::max(0, Settings::Manager::getInt("mesh cache memory budget", "Cells"))) * 1024 * 1024);
+    mResourceSystem->getTextureManager()->setMemoryBudget(
+                static_cast<size_t>(std::max(0, Settings::Manager::getInt("texture cache memory budget", "Cells"))) * 1024 * 1024);
+
+    mWorkQueue.reset(new SceneUtil::WorkQueue(Settings::Manager::getInt("worker threads", "General")));
+
     // Create input and UI first to set up a bootstrapping environment for
     // showing a loading screen and keeping the window responsive while doing so
 
@@ -501,7 +562,7 @@ void OMW::Engine::prepareEngine (Settings::Manager & settings)
     mEnvironment.setWindowManager (window);
 
     // Create sound system
-    mEnvironment.setSoundManager (new MWSound::SoundManager(mVFS.get(), mUseSound));
+    mEnvironment.setSoundManager (new MWSound::SoundManager(mVFS.get(), mUseSound, mWorkQueue.get()));
 
     if (!mSkipMenu)
     {
@@ -513,7 +574,7 @@ void OMW::Engine::prepareEngine (Settings::Manager & settings)
     // Create the world
     mEnvironment.setWorld( new MWWorld::World (mViewer, rootNode, mResourceSystem.get(),
         mFileCollections, mContentFiles, mEncoder, mFallbackMap,
-        mActivationDistanceOverride, mCellName, mStartupScript));
+        mActivationDistanceOverride, mCellName, mStartupScript, mWorkQueue.get()));
     mEnvironment.getWorld()->setupPlayer();
     input->setPlayer(&mEnvironment.getWorld()->getPlayer());
 
@@ -531,9 +592,18 @@ void OMW::Engine::prepareEngine (Settings::Manager & settings)
     mScriptContext = new MWScript::CompilerContext (MWScript::CompilerContext::Type_Full);
     mScriptContext->setExtensions (&mExtensions);
 
+    boost::filesystem::path scriptCacheFile;
+    std::string contentKey;
+    if (Settings::Manager::getBool("script cache", "General"))
+    {
+        scriptCacheFile = mCfgMgr.getCachePath() / "scripts.cache";
+        contentKey = getBuildVersion(mResDir) + '\n' + getContentKey(mFileCollections, mContentFiles);
+    }
+
     mEnvironment.setScriptManager (new MWScript::ScriptManager (mEnvironment.getWorld()->getStore(),
-        mVerboseScripts, *mScriptContext, mWarningsMode,
-        mScriptBlacklistUse ? mScriptBlacklist : std::vector<std::string>()));
+        mVerboseScripts, *mScriptContext, mWarningsMode, Settings::Manager::getBool("optimize scripts", "General"),
+        mScriptBlacklistUse ? mScriptBlacklist : std::vector<std::string>(),
+        scriptCacheFile, contentKey));
 
     // Create game mechanics system
     MWMechanics::MechanicsManager* mechanics = new MWMechanics::MechanicsManager;
@@ -627,10 +697,30 @@ void OMW::Engine::go()
 
     statshandler->addUserStatsLine("Script", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
                                    "script_time_taken", 1000.0, true, false, "script_time_begin", "script_time_end", 10000);
+    statshandler->addUserStatsLine("Local scripts", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "script_local_run", 1.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Deferred", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "script_local_deferred", 1.0, true, false, "", "", 10000);
     statshandler->addUserStatsLine("Mechanics", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
                                    "mechanics_time_taken", 1000.0, true, false, "mechanics_time_begin", "mechanics_time_end", 10000);
     statshandler->addUserStatsLine("Physics", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
                                    "physics_time_taken", 1000.0, true, false, "physics_time_begin", "physics_time_end", 10000);
+    statshandler->addUserStatsLine("Physics finish", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "physics_finish_time_taken", 1000.0, true, false, "physics_finish_time_begin", "physics_finish_time_end", 10000);
+    statshandler->addUserStatsLine("Physics sim", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "physics_simulation_time_taken", 1000.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Physics wait", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "physics_wait_time_taken", 1000.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Skinned rigs", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "skinned_rigs", 1.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Light sets hit", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "light_statesets_hit", 1.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Superset hit", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "light_statesets_superset", 1.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Missed", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "light_statesets_missed", 1.0, true, false, "", "", 10000);
+    statshandler->addUserStatsLine("Alive", osg::Vec4f(1.f, 1.f, 1.f, 1.f), osg::Vec4f(1.f, 1.f, 1.f, 1.f),
+                                   "light_statesets_alive", 1.0, true, false, "", "", 10000);
 
     mViewer->addEventHandler(statshandler);
 
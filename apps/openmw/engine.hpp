@@ -23,6 +23,11 @@ namespace VFS
     class Manager;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 namespace Compiler
 {
     class Context;
@@ -68,6 +73,8 @@ namespace OMW
             SDL_Window* mWindow;
             std::auto_ptr<VFS::Manager> mVFS;
             std::auto_ptr<Resource::ResourceSystem> mResourceSystem;
+            /// Background threads shared by all subsystems, which submit their work at different priorities
+            std::auto_ptr<SceneUtil::WorkQueue> mWorkQueue;
             MWBase::Environment mEnvironment;
             ToUTF8::FromType mEncoding;
             ToUTF8::Utf8Encoder* mEncoder;
@@ -1,6 +1,7 @@
 #ifndef GAME_MWBASE_SCRIPTMANAGER_H
 #define GAME_MWBASE_SCRIPTMANAGER_H
 
+#include <map>
 #include <string>
 
 namespace Interpreter
@@ -20,6 +21,16 @@ namespace MWScript
 
 namespace MWBase
 {
+    /// \brief Execution statistics of a script
+    struct ScriptProfile
+    {
+        ScriptProfile() : mCalls (0), mInstructions (0), mTime (0.0) {}
+
+        unsigned int mCalls;
+        unsigned long long mInstructions;
+        double mTime; ///< in seconds
+    };
+
     /// \brief Interface for script manager (implemented in MWScript)
     class ScriptManager
     {
@@ -50,6 +61,13 @@ namespace MWBase
             ///< Return locals for script \a name.
 
             virtual MWScript::GlobalScripts& getGlobalScripts() = 0;
+
+            typedef std::map<std::string, ScriptProfile> ScriptProfiles;
+
+            virtual const ScriptProfiles& getProfiles() const = 0;
+            ///< Execution statistics of each script that has run since the last resetProfiles().
+
+            virtual void resetProfiles() = 0;
    };
 }
 
@@ -136,6 +136,10 @@ namespace MWBase
             virtual void stopSound(const MWWorld::CellStore *cell) = 0;
             ///< Stop all sounds for the given cell.
 
+            virtual void preloadSounds(MWWorld::CellStore *cell) = 0;
+            ///< Start decoding the sounds that the creatures and the region of the given cell can play. Does nothing
+            /// if sounds are not decoded in the background.
+
             virtual void stopSound(const std::string& soundId) = 0;
             ///< Stop a non-3d looping sound
 
@@ -16,6 +16,7 @@ namespace osg
     class Vec3f;
     class Quat;
     class Image;
+    class Stats;
 }
 
 namespace Loading
@@ -348,6 +349,12 @@ namespace MWBase
 
             virtual void update (float duration, bool paused) = 0;
 
+            virtual void finishPhysics() = 0;
+            ///< Wait for the physics simulation started by the last update to finish, and move the actors accordingly.
+            /// Must be called before anything else in the frame uses the world.
+
+            virtual void reportStats (unsigned int frameNumber, osg::Stats& stats) const = 0;
+
             virtual MWWorld::Ptr placeObject (const MWWorld::Ptr& object, float cursorX, float cursorY, int amount) = 0;
             ///< copy and place an object into the gameworld at the specified cursor position
             /// @param object
@@ -416,6 +423,9 @@ namespace MWBase
             virtual bool getLOS(const MWWorld::Ptr& actor,const MWWorld::Ptr& targetActor) = 0;
             ///< get Line of Sight (morrowind stupid implementation)
 
+            virtual void getLOS(const std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& actors, std::vector<bool>& out) = 0;
+            ///< get Line of Sight for many pairs of actors at once, which is faster than one at a time
+
             virtual float getDistToNearestRayHit(const osg::Vec3f& from, const osg::Vec3f& dir, float maxDist) = 0;
 
             virtual void enableActorCollision(const MWWorld::Ptr& actor, bool enable) = 0;
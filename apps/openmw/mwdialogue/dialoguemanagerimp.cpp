@@ -49,7 +49,8 @@
 namespace MWDialogue
 {
     DialogueManager::DialogueManager (const Compiler::Extensions& extensions, bool scriptVerbose, Translation::Storage& translationDataStorage) :
-      mTranslationDataStorage(translationDataStorage)
+      mInfoIndex(MWBase::Environment::get().getWorld()->getStore().get<ESM::Dialogue>())
+      , mTranslationDataStorage(translationDataStorage)
       , mCompilerContext (MWScript::CompilerContext::Type_Dialogue)
       , mErrorStream(std::cout.rdbuf())
       , mErrorHandler(mErrorStream)
@@ -329,25 +330,34 @@ namespace MWDialogue
         mChoice = -1;
         mActorKnownTopics.clear();
 
-        const MWWorld::Store<ESM::Dialogue> &dialogs =
-            MWBase::Environment::get().getWorld()->getStore().get<ESM::Dialogue>();
-
         Filter filter (mActor, mChoice, mTalkedTo);
 
-        for (MWWorld::Store<ESM::Dialogue>::iterator iter = dialogs.begin(); iter != dialogs.end(); ++iter)
+        const std::vector<const ESM::Dialogue*>& topics = mInfoIndex.getTopics();
+        std::vector<bool> available (topics.size(), false);
+
+        const MWWorld::Ptr player = MWMechanics::getPlayer();
+        InfoIndex::EntryList candidates;
+        mInfoIndex.getCandidates (mActor, MWBase::Environment::get().getWorld()->getCellName (player.getCell()),
+            candidates);
+
+        for (InfoIndex::EntryList::const_iterator iter = candidates.begin(); iter != candidates.end(); ++iter)
+        {
+            // one matching response is enough to make the topic available
+            if (!available[(*iter)->mTopic] && filter.infoAvailable (*(*iter)->mInfo, (*iter)->mSelects))
+                available[(*iter)->mTopic] = true;
+        }
+
+        for (size_t i=0; i<topics.size(); ++i)
         {
-            if (iter->mType == ESM::Dialogue::Topic)
+            if (available[i])
             {
-                if (filter.responseAvailable (*iter))
-                {
-                    std::string lower = Misc::StringUtils::lowerCase(iter->mId);
-                    mActorKnownTopics.insert (lower);
+                std::string lower = Misc::StringUtils::lowerCase(topics[i]->mId);
+                mActorKnownTopics.insert (lower);
 
-                    //does the player know the topic?
-                    if (mKnownTopics.count(lower))
-                    {
-                        keywordList.push_back (iter->mId);
-                    }
+                //does the player know the topic?
+                if (mKnownTopics.count(lower))
+                {
+                    keywordList.push_back (topics[i]->mId);
                 }
             }
         }
@@ -670,3 +670,15 @@ bool MWDialogue::Filter::responseAvailable (const ESM::Dialogue& dialogue) const
 
     return false;
 }
+
+bool MWDialogue::Filter::infoAvailable (const ESM::DialInfo& info, const std::vector<SelectWrapper>& selects) const
+{
+    if (!testActor (info) || !testPlayer (info))
+        return false;
+
+    for (std::vector<SelectWrapper>::const_iterator iter (selects.begin()); iter != selects.end(); ++iter)
+        if (!testSelectStruct (*iter))
+            return false;
+
+    return true;
+}
@@ -67,6 +67,10 @@ namespace MWDialogue
 
             bool responseAvailable (const ESM::Dialogue& dialogue) const;
             ///< Does a matching response exist? (disposition is ignored for this check)
+
+            bool infoAvailable (const ESM::DialInfo& info, const std::vector<SelectWrapper>& selects) const;
+            ///< Does \a info match, with its select structs already decoded into \a selects?
+            /// (disposition is ignored for this check)
     };
 }
 
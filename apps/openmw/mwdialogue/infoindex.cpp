@@ -0,0 +1,97 @@
+#include "infoindex.hpp"
+
+#include <components/esm/loaddial.hpp>
+#include <components/esm/loadnpc.hpp>
+
+#include <components/misc/stringops.hpp>
+
+#include "../mwworld/class.hpp"
+#include "../mwworld/esmstore.hpp"
+
+MWDialogue::InfoIndex::InfoIndex (const MWWorld::Store<ESM::Dialogue>& dialogues)
+{
+    for (MWWorld::Store<ESM::Dialogue>::iterator iter = dialogues.begin(); iter != dialogues.end(); ++iter)
+    {
+        if (iter->mType == ESM::Dialogue::Topic)
+        {
+            for (ESM::Dialogue::InfoContainer::const_iterator info = iter->mInfo.begin();
+                info!=iter->mInfo.end(); ++info)
+            {
+                Entry entry;
+                entry.mTopic = mTopics.size();
+                entry.mInfo = &*info;
+
+                for (std::vector<ESM::DialInfo::SelectStruct>::const_iterator select (info->mSelects.begin());
+                    select != info->mSelects.end(); ++select)
+                    entry.mSelects.push_back (SelectWrapper (*select));
+
+                mEntries.push_back (entry);
+            }
+
+            mTopics.push_back (&*iter);
+        }
+    }
+
+    // Each info goes to the bucket of its most specific speaker restriction only, that is enough to find it
+    // for every actor it can match
+    for (size_t i=0; i<mEntries.size(); ++i)
+    {
+        const ESM::DialInfo& info = *mEntries[i].mInfo;
+
+        if (!info.mActor.empty())
+            mActorBuckets[Misc::StringUtils::lowerCase (info.mActor)].push_back (i);
+        else if (!info.mFaction.empty())
+            mFactionBuckets[Misc::StringUtils::lowerCase (info.mFaction)].push_back (i);
+        else if (!info.mClass.empty())
+            mClassBuckets[Misc::StringUtils::lowerCase (info.mClass)].push_back (i);
+        else if (!info.mRace.empty())
+            mRaceBuckets[Misc::StringUtils::lowerCase (info.mRace)].push_back (i);
+        else if (!info.mCell.empty())
+            mCellBuckets[Misc::StringUtils::lowerCase (info.mCell)].push_back (i);
+        else
+            mUnrestricted.push_back (i);
+    }
+}
+
+void MWDialogue::InfoIndex::addBucket (const Buckets& buckets, const std::string& key, EntryList& candidates) const
+{
+    Buckets::const_iterator iter = buckets.find (key);
+
+    if (iter==buckets.end())
+        return;
+
+    for (std::vector<size_t>::const_iterator index (iter->second.begin()); index!=iter->second.end(); ++index)
+        candidates.push_back (&mEntries[*index]);
+}
+
+const std::vector<const ESM::Dialogue*>& MWDialogue::InfoIndex::getTopics() const
+{
+    return mTopics;
+}
+
+void MWDialogue::InfoIndex::getCandidates (const MWWorld::Ptr& actor, const std::string& cellName,
+    EntryList& candidates) const
+{
+    addBucket (mActorBuckets, Misc::StringUtils::lowerCase (actor.getClass().getId (actor)), candidates);
+
+    // Creatures must not have topics aside of those specific to their id
+    if (actor.getTypeName() != typeid (ESM::NPC).name())
+        return;
+
+    const ESM::NPC* npc = actor.get<ESM::NPC>()->mBase;
+
+    std::string faction = actor.getClass().getPrimaryFaction (actor);
+    if (!faction.empty())
+        addBucket (mFactionBuckets, Misc::StringUtils::lowerCase (faction), candidates);
+
+    addBucket (mClassBuckets, Misc::StringUtils::lowerCase (npc->mClass), candidates);
+    addBucket (mRaceBuckets, Misc::StringUtils::lowerCase (npc->mRace), candidates);
+
+    // Cell conditions match any cell whose name starts with the condition
+    std::string cell = Misc::StringUtils::lowerCase (cellName);
+    for (size_t length=1; length<=cell.size(); ++length)
+        addBucket (mCellBuckets, cell.substr (0, length), candidates);
+
+    for (std::vector<size_t>::const_iterator index (mUnrestricted.begin()); index!=mUnrestricted.end(); ++index)
+        candidates.push_back (&mEntries[*index]);
+}
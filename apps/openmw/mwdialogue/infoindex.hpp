@@ -0,0 +1,71 @@
+#ifndef GAME_MWDIALOGUE_INFOINDEX_H
+#define GAME_MWDIALOGUE_INFOINDEX_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "selectwrapper.hpp"
+
+namespace ESM
+{
+    struct Dialogue;
+}
+
+namespace MWWorld
+{
+    class Ptr;
+
+    template <class T>
+    class Store;
+}
+
+namespace MWDialogue
+{
+    /// \brief Infos of all topics, bucketed by the speaker they are restricted to
+    ///
+    /// Built once the content files are loaded, so that finding the topics an actor can talk about only
+    /// has to test the infos that can possibly match that actor.
+    class InfoIndex
+    {
+        public:
+
+            struct Entry
+            {
+                size_t mTopic; ///< Index into getTopics()
+                const ESM::DialInfo* mInfo;
+                std::vector<SelectWrapper> mSelects;
+            };
+
+            typedef std::vector<const Entry*> EntryList;
+
+        private:
+
+            typedef std::map<std::string, std::vector<size_t> > Buckets;
+
+            std::vector<const ESM::Dialogue*> mTopics;
+            std::vector<Entry> mEntries;
+
+            Buckets mActorBuckets;
+            Buckets mFactionBuckets;
+            Buckets mClassBuckets;
+            Buckets mRaceBuckets;
+            Buckets mCellBuckets;
+            std::vector<size_t> mUnrestricted;
+
+            void addBucket (const Buckets& buckets, const std::string& key, EntryList& candidates) const;
+
+        public:
+
+            InfoIndex (const MWWorld::Store<ESM::Dialogue>& dialogues);
+
+            const std::vector<const ESM::Dialogue*>& getTopics() const;
+            ///< Dialogues of type Topic, in the order of the store.
+
+            void getCandidates (const MWWorld::Ptr& actor, const std::string& cellName, EntryList& candidates) const;
+            ///< Append the infos that can possibly be said by \a actor, while the player is in the cell called
+            /// \a cellName. Every other info is known to fail Filter::testActor or Filter::testPlayer.
+    };
+}
+
+#endif
@@ -1,17 +1,23 @@
 #ifndef GAME_MWDIALOGUE_KEYWORDSEARCH_H
 #define GAME_MWDIALOGUE_KEYWORDSEARCH_H
 
+#include <cctype>
 #include <map>
 #include <locale>
 #include <stdexcept>
 #include <vector>
-#include <algorithm>    // std::reverse
+#include <algorithm>
 
 #include <components/misc/stringops.hpp>
 
 namespace MWDialogue
 {
 
+/// \brief Finds keywords in a text, with an Aho-Corasick automaton
+///
+/// The automaton is built on the first search after the keywords changed. Its transitions are stored in a single
+/// table, indexed by state and by class of (lower-cased) character, so that the search only does a table lookup
+/// per character of the text.
 template <typename string_t, typename value_t>
 class KeywordSearch
 {
@@ -26,46 +32,38 @@ public:
         value_t mValue;
     };
 
+    KeywordSearch ()
+        : mNumClasses (0), mBuilt (false)
+    {
+        for (int i=0; i<256; ++i)
+            mFold[i] = static_cast<unsigned char> (std::tolower (static_cast<char> (i), mLocale));
+    }
+
     void seed (string_t keyword, value_t value)
     {
         if (keyword.empty())
             return;
-        seed_impl  (/*std::move*/ (keyword), /*std::move*/ (value), 0, mRoot);
+
+        if (!mKeywords.insert (std::make_pair (fold (keyword), value)).second)
+            throw std::runtime_error ("duplicate keyword inserted");
+
+        mBuilt = false;
     }
 
     void clear ()
     {
-        mRoot.mChildren.clear ();
-        mRoot.mKeyword.clear ();
+        mKeywords.clear ();
+        mBuilt = false;
     }
 
     bool containsKeyword (string_t keyword, value_t& value)
     {
-        typename Entry::childen_t::iterator current;
-        typename Entry::childen_t::iterator next;
-
-        current = mRoot.mChildren.find (std::tolower (*keyword.begin(), mLocale));
-        if (current == mRoot.mChildren.end())
+        typename KeywordMap::const_iterator found = mKeywords.find (fold (keyword));
+        if (found == mKeywords.end())
             return false;
-        else if (current->second.mKeyword.size() && Misc::StringUtils::ciEqual(current->second.mKeyword, keyword))
-        {
-            value = current->second.mValue;
-            return true;
-        }
 
-        for (Point i = ++keyword.begin(); i != keyword.end(); ++i)
-        {
-            next = current->second.mChildren.find(std::tolower (*i, mLocale));
-            if (next == current->second.mChildren.end())
-                return false;
-            if (Misc::StringUtils::ciEqual(next->second.mKeyword, keyword))
-            {
-                value = next->second.mValue;
-                return true;
-            }
-            current = next;
-        }
-        return false;
+        value = found->second;
+        return true;
     }
 
     static bool sortMatches(const Match& left, const Match& right)
@@ -75,86 +73,48 @@ public:
 
     void highlightKeywords (Point beg, Point end, std::vector<Match>& out)
     {
-        std::vector<Match> matches;
-        for (Point i = beg; i != end; ++i)
-        {
-            // check if previous character marked start of new word
-            if (i != beg)
-            {
-                Point prev = i;
-                --prev;
-                if(isalpha(*prev))
-                    continue;
-            }
-
-
-            // check first character
-            typename Entry::childen_t::iterator candidate = mRoot.mChildren.find (std::tolower (*i, mLocale));
+        if (!mBuilt)
+            build ();
 
-            // no match, on to next character
-            if (candidate == mRoot.mChildren.end ())
-                continue;
-
-            // see how far the match goes
-            Point j = i;
+        // longest keyword starting at each character, for the characters that start a word
+        std::vector<int> longest (end - beg, -1);
 
-            // some keywords might be longer variations of other keywords, so we definitely need a list of candidates
-            // the first element in the pair is length of the match, i.e. depth from the first character on
-            std::vector< typename std::pair<int, typename Entry::childen_t::iterator> > candidates;
+        int state = 0;
+        for (Point i = beg; i != end; ++i)
+        {
+            state = mTransitions[state * mNumClasses + mClasses[static_cast<unsigned char> (*i)]];
 
-            while ((j + 1) != end)
+            // every keyword that ends at this character
+            int keyword = mStates[state].mValue != -1 ? state : mStates[state].mDictionary;
+            for (; keyword != -1; keyword = mStates[keyword].mDictionary)
             {
-                typename Entry::childen_t::iterator next = candidate->second.mChildren.find (std::tolower (*++j, mLocale));
+                size_t length = mStates[keyword].mDepth;
+                size_t start = (i - beg) + 1 - length;
 
-                if (next == candidate->second.mChildren.end ())
-                {
-                    if (candidate->second.mKeyword.size() > 0)
-                        candidates.push_back(std::make_pair((j-i), candidate));
-                    break;
-                }
-
-                candidate = next;
+                // keywords must start a word
+                if (start != 0 && std::isalpha (static_cast<unsigned char> (*(beg + start - 1))))
+                    continue;
 
-                if (candidate->second.mKeyword.size() > 0)
-                    candidates.push_back(std::make_pair((j-i), candidate));
+                if (longest[start] == -1 || static_cast<size_t> (mStates[longest[start]].mDepth) < length)
+                    longest[start] = keyword;
             }
+        }
 
-            if (candidates.empty())
-                continue; // didn't match enough to disambiguate, on to next character
-
-            // shorter candidates will be added to the vector first. however, we want to check against longer candidates first
-            std::reverse(candidates.begin(), candidates.end());
-
-            for (typename std::vector< std::pair<int, typename Entry::childen_t::iterator> >::iterator it = candidates.begin();
-                 it != candidates.end(); ++it)
-            {
-                candidate = it->second;
-                // try to match the rest of the keyword
-                Point k = i + it->first;
-                typename string_t::const_iterator t = candidate->second.mKeyword.begin () + (k - i);
-
-
-                while (k != end && t != candidate->second.mKeyword.end ())
-                {
-                    if (std::tolower (*k, mLocale) != std::tolower (*t, mLocale))
-                        break;
-
-                    ++k, ++t;
-                }
-
-                // didn't match full keyword, try the next candidate
-                if (t != candidate->second.mKeyword.end ())
-                    continue;
+        // some keywords might be longer variations of other keywords, we keep the longest one starting at each
+        // character. there might still be longer keywords that start somewhere _within_ this keyword, we will
+        // resolve these overlapping keywords later, choosing the longest one in case of conflict
+        std::vector<Match> matches;
+        for (size_t start = 0; start < longest.size(); ++start)
+        {
+            if (longest[start] == -1)
+                continue;
 
-                // found a keyword, but there might still be longer keywords that start somewhere _within_ this keyword
-                // we will resolve these overlapping keywords later, choosing the longest one in case of conflict
-                Match match;
-                match.mValue = candidate->second.mValue;
-                match.mBeg = i;
-                match.mEnd = k;
-                matches.push_back(match);
-                break;
-            }
+            const State& state = mStates[longest[start]];
+            Match match;
+            match.mBeg = beg + start;
+            match.mEnd = beg + start + state.mDepth;
+            match.mValue = mValues[state.mValue];
+            matches.push_back(match);
         }
 
         // resolve overlapping keywords
@@ -201,54 +161,120 @@ public:
 
 private:
 
-    struct Entry
-    {
-        typedef std::map <wchar_t, Entry> childen_t;
+    typedef std::map<string_t, value_t> KeywordMap;
 
-        string_t mKeyword;
-        value_t mValue;
-        childen_t mChildren;
+    struct State
+    {
+        int mFailure; ///< State of the longest proper suffix that is a prefix of a keyword
+        int mDictionary; ///< State of the longest proper suffix that is a keyword, or -1
+        int mDepth;
+        int mValue; ///< Index into mValues of the keyword ending in this state, or -1
     };
 
-    void seed_impl (string_t keyword, value_t value, size_t depth, Entry  & entry)
+    string_t fold (const string_t& keyword) const
     {
-        int ch = tolower (keyword.at (depth), mLocale);
+        string_t folded (keyword);
+        for (typename string_t::iterator i = folded.begin(); i != folded.end(); ++i)
+            *i = mFold[static_cast<unsigned char> (*i)];
+        return folded;
+    }
 
-        typename Entry::childen_t::iterator j = entry.mChildren.find (ch);
+    int addState (int depth)
+    {
+        State state;
+        state.mFailure = 0;
+        state.mDictionary = -1;
+        state.mDepth = depth;
+        state.mValue = -1;
+        mStates.push_back (state);
+
+        mTransitions.resize (mTransitions.size() + mNumClasses, -1);
+        return mStates.size() - 1;
+    }
 
-        if (j == entry.mChildren.end ())
+    void build ()
+    {
+        mStates.clear ();
+        mTransitions.clear ();
+        mValues.clear ();
+
+        // characters that do not occur in any keyword share class 0
+        int foldedClasses[256] = { 0 };
+        mNumClasses = 1;
+        for (typename KeywordMap::const_iterator it = mKeywords.begin(); it != mKeywords.end(); ++it)
+            for (Point i = it->first.begin(); i != it->first.end(); ++i)
+                if (foldedClasses[static_cast<unsigned char> (*i)] == 0)
+                    foldedClasses[static_cast<unsigned char> (*i)] = mNumClasses++;
+
+        for (int i=0; i<256; ++i)
+            mClasses[i] = foldedClasses[mFold[i]];
+
+        // trie of the keywords
+        addState (0);
+        for (typename KeywordMap::const_iterator it = mKeywords.begin(); it != mKeywords.end(); ++it)
         {
-            entry.mChildren [ch].mValue = /*std::move*/ (value);
-            entry.mChildren [ch].mKeyword = /*std::move*/ (keyword);
+            int state = 0;
+            for (Point i = it->first.begin(); i != it->first.end(); ++i)
+            {
+                int transition = state * mNumClasses + foldedClasses[static_cast<unsigned char> (*i)];
+                if (mTransitions[transition] == -1)
+                {
+                    int next = addState (mStates[state].mDepth + 1);
+                    mTransitions[transition] = next;
+                }
+                state = mTransitions[transition];
+            }
+            mStates[state].mValue = mValues.size();
+            mValues.push_back (it->second);
         }
-        else
+
+        // breadth first, so the failure state of every state is complete before it is used. missing transitions
+        // are replaced by those of the failure state
+        std::vector<int> queue;
+        for (int c = 0; c < mNumClasses; ++c)
         {
-            if (j->second.mKeyword.size () > 0)
-            {
-                if (keyword == j->second.mKeyword)
-                    throw std::runtime_error ("duplicate keyword inserted");
+            int& next = mTransitions[c];
+            if (next == -1)
+                next = 0;
+            else
+                queue.push_back (next);
+        }
 
-                value_t pushValue = /*std::move*/ (j->second.mValue);
-                string_t pushKeyword = /*std::move*/ (j->second.mKeyword);
+        for (size_t head = 0; head < queue.size(); ++head)
+        {
+            int state = queue[head];
+            int failure = mStates[state].mFailure;
 
-                if (depth >= pushKeyword.size ())
-                    throw std::runtime_error ("unexpected");
+            for (int c = 0; c < mNumClasses; ++c)
+            {
+                int& next = mTransitions[state * mNumClasses + c];
+                int failureNext = mTransitions[failure * mNumClasses + c];
 
-                if (depth+1 < pushKeyword.size())
+                if (next == -1)
                 {
-                    seed_impl (/*std::move*/ (pushKeyword), /*std::move*/ (pushValue), depth+1, j->second);
-                    j->second.mKeyword.clear ();
+                    next = failureNext;
+                    continue;
                 }
+
+                mStates[next].mFailure = failureNext;
+                mStates[next].mDictionary = mStates[failureNext].mValue != -1 ? failureNext : mStates[failureNext].mDictionary;
+                queue.push_back (next);
             }
-            if (depth+1 == keyword.size())
-                j->second.mKeyword = value;
-            else // depth+1 < keyword.size()
-                seed_impl (/*std::move*/ (keyword), /*std::move*/ (value), depth+1, j->second);
         }
 
+        mBuilt = true;
     }
 
-    Entry mRoot;
+    KeywordMap mKeywords;
+
+    std::vector<State> mStates;
+    std::vector<value_t> mValues;
+    std::vector<int> mTransitions;
+    int mClasses[256];
+    int mNumClasses;
+    bool mBuilt;
+
+    unsigned char mFold[256];
     std::locale mLocale;
 };
 
@@ -27,30 +27,20 @@ namespace
         throw std::runtime_error ("unknown compare type in dialogue info select");
     }
 
-    template<typename T>
-    bool selectCompareImp (const ESM::DialInfo::SelectStruct& select, T value1)
+    int decodeIndex (const std::string& rule)
     {
-        if (select.mValue.getType()==ESM::VT_Int)
-        {
-            return selectCompareImp (select.mSelectRule[4], value1, select.mValue.getInteger());
-        }
-        else if (select.mValue.getType()==ESM::VT_Float)
-        {
-            return selectCompareImp (select.mSelectRule[4], value1, select.mValue.getFloat());
-        }
-        else
-            throw std::runtime_error (
-                "unsupported variable type in dialogue info select");
+        int index = 0;
+
+        if (rule.size()>2)
+            std::istringstream (rule.substr(2,2)) >> index;
+
+        return index;
     }
 }
 
-MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::decodeFunction() const
+MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::decodeFunction (const std::string& rule) const
 {
-    int index = 0;
-
-    std::istringstream (mSelect.mSelectRule.substr(2,2)) >> index;
-
-    switch (index)
+    switch (decodeIndex (rule))
     {
         case  0: return Function_RankLow;
         case  1: return Function_RankHigh;
@@ -97,15 +87,13 @@ MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::decodeFunction()
     return Function_False;
 }
 
-MWDialogue::SelectWrapper::SelectWrapper (const ESM::DialInfo::SelectStruct& select) : mSelect (select) {}
-
-MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::getFunction() const
+MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::decodeFunctionType (const std::string& rule) const
 {
-    char type = mSelect.mSelectRule[1];
+    char type = rule.size()>1 ? rule[1] : '0';
 
     switch (type)
     {
-        case '1': return decodeFunction();
+        case '1': return decodeFunction (rule);
         case '2': return Function_Global;
         case '3': return Function_Local;
         case '4': return Function_Journal;
@@ -122,16 +110,12 @@ MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::getFunction() con
     return Function_None;
 }
 
-int MWDialogue::SelectWrapper::getArgument() const
+int MWDialogue::SelectWrapper::decodeArgument (const std::string& rule) const
 {
-    if (mSelect.mSelectRule[1]!='1')
+    if (rule.size()<2 || rule[1]!='1')
         return 0;
 
-    int index = 0;
-
-    std::istringstream (mSelect.mSelectRule.substr(2,2)) >> index;
-
-    switch (index)
+    switch (decodeIndex (rule))
     {
         // AI settings
         case 67: return 1;
@@ -187,7 +171,7 @@ int MWDialogue::SelectWrapper::getArgument() const
     return 0;
 }
 
-MWDialogue::SelectWrapper::Type MWDialogue::SelectWrapper::getType() const
+MWDialogue::SelectWrapper::Type MWDialogue::SelectWrapper::decodeType() const
 {
     static const Function integerFunctions[] =
     {
@@ -236,7 +220,7 @@ MWDialogue::SelectWrapper::Type MWDialogue::SelectWrapper::getType() const
         Function_None // end marker
     };
 
-    Function function = getFunction();
+    Function function = mFunction;
 
     for (int i=0; integerFunctions[i]!=Function_None; ++i)
         if (integerFunctions[i]==function)
@@ -257,7 +241,7 @@ MWDialogue::SelectWrapper::Type MWDialogue::SelectWrapper::getType() const
     return Type_None;
 }
 
-bool MWDialogue::SelectWrapper::isNpcOnly() const
+bool MWDialogue::SelectWrapper::decodeNpcOnly() const
 {
     static const Function functions[] =
     {
@@ -274,7 +258,7 @@ bool MWDialogue::SelectWrapper::isNpcOnly() const
         Function_None // end marker
     };
 
-    Function function = getFunction();
+    Function function = mFunction;
 
     for (int i=0; functions[i]!=Function_None; ++i)
         if (functions[i]==function)
@@ -283,22 +267,74 @@ bool MWDialogue::SelectWrapper::isNpcOnly() const
     return false;
 }
 
+template<typename T>
+bool MWDialogue::SelectWrapper::compare (T value) const
+{
+    if (mValueType==ESM::VT_Int)
+        return selectCompareImp (mComparison, value, mIntValue);
+    else if (mValueType==ESM::VT_Float)
+        return selectCompareImp (mComparison, value, mFloatValue);
+    else
+        throw std::runtime_error (
+            "unsupported variable type in dialogue info select");
+}
+
+MWDialogue::SelectWrapper::SelectWrapper (const ESM::DialInfo::SelectStruct& select)
+: mComparison (select.mSelectRule.size()>4 ? select.mSelectRule[4] : '\0'),
+  mValueType (select.mValue.getType()), mIntValue (0), mFloatValue (0)
+{
+    const std::string& rule = select.mSelectRule;
+
+    mFunction = decodeFunctionType (rule);
+    mArgument = decodeArgument (rule);
+    mType = decodeType();
+    mNpcOnly = decodeNpcOnly();
+
+    if (rule.size()>5)
+        mName = Misc::StringUtils::lowerCase (rule.substr (5));
+
+    if (mValueType==ESM::VT_Int)
+        mIntValue = select.mValue.getInteger();
+    else if (mValueType==ESM::VT_Float)
+        mFloatValue = select.mValue.getFloat();
+}
+
+MWDialogue::SelectWrapper::Function MWDialogue::SelectWrapper::getFunction() const
+{
+    return mFunction;
+}
+
+int MWDialogue::SelectWrapper::getArgument() const
+{
+    return mArgument;
+}
+
+MWDialogue::SelectWrapper::Type MWDialogue::SelectWrapper::getType() const
+{
+    return mType;
+}
+
+bool MWDialogue::SelectWrapper::isNpcOnly() const
+{
+    return mNpcOnly;
+}
+
 bool MWDialogue::SelectWrapper::selectCompare (int value) const
 {
-    return selectCompareImp (mSelect, value);
+    return compare (value);
 }
 
 bool MWDialogue::SelectWrapper::selectCompare (float value) const
 {
-    return selectCompareImp (mSelect, value);
+    return compare (value);
 }
 
 bool MWDialogue::SelectWrapper::selectCompare (bool value) const
 {
-    return selectCompareImp (mSelect, static_cast<int> (value));
+    return compare (static_cast<int> (value));
 }
 
-std::string MWDialogue::SelectWrapper::getName() const
+const std::string& MWDialogue::SelectWrapper::getName() const
 {
-    return Misc::StringUtils::lowerCase (mSelect.mSelectRule.substr (5));
+    return mName;
 }
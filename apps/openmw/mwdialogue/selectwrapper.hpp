@@ -5,10 +5,9 @@
 
 namespace MWDialogue
 {
+    /// \brief Select struct of a dialogue info, decoded once for repeated evaluation
     class SelectWrapper
     {
-            const ESM::DialInfo::SelectStruct& mSelect;
-
         public:
 
             enum Function
@@ -57,7 +56,28 @@ namespace MWDialogue
 
         private:
 
-            Function decodeFunction() const;
+            Function mFunction;
+            int mArgument;
+            Type mType;
+            bool mNpcOnly;
+            std::string mName;
+            char mComparison;
+            ESM::VarType mValueType;
+            int mIntValue;
+            float mFloatValue;
+
+            Function decodeFunction (const std::string& rule) const;
+
+            Function decodeFunctionType (const std::string& rule) const;
+
+            int decodeArgument (const std::string& rule) const;
+
+            Type decodeType() const;
+
+            bool decodeNpcOnly() const;
+
+            template<typename T>
+            bool compare (T value) const;
 
         public:
 
@@ -78,7 +98,7 @@ namespace MWDialogue
 
             bool selectCompare (bool value) const;
 
-            std::string getName() const;
+            const std::string& getName() const;
             ///< Return case-smashed name.
     };
 }
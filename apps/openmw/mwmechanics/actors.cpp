@@ -1,6 +1,7 @@
 #include "actors.hpp"
 
 #include <typeinfo>
+#include <algorithm>
 #include <iostream>
 
 #include <osg/PositionAttitudeTransform>
@@ -39,12 +40,64 @@
 namespace
 {
 
+/// Number of actors whose line of sight to the sneaking player is checked at once. The checks stop at the first actor
+/// that notices the player, so larger batches waste more rays.
+const size_t sSneakCheckBatchSize = 4;
+
 bool isConscious(const MWWorld::Ptr& ptr)
 {
     const MWMechanics::CreatureStats& stats = ptr.getClass().getCreatureStats(ptr);
     return !stats.isDead() && !stats.getKnockedDown();
 }
 
+/// Check everything about head tracking except for the line of sight, awareness and closer targets.
+bool canHeadTrack(const MWWorld::Ptr& actor, const MWWorld::Ptr& targetActor, float& sqrDist)
+{
+    static const float fMaxHeadTrackDistance = MWBase::Environment::get().getWorld()->getStore().get<ESM::GameSetting>()
+            .find("fMaxHeadTrackDistance")->getFloat();
+    static const float fInteriorHeadTrackMult = MWBase::Environment::get().getWorld()->getStore().get<ESM::GameSetting>()
+            .find("fInteriorHeadTrackMult")->getFloat();
+    float maxDistance = fMaxHeadTrackDistance;
+    const ESM::Cell* currentCell = actor.getCell()->getCell();
+    if (!currentCell->isExterior() && !(currentCell->mData.mFlags & ESM::Cell::QuasiEx))
+        maxDistance *= fInteriorHeadTrackMult;
+
+    const ESM::Position& actor1Pos = actor.getRefData().getPosition();
+    const ESM::Position& actor2Pos = targetActor.getRefData().getPosition();
+    sqrDist = (actor1Pos.asVec3() - actor2Pos.asVec3()).length2();
+
+    if (sqrDist > maxDistance*maxDistance)
+        return false;
+
+    if (targetActor.getClass().getCreatureStats(targetActor).isDead())
+        return false;
+
+    if (!actor.getRefData().getBaseNode())
+        return false;
+
+    // stop tracking when target is behind the actor
+    osg::Vec3f actorDirection = actor.getRefData().getBaseNode()->getAttitude() * osg::Vec3f(0,1,0);
+    osg::Vec3f targetDirection (actor2Pos.asVec3() - actor1Pos.asVec3());
+    actorDirection.z() = 0;
+    targetDirection.z() = 0;
+    actorDirection.normalize();
+    targetDirection.normalize();
+    return std::acos(actorDirection * targetDirection) < osg::DegreesToRadians(90.f);
+}
+
+/// Check whether the guard \a ptr confronts the player on sight, because of the player's bounty.
+bool confrontsPlayerOnSight(const MWWorld::Ptr& ptr, const MWWorld::Ptr& player)
+{
+    const MWMechanics::CreatureStats& creatureStats = ptr.getClass().getCreatureStats(ptr);
+    if (!ptr.getClass().isClass(ptr, "Guard") || creatureStats.getAiSequence().getTypeId() == MWMechanics::AiPackage::TypeIdPursue
+            || creatureStats.getAiSequence().isInCombat())
+        return false;
+
+    // In vanilla morrowind, the greeting dialogue is scripted to either arrest the player (< 5000 bounty) or attack (>= 5000 bounty)
+    int cutoff = MWBase::Environment::get().getWorld()->getStore().get<ESM::GameSetting>().find("iCrimeThreshold")->getInt();
+    return player.getClass().getNpcStats(player).getBounty() >= cutoff;
+}
+
 void adjustBoundItem (const std::string& item, bool bound, const MWWorld::Ptr& actor)
 {
     if (bound)
@@ -230,73 +283,44 @@ namespace MWMechanics
         calculateRestoration(ptr, duration);
     }
 
-    void Actors::updateHeadTracking(const MWWorld::Ptr& actor, const MWWorld::Ptr& targetActor,
-                                    MWWorld::Ptr& headTrackTarget, float& sqrHeadTrackDistance)
+    MWWorld::Ptr Actors::findHeadTrackTarget(const MWWorld::Ptr& actor,
+                                             const std::vector<std::pair<float, MWWorld::Ptr> >& candidates)
     {
-        static const float fMaxHeadTrackDistance = MWBase::Environment::get().getWorld()->getStore().get<ESM::GameSetting>()
-                .find("fMaxHeadTrackDistance")->getFloat();
-        static const float fInteriorHeadTrackMult = MWBase::Environment::get().getWorld()->getStore().get<ESM::GameSetting>()
-                .find("fInteriorHeadTrackMult")->getFloat();
-        float maxDistance = fMaxHeadTrackDistance;
-        const ESM::Cell* currentCell = actor.getCell()->getCell();
-        if (!currentCell->isExterior() && !(currentCell->mData.mFlags & ESM::Cell::QuasiEx))
-            maxDistance *= fInteriorHeadTrackMult;
-
-        const ESM::Position& actor1Pos = actor.getRefData().getPosition();
-        const ESM::Position& actor2Pos = targetActor.getRefData().getPosition();
-        float sqrDist = (actor1Pos.asVec3() - actor2Pos.asVec3()).length2();
-
-        if (sqrDist > maxDistance*maxDistance)
-            return;
-
-        if (targetActor.getClass().getCreatureStats(targetActor).isDead())
-            return;
-
-        if (!actor.getRefData().getBaseNode())
-            return;
-
-        // stop tracking when target is behind the actor
-        osg::Vec3f actorDirection = actor.getRefData().getBaseNode()->getAttitude() * osg::Vec3f(0,1,0);
-        osg::Vec3f targetDirection (actor2Pos.asVec3() - actor1Pos.asVec3());
-        actorDirection.z() = 0;
-        targetDirection.z() = 0;
-        actorDirection.normalize();
-        targetDirection.normalize();
-        if (std::acos(actorDirection * targetDirection) < osg::DegreesToRadians(90.f)
-            && sqrDist <= sqrHeadTrackDistance
-            && MWBase::Environment::get().getWorld()->getLOS(actor, targetActor) // check LOS and awareness last as it's the most expensive function
-            && MWBase::Environment::get().getMechanicsManager()->awarenessCheck(targetActor, actor))
+        // The nearest one is checked first, so the others need neither line of sight nor awareness checks once it passes
+        for (std::vector<std::pair<float, MWWorld::Ptr> >::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
         {
-            sqrHeadTrackDistance = sqrDist;
-            headTrackTarget = targetActor;
+            if (MWBase::Environment::get().getWorld()->getLOS(actor, it->second)
+                && MWBase::Environment::get().getMechanicsManager()->awarenessCheck(it->second, actor))
+                return it->second;
         }
+        return MWWorld::Ptr();
     }
 
-    void Actors::engageCombat (const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer)
+    bool Actors::wouldEngageCombat (const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer)
     {
         CreatureStats& creatureStats = actor1.getClass().getCreatureStats(actor1);
 
         if (actor2.getClass().getCreatureStats(actor2).isDead()
                 || actor1.getClass().getCreatureStats(actor1).isDead())
-            return;
+            return false;
 
         const ESM::Position& actor1Pos = actor1.getRefData().getPosition();
         const ESM::Position& actor2Pos = actor2.getRefData().getPosition();
         float sqrDist = (actor1Pos.asVec3() - actor2Pos.asVec3()).length2();
         if (sqrDist > 7168*7168)
-            return;
+            return false;
 
         // pure water creatures won't try to fight with the target on the ground
         // except that creature is already hostile
         if ((againstPlayer || !creatureStats.getAiSequence().isInCombat())
             && !MWMechanics::isEnvironmentCompatible(actor1, actor2)) // creature can't swim to target
         {
-            return;
+            return false;
         }
 
         // no combat for totally static creatures (they have no movement or attack animations anyway)
         if (!actor1.getClass().isMobile(actor1))
-            return;
+            return false;
 
         bool aggressive;
 
@@ -305,7 +329,7 @@ namespace MWMechanics
             // followers with high fight should not engage in combat with the player (e.g. bm_bear_black_summon)
             const std::list<MWWorld::Ptr>& followers = getActorsFollowing(actor2);
             if (std::find(followers.begin(), followers.end(), actor1) != followers.end())
-                return;
+                return false;
 
             aggressive = MWBase::Environment::get().getMechanicsManager()->isAggressive(actor1, actor2);
         }
@@ -352,19 +376,27 @@ namespace MWMechanics
             }
         }
 
-        if(aggressive)
-        {
-            bool LOS = MWBase::Environment::get().getWorld()->getLOS(actor1, actor2);
+        return aggressive;
+    }
 
-            if (againstPlayer) LOS &= MWBase::Environment::get().getMechanicsManager()->awarenessCheck(actor2, actor1);
+    void Actors::engageCombat (const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer)
+    {
+        if (wouldEngageCombat(actor1, actor2, againstPlayer))
+            engageCombatOnSight(actor1, actor2, againstPlayer);
+    }
 
-            if (LOS)
+    void Actors::engageCombatOnSight (const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer)
+    {
+        bool LOS = MWBase::Environment::get().getWorld()->getLOS(actor1, actor2);
+
+        if (againstPlayer) LOS &= MWBase::Environment::get().getMechanicsManager()->awarenessCheck(actor2, actor1);
+
+        if (LOS)
+        {
+            MWBase::Environment::get().getMechanicsManager()->startCombat(actor1, actor2);
+            if (!againstPlayer) // start combat between each other
             {
-                MWBase::Environment::get().getMechanicsManager()->startCombat(actor1, actor2);
-                if (!againstPlayer) // start combat between each other
-                {
-                    MWBase::Environment::get().getMechanicsManager()->startCombat(actor2, actor1);
-                }
+                MWBase::Environment::get().getMechanicsManager()->startCombat(actor2, actor1);
             }
         }
     }
@@ -835,15 +867,13 @@ namespace MWMechanics
             if (player.getClass().getNpcStats(player).isWerewolf())
                 return;
 
-            if (ptr.getClass().isClass(ptr, "Guard") && creatureStats.getAiSequence().getTypeId() != AiPackage::TypeIdPursue && !creatureStats.getAiSequence().isInCombat())
+            // Force dialogue on sight if bounty is greater than the cutoff
+            if (confrontsPlayerOnSight(ptr, player))
             {
                 const MWWorld::ESMStore& esmStore = MWBase::Environment::get().getWorld()->getStore();
                 int cutoff = esmStore.get<ESM::GameSetting>().find("iCrimeThreshold")->getInt();
-                // Force dialogue on sight if bounty is greater than the cutoff
-                // In vanilla morrowind, the greeting dialogue is scripted to either arrest the player (< 5000 bounty) or attack (>= 5000 bounty)
-                if (   player.getClass().getNpcStats(player).getBounty() >= cutoff
-                       // TODO: do not run these two every frame. keep an Aware state for each actor and update it every 0.2 s or so?
-                    && MWBase::Environment::get().getWorld()->getLOS(ptr, player)
+                // TODO: do not run these two every frame. keep an Aware state for each actor and update it every 0.2 s or so?
+                if (   MWBase::Environment::get().getWorld()->getLOS(ptr, player)
                     && MWBase::Environment::get().getMechanicsManager()->awarenessCheck(player, ptr))
                 {
                     static int iCrimeThresholdMultiplier = esmStore.get<ESM::GameSetting>().find("iCrimeThresholdMultiplier")->getInt();
@@ -936,6 +966,71 @@ namespace MWMechanics
         }
     }
 
+    void Actors::checkLinesOfSight(float duration, float sqrProcessingDistance, bool updateTargets, bool headTracking,
+                                   TargetCandidateMap& candidates)
+    {
+        if (!MWBase::Environment::get().getMechanicsManager()->isAIActive())
+            return;
+
+        MWWorld::Ptr player = getPlayer();
+        bool playerIsWerewolf = player.getClass().getNpcStats(player).isWerewolf();
+
+        std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> > checks;
+        for(PtrActorMap::iterator iter(mActors.begin()); iter != mActors.end(); ++iter)
+        {
+            const MWWorld::Ptr& actor = iter->first;
+            if (actor.getClass().getCreatureStats(actor).isDead()
+                    || (player.getRefData().getPosition().asVec3() - actor.getRefData().getPosition().asVec3()).length2() > sqrProcessingDistance)
+                continue;
+
+            if (updateTargets || headTracking)
+            {
+                TargetCandidates& targets = candidates[actor];
+                for(PtrActorMap::iterator it(mActors.begin()); it != mActors.end(); ++it)
+                {
+                    if (it->first == actor)
+                        continue;
+
+                    if (updateTargets && actor != player && wouldEngageCombat(actor, it->first, it->first == player))
+                    {
+                        targets.mCombat.push_back(it->first);
+                        checks.push_back(std::make_pair(actor, it->first));
+                    }
+
+                    float sqrDist;
+                    if (headTracking && canHeadTrack(actor, it->first, sqrDist))
+                        targets.mHeadTracking.push_back(std::make_pair(sqrDist, it->first));
+                }
+
+                // Only the nearest one is sure to be checked, the others only if the actor does not see it
+                if (!targets.mHeadTracking.empty())
+                {
+                    std::sort(targets.mHeadTracking.begin(), targets.mHeadTracking.end());
+                    checks.push_back(std::make_pair(actor, targets.mHeadTracking.front().second));
+                }
+            }
+
+            if (actor == player)
+                continue;
+
+            if (actor.getClass().isNpc() && !playerIsWerewolf && confrontsPlayerOnSight(actor, player))
+                checks.push_back(std::make_pair(actor, player));
+
+            if (isConscious(actor))
+                actor.getClass().getCreatureStats(actor).getAiSequence().getLineOfSightChecks(actor, iter->second->getAiState(), duration, checks);
+        }
+
+        if (checks.empty())
+            return;
+
+        std::sort(checks.begin(), checks.end());
+        checks.erase(std::unique(checks.begin(), checks.end()), checks.end());
+
+        // The results stay cached for the rest of the frame, where the individual checks find them
+        std::vector<bool> results;
+        MWBase::Environment::get().getWorld()->getLOS(checks, results);
+    }
+
     void Actors::update (float duration, bool paused)
     {
         if(!paused)
@@ -959,6 +1054,10 @@ namespace MWMechanics
 
             /// \todo move update logic to Actor class where appropriate
 
+            TargetCandidateMap targetCandidates;
+            checkLinesOfSight(duration, sqrProcessingDistance, timerUpdateAITargets == 0, timerUpdateHeadTrack == 0,
+                              targetCandidates);
+
              // AI and magic effects update
             for(PtrActorMap::iterator iter(mActors.begin()); iter != mActors.end(); ++iter)
             {
@@ -975,31 +1074,24 @@ namespace MWMechanics
                     updateActor(iter->first, duration);
                     if (MWBase::Environment::get().getMechanicsManager()->isAIActive() && inProcessingRange)
                     {
+                        // Found by checkLinesOfSight() for the actors alive and in range at the start of the update
+                        const TargetCandidates& targets = targetCandidates[iter->first];
+
                         if (timerUpdateAITargets == 0)
                         {
                             if (iter->first != player)
                                 adjustCommandedActor(iter->first);
 
-                            for(PtrActorMap::iterator it(mActors.begin()); it != mActors.end(); ++it)
+                            // The player is not AI-controlled and has no combat candidates. Those that died since
+                            // they were found are skipped.
+                            for (std::vector<MWWorld::Ptr>::const_iterator it = targets.mCombat.begin(); it != targets.mCombat.end(); ++it)
                             {
-                                if (it->first == iter->first || iter->first == player) // player is not AI-controlled
-                                    continue;
-                                engageCombat(iter->first, it->first, it->first == player);
+                                if (!it->getClass().getCreatureStats(*it).isDead())
+                                    engageCombatOnSight(iter->first, *it, *it == player);
                             }
                         }
                         if (timerUpdateHeadTrack == 0)
-                        {
-                            float sqrHeadTrackDistance = std::numeric_limits<float>::max();
-                            MWWorld::Ptr headTrackTarget;
-
-                            for(PtrActorMap::iterator it(mActors.begin()); it != mActors.end(); ++it)
-                            {
-                                if (it->first == iter->first)
-                                    continue;
-                                updateHeadTracking(iter->first, it->first, headTrackTarget, sqrHeadTrackDistance);
-                            }
-                            iter->second->getCharacterController()->setHeadTrackTarget(headTrackTarget);
-                        }
+                            iter->second->getCharacterController()->setHeadTrackTarget(findHeadTrackTarget(iter->first, targets.mHeadTracking));
 
                         if (iter->first.getClass().isNpc() && iter->first != player)
                             updateCrimePersuit(iter->first, duration);
@@ -1113,24 +1205,39 @@ namespace MWMechanics
 
                     bool detected = false;
 
+                    std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> > inRange;
                     for (PtrActorMap::iterator iter(mActors.begin()); iter != mActors.end(); ++iter)
                     {
                         if (iter->first == player)  // not the player
                             continue;
 
-                        // is the player in range and can they be detected
-                        if ((iter->first.getRefData().getPosition().asVec3() - player.getRefData().getPosition().asVec3()).length2() <= radius*radius
-                            && MWBase::Environment::get().getWorld()->getLOS(player, iter->first))
+                        if ((iter->first.getRefData().getPosition().asVec3() - player.getRefData().getPosition().asVec3()).length2() <= radius*radius)
+                            inRange.push_back(std::make_pair(player, iter->first));
+                    }
+
+                    // check the lines of sight a few actors at a time, until one of them detects the player
+                    for (size_t first=0; first<inRange.size() && !detected; first+=sSneakCheckBatchSize)
+                    {
+                        std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> > batch(inRange.begin() + first,
+                            inRange.begin() + std::min(first + sSneakCheckBatchSize, inRange.size()));
+                        std::vector<bool> LOS;
+                        MWBase::Environment::get().getWorld()->getLOS(batch, LOS);
+
+                        for (size_t i=0; i<batch.size(); ++i)
                         {
-                            if (MWBase::Environment::get().getMechanicsManager()->awarenessCheck(player, iter->first))
+                            // can the player be detected
+                            if (LOS[i])
                             {
-                                detected = true;
-                                avoidedNotice = false;
-                                MWBase::Environment::get().getWindowManager()->setSneakVisibility(false);
-                                break;
+                                if (MWBase::Environment::get().getMechanicsManager()->awarenessCheck(player, batch[i].second))
+                                {
+                                    detected = true;
+                                    avoidedNotice = false;
+                                    MWBase::Environment::get().getWindowManager()->setSneakVisibility(false);
+                                    break;
+                                }
+                                else if (!detected)
+                                    avoidedNotice = true;
                             }
-                            else if (!detected)
-                                avoidedNotice = true;
                         }
                     }
 
@@ -41,6 +41,32 @@ namespace MWMechanics
 
             void updateCrimePersuit (const MWWorld::Ptr& ptr, float duration);
 
+            /// Check everything engageCombat() does before the line of sight.
+            bool wouldEngageCombat(const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer);
+
+            /// The actors that pass everything but the line of sight and awareness checks to become a target of an actor.
+            struct TargetCandidates
+            {
+                /// See wouldEngageCombat()
+                std::vector<MWWorld::Ptr> mCombat;
+                /// <squared distance, actor>, nearest first
+                std::vector<std::pair<float, MWWorld::Ptr> > mHeadTracking;
+            };
+            typedef std::map<MWWorld::Ptr, TargetCandidates> TargetCandidateMap;
+
+            /// Find the target candidates of all actors in processing distance, and check the lines of sight that the AI
+            /// update of this frame is sure to need all at once, so that the individual checks during the update find
+            /// them cached.
+            void checkLinesOfSight(float duration, float sqrProcessingDistance, bool updateTargets, bool headTracking,
+                                   TargetCandidateMap& candidates);
+
+            /// Start combat between \a actor1 and \a actor2 if \a actor1 sees \a actor2, see engageCombat().
+            void engageCombatOnSight(const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer);
+
+            /// Return the nearest of \a candidates that \a actor sees and is aware of, or an empty Ptr.
+            MWWorld::Ptr findHeadTrackTarget(const MWWorld::Ptr& actor,
+                                             const std::vector<std::pair<float, MWWorld::Ptr> >& candidates);
+
             void killDeadActors ();
 
         public:
@@ -86,9 +112,6 @@ namespace MWMechanics
             */
             void engageCombat(const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, bool againstPlayer);
 
-            void updateHeadTracking(const MWWorld::Ptr& actor, const MWWorld::Ptr& targetActor,
-                                            MWWorld::Ptr& headTrackTarget, float& sqrHeadTrackDistance);
-
             void restoreDynamicStats(bool sleep);
             ///< If the player is sleeping, this should be called every hour.
 
@@ -572,6 +572,19 @@ namespace MWMechanics
         return 1;
     }
 
+    void AiCombat::getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                        std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out)
+    {
+        // The line of sight to the target is checked when the next execute() reacts
+        AiCombatStorage* storage = state.find<AiCombatStorage>();
+        if (!storage || storage->mTimerReact < REACTION_INTERVAL)
+            return;
+
+        MWWorld::Ptr target = getTarget();
+        if (!target.isEmpty())
+            out.push_back(std::make_pair(actor, target));
+    }
+
     MWWorld::Ptr AiCombat::getTarget() const
     {
         return MWBase::Environment::get().getWorld()->searchPtrViaActorId(mTargetActorId);
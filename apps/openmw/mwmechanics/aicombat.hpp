@@ -48,6 +48,9 @@ namespace MWMechanics
 
             virtual unsigned int getPriority() const;
 
+            virtual void getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                              std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out);
+
             ///Returns target ID
             MWWorld::Ptr getTarget() const;
 
@@ -164,6 +164,20 @@ int AiFollow::getTypeId() const
     return TypeIdFollow;
 }
 
+void AiFollow::getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                    std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out)
+{
+    // Only the initial activation checks the line of sight, see execute()
+    AiFollowStorage* storage = state.find<AiFollowStorage>();
+    if (mActive || !storage || storage->mTimer - duration >= 0)
+        return;
+
+    MWWorld::Ptr target = getTarget();
+    if (!target.isEmpty() && (actor.getRefData().getPosition().asVec3() - target.getRefData().getPosition().asVec3()).length2()
+            < 500*500)
+        out.push_back(std::make_pair(actor, target));
+}
+
 bool AiFollow::isCommanded() const
 {
     return mCommanded;
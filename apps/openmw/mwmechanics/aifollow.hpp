@@ -39,6 +39,9 @@ namespace MWMechanics
 
             virtual int getTypeId() const;
 
+            virtual void getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                              std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out);
+
             /// Returns the actor being followed
             std::string getFollowedActor();
 
@@ -1,6 +1,9 @@
 #ifndef GAME_MWMECHANICS_AIPACKAGE_H
 #define GAME_MWMECHANICS_AIPACKAGE_H
 
+#include <vector>
+#include <utility>
+
 #include "pathfinding.hpp"
 #include <components/esm/defs.hpp>
 
@@ -69,6 +72,11 @@ namespace MWMechanics
             /// Simulates the passing of time
             virtual void fastForward(const MWWorld::Ptr& actor, AiState& state) {}
 
+            /// Add the pairs of actors whose line of sight the next execute() with \a duration is expected to check,
+            /// so that the checks of all actors can be done at once beforehand. A wrong guess only costs time.
+            virtual void getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                              std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out) {}
+
             bool isTargetMagicallyHidden(const MWWorld::Ptr& target);
 
         protected:
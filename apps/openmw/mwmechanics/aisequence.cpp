@@ -406,4 +406,12 @@ void AiSequence::fastForward(const MWWorld::Ptr& actor, AiState& state)
     }
 }
 
+void AiSequence::getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                      std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out) const
+{
+    // execute() might still switch to the combat package with the nearest target, whose checks are then not done early
+    if (actor != getPlayer() && !mPackages.empty())
+        mPackages.front()->getLineOfSightChecks(actor, state, duration, out);
+}
+
 } // namespace MWMechanics
@@ -2,6 +2,8 @@
 #define GAME_MWMECHANICS_AISEQUENCE_H
 
 #include <list>
+#include <vector>
+#include <utility>
 
 #include <components/esm/loadnpc.hpp>
 //#include "aistate.hpp"
@@ -101,6 +103,10 @@ namespace MWMechanics
             /// Simulate the passing of time using the currently active AI package
             void fastForward(const MWWorld::Ptr &actor, AiState &state);
 
+            /// Add the line of sight checks the next execute() is expected to do, see AiPackage::getLineOfSightChecks.
+            void getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                      std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out) const;
+
             /// Remove all packages.
             void clear();
 
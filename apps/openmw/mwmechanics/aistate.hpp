@@ -39,6 +39,13 @@ namespace MWMechanics
             //return a reference to the (new allocated) object 
             return *result;
         }
+
+        /// \brief returns the stored object if it has the requested type, or NULL. Unlike get(), never replaces it.
+        template< class Derived >
+        Derived* find()
+        {
+            return dynamic_cast<Derived*>(mStorage);
+        }
         
         template< class Derived >
         void store( const Derived& payload )
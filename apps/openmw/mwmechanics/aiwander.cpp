@@ -39,6 +39,16 @@ namespace MWMechanics
     // distance must be long enough that NPC will need to move to get there.
     static const int MINIMUM_WANDER_DISTANCE = DESTINATION_TOLERANCE * 2;
 
+    /// Distance at which the actor greets the player
+    static float getHelloDistance(const MWWorld::Ptr& actor)
+    {
+        int hello = actor.getClass().getCreatureStats(actor).getAiSetting(CreatureStats::AI_Hello).getModified();
+        static int iGreetDistanceMultiplier = MWBase::Environment::get().getWorld()->getStore()
+            .get<ESM::GameSetting>().find("iGreetDistanceMultiplier")->getInt();
+
+        return static_cast<float>(hello * iGreetDistanceMultiplier);
+    }
+
     const std::string AiWander::sIdleSelectToGroupName[GroupIndex_MaxIdle - GroupIndex_MinIdle + 1] =
     {
         std::string("idle2"),
@@ -489,12 +499,7 @@ namespace MWMechanics
     void AiWander::playGreetingIfPlayerGetsTooClose(const MWWorld::Ptr& actor, AiWanderStorage& storage)
     {
         // Play a random voice greeting if the player gets too close
-        int hello = actor.getClass().getCreatureStats(actor).getAiSetting(CreatureStats::AI_Hello).getModified();
-        float helloDistance = static_cast<float>(hello);
-        static int iGreetDistanceMultiplier = MWBase::Environment::get().getWorld()->getStore()
-            .get<ESM::GameSetting>().find("iGreetDistanceMultiplier")->getInt();
-
-        helloDistance *= iGreetDistanceMultiplier;
+        float helloDistance = getHelloDistance(actor);
 
         MWWorld::Ptr player = getPlayer();
         osg::Vec3f playerPos(player.getRefData().getPosition().asVec3());
@@ -685,6 +690,22 @@ namespace MWMechanics
         return selectedAnimation;
     }
 
+    void AiWander::getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                        std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out)
+    {
+        // Only the greeting in the next reaction is predictable, the idle voices depend on a random roll first
+        AiWanderStorage* storage = state.find<AiWanderStorage>();
+        if (!storage || storage->mReaction + duration < REACTION_INTERVAL || storage->mSaidGreeting != Greet_None
+                || (storage->mState != Wander_IdleNow && storage->mState != Wander_Walking))
+            return;
+
+        MWWorld::Ptr player = getPlayer();
+        float helloDistance = getHelloDistance(actor);
+        if ((player.getRefData().getPosition().asVec3() - actor.getRefData().getPosition().asVec3()).length2() <= helloDistance*helloDistance
+                && !player.getClass().getCreatureStats(player).isDead())
+            out.push_back(std::make_pair(player, actor));
+    }
+
     void AiWander::fastForward(const MWWorld::Ptr& actor, AiState &state)
     {
         if (mDistance == 0)
@@ -57,6 +57,9 @@ namespace MWMechanics
             virtual void writeState(ESM::AiSequence::AiSequence &sequence) const;
 
             virtual void fastForward(const MWWorld::Ptr& actor, AiState& state);
+
+            virtual void getLineOfSightChecks(const MWWorld::Ptr& actor, AiState& state, float duration,
+                                              std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& out);
             
             enum GreetingState {
                 Greet_None,
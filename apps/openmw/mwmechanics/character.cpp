@@ -1839,6 +1839,9 @@ void CharacterController::update(float duration)
     }
 
     osg::Vec3f moved = mAnimation->runAnimation(mSkipAnim ? 0.f : duration);
+    // The player is always close to the camera, and the first person view would suffer from any skipped frame
+    if (mPtr != getPlayer())
+        mAnimation->updateLod();
     if(duration > 0.0f)
         moved /= duration;
     else
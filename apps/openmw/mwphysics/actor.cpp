@@ -49,6 +49,8 @@ Actor::Actor(const MWWorld::Ptr& ptr, osg::ref_ptr<NifBullet::BulletShapeInstanc
     // already called by updateScale()
     //updatePosition();
 
+    resetSimulationPosition(mPtr.getRefData().getPosition().asVec3());
+
     updateCollisionMask();
 }
 
@@ -85,8 +87,11 @@ void Actor::updateCollisionMask()
 
 void Actor::updatePosition()
 {
-    osg::Vec3f position = mPtr.getRefData().getPosition().asVec3();
+    setPosition(mPtr.getRefData().getPosition().asVec3());
+}
 
+void Actor::setPosition(const osg::Vec3f& position)
+{
     btTransform tr = mCollisionObject->getWorldTransform();
     osg::Vec3f scaledTranslation = mRotation * osg::componentMultiply(mMeshTranslation, mScale);
     osg::Vec3f newPosition = scaledTranslation + position;
@@ -95,6 +100,18 @@ void Actor::updatePosition()
     mCollisionObject->setWorldTransform(tr);
 }
 
+void Actor::setSimulationPosition(const osg::Vec3f& position)
+{
+    mPreviousSimulationPosition = mSimulationPosition;
+    mSimulationPosition = position;
+}
+
+void Actor::resetSimulationPosition(const osg::Vec3f& position)
+{
+    mPreviousSimulationPosition = position;
+    mSimulationPosition = position;
+}
+
 void Actor::updateRotation ()
 {
     btTransform tr = mCollisionObject->getWorldTransform();
@@ -65,6 +65,26 @@ namespace MWPhysics
         void updateRotation();
         void updatePosition();
 
+        /// Move the collision object to \a position, instead of the position of the Ptr.
+        void setPosition(const osg::Vec3f& position);
+
+        /// Record the position of the actor after a simulation step. The position before is kept as well,
+        /// so that the displayed position can be interpolated in between.
+        void setSimulationPosition(const osg::Vec3f& position);
+
+        /// Forget about the previous simulation steps, the actor is not moving from \a position.
+        void resetSimulationPosition(const osg::Vec3f& position);
+
+        const osg::Vec3f& getSimulationPosition() const
+        {
+            return mSimulationPosition;
+        }
+
+        const osg::Vec3f& getPreviousSimulationPosition() const
+        {
+            return mPreviousSimulationPosition;
+        }
+
         /**
          * Returns the (scaled) half extents
          */
@@ -120,6 +140,9 @@ namespace MWPhysics
         osg::Vec3f mScale;
         osg::Vec3f mPosition;
 
+        osg::Vec3f mSimulationPosition;
+        osg::Vec3f mPreviousSimulationPosition;
+
         osg::Vec3f mForce;
         bool mOnGround;
         bool mInternalCollisionMode;
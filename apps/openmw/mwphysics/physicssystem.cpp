@@ -1,9 +1,14 @@
 #include "physicssystem.hpp"
 
+#include <cmath>
 #include <stdexcept>
 
 #include <osg/Group>
 #include <osg/PositionAttitudeTransform>
+#include <osg/Stats>
+#include <osg/Timer>
+
+#include <OpenThreads/Atomic>
 
 #include <BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
 #include <BulletCollision/CollisionShapes/btConeShape.h>
@@ -25,6 +30,10 @@
 
 #include <components/nifosg/particle.hpp> // FindRecIndexVisitor
 
+#include <components/sceneutil/workqueue.hpp>
+
+#include <components/settings/settings.hpp>
+
 #include "../mwbase/world.hpp"
 #include "../mwbase/environment.hpp"
 
@@ -57,6 +66,9 @@ namespace MWPhysics
     // Arbitrary number. To prevent infinite loops. They shouldn't happen but it's good to be prepared.
     static const int sMaxIterations = 8;
 
+    // Fewer actors or rays are not worth waking up another thread for
+    static const size_t sMinItemsPerThread = 4;
+
     // FIXME: move to a separate file
     class MovementSolver
     {
@@ -68,7 +80,7 @@ namespace MWPhysics
         }
 
         static bool stepMove(btCollisionObject *colobj, osg::Vec3f &position,
-                             const osg::Vec3f &toMove, float &remainingTime, btCollisionWorld* collisionWorld)
+                             const osg::Vec3f &toMove, float &remainingTime, btCollisionWorld* collisionWorld, bool threadSafe)
         {
             /*
              * Slide up an incline or set of stairs.  Should be called only after a
@@ -116,7 +128,7 @@ namespace MWPhysics
              */
             ActorTracer tracer, stepper;
 
-            stepper.doTrace(colobj, position, position+osg::Vec3f(0.0f,0.0f,sStepSizeUp), collisionWorld);
+            stepper.doTrace(colobj, position, position+osg::Vec3f(0.0f,0.0f,sStepSizeUp), collisionWorld, threadSafe);
             if(stepper.mFraction < std::numeric_limits<float>::epsilon())
                 return false; // didn't even move the smallest representable amount
                               // (TODO: shouldn't this be larger? Why bother with such a small amount?)
@@ -134,7 +146,7 @@ namespace MWPhysics
              *          +--+
              *    ==============================================
              */
-            tracer.doTrace(colobj, stepper.mEndPos, stepper.mEndPos + toMove, collisionWorld);
+            tracer.doTrace(colobj, stepper.mEndPos, stepper.mEndPos + toMove, collisionWorld, threadSafe);
             if(tracer.mFraction < std::numeric_limits<float>::epsilon())
                 return false; // didn't even move the smallest representable amount
 
@@ -153,7 +165,7 @@ namespace MWPhysics
              *          +--+            +--+
              *    ==============================================
              */
-            stepper.doTrace(colobj, tracer.mEndPos, tracer.mEndPos-osg::Vec3f(0.0f,0.0f,sStepSizeDown), collisionWorld);
+            stepper.doTrace(colobj, tracer.mEndPos, tracer.mEndPos-osg::Vec3f(0.0f,0.0f,sStepSizeDown), collisionWorld, threadSafe);
             if(stepper.mFraction < 1.0f && getSlope(stepper.mPlaneNormal) <= sMaxSlope)
             {
                 // don't allow stepping up other actors
@@ -232,13 +244,17 @@ namespace MWPhysics
             }
         }
 
-        static osg::Vec3f move(const MWWorld::Ptr &ptr, Actor* physicActor, const osg::Vec3f &movement, float time,
+        /// @param position Position of the actor before this step. May differ from the position of \a ptr if
+        /// several steps are simulated at once.
+        /// @param movement The jump is removed from it once applied, so that further steps do not repeat it.
+        /// @param threadSafe Allow other threads to solve the movement of other actors against the same collision world
+        /// meanwhile. The collision world must not be modified until all of them are done.
+        static osg::Vec3f move(const MWWorld::Ptr &ptr, Actor* physicActor, osg::Vec3f position, osg::Vec3f &movement, float time,
                                   bool isFlying, float waterlevel, float slowFall, btCollisionWorld* collisionWorld
                                   , std::map<MWWorld::Ptr, MWWorld::Ptr>& collisionTracker
-                                  , std::map<MWWorld::Ptr, MWWorld::Ptr>& standingCollisionTracker)
+                                  , std::map<MWWorld::Ptr, MWWorld::Ptr>& standingCollisionTracker, bool threadSafe)
         {
             const ESM::Position& refpos = ptr.getRefData().getPosition();
-            osg::Vec3f position(refpos.asVec3());
 
             // Early-out for totally static creatures
             // (Not sure if gravity should still apply?)
@@ -277,13 +293,15 @@ namespace MWPhysics
                 velocity = (osg::Quat(refpos.rot[2], osg::Vec3f(0, 0, -1))) * movement;
 
                 if (velocity.z() > 0.f)
+                {
                     inertia = velocity;
+                    movement.z() = 0.f;
+                }
                 if(!physicActor->getOnGround())
                 {
                     velocity = velocity + physicActor->getInertialForce();
                 }
             }
-            ptr.getClass().getMovementSettings(ptr).mPosition[2] = 0;
 
             // Now that we have the effective movement vector, apply wind forces to it
             if (MWBase::Environment::get().getWorld()->isInStorm())
@@ -326,7 +344,7 @@ namespace MWPhysics
                 if((newPosition - nextpos).length2() > 0.0001)
                 {
                     // trace to where character would go if there were no obstructions
-                    tracer.doTrace(colobj, newPosition, nextpos, collisionWorld);
+                    tracer.doTrace(colobj, newPosition, nextpos, collisionWorld, threadSafe);
 
                     // check for obstructions
                     if(tracer.mFraction >= 1.0f)
@@ -358,12 +376,12 @@ namespace MWPhysics
                 osg::Vec3f oldPosition = newPosition;
                 // We hit something. Try to step up onto it. (NOTE: stepMove does not allow stepping over)
                 // NOTE: stepMove modifies newPosition if successful
-                bool result = stepMove(colobj, newPosition, velocity*remainingTime, remainingTime, collisionWorld);
+                bool result = stepMove(colobj, newPosition, velocity*remainingTime, remainingTime, collisionWorld, threadSafe);
                 if (!result) // to make sure the maximum stepping distance isn't framerate-dependent or movement-speed dependent
                 {
                     osg::Vec3f normalizedVelocity = velocity;
                     normalizedVelocity.normalize();
-                    result = stepMove(colobj, newPosition, normalizedVelocity*10.f, remainingTime, collisionWorld);
+                    result = stepMove(colobj, newPosition, normalizedVelocity*10.f, remainingTime, collisionWorld, threadSafe);
                 }
                 if(result)
                 {
@@ -401,7 +419,7 @@ namespace MWPhysics
                 osg::Vec3f from = newPosition;
                 osg::Vec3f to = newPosition - (physicActor->getOnGround() ?
                              osg::Vec3f(0,0,sStepSizeDown+2.f) : osg::Vec3f(0,0,2.f));
-                tracer.doTrace(colobj, from, to, collisionWorld);
+                tracer.doTrace(colobj, from, to, collisionWorld, threadSafe);
                 if(tracer.mFraction < 1.0f && getSlope(tracer.mPlaneNormal) <= sMaxSlope
                         && tracer.mHitObject->getBroadphaseHandle()->m_collisionFilterGroup != CollisionType_Actor)
                 {
@@ -455,6 +473,283 @@ namespace MWPhysics
         }
     };
 
+    /// The movement of a single actor, with everything MovementSolver::move needs to know about it.
+    /// @note The inputs are gathered on the main thread, since they can't be safely read from elsewhere.
+    struct MovementJob
+    {
+        MWWorld::Ptr mPtr;
+        Actor* mActor;
+        osg::Vec3f mMovement;
+        bool mIsFlying;
+        float mWaterLevel;
+        float mSlowFall;
+
+        /// Position before the current step
+        osg::Vec3f mPosition;
+
+        osg::Vec3f mNewPosition;
+        /// Total height the actor fell in all steps
+        float mFallHeight;
+        std::map<MWWorld::Ptr, MWWorld::Ptr> mCollisions;
+        std::map<MWWorld::Ptr, MWWorld::Ptr> mStandingCollisions;
+
+        /// Set if solving the movement failed
+        std::string mError;
+    };
+
+    static void solveMovement(std::vector<MovementJob>& jobs, size_t begin, size_t end, float time,
+                              btCollisionWorld* collisionWorld, bool threadSafe)
+    {
+        for (size_t i=begin; i<end; ++i)
+        {
+            MovementJob& job = jobs[i];
+            if (!job.mError.empty())
+                continue;
+            try
+            {
+                job.mNewPosition = MovementSolver::move(job.mPtr, job.mActor, job.mPosition, job.mMovement, time, job.mIsFlying,
+                                                        job.mWaterLevel, job.mSlowFall, collisionWorld,
+                                                        job.mCollisions, job.mStandingCollisions, threadSafe);
+            }
+            catch (std::exception& e)
+            {
+                job.mError = e.what();
+            }
+        }
+    }
+
+    /// [0, count) split into contiguous ranges, which any number of threads take turns in processing.
+    /// @note Referenced by the helper work items, which may only start once all ranges are done.
+    template <class Functor>
+    class ParallelFor : public osg::Referenced
+    {
+    public:
+        ParallelFor(const Functor& functor, size_t count, size_t rangeSize)
+            : mFunctor(functor)
+            , mCount(count)
+            , mRangeSize(rangeSize)
+            , mNumRanges((count + rangeSize - 1) / rangeSize)
+            , mNextRange(0)
+            , mRangesDone(0)
+            , mDone(new SceneUtil::WorkTicket)
+        {
+            setThreadSafeRefUnref(true);
+        }
+
+        /// Process ranges until none are left to start.
+        void run()
+        {
+            while (true)
+            {
+                unsigned int range = (++mNextRange) - 1;
+                if (range >= mNumRanges)
+                    return;
+
+                size_t begin = range * mRangeSize;
+                mFunctor(begin, std::min(begin + mRangeSize, mCount));
+
+                if (++mRangesDone == mNumRanges)
+                    mDone->signalDone();
+            }
+        }
+
+        /// Block until all ranges are done, including those other threads are still processing.
+        void waitTillDone()
+        {
+            mDone->waitTillDone();
+        }
+
+    private:
+        Functor mFunctor;
+        size_t mCount;
+        size_t mRangeSize;
+        unsigned int mNumRanges;
+        OpenThreads::Atomic mNextRange;
+        OpenThreads::Atomic mRangesDone;
+        osg::ref_ptr<SceneUtil::WorkTicket> mDone;
+    };
+
+    /// Helps processing a ParallelFor on a worker thread.
+    template <class Functor>
+    class ParallelForItem : public SceneUtil::WorkItem
+    {
+    public:
+        ParallelForItem(ParallelFor<Functor>* parallelFor)
+            : mParallelFor(parallelFor)
+        {
+        }
+
+        virtual void doWork()
+        {
+            mParallelFor->run();
+            mTicket->signalDone();
+        }
+
+    private:
+        osg::ref_ptr<ParallelFor<Functor> > mParallelFor;
+    };
+
+    /// Split [0, count) into contiguous ranges, and call \a functor(begin, end) for each of them. The ranges are processed
+    /// in parallel by this thread and the threads of \a workQueue. Without a \a workQueue, this thread does all the work.
+    /// @note This thread takes on any ranges the workers did not get to, so it never waits for work that was not started,
+    /// even if the workers are busy with other work or this is one of them.
+    template <class Functor>
+    static void parallelFor(size_t count, const Functor& functor, SceneUtil::WorkQueue* workQueue)
+    {
+        if (!workQueue || count == 0)
+        {
+            functor(0, count);
+            return;
+        }
+
+        size_t numRanges = std::min(static_cast<size_t>(workQueue->getNumThreads()) + 1,
+                                    (count + sMinItemsPerThread - 1) / sMinItemsPerThread);
+        numRanges = std::max(numRanges, static_cast<size_t>(1));
+        size_t rangeSize = (count + numRanges - 1) / numRanges;
+
+        osg::ref_ptr<ParallelFor<Functor> > work (new ParallelFor<Functor>(functor, count, rangeSize));
+        for (size_t i=1; i<numRanges; ++i)
+            workQueue->addWorkItem(new ParallelForItem<Functor>(work), SceneUtil::WorkQueue::Priority_High);
+
+        work->run();
+        work->waitTillDone();
+    }
+
+    struct SolveMovement
+    {
+        SolveMovement(std::vector<MovementJob>& jobs, float time, btCollisionWorld* collisionWorld, bool threadSafe)
+            : mJobs(&jobs)
+            , mTime(time)
+            , mCollisionWorld(collisionWorld)
+            , mThreadSafe(threadSafe)
+        {
+        }
+
+        void operator()(size_t begin, size_t end) const
+        {
+            solveMovement(*mJobs, begin, end, mTime, mCollisionWorld, mThreadSafe);
+        }
+
+        std::vector<MovementJob>* mJobs;
+        float mTime;
+        btCollisionWorld* mCollisionWorld;
+        bool mThreadSafe;
+    };
+
+    /// Solve the movement of all \a jobs for a time step of \a time.
+    /// @param workQueue Optional, threads to help solving the movement.
+    static void solveMovement(std::vector<MovementJob>& jobs, float time, btCollisionWorld* collisionWorld,
+                              SceneUtil::WorkQueue* workQueue)
+    {
+        // The collision world is not modified until all movement is solved, so the actors can be traced
+        // against it in parallel
+        parallelFor(jobs.size(), SolveMovement(jobs, time, collisionWorld, workQueue != NULL), workQueue);
+    }
+
+    /// The movement of all queued actors over one or more time steps.
+    /// @note Written by the thread running the simulation, only to be read once it is done.
+    class MovementSimulation : public osg::Referenced
+    {
+    public:
+        MovementSimulation()
+            : mNumSteps(0)
+            , mStepSize(0.f)
+            , mTimeTaken(0.0)
+            , mClaims(0)
+            , mDone(new SceneUtil::WorkTicket)
+        {
+            setThreadSafeRefUnref(true);
+        }
+
+        std::vector<MovementJob> mJobs;
+        int mNumSteps;
+        float mStepSize;
+
+        /// How long the simulation took, in seconds
+        double mTimeTaken;
+
+        /// Incremented by each thread that wants to run the simulation, only the first one does.
+        OpenThreads::Atomic mClaims;
+        osg::ref_ptr<SceneUtil::WorkTicket> mDone;
+    };
+
+    /// Run all steps of \a simulation.
+    /// @note Only changes the physics actors and the collision world, so it can run on another thread as long as nothing
+    /// else uses the PhysicsSystem meanwhile.
+    static void simulate(MovementSimulation& simulation, btCollisionWorld* collisionWorld, SceneUtil::WorkQueue* workQueue)
+    {
+        osg::Timer_t startTick = osg::Timer::instance()->tick();
+
+        std::vector<MovementJob>& jobs = simulation.mJobs;
+        for (int step=0; step<simulation.mNumSteps; ++step)
+        {
+            solveMovement(jobs, simulation.mStepSize, collisionWorld, workQueue);
+
+            // Update the actors in queue order, so that the results do not depend on which thread solved what
+            for (std::vector<MovementJob>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+            {
+                if (!it->mError.empty())
+                    continue;
+
+                float heightDiff = it->mNewPosition.z() - it->mPosition.z();
+                if (heightDiff < 0)
+                    it->mFallHeight -= heightDiff;
+
+                it->mPosition = it->mNewPosition;
+                it->mActor->setSimulationPosition(it->mPosition);
+
+                // The next step must see where the other actors went
+                if (step+1 < simulation.mNumSteps)
+                {
+                    it->mActor->setPosition(it->mPosition);
+                    collisionWorld->updateSingleAabb(it->mActor->getCollisionObject());
+                }
+            }
+        }
+
+        simulation.mTimeTaken = osg::Timer::instance()->delta_s(startTick, osg::Timer::instance()->tick());
+    }
+
+    /// Run \a simulation, unless another thread has claimed it already.
+    static void runSimulation(MovementSimulation& simulation, btCollisionWorld* collisionWorld, SceneUtil::WorkQueue* workQueue)
+    {
+        if (++simulation.mClaims != 1)
+            return;
+        simulate(simulation, collisionWorld, workQueue);
+        simulation.mDone->signalDone();
+    }
+
+    /// Run \a simulation on this thread if no other thread has claimed it yet, otherwise block until it is done.
+    /// @note Queued simulations are waited for this way, so that they never wait behind other work in the queue.
+    static void finishSimulation(MovementSimulation& simulation, btCollisionWorld* collisionWorld, SceneUtil::WorkQueue* workQueue)
+    {
+        runSimulation(simulation, collisionWorld, workQueue);
+        simulation.mDone->waitTillDone();
+    }
+
+    /// Runs a simulation on a worker thread, while the main thread goes on with rendering.
+    class SimulateMovementItem : public SceneUtil::WorkItem
+    {
+    public:
+        SimulateMovementItem(MovementSimulation* simulation, btCollisionWorld* collisionWorld, SceneUtil::WorkQueue* workQueue)
+            : mSimulation(simulation)
+            , mCollisionWorld(collisionWorld)
+            , mWorkQueue(workQueue)
+        {
+        }
+
+        virtual void doWork()
+        {
+            runSimulation(*mSimulation, mCollisionWorld, mWorkQueue);
+            mTicket->signalDone();
+        }
+
+    private:
+        osg::ref_ptr<MovementSimulation> mSimulation;
+        btCollisionWorld* mCollisionWorld;
+        SceneUtil::WorkQueue* mWorkQueue;
+    };
+
 
     // ---------------------------------------------------------------
 
@@ -594,14 +889,26 @@ namespace MWPhysics
 
     // ---------------------------------------------------------------
 
-    PhysicsSystem::PhysicsSystem(Resource::ResourceSystem* resourceSystem, osg::ref_ptr<osg::Group> parentNode)
+    PhysicsSystem::PhysicsSystem(Resource::ResourceSystem* resourceSystem, osg::ref_ptr<osg::Group> parentNode,
+                                 SceneUtil::WorkQueue* workQueue)
         : mShapeManager(new NifBullet::BulletShapeManager(resourceSystem->getVFS()))
+        , mResourceSystem(resourceSystem)
         , mDebugDrawEnabled(false)
         , mTimeAccum(0.0f)
+        , mStepSize(1.0f/60.0f)
+        , mMaxSteps(1)
+        , mWorkQueue(NULL)
+        , mSimulationWorkQueue(NULL)
+        , mSimulationTime(0.0)
+        , mSimulationWaitTime(0.0)
+        , mTime(0.0)
+        , mLineOfSightCacheTime(0.f)
         , mWaterHeight(0)
         , mWaterEnabled(false)
         , mParentNode(parentNode)
     {
+        mResourceSystem->addResourceManager(mShapeManager.get());
+
         mCollisionConfiguration = new btDefaultCollisionConfiguration();
         mDispatcher = new btCollisionDispatcher(mCollisionConfiguration);
         mBroadphase = new btDbvtBroadphase();
@@ -611,10 +918,26 @@ namespace MWPhysics
         // Don't update AABBs of all objects every frame. Most objects in MW are static, so we don't need this.
         // Should a "static" object ever be moved, we have to update its AABB manually using DynamicsWorld::updateSingleAabb.
         mCollisionWorld->setForceUpdateAllAabbs(false);
+
+        mStepSize = 1.f / std::max(1.f, Settings::Manager::getFloat("simulation rate", "Physics"));
+        mMaxSteps = std::max(1, Settings::Manager::getInt("max simulation steps", "Physics"));
+
+        if (Settings::Manager::getBool("use worker threads", "Physics"))
+            mWorkQueue = workQueue;
+
+        mLineOfSightCacheTime = Settings::Manager::getFloat("line of sight cache time", "Physics");
+
+        if (Settings::Manager::getBool("async simulation", "Physics"))
+            mSimulationWorkQueue = workQueue;
     }
 
     PhysicsSystem::~PhysicsSystem()
     {
+        if (mSimulation)
+            finishSimulation(*mSimulation, mCollisionWorld, mWorkQueue);
+
+        mResourceSystem->removeResourceManager(mShapeManager.get());
+
         if (mWaterCollisionObject.get())
             mCollisionWorld->removeCollisionObject(mWaterCollisionObject.get());
 
@@ -641,6 +964,11 @@ namespace MWPhysics
         delete mBroadphase;
     }
 
+    NifBullet::BulletShapeManager* PhysicsSystem::getShapeManager()
+    {
+        return mShapeManager.get();
+    }
+
     bool PhysicsSystem::toggleDebugRendering()
     {
         mDebugDrawEnabled = !mDebugDrawEnabled;
@@ -757,26 +1085,65 @@ namespace MWPhysics
         const btCollisionObject* mMe;
     };
 
-    PhysicsSystem::RayResult PhysicsSystem::castRay(const osg::Vec3f &from, const osg::Vec3f &to, MWWorld::Ptr ignore, int mask, int group)
+    /// Runs a ray test against each collision object whose broadphase proxy the ray passes through.
+    class RayTestProxiesCallback : public btDbvt::ICollide
     {
-        btVector3 btFrom = toBullet(from);
-        btVector3 btTo = toBullet(to);
+    public:
+        RayTestProxiesCallback(const btVector3& from, const btVector3& to, btCollisionWorld::RayResultCallback& resultCallback)
+            : mResultCallback(resultCallback)
+        {
+            mFrom.setIdentity();
+            mFrom.setOrigin(from);
+            mTo.setIdentity();
+            mTo.setOrigin(to);
+        }
 
-        const btCollisionObject* me = NULL;
-        if (!ignore.isEmpty())
+        virtual void Process(const btDbvtNode* leaf)
         {
-            Actor* actor = getActor(ignore);
-            if (actor)
-                me = actor->getCollisionObject();
+            if (mResultCallback.m_closestHitFraction == btScalar(0))
+                return; // can't get any closer
+
+            btBroadphaseProxy* proxy = static_cast<btBroadphaseProxy*>(leaf->data);
+            if (!mResultCallback.needsCollision(proxy))
+                return;
+
+            btCollisionObject* object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+            btCollisionWorld::rayTestSingle(mFrom, mTo, object, object->getCollisionShape(), object->getWorldTransform(),
+                                            mResultCallback);
         }
 
-        ClosestNotMeRayResultCallback resultCallback(me, btFrom, btTo);
+    private:
+        btTransform mFrom;
+        btTransform mTo;
+        btCollisionWorld::RayResultCallback& mResultCallback;
+    };
+
+    /// Cast a ray through \a collisionWorld.
+    /// @param threadSafe Allow other threads to cast rays through the same collision world meanwhile. btDbvtBroadphase::rayTest
+    /// shares one traversal stack between all callers, so instead, each tree of the broadphase is traversed with a stack
+    /// of our own. The collision world must not be modified until all of them are done.
+    static PhysicsSystem::RayResult castRay(const osg::Vec3f& from, const osg::Vec3f& to, const btCollisionObject* ignore,
+                                            int mask, int group, btCollisionWorld* collisionWorld, bool threadSafe)
+    {
+        btVector3 btFrom = toBullet(from);
+        btVector3 btTo = toBullet(to);
+
+        ClosestNotMeRayResultCallback resultCallback(ignore, btFrom, btTo);
         resultCallback.m_collisionFilterGroup = group;
         resultCallback.m_collisionFilterMask = mask;
 
-        mCollisionWorld->rayTest(btFrom, btTo, resultCallback);
+        if (threadSafe)
+        {
+            RayTestProxiesCallback callback(btFrom, btTo, resultCallback);
+            btDbvtBroadphase* broadphase = static_cast<btDbvtBroadphase*>(collisionWorld->getBroadphase());
+            // Dynamic and static proxies are kept in separate trees
+            for (int i=0; i<2; ++i)
+                btDbvt::rayTest(broadphase->m_sets[i].m_root, btFrom, btTo, callback);
+        }
+        else
+            collisionWorld->rayTest(btFrom, btTo, resultCallback);
 
-        RayResult result;
+        PhysicsSystem::RayResult result;
         result.mHit = resultCallback.hasHit();
         if (resultCallback.hasHit())
         {
@@ -788,6 +1155,69 @@ namespace MWPhysics
         return result;
     }
 
+    struct CastRays
+    {
+        CastRays(const std::vector<PhysicsSystem::RayQuery>& queries, const std::vector<const btCollisionObject*>& ignore,
+                 std::vector<PhysicsSystem::RayResult>& results, btCollisionWorld* collisionWorld, bool threadSafe)
+            : mQueries(&queries)
+            , mIgnore(&ignore)
+            , mResults(&results)
+            , mCollisionWorld(collisionWorld)
+            , mThreadSafe(threadSafe)
+        {
+        }
+
+        void operator()(size_t begin, size_t end) const
+        {
+            for (size_t i=begin; i<end; ++i)
+            {
+                const PhysicsSystem::RayQuery& query = (*mQueries)[i];
+                (*mResults)[i] = castRay(query.mFrom, query.mTo, (*mIgnore)[i], query.mMask, query.mGroup,
+                                         mCollisionWorld, mThreadSafe);
+            }
+        }
+
+        const std::vector<PhysicsSystem::RayQuery>* mQueries;
+        const std::vector<const btCollisionObject*>* mIgnore;
+        std::vector<PhysicsSystem::RayResult>* mResults;
+        btCollisionWorld* mCollisionWorld;
+        bool mThreadSafe;
+    };
+
+    PhysicsSystem::RayResult PhysicsSystem::castRay(const osg::Vec3f &from, const osg::Vec3f &to, MWWorld::Ptr ignore, int mask, int group)
+    {
+        const btCollisionObject* me = NULL;
+        if (!ignore.isEmpty())
+        {
+            Actor* actor = getActor(ignore);
+            if (actor)
+                me = actor->getCollisionObject();
+        }
+
+        return MWPhysics::castRay(from, to, me, mask, group, mCollisionWorld, false);
+    }
+
+    void PhysicsSystem::castRays(const std::vector<RayQuery>& queries, std::vector<RayResult>& results)
+    {
+        std::vector<const btCollisionObject*> ignore;
+        ignore.reserve(queries.size());
+        for (std::vector<RayQuery>::const_iterator it = queries.begin(); it != queries.end(); ++it)
+        {
+            const btCollisionObject* me = NULL;
+            if (!it->mIgnore.isEmpty())
+            {
+                Actor* actor = getActor(it->mIgnore);
+                if (actor)
+                    me = actor->getCollisionObject();
+            }
+            ignore.push_back(me);
+        }
+
+        results.clear();
+        results.resize(queries.size());
+        parallelFor(queries.size(), CastRays(queries, ignore, results, mCollisionWorld, mWorkQueue != NULL), mWorkQueue);
+    }
+
     PhysicsSystem::RayResult PhysicsSystem::castSphere(const osg::Vec3f &from, const osg::Vec3f &to, float radius)
     {
         btCollisionWorld::ClosestConvexResultCallback callback(toBullet(from), toBullet(to));
@@ -812,7 +1242,7 @@ namespace MWPhysics
         return result;
     }
 
-    bool PhysicsSystem::getLineOfSight(const MWWorld::Ptr &actor1, const MWWorld::Ptr &actor2)
+    bool PhysicsSystem::getLineOfSightQuery(const MWWorld::Ptr &actor1, const MWWorld::Ptr &actor2, RayQuery& query)
     {
         Actor* physactor1 = getActor(actor1);
         Actor* physactor2 = getActor(actor2);
@@ -821,17 +1251,88 @@ namespace MWPhysics
             return false;
 
         osg::Vec3f halfExt1 = physactor1->getHalfExtents();
-        osg::Vec3f pos1 (actor1.getRefData().getPosition().asVec3());
-        pos1.z() += halfExt1.z()*2*0.9f; // eye level
+        query.mFrom = actor1.getRefData().getPosition().asVec3();
+        query.mFrom.z() += halfExt1.z()*2*0.9f; // eye level
         osg::Vec3f halfExt2 = physactor2->getHalfExtents();
-        osg::Vec3f pos2 (actor2.getRefData().getPosition().asVec3());
-        pos2.z() += halfExt2.z()*2*0.9f;
+        query.mTo = actor2.getRefData().getPosition().asVec3();
+        query.mTo.z() += halfExt2.z()*2*0.9f;
+
+        query.mIgnore = MWWorld::Ptr();
+        query.mMask = CollisionType_World|CollisionType_HeightMap;
+        query.mGroup = 0xff;
+        return true;
+    }
+
+    bool PhysicsSystem::getLineOfSight(const MWWorld::Ptr &actor1, const MWWorld::Ptr &actor2)
+    {
+        std::pair<MWWorld::Ptr, MWWorld::Ptr> key(actor1, actor2);
+        LineOfSightCache::const_iterator found = mLineOfSightCache.find(key);
+        if (found != mLineOfSightCache.end())
+            return found->second.mResult;
+
+        RayQuery query;
+        if (!getLineOfSightQuery(actor1, actor2, query))
+            return false;
 
-        RayResult result = castRay(pos1, pos2, MWWorld::Ptr(), CollisionType_World|CollisionType_HeightMap);
+        RayResult result = castRay(query.mFrom, query.mTo, query.mIgnore, query.mMask, query.mGroup);
 
+        cacheLineOfSight(key, !result.mHit);
         return !result.mHit;
     }
 
+    void PhysicsSystem::getLinesOfSight(const std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> > &actors, std::vector<bool> &out)
+    {
+        out.assign(actors.size(), false);
+
+        // Cast the rays that are not cached, all at once
+        std::vector<RayQuery> queries;
+        std::vector<size_t> queryIndices;
+        for (size_t i=0; i<actors.size(); ++i)
+        {
+            LineOfSightCache::const_iterator found = mLineOfSightCache.find(actors[i]);
+            if (found != mLineOfSightCache.end())
+            {
+                out[i] = found->second.mResult;
+                continue;
+            }
+
+            RayQuery query;
+            if (getLineOfSightQuery(actors[i].first, actors[i].second, query))
+            {
+                queries.push_back(query);
+                queryIndices.push_back(i);
+            }
+        }
+
+        std::vector<RayResult> results;
+        castRays(queries, results);
+
+        for (size_t i=0; i<results.size(); ++i)
+        {
+            out[queryIndices[i]] = !results[i].mHit;
+            cacheLineOfSight(actors[queryIndices[i]], !results[i].mHit);
+        }
+    }
+
+    void PhysicsSystem::cacheLineOfSight(const std::pair<MWWorld::Ptr, MWWorld::Ptr> &actors, bool result)
+    {
+        // Even without a cache time, the result is kept until the next simulation step, while nothing moves
+        LineOfSightEntry& entry = mLineOfSightCache[actors];
+        entry.mResult = result;
+        entry.mExpiryTime = mTime + mLineOfSightCacheTime;
+    }
+
+    void PhysicsSystem::uncacheLineOfSight(const MWWorld::Ptr &ptr)
+    {
+        for (LineOfSightCache::iterator it = mLineOfSightCache.begin(); it != mLineOfSightCache.end();)
+        {
+            if (it->first.first == ptr || it->first.second == ptr)
+                mLineOfSightCache.erase(it++);
+            else
+                ++it;
+        }
+    }
+
     // physactor->getOnGround() is not a reliable indicator of whether the actor
     // is on the ground (defaults to false, which means code blocks such as
     // CharacterController::update() may falsely detect "falling").
@@ -976,6 +1477,7 @@ namespace MWPhysics
         {
             delete foundActor->second;
             mActors.erase(foundActor);
+            uncacheLineOfSight(ptr);
         }
     }
 
@@ -1013,6 +1515,7 @@ namespace MWPhysics
             actor->updatePtr(updated);
             mActors.erase(foundActor);
             mActors.insert(std::make_pair(updated, actor));
+            uncacheLineOfSight(old);
         }
 
         updateCollisionMapPtr(mCollisions, old, updated);
@@ -1121,6 +1624,12 @@ namespace MWPhysics
 
     void PhysicsSystem::clearQueuedMovement()
     {
+        if (mSimulation)
+        {
+            finishSimulation(*mSimulation, mCollisionWorld, mWorkQueue);
+            mSimulation = NULL;
+        }
+
         mMovementQueue.clear();
         mCollisions.clear();
         mStandingCollisions.clear();
@@ -1129,64 +1638,198 @@ namespace MWPhysics
     const PtrVelocityList& PhysicsSystem::applyQueuedMovement(float dt)
     {
         mMovementResults.clear();
+        mSimulationTime = 0.0;
+
+        osg::ref_ptr<MovementSimulation> simulation = prepareSimulation(dt);
+        if (simulation)
+        {
+            simulate(*simulation, mCollisionWorld, mWorkQueue);
+            applySimulation(*simulation);
+        }
+
+        return mMovementResults;
+    }
+
+    void PhysicsSystem::startQueuedMovement(float dt)
+    {
+        // Should have been finished already, but must not run twice at once either way
+        if (mSimulation)
+            finishSimulation(*mSimulation, mCollisionWorld, mWorkQueue);
+
+        mSimulation = prepareSimulation(dt);
+        if (mSimulation)
+            mSimulationWorkQueue->addWorkItem(new SimulateMovementItem(mSimulation, mCollisionWorld, mWorkQueue),
+                                              SceneUtil::WorkQueue::Priority_High);
+    }
+
+    const PtrVelocityList& PhysicsSystem::finishQueuedMovement()
+    {
+        mMovementResults.clear();
+        mSimulationTime = 0.0;
+        mSimulationWaitTime = 0.0;
 
+        if (!mSimulation)
+            return mMovementResults;
+
+        // Simulate here if no worker got to it yet
+        osg::Timer_t startTick = osg::Timer::instance()->tick();
+        finishSimulation(*mSimulation, mCollisionWorld, mWorkQueue);
+        mSimulationWaitTime = osg::Timer::instance()->delta_s(startTick, osg::Timer::instance()->tick());
+
+        osg::ref_ptr<MovementSimulation> simulation = mSimulation;
+        mSimulation = NULL;
+
+        applySimulation(*simulation);
+        return mMovementResults;
+    }
+
+    bool PhysicsSystem::isSimulationAsync() const
+    {
+        return mSimulationWorkQueue != NULL;
+    }
+
+    osg::ref_ptr<MovementSimulation> PhysicsSystem::prepareSimulation(float dt)
+    {
         mTimeAccum += dt;
-        if(mTimeAccum >= 1.0f/60.0f)
+        int numSteps = static_cast<int>(mTimeAccum / mStepSize);
+        if (numSteps > mMaxSteps)
+        {
+            // Can't keep up, let the simulation fall behind rather than spending even more time on it
+            numSteps = mMaxSteps;
+            mTimeAccum = std::fmod(mTimeAccum, mStepSize);
+        }
+        else
+            mTimeAccum -= numSteps * mStepSize;
+
+        if (numSteps == 0)
         {
-            // Collision events should be available on every frame
-            mCollisions.clear();
-            mStandingCollisions.clear();
+            mMovementQueue.clear();
+            return NULL;
+        }
 
-            const MWBase::World *world = MWBase::Environment::get().getWorld();
-            PtrVelocityList::iterator iter = mMovementQueue.begin();
-            for(;iter != mMovementQueue.end();++iter)
-            {
-                float waterlevel = -std::numeric_limits<float>::max();
-                const MWWorld::CellStore *cell = iter->first.getCell();
-                if(cell->getCell()->hasWater())
-                    waterlevel = cell->getWaterLevel();
+        osg::ref_ptr<MovementSimulation> simulation = new MovementSimulation;
+        simulation->mNumSteps = numSteps;
+        simulation->mStepSize = mStepSize;
 
-                float oldHeight = iter->first.getRefData().getPosition().pos[2];
+        // Actors that are not moved in this frame should be displayed where they are
+        for (ActorMap::iterator it = mActors.begin(); it != mActors.end(); ++it)
+            it->second->resetSimulationPosition(it->second->getPtr().getRefData().getPosition().asVec3());
 
-                const MWMechanics::MagicEffects& effects = iter->first.getClass().getCreatureStats(iter->first).getMagicEffects();
+        const MWBase::World *world = MWBase::Environment::get().getWorld();
+        std::vector<MovementJob>& jobs = simulation->mJobs;
+        jobs.reserve(mMovementQueue.size());
+        PtrVelocityList::iterator iter = mMovementQueue.begin();
+        for(;iter != mMovementQueue.end();++iter)
+        {
+            float waterlevel = -std::numeric_limits<float>::max();
+            const MWWorld::CellStore *cell = iter->first.getCell();
+            if(cell->getCell()->hasWater())
+                waterlevel = cell->getWaterLevel();
+
+            const MWMechanics::MagicEffects& effects = iter->first.getClass().getCreatureStats(iter->first).getMagicEffects();
+
+            bool waterCollision = false;
+            if (effects.get(ESM::MagicEffect::WaterWalking).getMagnitude()
+                    && cell->getCell()->hasWater()
+                    && !world->isUnderwater(iter->first.getCell(),
+                                           osg::Vec3f(iter->first.getRefData().getPosition().asVec3())))
+                waterCollision = true;
+
+            ActorMap::iterator foundActor = mActors.find(iter->first);
+            if (foundActor == mActors.end()) // actor was already removed from the scene
+                continue;
+            Actor* physicActor = foundActor->second;
+            // Changes the collision world, so this must be done before any movement is solved
+            physicActor->setCanWaterWalk(waterCollision);
+
+            // Slow fall reduces fall speed by a factor of (effect magnitude / 200)
+            float slowFall = 1.f - std::max(0.f, std::min(1.f, effects.get(ESM::MagicEffect::SlowFall).getMagnitude() * 0.005f));
+
+            // The vertical movement (e.g. a jump) is consumed by the simulation
+            if (iter->first.getClass().isMobile(iter->first) && physicActor->getCollisionMode())
+                iter->first.getClass().getMovementSettings(iter->first).mPosition[2] = 0;
+
+            MovementJob job;
+            job.mPtr = iter->first;
+            job.mActor = physicActor;
+            job.mMovement = iter->second;
+            job.mIsFlying = world->isFlying(iter->first);
+            job.mWaterLevel = waterlevel;
+            job.mSlowFall = slowFall;
+            job.mPosition = iter->first.getRefData().getPosition().asVec3();
+            job.mFallHeight = 0.f;
+            jobs.push_back(job);
+        }
+        mMovementQueue.clear();
 
-                bool waterCollision = false;
-                if (effects.get(ESM::MagicEffect::WaterWalking).getMagnitude()
-                        && cell->getCell()->hasWater()
-                        && !world->isUnderwater(iter->first.getCell(),
-                                               osg::Vec3f(iter->first.getRefData().getPosition().asVec3())))
-                    waterCollision = true;
+        return simulation;
+    }
 
-                ActorMap::iterator foundActor = mActors.find(iter->first);
-                if (foundActor == mActors.end()) // actor was already removed from the scene
-                    continue;
-                Actor* physicActor = foundActor->second;
-                physicActor->setCanWaterWalk(waterCollision);
+    void PhysicsSystem::applySimulation(const MovementSimulation& simulation)
+    {
+        // Collision events should be available on every frame
+        mCollisions.clear();
+        mStandingCollisions.clear();
 
-                // Slow fall reduces fall speed by a factor of (effect magnitude / 200)
-                float slowFall = 1.f - std::max(0.f, std::min(1.f, effects.get(ESM::MagicEffect::SlowFall).getMagnitude() * 0.005f));
+        for (std::vector<MovementJob>::const_iterator it = simulation.mJobs.begin(); it != simulation.mJobs.end(); ++it)
+        {
+            if (!it->mError.empty())
+                throw std::runtime_error("Failed to solve movement of " + it->mPtr.getCellRef().getRefId() + ": " + it->mError);
 
-                osg::Vec3f newpos = MovementSolver::move(iter->first, physicActor, iter->second, mTimeAccum,
-                                                            world->isFlying(iter->first),
-                                                            waterlevel, slowFall, mCollisionWorld, mCollisions, mStandingCollisions);
+            mCollisions.insert(it->mCollisions.begin(), it->mCollisions.end());
+            mStandingCollisions.insert(it->mStandingCollisions.begin(), it->mStandingCollisions.end());
 
-                float heightDiff = newpos.z() - oldHeight;
+            if (it->mFallHeight > 0)
+                it->mPtr.getClass().getCreatureStats(it->mPtr).addToFallHeight(it->mFallHeight);
 
-                if (heightDiff < 0)
-                    iter->first.getClass().getCreatureStats(iter->first).addToFallHeight(-heightDiff);
+            mMovementResults.push_back(std::make_pair(it->mPtr, it->mPosition));
+        }
+
+        mSimulationTime = simulation.mTimeTaken;
+    }
 
-                mMovementResults.push_back(std::make_pair(iter->first, newpos));
+    void PhysicsSystem::reportStats(unsigned int frameNumber, osg::Stats& stats) const
+    {
+        stats.setAttribute(frameNumber, "physics_simulation_time_taken", mSimulationTime);
+        if (isSimulationAsync())
+            stats.setAttribute(frameNumber, "physics_wait_time_taken", mSimulationWaitTime);
+    }
+
+    const PtrVelocityList& PhysicsSystem::getInterpolatedPositions()
+    {
+        mInterpolatedPositions.clear();
+
+        float alpha = mTimeAccum / mStepSize;
+        for (ActorMap::const_iterator it = mActors.begin(); it != mActors.end(); ++it)
+        {
+            const MWWorld::Ptr& ptr = it->second->getPtr();
+            osg::Vec3f position = ptr.getRefData().getPosition().asVec3();
+            const osg::Vec3f& current = it->second->getSimulationPosition();
+
+            // Otherwise the actor was moved by something other than the simulation, e.g. teleported
+            if (position == current)
+            {
+                const osg::Vec3f& previous = it->second->getPreviousSimulationPosition();
+                position = previous + (current - previous) * alpha;
             }
 
-            mTimeAccum = 0.0f;
+            mInterpolatedPositions.push_back(std::make_pair(ptr, position));
         }
-        mMovementQueue.clear();
 
-        return mMovementResults;
+        return mInterpolatedPositions;
     }
 
     void PhysicsSystem::stepSimulation(float dt)
     {
+        mTime += dt;
+        for (LineOfSightCache::iterator it = mLineOfSightCache.begin(); it != mLineOfSightCache.end();)
+        {
+            if (it->second.mExpiryTime <= mTime)
+                mLineOfSightCache.erase(it++);
+            else
+                ++it;
+        }
+
         for (ObjectMap::iterator it = mObjects.begin(); it != mObjects.end(); ++it)
             it->second->animateCollisionShapes(mCollisionWorld);
 
@@ -14,6 +14,7 @@
 namespace osg
 {
     class Group;
+    class Stats;
 }
 
 namespace MWRender
@@ -31,6 +32,11 @@ namespace Resource
     class ResourceSystem;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 class btCollisionWorld;
 class btBroadphaseInterface;
 class btDefaultCollisionConfiguration;
@@ -45,11 +51,17 @@ namespace MWPhysics
     class HeightField;
     class Object;
     class Actor;
+    class MovementSimulation;
 
+    /// @note With async simulation, the PhysicsSystem must not be used between startQueuedMovement() and
+    /// finishQueuedMovement(), other than to clear the queued movement.
     class PhysicsSystem
     {
         public:
-            PhysicsSystem (Resource::ResourceSystem* resourceSystem, osg::ref_ptr<osg::Group> parentNode);
+            /// @param workQueue Shared with the rest of the engine. Only used if worker threads or async simulation
+            /// are enabled.
+            PhysicsSystem (Resource::ResourceSystem* resourceSystem, osg::ref_ptr<osg::Group> parentNode,
+                           SceneUtil::WorkQueue* workQueue);
             ~PhysicsSystem ();
 
             void enableWater(float height);
@@ -102,9 +114,28 @@ namespace MWPhysics
 
             RayResult castSphere(const osg::Vec3f& from, const osg::Vec3f& to, float radius);
 
+            struct RayQuery
+            {
+                osg::Vec3f mFrom;
+                osg::Vec3f mTo;
+                /// Optional, a Ptr to ignore in the list of results
+                MWWorld::Ptr mIgnore;
+                int mMask;
+                int mGroup;
+            };
+
+            /// Cast many rays at once, in parallel if there are worker threads.
+            /// @param results Gets one result per query, in the same order.
+            void castRays(const std::vector<RayQuery>& queries, std::vector<RayResult>& results);
+
             /// Return true if actor1 can see actor2.
+            /// @note The result is cached until the next simulation step, or for the "line of sight cache time" if longer.
             bool getLineOfSight(const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2);
 
+            /// Like getLineOfSight for each pair of actors, but casts the rays that are not cached all at once.
+            /// @param out Gets one result per pair, in the same order.
+            void getLinesOfSight(const std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& actors, std::vector<bool>& out);
+
             bool isOnGround (const MWWorld::Ptr& actor);
 
             osg::Vec3f getHalfExtents(const MWWorld::Ptr& actor);
@@ -113,9 +144,35 @@ namespace MWPhysics
             /// be overwritten. Valid until the next call to applyQueuedMovement.
             void queueObjectMovement(const MWWorld::Ptr &ptr, const osg::Vec3f &velocity);
 
-            /// Apply all queued movements, then clear the list.
+            /// Simulate as many fixed time steps as fit into the time passed, then clear the list of queued movements.
+            /// @return The simulated positions of the moved actors. Empty if no step was simulated.
+            /// @note If there are movement threads, the actors are moved in parallel. The results do not depend on how
+            /// the actors were distributed over the threads.
             const PtrVelocityList& applyQueuedMovement(float dt);
 
+            /// Like applyQueuedMovement(), but simulate on the physics thread, so that the caller can go on with other
+            /// work, e.g. rendering. The results are applied by finishQueuedMovement().
+            /// @note Requires async simulation.
+            void startQueuedMovement(float dt);
+
+            /// Wait for the simulation started by startQueuedMovement() to finish, then apply its results.
+            /// @return The simulated positions of the moved actors. Empty if no simulation was started, or no step was
+            /// simulated.
+            const PtrVelocityList& finishQueuedMovement();
+
+            /// Should the movement be simulated on the physics thread?
+            bool isSimulationAsync() const;
+
+            /// Report the time spent simulating the movement in this frame and, with async simulation, the time spent
+            /// waiting for the simulation to finish.
+            void reportStats(unsigned int frameNumber, osg::Stats& stats) const;
+
+            /// Get the positions to display the actors at, in between their last two simulation steps, so that their
+            /// movement looks smooth regardless of the frame rate. Actors that were moved by other means are
+            /// displayed at their actual position.
+            /// @note Call after the results of applyQueuedMovement were applied.
+            const PtrVelocityList& getInterpolatedPositions();
+
             /// Clear the queued movements list without applying.
             void clearQueuedMovement();
 
@@ -136,16 +193,35 @@ namespace MWPhysics
 
             bool toggleDebugRendering();
 
+            NifBullet::BulletShapeManager* getShapeManager();
+
         private:
 
             void updateWater();
 
+            /// Gather everything needed to simulate the queued movement, then clear the queue.
+            /// @return NULL if no step is due yet.
+            osg::ref_ptr<MovementSimulation> prepareSimulation(float dt);
+
+            /// Move the results of a simulation that is done to the collision maps and mMovementResults.
+            void applySimulation(const MovementSimulation& simulation);
+
+            /// Get the ray between the eyes of two actors.
+            /// @return false if either actor has no physics.
+            bool getLineOfSightQuery(const MWWorld::Ptr& actor1, const MWWorld::Ptr& actor2, RayQuery& query);
+
+            void cacheLineOfSight(const std::pair<MWWorld::Ptr, MWWorld::Ptr>& actors, bool result);
+
+            /// Drop the cached lines of sight from or to \a ptr.
+            void uncacheLineOfSight(const MWWorld::Ptr& ptr);
+
             btBroadphaseInterface* mBroadphase;
             btDefaultCollisionConfiguration* mCollisionConfiguration;
             btCollisionDispatcher* mDispatcher;
             btCollisionWorld* mCollisionWorld;
 
             std::auto_ptr<NifBullet::BulletShapeManager> mShapeManager;
+            Resource::ResourceSystem* mResourceSystem;
 
             typedef std::map<MWWorld::Ptr, Object*> ObjectMap;
             ObjectMap mObjects;
@@ -170,8 +246,36 @@ namespace MWPhysics
 
             PtrVelocityList mMovementQueue;
             PtrVelocityList mMovementResults;
+            PtrVelocityList mInterpolatedPositions;
+
+            /// Solves queued movement and casts batches of rays together with the main thread. NULL to do all of it on the
+            /// main thread.
+            SceneUtil::WorkQueue* mWorkQueue;
+
+            /// Runs the simulation while the main thread renders. NULL to simulate on the main thread.
+            SceneUtil::WorkQueue* mSimulationWorkQueue;
+            /// The simulation started by startQueuedMovement(), if any.
+            osg::ref_ptr<MovementSimulation> mSimulation;
+
+            double mSimulationTime;
+            double mSimulationWaitTime;
+
+            /// Time simulated so far, in seconds
+            double mTime;
+
+            struct LineOfSightEntry
+            {
+                bool mResult;
+                double mExpiryTime;
+            };
+            typedef std::map<std::pair<MWWorld::Ptr, MWWorld::Ptr>, LineOfSightEntry> LineOfSightCache;
+            LineOfSightCache mLineOfSightCache;
+            float mLineOfSightCacheTime;
 
+            /// Time that passed since the last simulation step
             float mTimeAccum;
+            float mStepSize;
+            int mMaxSteps;
 
             float mWaterHeight;
             float mWaterEnabled;
@@ -2,9 +2,11 @@
 
 #include <map>
 
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
 #include <BulletCollision/CollisionDispatch/btCollisionWorld.h>
 #include <BulletCollision/CollisionShapes/btConvexShape.h>
 #include <BulletCollision/CollisionShapes/btCylinderShape.h>
+#include <LinearMath/btTransformUtil.h>
 
 #include "collisiontype.hpp"
 #include "actor.hpp"
@@ -49,8 +51,69 @@ protected:
     const btScalar mMinSlopeDot;
 };
 
+/// Runs a convex sweep against each collision object whose broadphase proxy overlaps the swept volume.
+class SweepProxiesCallback : public btDbvt::ICollide
+{
+public:
+    SweepProxiesCallback(const btConvexShape* castShape, const btTransform& from, const btTransform& to,
+                         btCollisionWorld::ConvexResultCallback& resultCallback)
+        : mCastShape(castShape), mFrom(from), mTo(to), mResultCallback(resultCallback)
+    {
+    }
+
+    virtual void Process(const btDbvtNode* leaf)
+    {
+        if (mResultCallback.m_closestHitFraction == btScalar(0))
+            return; // can't get any closer
+
+        btBroadphaseProxy* proxy = static_cast<btBroadphaseProxy*>(leaf->data);
+        if (!mResultCallback.needsCollision(proxy))
+            return;
+
+        btCollisionObject* object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+        btCollisionWorld::objectQuerySingle(mCastShape, mFrom, mTo, object, object->getCollisionShape(),
+                                            object->getWorldTransform(), mResultCallback, btScalar(0));
+    }
+
+private:
+    const btConvexShape* mCastShape;
+    const btTransform& mFrom;
+    const btTransform& mTo;
+    btCollisionWorld::ConvexResultCallback& mResultCallback;
+};
+
+/// Same as btCollisionWorld::convexSweepTest, except that it can be called from several threads at once.
+/// btDbvtBroadphase::rayTest, which convexSweepTest relies on, shares one traversal stack between all callers.
+/// Instead, the overlapping proxies are found by querying the broadphase trees with the swept bounding box.
+/// @note \a world must use a btDbvtBroadphase, and must not be modified meanwhile.
+static void convexSweepTestThreadSafe(const btConvexShape* castShape, const btTransform& from, const btTransform& to,
+                                      btCollisionWorld::ConvexResultCallback& resultCallback, btCollisionWorld* world)
+{
+    // Bounding box of the shape over the whole sweep, computed like btCollisionWorld::convexSweepTest does
+    btVector3 linVel, angVel;
+    btTransformUtil::calculateVelocity(from, to, btScalar(1), linVel, angVel);
+    btTransform rotation;
+    rotation.setIdentity();
+    rotation.setRotation(from.getRotation());
+    btVector3 castShapeAabbMin, castShapeAabbMax;
+    castShape->calculateTemporalAabb(rotation, btVector3(0,0,0), angVel, btScalar(1), castShapeAabbMin, castShapeAabbMax);
+
+    btVector3 aabbMin = from.getOrigin();
+    aabbMin.setMin(to.getOrigin());
+    btVector3 aabbMax = from.getOrigin();
+    aabbMax.setMax(to.getOrigin());
+    const btDbvtVolume volume = btDbvtVolume::FromMM(aabbMin + castShapeAabbMin, aabbMax + castShapeAabbMax);
+
+    SweepProxiesCallback callback(castShape, from, to, resultCallback);
+    btDbvtBroadphase* broadphase = static_cast<btDbvtBroadphase*>(world->getBroadphase());
+    // Dynamic and static proxies are kept in separate trees
+    for (int i=0; i<2; ++i)
+        broadphase->m_sets[i].collideTV(broadphase->m_sets[i].m_root, volume, callback);
+}
 
-void ActorTracer::doTrace(btCollisionObject *actor, const osg::Vec3f& start, const osg::Vec3f& end, btCollisionWorld* world)
+
+void ActorTracer::doTrace(btCollisionObject *actor, const osg::Vec3f& start, const osg::Vec3f& end, btCollisionWorld* world,
+                          bool threadSafe)
 {
     const btVector3 btstart = toBullet(start);
     const btVector3 btend = toBullet(end);
@@ -68,7 +131,10 @@ void ActorTracer::doTrace(btCollisionObject *actor, const osg::Vec3f& start, con
 
     btCollisionShape *shape = actor->getCollisionShape();
     assert(shape->isConvex());
-    world->convexSweepTest(static_cast<btConvexShape*>(shape),
+    if (threadSafe)
+        convexSweepTestThreadSafe(static_cast<btConvexShape*>(shape), from, to, newTraceCallback, world);
+    else
+        world->convexSweepTest(static_cast<btConvexShape*>(shape),
                                                from, to, newTraceCallback);
 
     // Copy the hit data over to our trace results struct:
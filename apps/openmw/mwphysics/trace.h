@@ -19,7 +19,10 @@ namespace MWPhysics
 
         float mFraction;
 
-        void doTrace(btCollisionObject *actor, const osg::Vec3f& start, const osg::Vec3f& end, btCollisionWorld* world);
+        /// @param threadSafe Sweep in a way that allows several threads to trace against \a world at once,
+        /// as long as none of them modifies it meanwhile.
+        void doTrace(btCollisionObject *actor, const osg::Vec3f& start, const osg::Vec3f& end, btCollisionWorld* world,
+                     bool threadSafe = false);
         void findGround(const Actor* actor, const osg::Vec3f& start, const osg::Vec3f& end, btCollisionWorld* world);
     };
 }
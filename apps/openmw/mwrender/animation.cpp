@@ -1,5 +1,6 @@
 #include "animation.hpp"
 
+#include <algorithm>
 #include <iomanip>
 #include <limits>
 
@@ -284,6 +285,43 @@ namespace MWRender
         osg::Vec3f mResetAxes;
     };
 
+    class LodCallback : public osg::NodeCallback
+    {
+    public:
+        LodCallback()
+            : mVisible(false)
+            , mDistance(0.f)
+        {
+        }
+
+        virtual void operator()(osg::Node* node, osg::NodeVisitor* nv)
+        {
+            // Only called if the node was not culled. With several cameras, the nearest one counts.
+            float distance = nv->getDistanceToViewPoint(osg::Vec3f(), true);
+            if (!mVisible || distance < mDistance)
+                mDistance = distance;
+            mVisible = true;
+
+            traverse(node, nv);
+        }
+
+        /// Was the node in view of any camera since the last call? If so, \a distance is set to its distance from the camera.
+        bool getVisible(float& distance)
+        {
+            bool visible = mVisible;
+            distance = mDistance;
+            mVisible = false;
+            return visible;
+        }
+
+    private:
+        bool mVisible;
+        float mDistance;
+    };
+
+    float Animation::sLodDistance = 0.f;
+    unsigned int Animation::sMaxLodInterval = 1;
+
     Animation::Animation(const MWWorld::Ptr &ptr, osg::ref_ptr<osg::Group> parentNode, Resource::ResourceSystem* resourceSystem)
         : mInsert(parentNode)
         , mPtr(ptr)
@@ -292,6 +330,8 @@ namespace MWRender
         , mTextKeyListener(NULL)
         , mHeadYawRadians(0.f)
         , mHeadPitchRadians(0.f)
+        , mActive(true)
+        , mLodFrames(0)
     {
         for(size_t i = 0;i < sNumBlendMasks;i++)
             mAnimationTimePtr[i].reset(new AnimationTime);
@@ -312,12 +352,44 @@ namespace MWRender
 
     void Animation::setActive(bool active)
     {
+        mActive = active;
         if (SceneUtil::Skeleton* skel = dynamic_cast<SceneUtil::Skeleton*>(mObjectRoot.get()))
         {
             skel->setActive(active);
         }
     }
 
+    void Animation::updateLod()
+    {
+        SceneUtil::Skeleton* skel = dynamic_cast<SceneUtil::Skeleton*>(mObjectRoot.get());
+        if (!skel || !mLodCallback)
+            return;
+
+        unsigned int interval = 1;
+        float distance;
+        bool visible = mLodCallback->getVisible(distance);
+        if (sLodDistance > 0.f)
+        {
+            // Still update bones out of view from time to time, the bounds used for culling depend on them
+            if (!visible)
+                interval = sMaxLodInterval;
+            else
+                interval = std::min(sMaxLodInterval, 1 + static_cast<unsigned int>(distance / sLodDistance));
+        }
+
+        // A skeleton that is not active skips the update of its bones and the skinning of its meshes
+        bool update = ++mLodFrames >= interval;
+        if (update)
+            mLodFrames = 0;
+        skel->setActive(mActive && update);
+    }
+
+    void Animation::setLodSettings(float distance, unsigned int maxInterval)
+    {
+        sLodDistance = distance;
+        sMaxLodInterval = std::max(1u, maxInterval);
+    }
+
     void Animation::updatePtr(const MWWorld::Ptr &ptr)
     {
         mPtr = ptr;
@@ -977,6 +1049,9 @@ namespace MWRender
         mNodeMap = visitor.getNodeMap();
 
         mObjectRoot->addCullCallback(new SceneUtil::LightListCallback);
+
+        mLodCallback = new LodCallback;
+        mObjectRoot->addCullCallback(mLodCallback);
     }
 
     osg::Group* Animation::getObjectRoot()
@@ -31,6 +31,7 @@ namespace MWRender
 
 class ResetAccumRootCallback;
 class RotateController;
+class LodCallback;
 
 class EffectAnimationTime : public SceneUtil::ControllerSource
 {
@@ -243,6 +244,14 @@ protected:
 
     osg::ref_ptr<SceneUtil::LightSource> mGlowLight;
 
+    // Records the visibility of mObjectRoot for updateLod()
+    osg::ref_ptr<LodCallback> mLodCallback;
+    bool mActive;
+    unsigned int mLodFrames;
+
+    static float sLodDistance;
+    static unsigned int sMaxLodInterval;
+
     /* Sets the appropriate animations on the bone groups based on priority.
      */
     void resetActiveGroups();
@@ -306,6 +315,14 @@ public:
     /// @see SceneUtil::Skeleton::setActive
     void setActive(bool active);
 
+    /// Update the bones and skinned meshes of an active animation less often the further it was from the camera in the
+    /// last frame, and at the lowest rate if it was out of view. Call once per frame, before the scene is updated.
+    void updateLod();
+
+    /// Bones are updated every frame up to \a distance from the camera, and one frame less often for each further
+    /// \a distance, down to every \a maxInterval frames. A \a distance of 0 updates all animations every frame.
+    static void setLodSettings(float distance, unsigned int maxInterval);
+
     osg::Group* getOrCreateObjectRoot();
 
     osg::Group* getObjectRoot();
@@ -1,5 +1,6 @@
 #include "renderingmanager.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 #include <limits>
 
@@ -11,6 +12,7 @@
 #include <osg/PositionAttitudeTransform>
 #include <osg/UserDataContainer>
 #include <osg/ComputeBoundsVisitor>
+#include <osg/Stats>
 
 #include <osgUtil/LineSegmentIntersector>
 #include <osgUtil/IncrementalCompileOperation>
@@ -26,8 +28,10 @@
 #include <components/sceneutil/util.hpp>
 #include <components/sceneutil/lightmanager.hpp>
 #include <components/sceneutil/statesetupdater.hpp>
+#include <components/sceneutil/riggeometry.hpp>
 
 #include <components/terrain/terraingrid.hpp>
+#include <components/terrain/quadtreeworld.hpp>
 
 #include <components/esm/loadcell.hpp>
 
@@ -122,10 +126,12 @@ namespace MWRender
         bool mWireframe;
     };
 
-    RenderingManager::RenderingManager(osgViewer::Viewer* viewer, osg::ref_ptr<osg::Group> rootNode, Resource::ResourceSystem* resourceSystem, const MWWorld::Fallback* fallback)
+    RenderingManager::RenderingManager(osgViewer::Viewer* viewer, osg::ref_ptr<osg::Group> rootNode, Resource::ResourceSystem* resourceSystem,
+                                       const MWWorld::Fallback* fallback, SceneUtil::WorkQueue* workQueue)
         : mViewer(viewer)
         , mRootNode(rootNode)
         , mResourceSystem(resourceSystem)
+        , mWorkQueue(workQueue)
         , mFogDepth(0.f)
         , mNightEyeFactor(0.f)
     {
@@ -147,8 +153,29 @@ namespace MWRender
 
         mWater.reset(new Water(lightRoot, mResourceSystem, mViewer->getIncrementalCompileOperation(), fallback));
 
-        mTerrain.reset(new Terrain::TerrainGrid(lightRoot, mResourceSystem, mViewer->getIncrementalCompileOperation(),
-                                                new TerrainStorage(mResourceSystem->getVFS(), false), Mask_Terrain));
+        if (Settings::Manager::getBool("skin on worker threads", "Objects"))
+            SceneUtil::RigGeometry::setWorkQueue(mWorkQueue);
+
+        Animation::setLodSettings(Settings::Manager::getFloat("animation lod distance", "Objects"),
+                                  std::max(1, Settings::Manager::getInt("max animation lod interval", "Objects")));
+
+        if (Settings::Manager::getBool("distant land", "Terrain"))
+        {
+            Terrain::QuadTreeWorld* terrain = new Terrain::QuadTreeWorld(lightRoot, mResourceSystem, mViewer->getIncrementalCompileOperation(),
+                                                                         new TerrainStorage(mResourceSystem->getVFS(), false), Mask_Terrain,
+                                                                         mWorkQueue);
+            terrain->setLodFactor(Settings::Manager::getFloat("lod factor", "Terrain"));
+            terrain->setCompositeMapResolution(Settings::Manager::getInt("composite map resolution", "Terrain"));
+            mTerrain.reset(terrain);
+        }
+        else
+        {
+            Terrain::TerrainGrid* terrain = new Terrain::TerrainGrid(lightRoot, mResourceSystem, mViewer->getIncrementalCompileOperation(),
+                                                                     new TerrainStorage(mResourceSystem->getVFS(), false), Mask_Terrain,
+                                                                     mWorkQueue);
+            terrain->setUnloadedCacheSize(Settings::Manager::getInt("unloaded cell cache size", "Terrain"));
+            mTerrain.reset(terrain);
+        }
 
         mCamera.reset(new Camera(mViewer->getCamera()));
 
@@ -201,6 +228,7 @@ namespace MWRender
 
     RenderingManager::~RenderingManager()
     {
+        SceneUtil::RigGeometry::setWorkQueue(NULL);
     }
 
     MWRender::Objects& RenderingManager::getObjects()
@@ -213,6 +241,11 @@ namespace MWRender
         return mResourceSystem;
     }
 
+    Terrain::World* RenderingManager::getTerrain()
+    {
+        return mTerrain.get();
+    }
+
     void RenderingManager::setNightEyeFactor(float factor)
     {
         if (factor != mNightEyeFactor)
@@ -369,6 +402,8 @@ namespace MWRender
         mWater->update(dt);
         mCamera->update(dt, paused);
 
+        mTerrain->update();
+
         osg::Vec3f focal, cameraPos;
         mCamera->getPosition(focal, cameraPos);
         if (mWater->isUnderwater(cameraPos))
@@ -394,6 +429,12 @@ namespace MWRender
         }
     }
 
+    void RenderingManager::reportStats(unsigned int frameNumber, osg::Stats& stats) const
+    {
+        stats.setAttribute(frameNumber, "skinned_rigs", SceneUtil::RigGeometry::resetSkinCount());
+        static_cast<SceneUtil::LightManager*>(mLightRoot.get())->reportStats(frameNumber, stats);
+    }
+
     void RenderingManager::updatePlayerPtr(const MWWorld::Ptr &ptr)
     {
         if(mPlayerAnimation.get())
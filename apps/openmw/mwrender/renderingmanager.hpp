@@ -15,6 +15,7 @@ namespace osg
 {
     class Group;
     class PositionAttitudeTransform;
+    class Stats;
 }
 
 namespace Resource
@@ -37,6 +38,11 @@ namespace Terrain
     class World;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 namespace MWWorld
 {
     class Fallback;
@@ -57,13 +63,17 @@ namespace MWRender
     class RenderingManager : public MWRender::RenderingInterface
     {
     public:
-        RenderingManager(osgViewer::Viewer* viewer, osg::ref_ptr<osg::Group> rootNode, Resource::ResourceSystem* resourceSystem, const MWWorld::Fallback* fallback);
+        /// @param workQueue Shared with the rest of the engine, builds terrain and skins animated meshes.
+        RenderingManager(osgViewer::Viewer* viewer, osg::ref_ptr<osg::Group> rootNode, Resource::ResourceSystem* resourceSystem,
+                         const MWWorld::Fallback* fallback, SceneUtil::WorkQueue* workQueue);
         ~RenderingManager();
 
         MWRender::Objects& getObjects();
 
         Resource::ResourceSystem* getResourceSystem();
 
+        Terrain::World* getTerrain();
+
         void setNightEyeFactor(float factor);
 
         void setAmbientColour(const osg::Vec4f& colour);
@@ -132,6 +142,9 @@ namespace MWRender
 
         void update(float dt, bool paused);
 
+        /// Report the number of meshes skinned and the use of the light StateSet cache while rendering the last frame.
+        void reportStats(unsigned int frameNumber, osg::Stats& stats) const;
+
         Animation* getAnimation(const MWWorld::Ptr& ptr);
         Animation* getPlayerAnimation();
 
@@ -181,6 +194,7 @@ namespace MWRender
         std::auto_ptr<Pathgrid> mPathgrid;
         std::auto_ptr<Objects> mObjects;
         std::auto_ptr<Water> mWater;
+        SceneUtil::WorkQueue* mWorkQueue;
         std::auto_ptr<Terrain::World> mTerrain;
         std::auto_ptr<SkyManager> mSky;
         std::auto_ptr<EffectManager> mEffectManager;
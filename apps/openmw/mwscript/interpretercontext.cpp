@@ -139,7 +139,7 @@ namespace MWScript
     InterpreterContext::InterpreterContext (
         MWScript::Locals *locals, MWWorld::Ptr reference, const std::string& targetId)
     : mLocals (locals), mReference (reference),
-      mActivationHandled (false), mTargetId (targetId)
+      mActivationHandled (false), mTargetId (targetId), mSecondsPassed (-1.f)
     {
         // If we run on a reference (local script, dialogue script or console with object
         // selected), store the ID of that reference store it so it can be inherited by
@@ -148,6 +148,11 @@ namespace MWScript
             mTargetId = reference.getClass().getId (reference);
     }
 
+    void InterpreterContext::setSecondsPassed (float seconds)
+    {
+        mSecondsPassed = seconds;
+    }
+
     int InterpreterContext::getLocalShort (int index) const
     {
         if (!mLocals)
@@ -512,6 +517,9 @@ namespace MWScript
 
     float InterpreterContext::getSecondsPassed() const
     {
+        if (mSecondsPassed >= 0.f)
+            return mSecondsPassed;
+
         return MWBase::Environment::get().getFrameDuration();
     }
 
@@ -1,6 +1,8 @@
 #include "miscextensions.hpp"
 
+#include <algorithm>
 #include <cstdlib>
+#include <sstream>
 
 #include <components/compiler/extensions.hpp>
 #include <components/compiler/opcodes.hpp>
@@ -910,6 +912,35 @@ namespace MWScript
             }
         };
 
+        /// Report the scripts that took the most time since the last report.
+        class OpScriptProfile : public Interpreter::Opcode0
+        {
+        public:
+            virtual void execute (Interpreter::Runtime& runtime)
+            {
+                MWBase::ScriptManager* scriptManager = MWBase::Environment::get().getScriptManager();
+                const MWBase::ScriptManager::ScriptProfiles& profiles = scriptManager->getProfiles();
+
+                std::vector<std::pair<double, std::string> > byTime;
+                for (MWBase::ScriptManager::ScriptProfiles::const_iterator it = profiles.begin(); it != profiles.end(); ++it)
+                    byTime.push_back(std::make_pair(it->second.mTime, it->first));
+                std::sort(byTime.rbegin(), byTime.rend());
+
+                std::stringstream str;
+                str << "Script, calls, instructions, microseconds";
+                for (size_t i=0; i<byTime.size() && i<20; ++i)
+                {
+                    const MWBase::ScriptProfile& profile = profiles.find(byTime[i].second)->second;
+                    str << std::endl << byTime[i].second << ", " << profile.mCalls << ", " << profile.mInstructions
+                        << ", " << static_cast<unsigned long long>(profile.mTime * 1000000);
+                }
+
+                runtime.getContext().report(str.str());
+
+                scriptManager->resetProfiles();
+            }
+        };
+
         class OpToggleGodMode : public Interpreter::Opcode0
         {
             public:
@@ -1218,6 +1249,7 @@ namespace MWScript
             interpreter.installSegment5 (Compiler::Misc::opcodeShowVarsExplicit, new OpShowVars<ExplicitRef>);
             interpreter.installSegment5 (Compiler::Misc::opcodeToggleGodMode, new OpToggleGodMode);
             interpreter.installSegment5 (Compiler::Misc::opcodeToggleScripts, new OpToggleScripts);
+            interpreter.installSegment5 (Compiler::Misc::opcodeScriptProfile, new OpScriptProfile);
             interpreter.installSegment5 (Compiler::Misc::opcodeDisableLevitation, new OpEnableLevitation<false>);
             interpreter.installSegment5 (Compiler::Misc::opcodeEnableLevitation, new OpEnableLevitation<true>);
             interpreter.installSegment5 (Compiler::Misc::opcodeCast, new OpCast<ImplicitRef>);
@@ -6,30 +6,88 @@
 #include <exception>
 #include <algorithm>
 
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <osg/Timer>
+
 #include <components/esm/loadscpt.hpp>
 
 #include <components/misc/stringops.hpp>
+#include <components/misc/hash.hpp>
 
 #include <components/compiler/scanner.hpp>
 #include <components/compiler/context.hpp>
+#include <components/compiler/extensions.hpp>
 #include <components/compiler/exception.hpp>
 #include <components/compiler/quickfileparser.hpp>
+#include <components/compiler/optimizer.hpp>
 
 #include "../mwworld/esmstore.hpp"
 
 #include "extensions.hpp"
 
+namespace
+{
+    /// Increase when the layout of the script cache or the code generated by the compiler changes. Release builds
+    /// also discard caches written by a different build, in case this was forgotten.
+    const uint32_t sCacheFormat = 1;
+
+    const char sCacheMagic[4] = { 'O', 'M', 'W', 'S' };
+
+    template<typename T>
+    void writeValue (std::ostream& stream, const T& value)
+    {
+        stream.write (reinterpret_cast<const char *> (&value), sizeof (T));
+    }
+
+    void writeString (std::ostream& stream, const std::string& value)
+    {
+        writeValue (stream, static_cast<uint32_t> (value.size()));
+        stream.write (value.data(), value.size());
+    }
+
+    template<typename T>
+    void readValue (std::istream& stream, T& value)
+    {
+        stream.read (reinterpret_cast<char *> (&value), sizeof (T));
+        if (!stream)
+            throw std::runtime_error ("unexpected end of file");
+    }
+
+    void readString (std::istream& stream, std::string& value)
+    {
+        uint32_t size;
+        readValue (stream, size);
+        value.resize (size);
+        if (size)
+            stream.read (&value[0], size);
+        if (!stream)
+            throw std::runtime_error ("unexpected end of file");
+    }
+}
+
 namespace MWScript
 {
     ScriptManager::ScriptManager (const MWWorld::ESMStore& store, bool verbose,
-        Compiler::Context& compilerContext, int warningsMode,
-        const std::vector<std::string>& scriptBlacklist)
+        Compiler::Context& compilerContext, int warningsMode, bool optimize,
+        const std::vector<std::string>& scriptBlacklist,
+        const boost::filesystem::path& cacheFile, const std::string& contentKey)
     : mErrorHandler (std::cerr), mStore (store), mVerbose (verbose),
       mCompilerContext (compilerContext), mParser (mErrorHandler, mCompilerContext),
-      mOpcodesInstalled (false), mGlobalScripts (store)
+      mOpcodesInstalled (false), mGlobalScripts (store), mOptimize (optimize), mCacheFile (cacheFile),
+      mCacheLoaded (false), mCacheChanged (false)
     {
         mErrorHandler.setWarningsMode (warningsMode);
 
+        // The compiled code also depends on the records and the other scripts the compiler looks up, so on the
+        // content files, on whether warnings are treated as errors and on whether the code is optimized
+        std::ostringstream key;
+        key << sCacheFormat << '\n'
+            << (compilerContext.getExtensions() ? compilerContext.getExtensions()->getHash() : 0) << '\n'
+            << warningsMode << '\n' << optimize << '\n' << contentKey;
+        mCacheKey = key.str();
+
         mScriptBlacklist.resize (scriptBlacklist.size());
 
         std::transform (scriptBlacklist.begin(), scriptBlacklist.end(),
@@ -37,6 +95,12 @@ namespace MWScript
         std::sort (mScriptBlacklist.begin(), mScriptBlacklist.end());
     }
 
+    ScriptManager::~ScriptManager()
+    {
+        if (mCacheChanged)
+            writeCache();
+    }
+
     bool ScriptManager::compile (const std::string& name)
     {
         mParser.reset();
@@ -44,6 +108,15 @@ namespace MWScript
 
         if (const ESM::Script *script = mStore.get<ESM::Script>().find (name))
         {
+            uint64_t textHash = Misc::fnv1aHash (script->mScriptText);
+            std::string lowerName = Misc::StringUtils::lowerCase (name);
+
+            if (const CachedScript *cached = searchCache (lowerName, textHash))
+            {
+                mScripts.insert (std::make_pair (name, cached->mScript));
+                return true;
+            }
+
             if (mVerbose)
                 std::cout << "compiling script: " << name << std::endl;
 
@@ -82,8 +155,20 @@ namespace MWScript
             {
                 std::vector<Interpreter::Type_Code> code;
                 mParser.getCode (code);
+
+                if (mOptimize)
+                    Compiler::optimize (code);
+
                 mScripts.insert (std::make_pair (name, std::make_pair (code, mParser.getLocals())));
 
+                if (!mCacheFile.empty())
+                {
+                    CachedScript& cached = mCache[lowerName];
+                    cached.mTextHash = textHash;
+                    cached.mScript = std::make_pair (code, mParser.getLocals());
+                    mCacheChanged = true;
+                }
+
                 return true;
             }
         }
@@ -120,7 +205,15 @@ namespace MWScript
                     mOpcodesInstalled = true;
                 }
 
+                unsigned long long instructions = mInterpreter.getInstructionCount();
+                osg::Timer_t startTick = osg::Timer::instance()->tick();
+
                 mInterpreter.run (&iter->second.first[0], iter->second.first.size(), interpreterContext);
+
+                MWBase::ScriptProfile& profile = mProfiles[name];
+                ++profile.mCalls;
+                profile.mInstructions += mInterpreter.getInstructionCount() - instructions;
+                profile.mTime += osg::Timer::instance()->delta_s (startTick, osg::Timer::instance()->tick());
             }
             catch (const std::exception& e)
             {
@@ -149,6 +242,9 @@ namespace MWScript
                     ++success;
             }
 
+        if (mCacheChanged)
+            writeCache();
+
         return std::make_pair (count, success);
     }
 
@@ -172,6 +268,9 @@ namespace MWScript
 
         if (const ESM::Script *script = mStore.get<ESM::Script>().find (name2))
         {
+            if (const CachedScript *cached = searchCache (name2, Misc::fnv1aHash (script->mScriptText)))
+                return mOtherLocals.insert (std::make_pair (name2, cached->mScript.second)).first->second;
+
             if (mVerbose)
                 std::cout
                     << "scanning script for local variable declarations: " << name2
@@ -197,4 +296,142 @@ namespace MWScript
     {
         return mGlobalScripts;
     }
+
+    const ScriptManager::ScriptProfiles& ScriptManager::getProfiles() const
+    {
+        return mProfiles;
+    }
+
+    void ScriptManager::resetProfiles()
+    {
+        mProfiles.clear();
+    }
+
+    const ScriptManager::CachedScript *ScriptManager::searchCache (const std::string& name, uint64_t textHash)
+    {
+        if (mCacheFile.empty())
+            return NULL;
+
+        if (!mCacheLoaded)
+            loadCache();
+
+        ScriptCache::const_iterator iter = mCache.find (name);
+        if (iter==mCache.end() || iter->second.mTextHash!=textHash)
+            return NULL;
+
+        return &iter->second;
+    }
+
+    void ScriptManager::loadCache()
+    {
+        mCacheLoaded = true;
+
+        if (!boost::filesystem::exists (mCacheFile))
+            return;
+
+        try
+        {
+            boost::filesystem::ifstream stream (mCacheFile, std::ios::binary);
+
+            char magic[4];
+            stream.read (magic, 4);
+            if (!stream || !std::equal (magic, magic+4, sCacheMagic))
+                return;
+
+            std::string key;
+            readString (stream, key);
+            if (key!=mCacheKey)
+                return;
+
+            uint32_t numScripts;
+            readValue (stream, numScripts);
+
+            ScriptCache cache;
+            for (uint32_t i=0; i<numScripts; ++i)
+            {
+                std::string name;
+                readString (stream, name);
+
+                CachedScript& cached = cache[name];
+                readValue (stream, cached.mTextHash);
+
+                uint32_t codeSize;
+                readValue (stream, codeSize);
+                cached.mScript.first.resize (codeSize);
+                if (codeSize)
+                    stream.read (reinterpret_cast<char *> (&cached.mScript.first[0]),
+                        codeSize * sizeof (Interpreter::Type_Code));
+
+                const char types[] = { 's', 'l', 'f' };
+                for (int j=0; j<3; ++j)
+                {
+                    uint32_t numLocals;
+                    readValue (stream, numLocals);
+                    for (uint32_t k=0; k<numLocals; ++k)
+                    {
+                        std::string local;
+                        readString (stream, local);
+                        cached.mScript.second.declare (types[j], local);
+                    }
+                }
+            }
+
+            mCache.swap (cache);
+
+            if (mVerbose)
+                std::cout << "loaded " << mCache.size() << " scripts from " << mCacheFile.string() << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Ignoring script cache " << mCacheFile.string() << ": " << e.what() << std::endl;
+        }
+    }
+
+    void ScriptManager::writeCache()
+    {
+        // Write to a separate file first, so that an interrupted write can not leave a broken cache behind
+        boost::filesystem::path tempFile = mCacheFile.string() + ".tmp";
+        try
+        {
+            boost::filesystem::create_directories (mCacheFile.parent_path());
+
+            {
+                boost::filesystem::ofstream stream (tempFile, std::ios::binary);
+
+                stream.write (sCacheMagic, 4);
+                writeString (stream, mCacheKey);
+                writeValue (stream, static_cast<uint32_t> (mCache.size()));
+
+                for (ScriptCache::const_iterator iter (mCache.begin()); iter!=mCache.end(); ++iter)
+                {
+                    writeString (stream, iter->first);
+                    writeValue (stream, iter->second.mTextHash);
+
+                    const std::vector<Interpreter::Type_Code>& code = iter->second.mScript.first;
+                    writeValue (stream, static_cast<uint32_t> (code.size()));
+                    if (!code.empty())
+                        stream.write (reinterpret_cast<const char *> (&code[0]), code.size() * sizeof (Interpreter::Type_Code));
+
+                    const char types[] = { 's', 'l', 'f' };
+                    for (int j=0; j<3; ++j)
+                    {
+                        const std::vector<std::string>& locals = iter->second.mScript.second.get (types[j]);
+                        writeValue (stream, static_cast<uint32_t> (locals.size()));
+                        for (std::vector<std::string>::const_iterator local (locals.begin()); local!=locals.end(); ++local)
+                            writeString (stream, *local);
+                    }
+                }
+
+                if (!stream)
+                    throw std::runtime_error ("write error");
+            }
+
+            boost::filesystem::rename (tempFile, mCacheFile);
+            mCacheChanged = false;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to write script cache " << mCacheFile.string() << ": " << e.what() << std::endl;
+        }
+    }
 }
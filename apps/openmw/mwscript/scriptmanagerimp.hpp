@@ -4,6 +4,10 @@
 #include <map>
 #include <string>
 
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+
 #include <components/compiler/streamerrorhandler.hpp>
 #include <components/compiler/fileparser.hpp>
 
@@ -32,6 +36,10 @@ namespace Interpreter
 
 namespace MWScript
 {
+    /// \brief Compiles and runs scripts
+    ///
+    /// Unless disabled, compiled scripts are kept in a script cache file. A script is only compiled again when its
+    /// text, the compiler extensions or the content files change.
     class ScriptManager : public MWBase::ScriptManager
     {
             Compiler::StreamErrorHandler mErrorHandler;
@@ -49,12 +57,43 @@ namespace MWScript
             GlobalScripts mGlobalScripts;
             std::map<std::string, Compiler::Locals> mOtherLocals;
             std::vector<std::string> mScriptBlacklist;
+            ScriptProfiles mProfiles;
+            bool mOptimize;
+
+            struct CachedScript
+            {
+                uint64_t mTextHash;
+                CompiledScript mScript;
+            };
+            typedef std::map<std::string, CachedScript> ScriptCache;
+
+            /// Empty if the script cache is disabled.
+            boost::filesystem::path mCacheFile;
+            /// Identifies what, besides its text, a compiled script depends on.
+            std::string mCacheKey;
+            ScriptCache mCache;
+            bool mCacheLoaded;
+            bool mCacheChanged;
+
+            const CachedScript *searchCache (const std::string& name, uint64_t textHash);
+            ///< Return the cached compilation of script \a name, if it was compiled from a text with this hash.
+            /// Reads the cache file on the first call.
+
+            void loadCache();
+
+            void writeCache();
 
         public:
 
             ScriptManager (const MWWorld::ESMStore& store, bool verbose,
-                Compiler::Context& compilerContext, int warningsMode,
-                const std::vector<std::string>& scriptBlacklist);
+                Compiler::Context& compilerContext, int warningsMode, bool optimize,
+                const std::vector<std::string>& scriptBlacklist,
+                const boost::filesystem::path& cacheFile, const std::string& contentKey);
+            ///< \param optimize Run the optimizer over the compiled code, see Compiler::optimize.
+            /// \param cacheFile Script cache file, empty to disable the cache.
+            /// \param contentKey Identifies the loaded content files and the build.
+
+            virtual ~ScriptManager();
 
             virtual void run (const std::string& name, Interpreter::Context& interpreterContext);
             ///< Run the script with the given name (compile first, if not compiled yet)
@@ -71,6 +110,11 @@ namespace MWScript
             ///< Return locals for script \a name.
 
             virtual GlobalScripts& getGlobalScripts();
+
+            virtual const ScriptProfiles& getProfiles() const;
+            ///< Execution statistics of each script that has run since the last resetProfiles().
+
+            virtual void resetProfiles();
     };
 }
 
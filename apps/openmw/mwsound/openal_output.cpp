@@ -6,6 +6,8 @@
 #include <stdint.h>
 
 #include <components/vfs/manager.hpp>
+#include <components/settings/settings.hpp>
+#include <components/sceneutil/workqueue.hpp>
 
 #include <boost/thread.hpp>
 
@@ -498,10 +500,16 @@ protected:
     ALuint mSource;
     ALuint mBuffer;
 
+    /// Waiting for its buffer to be decoded, see OpenAL_Output::mWaitingSounds
+    bool mWaiting;
+
     friend class OpenAL_Output;
 
     void updateAll(bool local);
 
+    /// Start playing mBuffer, from the fraction \a offset of its length.
+    void play(float offset);
+
 private:
     OpenAL_Sound(const OpenAL_Sound &rhs);
     OpenAL_Sound& operator=(const OpenAL_Sound &rhs);
@@ -535,7 +543,7 @@ public:
 
 OpenAL_Sound::OpenAL_Sound(OpenAL_Output &output, ALuint src, ALuint buf, const osg::Vec3f& pos, float vol, float basevol, float pitch, float mindist, float maxdist, int flags)
   : Sound(pos, vol, basevol, pitch, mindist, maxdist, flags)
-  , mOutput(output), mSource(src), mBuffer(buf)
+  , mOutput(output), mSource(src), mBuffer(buf), mWaiting(false)
 {
     mOutput.mActiveSounds.push_back(this);
 }
@@ -545,7 +553,10 @@ OpenAL_Sound::~OpenAL_Sound()
     alSourcei(mSource, AL_BUFFER, 0);
 
     mOutput.mFreeSources.push_back(mSource);
-    mOutput.bufferFinished(mBuffer);
+    if(mWaiting)
+        mOutput.removeWaitingSound(this);
+    if(mBuffer)
+        mOutput.bufferFinished(mBuffer);
 
     mOutput.mActiveSounds.erase(std::find(mOutput.mActiveSounds.begin(),
                                           mOutput.mActiveSounds.end(), this));
@@ -553,12 +564,21 @@ OpenAL_Sound::~OpenAL_Sound()
 
 void OpenAL_Sound::stop()
 {
+    if(mWaiting)
+    {
+        mOutput.removeWaitingSound(this);
+        mWaiting = false;
+    }
+
     alSourceStop(mSource);
     throwALerror();
 }
 
 bool OpenAL_Sound::isPlaying()
 {
+    if(mWaiting)
+        return true;
+
     ALint state;
 
     alGetSourcei(mSource, AL_SOURCE_STATE, &state);
@@ -579,6 +599,9 @@ double OpenAL_Sound::getTimeOffset()
 
 double OpenAL_Sound::getLength()
 {
+    if(!mBuffer)
+        return 0.0;
+
     ALint bufferSize, frequency, channels, bitsPerSample;
     alGetBufferi(mBuffer, AL_SIZE, &bufferSize);
     alGetBufferi(mBuffer, AL_FREQUENCY, &frequency);
@@ -588,6 +611,19 @@ double OpenAL_Sound::getLength()
     return (8.0*bufferSize)/(frequency*channels*bitsPerSample);
 }
 
+void OpenAL_Sound::play(float offset)
+{
+    if(offset<0)
+        offset=0;
+    if(offset>1)
+        offset=1;
+
+    alSourcei(mSource, AL_BUFFER, mBuffer);
+    alSourcef(mSource, AL_SEC_OFFSET, static_cast<ALfloat>(getLength()*offset / mPitch));
+    alSourcePlay(mSource);
+    throwALerror();
+}
+
 void OpenAL_Sound::updateAll(bool local)
 {
     alSourcef(mSource, AL_REFERENCE_DISTANCE, mMinDistance);
@@ -647,6 +683,76 @@ void OpenAL_Sound3D::update()
 }
 
 
+//
+// Decoding of sound effects into buffers
+//
+
+/// Samples of a sound, decoded to be loaded into a buffer.
+/// @note Written by the worker thread, only to be read once the work ticket is done.
+struct DecodedSound : public osg::Referenced
+{
+    std::vector<char> mData;
+    ChannelConfig mChannels;
+    SampleType mType;
+    int mSampleRate;
+    std::vector<float> mLoudnessVector;
+
+    /// Set if the sound could not be decoded
+    std::string mError;
+};
+
+static void decodeSound(DecoderPtr decoder, const std::string &fname, DecodedSound &decoded)
+{
+    // Workaround: Bethesda at some point converted some of the files to mp3, but the references were kept as .wav.
+    std::string file = fname;
+    if (!decoder->mResourceMgr->exists(file))
+    {
+        std::string::size_type pos = file.rfind('.');
+        if(pos != std::string::npos)
+            file = file.substr(0, pos)+".mp3";
+    }
+    decoder->open(file);
+
+    decoder->getInfo(&decoded.mSampleRate, &decoded.mChannels, &decoded.mType);
+
+    decoder->readAll(decoded.mData);
+    decoder->close();
+
+    analyzeLoudness(decoded.mData, decoded.mSampleRate, decoded.mChannels, decoded.mType, decoded.mLoudnessVector,
+                    static_cast<float>(loudnessFPS));
+}
+
+class DecodeSoundItem : public SceneUtil::WorkItem
+{
+public:
+    DecodeSoundItem(DecoderPtr decoder, const std::string &fname, DecodedSound *result)
+      : mDecoder(decoder)
+      , mFileName(fname)
+      , mResult(result)
+    {
+    }
+
+    virtual void doWork()
+    {
+        try
+        {
+            decodeSound(mDecoder, mFileName, *mResult);
+        }
+        catch(std::exception &e)
+        {
+            mResult->mError = e.what();
+        }
+
+        mTicket->signalDone();
+    }
+
+private:
+    DecoderPtr mDecoder;
+    std::string mFileName;
+    osg::ref_ptr<DecodedSound> mResult;
+};
+
+
 //
 // An OpenAL output device
 //
@@ -737,6 +843,11 @@ void OpenAL_Output::deinit()
         alDeleteSources(1, &mFreeSources[i]);
     mFreeSources.clear();
 
+    for(size_t i = 0;i < mWaitingSounds.size();i++)
+        mWaitingSounds[i].mSound->mWaiting = false;
+    mWaitingSounds.clear();
+    mPendingBuffers.clear();
+
     mBufferRefs.clear();
     mUnusedBuffers.clear();
     while(!mBufferCache.empty())
@@ -744,6 +855,7 @@ void OpenAL_Output::deinit()
         alDeleteBuffers(1, &mBufferCache.begin()->second.mALBuffer);
         mBufferCache.erase(mBufferCache.begin());
     }
+    mBufferCacheMemSize = 0;
 
     alcMakeContextCurrent(0);
     if(mContext)
@@ -757,66 +869,71 @@ void OpenAL_Output::deinit()
 }
 
 
-const CachedSound& OpenAL_Output::getBuffer(const std::string &fname)
+const CachedSound* OpenAL_Output::getBuffer(const std::string &fname)
 {
-    ALuint buf = 0;
+    finishPendingBuffers();
 
     NameMap::iterator iditer = mBufferCache.find(fname);
-    if(iditer != mBufferCache.end())
+    if(iditer == mBufferCache.end())
     {
-        buf = iditer->second.mALBuffer;
-        if(mBufferRefs[buf]++ == 0)
-        {
-            IDDq::iterator iter = std::find(mUnusedBuffers.begin(),
-                                            mUnusedBuffers.end(), buf);
-            if(iter != mUnusedBuffers.end())
-                mUnusedBuffers.erase(iter);
-        }
+        loadBuffer(fname);
 
-        return iditer->second;
+        iditer = mBufferCache.find(fname);
+        if(iditer == mBufferCache.end())
+            return NULL;
     }
-    throwALerror();
 
-    std::vector<char> data;
-    ChannelConfig chans;
-    SampleType type;
-    ALenum format;
-    int srate;
+    ALuint buf = iditer->second.mALBuffer;
+    if(mBufferRefs[buf]++ == 0)
+    {
+        IDDq::iterator iter = std::find(mUnusedBuffers.begin(),
+                                        mUnusedBuffers.end(), buf);
+        if(iter != mUnusedBuffers.end())
+            mUnusedBuffers.erase(iter);
+    }
 
-    DecoderPtr decoder = mManager.getDecoder();
-    // Workaround: Bethesda at some point converted some of the files to mp3, but the references were kept as .wav.
-    std::string file = fname;
-    if (!decoder->mResourceMgr->exists(file))
+    return &iditer->second;
+}
+
+void OpenAL_Output::loadBuffer(const std::string &fname)
+{
+    if(mBufferCache.find(fname) != mBufferCache.end() || mPendingBuffers.find(fname) != mPendingBuffers.end())
+        return;
+
+    osg::ref_ptr<DecodedSound> decoded = new DecodedSound;
+
+    if(!mDecodeWorkQueue)
     {
-        std::string::size_type pos = file.rfind('.');
-        if(pos != std::string::npos)
-            file = file.substr(0, pos)+".mp3";
+        decodeSound(mManager.getDecoder(), fname, *decoded);
+        addBuffer(fname, *decoded);
+        return;
     }
-    decoder->open(file);
 
-    decoder->getInfo(&srate, &chans, &type);
-    format = getALFormat(chans, type);
+    PendingBuffer& pending = mPendingBuffers[fname];
+    pending.mResult = decoded;
+    pending.mTicket = mDecodeWorkQueue->addWorkItem(new DecodeSoundItem(mManager.getDecoder(), fname, decoded));
+}
 
-    decoder->readAll(data);
-    decoder->close();
+void OpenAL_Output::addBuffer(const std::string &fname, const DecodedSound &decoded)
+{
+    throwALerror();
+
+    ALenum format = getALFormat(decoded.mChannels, decoded.mType);
 
     CachedSound cached;
-    analyzeLoudness(data, srate, chans, type, cached.mLoudnessVector, static_cast<float>(loudnessFPS));
+    cached.mLoudnessVector = decoded.mLoudnessVector;
 
-    alGenBuffers(1, &buf);
+    alGenBuffers(1, &cached.mALBuffer);
     throwALerror();
 
-    alBufferData(buf, format, &data[0], data.size(), srate);
-    mBufferRefs[buf] = 1;
-    cached.mALBuffer = buf;
-    mBufferCache[fname] = cached;
+    alBufferData(cached.mALBuffer, format, &decoded.mData[0], decoded.mData.size(), decoded.mSampleRate);
 
-    ALint bufsize = 0;
-    alGetBufferi(buf, AL_SIZE, &bufsize);
-    mBufferCacheMemSize += bufsize;
+    cached.mSize = 0;
+    alGetBufferi(cached.mALBuffer, AL_SIZE, &cached.mSize);
+    mBufferCacheMemSize += cached.mSize;
 
-    // NOTE: Max buffer cache: 15MB
-    while(mBufferCacheMemSize > 15*1024*1024)
+    // Drop the least recently used buffers that are not playing, except the new one
+    while(mBufferCacheMemSize > mBufferCacheMaxSize)
     {
         if(mUnusedBuffers.empty())
         {
@@ -831,18 +948,77 @@ const CachedSound& OpenAL_Output::getBuffer(const std::string &fname)
         while(nameiter != mBufferCache.end())
         {
             if(nameiter->second.mALBuffer == oldbuf)
+            {
+                mBufferCacheMemSize -= nameiter->second.mSize;
                 mBufferCache.erase(nameiter++);
+            }
             else
                 ++nameiter;
         }
 
-        bufsize = 0;
-        alGetBufferi(oldbuf, AL_SIZE, &bufsize);
         alDeleteBuffers(1, &oldbuf);
-        mBufferCacheMemSize -= bufsize;
     }
 
-    return mBufferCache[fname];
+    mUnusedBuffers.push_back(cached.mALBuffer);
+    mBufferCache[fname] = cached;
+}
+
+void OpenAL_Output::finishPendingBuffers()
+{
+    PendingMap::iterator iter = mPendingBuffers.begin();
+    while(iter != mPendingBuffers.end())
+    {
+        if(!iter->second.mTicket->isDone())
+        {
+            ++iter;
+            continue;
+        }
+
+        const DecodedSound& decoded = *iter->second.mResult;
+        bool added = false;
+        if(decoded.mError.empty())
+        {
+            try
+            {
+                addBuffer(iter->first, decoded);
+                added = true;
+            }
+            catch(std::exception &e)
+            {
+                std::cout <<"Sound Error: "<<e.what()<< std::endl;
+            }
+        }
+
+        bool reported = false;
+        for(size_t i = 0;i < mWaitingSounds.size();i++)
+        {
+            WaitingSound &waiting = mWaitingSounds[i];
+            if(waiting.mFileName != iter->first)
+                continue;
+
+            if(added)
+            {
+                // Pin the buffer for the sound right away, so that buffers finishing later can not evict it before
+                // the sound starts. The sound releases it when destroyed.
+                ALuint buf = mBufferCache[iter->first].mALBuffer;
+                if(mBufferRefs[buf]++ == 0)
+                {
+                    IDDq::iterator unused = std::find(mUnusedBuffers.begin(), mUnusedBuffers.end(), buf);
+                    if(unused != mUnusedBuffers.end())
+                        mUnusedBuffers.erase(unused);
+                }
+                waiting.mSound->mBuffer = buf;
+            }
+            // Only report the errors of sounds that were played, not those of preloaded sounds
+            else if(!decoded.mError.empty() && !reported)
+            {
+                std::cout <<"Sound Error: "<<decoded.mError<< std::endl;
+                reported = true;
+            }
+        }
+
+        mPendingBuffers.erase(iter++);
+    }
 }
 
 void OpenAL_Output::bufferFinished(ALuint buf)
@@ -854,6 +1030,18 @@ void OpenAL_Output::bufferFinished(ALuint buf)
     }
 }
 
+void OpenAL_Output::removeWaitingSound(OpenAL_Sound *sound)
+{
+    for(WaitingSoundVec::iterator iter = mWaitingSounds.begin();iter != mWaitingSounds.end();++iter)
+    {
+        if(iter->mSound == sound)
+        {
+            mWaitingSounds.erase(iter);
+            return;
+        }
+    }
+}
+
 MWBase::SoundPtr OpenAL_Output::playSound(const std::string &fname, float vol, float basevol, float pitch, int flags,float offset)
 {
     boost::shared_ptr<OpenAL_Sound> sound;
@@ -866,7 +1054,9 @@ MWBase::SoundPtr OpenAL_Output::playSound(const std::string &fname, float vol, f
 
     try
     {
-        buf = getBuffer(fname).mALBuffer;
+        const CachedSound* cached = getBuffer(fname);
+        if(cached)
+            buf = cached->mALBuffer;
         sound.reset(new OpenAL_Sound(*this, src, buf, osg::Vec3f(0.f, 0.f, 0.f), vol, basevol, pitch, 1.0f, 1000.0f, flags));
     }
     catch(std::exception&)
@@ -879,15 +1069,16 @@ MWBase::SoundPtr OpenAL_Output::playSound(const std::string &fname, float vol, f
     }
 
     sound->updateAll(true);
-    if(offset<0)
-        offset=0;
-    if(offset>1)
-        offset=1;
 
-    alSourcei(src, AL_BUFFER, buf);
-    alSourcef(src, AL_SEC_OFFSET, static_cast<ALfloat>(sound->getLength()*offset / pitch));
-    alSourcePlay(src);
-    throwALerror();
+    if(!buf)
+    {
+        WaitingSound waiting = { sound.get(), fname, offset, false };
+        mWaitingSounds.push_back(waiting);
+        sound->mWaiting = true;
+        return sound;
+    }
+
+    sound->play(offset);
 
     return sound;
 }
@@ -905,12 +1096,13 @@ MWBase::SoundPtr OpenAL_Output::playSound3D(const std::string &fname, const osg:
 
     try
     {
-        const CachedSound& cached = getBuffer(fname);
-        buf = cached.mALBuffer;
+        const CachedSound* cached = getBuffer(fname);
+        if(cached)
+            buf = cached->mALBuffer;
 
         sound.reset(new OpenAL_Sound3D(*this, src, buf, pos, vol, basevol, pitch, min, max, flags));
-        if (extractLoudness)
-            sound->setLoudnessVector(cached.mLoudnessVector, static_cast<float>(loudnessFPS));
+        if (cached && extractLoudness)
+            sound->setLoudnessVector(cached->mLoudnessVector, static_cast<float>(loudnessFPS));
     }
     catch(std::exception&)
     {
@@ -923,16 +1115,15 @@ MWBase::SoundPtr OpenAL_Output::playSound3D(const std::string &fname, const osg:
 
     sound->updateAll(false);
 
-    if(offset<0)
-        offset=0;
-    if(offset>1)
-        offset=1;
-
-    alSourcei(src, AL_BUFFER, buf);
-    alSourcef(src, AL_SEC_OFFSET, static_cast<ALfloat>(sound->getLength()*offset / pitch));
+    if(!buf)
+    {
+        WaitingSound waiting = { sound.get(), fname, offset, extractLoudness };
+        mWaitingSounds.push_back(waiting);
+        sound->mWaiting = true;
+        return sound;
+    }
 
-    alSourcePlay(src);
-    throwALerror();
+    sound->play(offset);
 
     return sound;
 }
@@ -967,6 +1158,57 @@ MWBase::SoundPtr OpenAL_Output::streamSound(DecoderPtr decoder, float volume, fl
 }
 
 
+void OpenAL_Output::preloadSound(const std::string &fname)
+{
+    // Decoding on the main thread now would only move the stall from playing the sound to here
+    if(mDecodeWorkQueue)
+        loadBuffer(fname);
+}
+
+bool OpenAL_Output::decodesInBackground() const
+{
+    return mDecodeWorkQueue != NULL;
+}
+
+
+void OpenAL_Output::update()
+{
+    finishPendingBuffers();
+
+    WaitingSoundVec waitingSounds;
+    waitingSounds.swap(mWaitingSounds);
+
+    for(size_t i = 0;i < waitingSounds.size();i++)
+    {
+        WaitingSound &waiting = waitingSounds[i];
+        if(mPendingBuffers.find(waiting.mFileName) != mPendingBuffers.end())
+        {
+            mWaitingSounds.push_back(waiting);
+            continue;
+        }
+
+        // No buffer was pinned if it could not be decoded, the sound then stops
+        waiting.mSound->mWaiting = false;
+        if(!waiting.mSound->mBuffer)
+            continue;
+
+        try
+        {
+            if(waiting.mExtractLoudness)
+            {
+                const CachedSound& cached = mBufferCache[waiting.mFileName];
+                waiting.mSound->setLoudnessVector(cached.mLoudnessVector, static_cast<float>(loudnessFPS));
+            }
+            waiting.mSound->play(waiting.mOffset);
+        }
+        catch(std::exception &e)
+        {
+            std::cout <<"Sound Error: "<<e.what()<< std::endl;
+        }
+    }
+}
+
+
 void OpenAL_Output::updateListener(const osg::Vec3f &pos, const osg::Vec3f &atdir, const osg::Vec3f &updir, Environment env)
 {
     mPos = pos;
@@ -1000,7 +1242,7 @@ void OpenAL_Output::pauseSounds(int types)
         else
         {
             const OpenAL_Sound *sound = dynamic_cast<OpenAL_Sound*>(*iter);
-            if(sound && sound->mSource && (sound->getPlayType()&types))
+            if(sound && sound->mSource && !sound->mWaiting && (sound->getPlayType()&types))
                 sources.push_back(sound->mSource);
         }
         ++iter;
@@ -1027,7 +1269,7 @@ void OpenAL_Output::resumeSounds(int types)
         else
         {
             const OpenAL_Sound *sound = dynamic_cast<OpenAL_Sound*>(*iter);
-            if(sound && sound->mSource && (sound->getPlayType()&types))
+            if(sound && sound->mSource && !sound->mWaiting && (sound->getPlayType()&types))
                 sources.push_back(sound->mSource);
         }
         ++iter;
@@ -1042,8 +1284,11 @@ void OpenAL_Output::resumeSounds(int types)
 
 OpenAL_Output::OpenAL_Output(SoundManager &mgr)
   : Sound_Output(mgr), mDevice(0), mContext(0), mBufferCacheMemSize(0),
-    mLastEnvironment(Env_Normal), mStreamThread(new StreamThread)
+    mBufferCacheMaxSize(static_cast<uint64_t>(std::max(Settings::Manager::getInt("buffer cache size", "Sound"), 0)) * 1024 * 1024),
+    mLastEnvironment(Env_Normal), mStreamThread(new StreamThread), mDecodeWorkQueue(NULL)
 {
+    if(Settings::Manager::getBool("decode in background", "Sound"))
+        mDecodeWorkQueue = mgr.mWorkQueue;
 }
 
 OpenAL_Output::~OpenAL_Output()
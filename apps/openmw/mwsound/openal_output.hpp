@@ -6,19 +6,30 @@
 #include <map>
 #include <deque>
 
+#include <osg/ref_ptr>
+
 #include "alc.h"
 #include "al.h"
 
 #include "sound_output.hpp"
 
+namespace SceneUtil
+{
+    class WorkQueue;
+    class WorkTicket;
+}
+
 namespace MWSound
 {
     class SoundManager;
     class Sound;
+    class OpenAL_Sound;
+    struct DecodedSound;
 
     struct CachedSound
     {
         ALuint mALBuffer;
+        ALint mSize;
         std::vector<float> mLoudnessVector;
     };
 
@@ -38,13 +49,39 @@ namespace MWSound
         IDRefMap mBufferRefs;
 
         uint64_t mBufferCacheMemSize;
+        uint64_t mBufferCacheMaxSize;
+
+        struct PendingBuffer
+        {
+            osg::ref_ptr<SceneUtil::WorkTicket> mTicket;
+            osg::ref_ptr<DecodedSound> mResult;
+        };
+        typedef std::map<std::string,PendingBuffer> PendingMap;
+        PendingMap mPendingBuffers;
+
+        /// A sound that starts playing once its buffer is decoded
+        struct WaitingSound
+        {
+            OpenAL_Sound *mSound;
+            std::string mFileName;
+            float mOffset;
+            bool mExtractLoudness;
+        };
+        typedef std::vector<WaitingSound> WaitingSoundVec;
+        WaitingSoundVec mWaitingSounds;
 
         typedef std::vector<Sound*> SoundVec;
         SoundVec mActiveSounds;
 
-        const CachedSound& getBuffer(const std::string &fname);
+        /// Return the cached buffer of \a fname and mark it as used, or NULL while it is decoded in the background.
+        const CachedSound* getBuffer(const std::string &fname);
+        void loadBuffer(const std::string &fname);
+        void addBuffer(const std::string &fname, const DecodedSound &decoded);
+        void finishPendingBuffers();
         void bufferFinished(ALuint buffer);
 
+        void removeWaitingSound(OpenAL_Sound *sound);
+
         Environment mLastEnvironment;
 
         virtual std::vector<std::string> enumerate();
@@ -58,6 +95,10 @@ namespace MWSound
                                              float vol, float basevol, float pitch, float min, float max, int flags, float offset, bool extractLoudness=false);
         virtual MWBase::SoundPtr streamSound(DecoderPtr decoder, float volume, float pitch, int flags);
 
+        virtual void preloadSound(const std::string &fname);
+        virtual bool decodesInBackground() const;
+        virtual void update();
+
         virtual void updateListener(const osg::Vec3f &pos, const osg::Vec3f &atdir, const osg::Vec3f &updir, Environment env);
 
         virtual void pauseSounds(int types);
@@ -72,6 +113,9 @@ namespace MWSound
         struct StreamThread;
         std::auto_ptr<StreamThread> mStreamThread;
 
+        /// Decodes sound effects in the background, NULL to decode them on the main thread
+        SceneUtil::WorkQueue* mDecodeWorkQueue;
+
         friend class OpenAL_Sound;
         friend class OpenAL_Sound3D;
         friend class OpenAL_SoundStream;
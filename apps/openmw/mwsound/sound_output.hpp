@@ -29,6 +29,15 @@ namespace MWSound
                                              float vol, float basevol, float pitch, float min, float max, int flags, float offset, bool extractLoudness=false) = 0;
         virtual MWBase::SoundPtr streamSound(DecoderPtr decoder, float volume, float pitch, int flags) = 0;
 
+        /// Start decoding \a fname in the background, so it does not have to be decoded when first played. Does nothing
+        /// unless decodesInBackground().
+        virtual void preloadSound(const std::string &fname) = 0;
+        /// Are sound effects decoded in the background? Otherwise they are decoded by the thread that plays them.
+        virtual bool decodesInBackground() const = 0;
+
+        /// Cache the sounds that finished decoding, and start the sounds waiting for them.
+        virtual void update() = 0;
+
         virtual void updateListener(const osg::Vec3f &pos, const osg::Vec3f &atdir, const osg::Vec3f &updir, Environment env) = 0;
 
         virtual void pauseSounds(int types) = 0;
@@ -3,8 +3,10 @@
 #include <iostream>
 #include <algorithm>
 #include <map>
+#include <set>
 
 #include <components/misc/rng.hpp>
+#include <components/misc/stringops.hpp>
 
 #include <components/vfs/manager.hpp>
 
@@ -31,8 +33,9 @@
 
 namespace MWSound
 {
-    SoundManager::SoundManager(const VFS::Manager* vfs, bool useSound)
+    SoundManager::SoundManager(const VFS::Manager* vfs, bool useSound, SceneUtil::WorkQueue* workQueue)
         : mVFS(vfs)
+        , mWorkQueue(workQueue)
         , mOutput(new DEFAULT_OUTPUT(*this))
         , mMasterVolume(1.0f)
         , mSFXVolume(1.0f)
@@ -503,6 +506,59 @@ namespace MWSound
         }
     }
 
+    void SoundManager::preloadSounds(MWWorld::CellStore *cell)
+    {
+        if(!mOutput->isInitialized() || !mOutput->decodesInBackground())
+            return;
+
+        const MWWorld::ESMStore &store = MWBase::Environment::get().getWorld()->getStore();
+        std::set<std::string> soundIds;
+
+        // Sounds of the creatures, see Creature::getSoundIdFromSndGen
+        std::set<std::string> creatures;
+        const MWWorld::CellRefList<ESM::Creature>::List &creatureList = cell->get<ESM::Creature>().mList;
+        for(MWWorld::CellRefList<ESM::Creature>::List::const_iterator iter = creatureList.begin(); iter != creatureList.end(); ++iter)
+        {
+            const ESM::Creature *creature = iter->mBase;
+            creatures.insert(Misc::StringUtils::lowerCase(creature->mOriginal.empty() ? creature->mId : creature->mOriginal));
+        }
+
+        if(!creatures.empty())
+        {
+            const MWWorld::Store<ESM::SoundGenerator> &soundGens = store.get<ESM::SoundGenerator>();
+            for(MWWorld::Store<ESM::SoundGenerator>::iterator iter = soundGens.begin(); iter != soundGens.end(); ++iter)
+            {
+                if(!iter->mCreature.empty() && creatures.count(Misc::StringUtils::lowerCase(iter->mCreature)))
+                    soundIds.insert(iter->mSound);
+            }
+        }
+
+        // Sounds of the region, see updateRegionSound
+        if(cell->getCell()->isExterior())
+        {
+            const ESM::Region *region = store.get<ESM::Region>().search(cell->getCell()->mRegion);
+            if(region)
+            {
+                std::vector<ESM::Region::SoundRef>::const_iterator soundIter = region->mSoundList.begin();
+                for(; soundIter != region->mSoundList.end(); ++soundIter)
+                    soundIds.insert(soundIter->mSound.toString());
+            }
+        }
+
+        for(std::set<std::string>::const_iterator iter = soundIds.begin(); iter != soundIds.end(); ++iter)
+        {
+            try
+            {
+                float volume = 1.f, min, max;
+                mOutput->preloadSound(lookup(*iter, volume, min, max));
+            }
+            catch(std::exception&)
+            {
+                // ignore, the error will be reported when the sound is played
+            }
+        }
+    }
+
     void SoundManager::stopSound(const std::string& soundId)
     {
         SoundMap::iterator snditer = mActiveSounds.begin();
@@ -699,6 +755,8 @@ namespace MWSound
         if(!mOutput->isInitialized())
             return;
 
+        mOutput->update();
+
         if (MWBase::Environment::get().getStateManager()->getState()!=
             MWBase::StateManager::State_NoGame)
         {
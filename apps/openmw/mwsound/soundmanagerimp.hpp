@@ -16,6 +16,11 @@ namespace VFS
     class Manager;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 namespace MWSound
 {
     class Sound_Output;
@@ -31,6 +36,10 @@ namespace MWSound
     {
         const VFS::Manager* mVFS;
 
+        /// Shared with the rest of the engine, decodes sound effects.
+        /// @note Declared ahead of mOutput, which uses it.
+        SceneUtil::WorkQueue* mWorkQueue;
+
         std::auto_ptr<Sound_Output> mOutput;
 
         // Caches available music tracks by <playlist name, (sound files) >
@@ -76,7 +85,7 @@ namespace MWSound
         friend class OpenAL_Output;
 
     public:
-        SoundManager(const VFS::Manager* vfs, bool useSound);
+        SoundManager(const VFS::Manager* vfs, bool useSound, SceneUtil::WorkQueue* workQueue);
         virtual ~SoundManager();
 
         virtual void processChangedSettings(const Settings::CategorySettingVector& settings);
@@ -149,6 +158,9 @@ namespace MWSound
         virtual void stopSound(const MWWorld::CellStore *cell);
         ///< Stop all sounds for the given cell.
 
+        virtual void preloadSounds(MWWorld::CellStore *cell);
+        ///< Start decoding the sounds that the creatures and the region of the given cell can play.
+
         virtual void stopSound(const std::string& soundId);
         ///< Stop a non-3d looping sound
 
@@ -0,0 +1,250 @@
+#include "cellpreloader.hpp"
+
+#include <set>
+
+#include <components/misc/resourcehelpers.hpp>
+#include <components/resource/resourcesystem.hpp>
+#include <components/resource/scenemanager.hpp>
+#include <components/nifbullet/bulletshapemanager.hpp>
+#include <components/nifbullet/bulletnifloader.hpp>
+#include <components/sceneutil/workqueue.hpp>
+#include <components/sceneutil/visitor.hpp>
+#include <components/terrain/world.hpp>
+#include <components/terrain/storage.hpp>
+#include <components/vfs/manager.hpp>
+
+#include "../mwbase/environment.hpp"
+#include "../mwbase/world.hpp"
+
+#include "cellstore.hpp"
+#include "class.hpp"
+#include "esmstore.hpp"
+
+namespace
+{
+
+    struct ListModelsFunctor
+    {
+        ListModelsFunctor(std::set<std::string>& out, const VFS::Manager* vfs)
+            : mOut(out)
+            , mVFS(vfs)
+        {
+        }
+
+        bool operator() (const MWWorld::Ptr& ptr)
+        {
+            if (ptr.getRefData().isDeleted() || !ptr.getRefData().isEnabled())
+                return true;
+
+            std::string model = ptr.getClass().getModel(ptr);
+            if (!model.empty())
+                mOut.insert(Misc::ResourceHelpers::correctActorModelPath(model, mVFS));
+            return true;
+        }
+
+        std::set<std::string>& mOut;
+        const VFS::Manager* mVFS;
+    };
+
+}
+
+namespace MWWorld
+{
+
+    /// Holds on to the preloaded resources of a cell, so they stay in the resource caches.
+    /// @note Written by the worker thread, only to be read once the work ticket is done.
+    class PreloadResult : public osg::Referenced
+    {
+    public:
+        PreloadResult()
+            : mEstimatedSize(0)
+        {
+        }
+
+        std::vector<osg::ref_ptr<const osg::Referenced> > mPreloaded;
+        size_t mEstimatedSize;
+    };
+
+    class PreloadItem : public SceneUtil::WorkItem
+    {
+    public:
+        PreloadItem(const std::set<std::string>& meshes, bool terrain, int x, int y, PreloadResult* result,
+                    Resource::SceneManager* sceneManager, NifBullet::BulletShapeManager* bulletShapeManager, Terrain::World* terrainWorld)
+            : mMeshes(meshes)
+            , mTerrain(terrain)
+            , mX(x)
+            , mY(y)
+            , mResult(result)
+            , mSceneManager(sceneManager)
+            , mBulletShapeManager(bulletShapeManager)
+            , mTerrainWorld(terrainWorld)
+        {
+        }
+
+        virtual void doWork()
+        {
+            SceneUtil::EstimateMemoryVisitor estimate;
+
+            const VFS::Manager* vfs = mSceneManager->getVFS();
+            for (std::set<std::string>::const_iterator it = mMeshes.begin(); it != mMeshes.end(); ++it)
+            {
+                try
+                {
+                    VFS::FileKey key = vfs->makeKey(*it);
+
+                    osg::ref_ptr<const osg::Node> node = mSceneManager->getTemplate(key);
+                    const_cast<osg::Node*>(node.get())->accept(estimate);
+                    mResult->mPreloaded.push_back(node);
+
+                    mResult->mPreloaded.push_back(mBulletShapeManager->getShape(key));
+                }
+                catch (std::exception&)
+                {
+                    // ignore, the error will be reported when the cell is actually loaded
+                }
+            }
+
+            if (mTerrain)
+            {
+                osg::ref_ptr<osg::Node> terrain = mTerrainWorld->cacheCell(mX, mY);
+                if (terrain)
+                {
+                    terrain->accept(estimate);
+                    mResult->mPreloaded.push_back(terrain);
+                }
+            }
+
+            mResult->mEstimatedSize = estimate.mSize;
+
+            mTicket->signalDone();
+        }
+
+    private:
+        std::set<std::string> mMeshes;
+        bool mTerrain;
+        int mX, mY;
+        osg::ref_ptr<PreloadResult> mResult;
+
+        Resource::SceneManager* mSceneManager;
+        NifBullet::BulletShapeManager* mBulletShapeManager;
+        Terrain::World* mTerrainWorld;
+    };
+
+    CellPreloader::CellPreloader(Resource::ResourceSystem* resourceSystem, NifBullet::BulletShapeManager* bulletShapeManager,
+                                 Terrain::World* terrain, SceneUtil::WorkQueue* workQueue)
+        : mResourceSystem(resourceSystem)
+        , mBulletShapeManager(bulletShapeManager)
+        , mTerrain(terrain)
+        , mWorkQueue(workQueue)
+        , mExpiryDelay(0.0)
+        , mMemoryBudget(0)
+    {
+    }
+
+    CellPreloader::~CellPreloader()
+    {
+        // Wait for the preloads in progress, so that no worker is using the resources when they go away
+        clear();
+    }
+
+    void CellPreloader::preload(CellStore *cell, double timestamp)
+    {
+        PreloadMap::iterator found = mPreloadCells.find(cell);
+        if (found != mPreloadCells.end())
+        {
+            found->second.mTimeStamp = timestamp;
+            return;
+        }
+
+        std::set<std::string> meshes;
+        ListModelsFunctor functor(meshes, mResourceSystem->getVFS());
+        cell->forEachConst(functor);
+
+        bool terrain = false;
+        int x = 0, y = 0;
+        if (cell->isExterior())
+        {
+            x = cell->getCell()->getGridX();
+            y = cell->getCell()->getGridY();
+
+            // The land data is read from the content file, which can not be done from a background thread
+            ESM::Land* land = MWBase::Environment::get().getWorld()->getStore().get<ESM::Land>().search(x, y);
+            if (land && land->mDataTypes&ESM::Land::DATA_VHGT)
+            {
+                mTerrain->getStorage()->loadCellData(x, y);
+                terrain = true;
+            }
+        }
+
+        PreloadEntry entry;
+        entry.mTimeStamp = timestamp;
+        entry.mResult = new PreloadResult;
+        entry.mTicket = mWorkQueue->addWorkItem(new PreloadItem(meshes, terrain, x, y, entry.mResult,
+                                                                mResourceSystem->getSceneManager(), mBulletShapeManager, mTerrain),
+                                                SceneUtil::WorkQueue::Priority_Low);
+
+        mPreloadCells[cell] = entry;
+    }
+
+    void CellPreloader::updateCache(double timestamp)
+    {
+        for (PreloadMap::iterator it = mPreloadCells.begin(); it != mPreloadCells.end();)
+        {
+            // Work in progress can not be cancelled, keep it until done
+            if (it->second.mTicket->isDone() && it->second.mTimeStamp + mExpiryDelay < timestamp)
+                mPreloadCells.erase(it++);
+            else
+                ++it;
+        }
+
+        size_t usage = getMemoryUsage();
+        while (usage > mMemoryBudget)
+        {
+            PreloadMap::iterator oldest = mPreloadCells.end();
+            for (PreloadMap::iterator it = mPreloadCells.begin(); it != mPreloadCells.end(); ++it)
+            {
+                if (it->second.mTicket->isDone() && (oldest == mPreloadCells.end() || it->second.mTimeStamp < oldest->second.mTimeStamp))
+                    oldest = it;
+            }
+            if (oldest == mPreloadCells.end())
+                break;
+
+            usage -= oldest->second.mResult->mEstimatedSize;
+            mPreloadCells.erase(oldest);
+        }
+    }
+
+    void CellPreloader::clear()
+    {
+        for (PreloadMap::iterator it = mPreloadCells.begin(); it != mPreloadCells.end(); ++it)
+            it->second.mTicket->waitTillDone();
+        mPreloadCells.clear();
+    }
+
+    void CellPreloader::setExpiryDelay(double expiryDelay)
+    {
+        mExpiryDelay = expiryDelay;
+    }
+
+    void CellPreloader::setMemoryBudget(size_t budget)
+    {
+        mMemoryBudget = budget;
+    }
+
+    unsigned int CellPreloader::getNumCells() const
+    {
+        return mPreloadCells.size();
+    }
+
+    size_t CellPreloader::getMemoryUsage() const
+    {
+        size_t usage = 0;
+        for (PreloadMap::const_iterator it = mPreloadCells.begin(); it != mPreloadCells.end(); ++it)
+        {
+            if (it->second.mTicket->isDone())
+                usage += it->second.mResult->mEstimatedSize;
+        }
+        return usage;
+    }
+
+}
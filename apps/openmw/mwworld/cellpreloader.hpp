@@ -0,0 +1,94 @@
+#ifndef GAME_MWWORLD_CELLPRELOADER_H
+#define GAME_MWWORLD_CELLPRELOADER_H
+
+#include <map>
+
+#include <osg/ref_ptr>
+
+namespace Resource
+{
+    class ResourceSystem;
+}
+
+namespace NifBullet
+{
+    class BulletShapeManager;
+}
+
+namespace Terrain
+{
+    class World;
+}
+
+namespace SceneUtil
+{
+    class WorkQueue;
+    class WorkTicket;
+}
+
+namespace MWWorld
+{
+    class CellStore;
+
+    class PreloadResult;
+
+    /// @brief Loads the meshes, textures, collision shapes and terrain used by a cell on background threads,
+    /// ahead of the cell being added to the scene, so that the actual cell change only has to instance ready resources.
+    class CellPreloader
+    {
+    public:
+        /// @param workQueue Shared with the rest of the engine, preloads run at low priority.
+        CellPreloader(Resource::ResourceSystem* resourceSystem, NifBullet::BulletShapeManager* bulletShapeManager,
+                      Terrain::World* terrain, SceneUtil::WorkQueue* workQueue);
+        ~CellPreloader();
+
+        /// Ask a background thread to preload the resources used by objects in this cell. If the cell was
+        /// already preloaded, just refreshes its timestamp.
+        /// @note Must be called from the main thread. The cell itself must be in State_Loaded.
+        void preload(CellStore* cell, double timestamp);
+
+        /// Drop preloaded cells that have not been requested within the expiry delay, then the least recently
+        /// requested ones until the memory budget is met.
+        void updateCache(double timestamp);
+
+        /// Drop all preloaded cells. Preloads still in progress are waited for.
+        void clear();
+
+        /// How long to keep a preloaded cell after its last request, in seconds.
+        void setExpiryDelay(double expiryDelay);
+
+        /// Estimated memory the preloaded resources may use, in bytes.
+        void setMemoryBudget(size_t budget);
+
+        unsigned int getNumCells() const;
+
+        /// Estimated memory used by the preloaded resources of completed preloads, in bytes.
+        /// @note Resources shared between cells are counted once for each cell.
+        size_t getMemoryUsage() const;
+
+    private:
+        Resource::ResourceSystem* mResourceSystem;
+        NifBullet::BulletShapeManager* mBulletShapeManager;
+        Terrain::World* mTerrain;
+
+        SceneUtil::WorkQueue* mWorkQueue;
+
+        double mExpiryDelay;
+        size_t mMemoryBudget;
+
+        struct PreloadEntry
+        {
+            double mTimeStamp;
+            osg::ref_ptr<SceneUtil::WorkTicket> mTicket;
+            osg::ref_ptr<PreloadResult> mResult;
+        };
+        typedef std::map<const CellStore*, PreloadEntry> PreloadMap;
+        PreloadMap mPreloadCells;
+
+        CellPreloader(const CellPreloader&);
+        CellPreloader& operator=(const CellPreloader&);
+    };
+
+}
+
+#endif
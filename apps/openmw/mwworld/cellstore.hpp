@@ -145,27 +145,17 @@ namespace MWWorld
             {
                 mHasState = true;
 
-                return
-                    forEachImp (functor, mActivators) &&
-                    forEachImp (functor, mPotions) &&
-                    forEachImp (functor, mAppas) &&
-                    forEachImp (functor, mArmors) &&
-                    forEachImp (functor, mBooks) &&
-                    forEachImp (functor, mClothes) &&
-                    forEachImp (functor, mContainers) &&
-                    forEachImp (functor, mDoors) &&
-                    forEachImp (functor, mIngreds) &&
-                    forEachImp (functor, mItemLists) &&
-                    forEachImp (functor, mLights) &&
-                    forEachImp (functor, mLockpicks) &&
-                    forEachImp (functor, mMiscItems) &&
-                    forEachImp (functor, mProbes) &&
-                    forEachImp (functor, mRepairs) &&
-                    forEachImp (functor, mStatics) &&
-                    forEachImp (functor, mWeapons) &&
-                    forEachImp (functor, mCreatures) &&
-                    forEachImp (functor, mNpcs) &&
-                    forEachImp (functor, mCreatureLists);
+                return forEachAll (functor);
+            }
+
+            /// Call functor (ref) for each reference, without flagging the cell as having state that needs to be
+            /// stored in a saved game file. The functor must not modify the references.
+            /// \attention This function also lists deleted (count 0) objects!
+            /// \return Iteration completed?
+            template<class Functor>
+            bool forEachConst (Functor& functor) const
+            {
+                return const_cast<CellStore*>(this)->forEachAll (functor);
             }
 
             template<class Functor>
@@ -214,6 +204,32 @@ namespace MWWorld
 
         private:
 
+            template<class Functor>
+            bool forEachAll (Functor& functor)
+            {
+                return
+                    forEachImp (functor, mActivators) &&
+                    forEachImp (functor, mPotions) &&
+                    forEachImp (functor, mAppas) &&
+                    forEachImp (functor, mArmors) &&
+                    forEachImp (functor, mBooks) &&
+                    forEachImp (functor, mClothes) &&
+                    forEachImp (functor, mContainers) &&
+                    forEachImp (functor, mDoors) &&
+                    forEachImp (functor, mIngreds) &&
+                    forEachImp (functor, mItemLists) &&
+                    forEachImp (functor, mLights) &&
+                    forEachImp (functor, mLockpicks) &&
+                    forEachImp (functor, mMiscItems) &&
+                    forEachImp (functor, mProbes) &&
+                    forEachImp (functor, mRepairs) &&
+                    forEachImp (functor, mStatics) &&
+                    forEachImp (functor, mWeapons) &&
+                    forEachImp (functor, mCreatures) &&
+                    forEachImp (functor, mNpcs) &&
+                    forEachImp (functor, mCreatureLists);
+            }
+
             template<class Functor, class List>
             bool forEachImp (Functor& functor, List& list)
             {
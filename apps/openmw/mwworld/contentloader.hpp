@@ -27,6 +27,11 @@ struct ContentLoader
       mListener.setLabel(filepath.string());
     }
 
+    /// Called after all content files were passed to load(). Loaders that work in the background complete loading here.
+    virtual void finish()
+    {
+    }
+
     protected:
         Loading::Listener& mListener;
 };
@@ -1,31 +1,147 @@
 #include "esmloader.hpp"
 #include "esmstore.hpp"
 
+#include <iostream>
+
+#include <osg/Timer>
+
 #include <components/esm/esmreader.hpp>
+#include <components/settings/settings.hpp>
+#include <components/sceneutil/workqueue.hpp>
 
 namespace MWWorld
 {
 
+struct EsmLoader::PendingFile
+{
+  boost::filesystem::path mPath;
+  int mIndex;
+
+  ESM::ESMReader mReader;
+  // The encoders are not thread safe, so every file being staged needs its own
+  std::auto_ptr<ToUTF8::Utf8Encoder> mEncoder;
+
+  StagedContentFile mStaged;
+  double mStageTime;
+  std::string mError;
+
+  osg::ref_ptr<SceneUtil::WorkTicket> mTicket;
+};
+
+namespace
+{
+  class StageContentFileItem : public SceneUtil::WorkItem
+  {
+  public:
+    StageContentFileItem(const ESMStore& store, ESM::ESMReader& reader, StagedContentFile& staged,
+                         const std::string& path, double& stageTime, std::string& error)
+      : mStore(store)
+      , mReader(reader)
+      , mStaged(staged)
+      , mPath(path)
+      , mStageTime(stageTime)
+      , mError(error)
+    {
+    }
+
+    virtual void doWork()
+    {
+      osg::Timer timer;
+      try
+      {
+        mReader.open(mPath);
+        mStore.stage(mReader, mStaged);
+      }
+      catch (std::exception& e)
+      {
+        // Rethrown on the main thread once the file is merged
+        mError = e.what();
+      }
+      mStageTime = timer.time_m();
+
+      mTicket->signalDone();
+    }
+
+  private:
+    const ESMStore& mStore;
+    ESM::ESMReader& mReader;
+    StagedContentFile& mStaged;
+    std::string mPath;
+    double& mStageTime;
+    std::string& mError;
+  };
+}
+
 EsmLoader::EsmLoader(MWWorld::ESMStore& store, std::vector<ESM::ESMReader>& readers,
-  ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener)
+  ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener, SceneUtil::WorkQueue* workQueue)
   : ContentLoader(listener)
   , mEsm(readers)
   , mStore(store)
   , mEncoder(encoder)
+  , mUseMemoryMapping(Settings::Manager::getBool("memory map content files", "General"))
+  , mWorkQueue(workQueue)
 {
 }
 
+EsmLoader::~EsmLoader()
+{
+  // Wait for the workers before freeing what they work on
+  for (std::vector<PendingFile*>::iterator it = mPendingFiles.begin(); it != mPendingFiles.end(); ++it)
+  {
+    (*it)->mTicket->waitTillDone();
+    delete *it;
+  }
+}
+
 void EsmLoader::load(const boost::filesystem::path& filepath, int& index)
 {
-  ContentLoader::load(filepath.filename(), index);
-
-  ESM::ESMReader lEsm;
-  lEsm.setEncoder(mEncoder);
-  lEsm.setIndex(index);
-  lEsm.setGlobalReaderList(&mEsm);
-  lEsm.open(filepath.string());
-  mEsm[index] = lEsm;
-  mStore.load(mEsm[index], &mListener);
+  PendingFile* file = new PendingFile;
+  mPendingFiles.push_back(file);
+
+  file->mPath = filepath;
+  file->mIndex = index;
+  file->mStageTime = 0.0;
+  if (mEncoder)
+    file->mEncoder.reset(new ToUTF8::Utf8Encoder(mEncoder->getEncoding()));
+  file->mReader.setEncoder(file->mEncoder.get());
+  file->mReader.setUseMemoryMapping(mUseMemoryMapping);
+  file->mReader.setIndex(index);
+  file->mReader.setGlobalReaderList(&mEsm);
+
+  file->mTicket = mWorkQueue->addWorkItem(new StageContentFileItem(mStore, file->mReader, file->mStaged,
+                                                                   filepath.string(), file->mStageTime, file->mError));
+}
+
+void EsmLoader::finish()
+{
+  for (std::vector<PendingFile*>::iterator it = mPendingFiles.begin(); it != mPendingFiles.end(); ++it)
+  {
+    PendingFile* file = *it;
+    int index = file->mIndex;
+    ContentLoader::load(file->mPath.filename(), index);
+
+    osg::Timer waitTimer;
+    file->mTicket->waitTillDone();
+    double waitTime = waitTimer.time_m();
+
+    if (!file->mError.empty())
+      throw std::runtime_error(file->mError);
+
+    mEsm[index] = file->mReader;
+    // The staging encoder goes away with the pending file
+    mEsm[index].setEncoder(mEncoder);
+
+    osg::Timer mergeTimer;
+    mStore.merge(mEsm[index], file->mStaged, &mListener);
+
+    std::cout << "  " << file->mStaged.mEntries.size() << " records: decoded in " << static_cast<int>(file->mStageTime)
+              << " ms, waited " << static_cast<int>(waitTime) << " ms, merged in " << static_cast<int>(mergeTimer.time_m())
+              << " ms" << std::endl;
+
+    delete file;
+    *it = NULL;
+  }
+  mPendingFiles.clear();
 }
 
 } /* namespace MWWorld */
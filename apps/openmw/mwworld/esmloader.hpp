@@ -2,6 +2,7 @@
 #define ESMLOADER_HPP
 
 #include <vector>
+#include <memory>
 
 #include "contentloader.hpp"
 
@@ -15,22 +16,39 @@ namespace ESM
     class ESMReader;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 namespace MWWorld
 {
 
 class ESMStore;
 
+/// @brief Loads content files in two phases: load() starts decoding the records of a file on a background thread, and
+/// once all files were passed to load(), finish() merges them into the ESMStore in load order.
 struct EsmLoader : public ContentLoader
 {
+    /// @param workQueue Shared with the rest of the engine, decodes the content files.
     EsmLoader(MWWorld::ESMStore& store, std::vector<ESM::ESMReader>& readers,
-      ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener);
+      ToUTF8::Utf8Encoder* encoder, Loading::Listener& listener, SceneUtil::WorkQueue* workQueue);
+    ~EsmLoader();
 
     void load(const boost::filesystem::path& filepath, int& index);
 
+    void finish();
+
     private:
+      struct PendingFile;
+
       std::vector<ESM::ESMReader>& mEsm;
       MWWorld::ESMStore& mStore;
       ToUTF8::Utf8Encoder* mEncoder;
+      bool mUseMemoryMapping;
+
+      std::vector<PendingFile*> mPendingFiles;
+      SceneUtil::WorkQueue* mWorkQueue;
 };
 
 } /* namespace MWWorld */
@@ -26,12 +26,14 @@ static bool isCacheableRecord(int id)
     return false;
 }
 
-void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
+StagedContentFile::~StagedContentFile()
 {
-    listener->setProgressRange(1000);
-
-    ESM::Dialogue *dialogue = 0;
+    for (std::vector<Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+        delete it->mRecord;
+}
 
+void ESMStore::resolveMasters(ESM::ESMReader &esm)
+{
     /// \todo Move this to somewhere else. ESMReader?
     // Cache parent esX files by tracking their indices in the global list of
     //  all files/readers used by the engine. This will greaty accelerate
@@ -59,6 +61,78 @@ void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
         }
         mast.index = index;
     }
+}
+
+void ESMStore::loadRecord(ESM::ESMReader &esm, ESM::NAME n, ESM::Dialogue*& dialogue)
+{
+    // Look up the record type.
+    std::map<int, StoreBase *>::iterator it = mStores.find(n.val);
+
+    if (it == mStores.end()) {
+        if (n.val == ESM::REC_INFO) {
+            if (dialogue)
+            {
+                dialogue->readInfo(esm, esm.getIndex() != 0);
+            }
+            else
+            {
+                std::cerr << "error: info record without dialog" << std::endl;
+                esm.skipRecord();
+            }
+        } else if (n.val == ESM::REC_MGEF) {
+            mMagicEffects.load (esm);
+        } else if (n.val == ESM::REC_SKIL) {
+            mSkills.load (esm);
+        }
+        else if (n.val==ESM::REC_FILT || n.val == ESM::REC_DBGP)
+        {
+            // ignore project file only records
+            esm.skipRecord();
+        }
+        else {
+            std::stringstream error;
+            error << "Unknown record: " << n.toString();
+            throw std::runtime_error(error.str());
+        }
+    } else {
+        // Load it
+        std::string id = esm.getHNOString("NAME");
+        // ... unless it got deleted! This means that the following record
+        //  has been deleted, and trying to load it using standard assumptions
+        //  on the structure will (probably) fail.
+        if (esm.isNextSub("DELE")) {
+          esm.skipRecord();
+          it->second->eraseStatic(id);
+          return;
+        }
+        it->second->load(esm, id);
+
+        // DELE can also occur after the usual subrecords
+        if (esm.isNextSub("DELE")) {
+          esm.skipRecord();
+          it->second->eraseStatic(id);
+          return;
+        }
+
+        if (n.val==ESM::REC_DIAL) {
+            dialogue = const_cast<ESM::Dialogue*>(mDialogs.find(id));
+        } else {
+            dialogue = 0;
+        }
+        // Insert the reference into the global lookup
+        if (!id.empty() && isCacheableRecord(n.val)) {
+            mIds[Misc::StringUtils::lowerCase (id)] = n.val;
+        }
+    }
+}
+
+void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
+{
+    listener->setProgressRange(1000);
+
+    ESM::Dialogue *dialogue = 0;
+
+    resolveMasters(esm);
 
     // Loop through all records
     while(esm.hasMoreRecs())
@@ -66,66 +140,106 @@ void ESMStore::load(ESM::ESMReader &esm, Loading::Listener* listener)
         ESM::NAME n = esm.getRecName();
         esm.getRecHeader();
 
-        // Look up the record type.
-        std::map<int, StoreBase *>::iterator it = mStores.find(n.val);
+        loadRecord(esm, n, dialogue);
 
-        if (it == mStores.end()) {
-            if (n.val == ESM::REC_INFO) {
-                if (dialogue)
-                {
-                    dialogue->readInfo(esm, esm.getIndex() != 0);
-                }
-                else
-                {
-                    std::cerr << "error: info record without dialog" << std::endl;
-                    esm.skipRecord();
-                }
-            } else if (n.val == ESM::REC_MGEF) {
-                mMagicEffects.load (esm);
-            } else if (n.val == ESM::REC_SKIL) {
-                mSkills.load (esm);
-            }
-            else if (n.val==ESM::REC_FILT || n.val == ESM::REC_DBGP)
+        listener->setProgress(static_cast<size_t>(esm.getFileOffset() / (float)esm.getFileSize() * 1000));
+    }
+}
+
+void ESMStore::stage(ESM::ESMReader &esm, StagedContentFile &staged) const
+{
+    while(esm.hasMoreRecs())
+    {
+        ESM::NAME n = esm.getRecName();
+        esm.getRecHeader();
+
+        StagedContentFile::Entry entry;
+        entry.mType = n.val;
+        entry.mDecoded = false;
+        entry.mDeleted = false;
+        entry.mRecord = NULL;
+
+        std::map<int, StoreBase *>::const_iterator it = mStores.find(n.val);
+        if (it == mStores.end() || !it->second->isStageable())
+        {
+            // Remember where the record is, merge will load it from there
+            entry.mContext = esm.getContext();
+            staged.mEntries.push_back(entry);
+            esm.skipRecord();
+            continue;
+        }
+
+        // Also kept for records that are decoded, in case they override an existing record
+        entry.mContext = esm.getContext();
+        entry.mDecoded = true;
+        entry.mId = esm.getHNOString("NAME");
+        staged.mEntries.push_back(entry);
+        StagedContentFile::Entry& stagedEntry = staged.mEntries.back();
+
+        // See loadRecord for the handling of deleted records
+        if (esm.isNextSub("DELE")) {
+            esm.skipRecord();
+            stagedEntry.mDeleted = true;
+            continue;
+        }
+
+        stagedEntry.mRecord = it->second->decode(esm, stagedEntry.mId);
+
+        if (esm.isNextSub("DELE")) {
+            esm.skipRecord();
+            stagedEntry.mDeleted = true;
+            delete stagedEntry.mRecord;
+            stagedEntry.mRecord = NULL;
+        }
+    }
+}
+
+void ESMStore::merge(ESM::ESMReader &esm, StagedContentFile &staged, Loading::Listener *listener)
+{
+    listener->setProgressRange(1000);
+
+    ESM::Dialogue *dialogue = 0;
+
+    resolveMasters(esm);
+
+    const size_t numEntries = staged.mEntries.size();
+    for (size_t i=0; i<numEntries; ++i)
+    {
+        StagedContentFile::Entry& entry = staged.mEntries[i];
+
+        if (!entry.mDecoded)
+        {
+            esm.restoreContext(entry.mContext);
+            loadRecord(esm, entry.mContext.recName, dialogue);
+        }
+        else
+        {
+            StoreBase* store = mStores[entry.mType];
+            if (entry.mDeleted)
+                store->eraseStatic(entry.mId);
+            else if (!store->merge(*entry.mRecord))
             {
-                // ignore project file only records
-                esm.skipRecord();
-            }
-            else {
-                std::stringstream error;
-                error << "Unknown record: " << n.toString();
-                throw std::runtime_error(error.str());
+                // Overrides an existing record, load it on top of that one again
+                esm.restoreContext(entry.mContext);
+                loadRecord(esm, entry.mContext.recName, dialogue);
             }
-        } else {
-            // Load it
-            std::string id = esm.getHNOString("NAME");
-            // ... unless it got deleted! This means that the following record
-            //  has been deleted, and trying to load it using standard assumptions
-            //  on the structure will (probably) fail.
-            if (esm.isNextSub("DELE")) {
-              esm.skipRecord();
-              it->second->eraseStatic(id);
-              continue;
-            }
-            it->second->load(esm, id);
+            else
+            {
+                // Dialogues are never staged, so this can not be the start of a new dialogue
+                dialogue = 0;
 
-            // DELE can also occur after the usual subrecords
-            if (esm.isNextSub("DELE")) {
-              esm.skipRecord();
-              it->second->eraseStatic(id);
-              continue;
+                if (!entry.mId.empty() && isCacheableRecord(entry.mType)) {
+                    mIds[Misc::StringUtils::lowerCase (entry.mId)] = entry.mType;
+                }
             }
 
-            if (n.val==ESM::REC_DIAL) {
-                dialogue = const_cast<ESM::Dialogue*>(mDialogs.find(id));
-            } else {
-                dialogue = 0;
-            }
-            // Insert the reference into the global lookup
-            if (!id.empty() && isCacheableRecord(n.val)) {
-                mIds[Misc::StringUtils::lowerCase (id)] = n.val;
-            }
+            // Free the staged copy as soon as possible, to keep the peak memory usage down
+            delete entry.mRecord;
+            entry.mRecord = NULL;
         }
-        listener->setProgress(static_cast<size_t>(esm.getFileOffset() / (float)esm.getFileSize() * 1000));
+
+        if (i % 64 == 0)
+            listener->setProgress(static_cast<size_t>(i / (float)numEntries * 1000));
     }
 }
 
@@ -14,6 +14,33 @@ namespace Loading
 
 namespace MWWorld
 {
+    /// @brief The records of one content file, decoded by ESMStore::stage and waiting to be merged into the store.
+    class StagedContentFile
+    {
+    public:
+        StagedContentFile() {}
+        ~StagedContentFile();
+
+        struct Entry
+        {
+            int mType;
+            std::string mId;
+
+            /// Was the record decoded by ESMStore::stage? If not, it is loaded from mContext when merging. So are
+            /// decoded records that override an existing record.
+            bool mDecoded;
+            bool mDeleted;
+            StagedRecord* mRecord;
+
+            ESM::ESM_Context mContext;
+        };
+        std::vector<Entry> mEntries;
+
+    private:
+        StagedContentFile(const StagedContentFile&);
+        StagedContentFile& operator= (const StagedContentFile&);
+    };
+
     class ESMStore
     {
         Store<ESM::Activator>       mActivators;
@@ -70,6 +97,12 @@ namespace MWWorld
         std::map<std::string, int> mIds;
         std::map<int, StoreBase *> mStores;
 
+        /// Resolve the indices of the content files \a esm depends on.
+        void resolveMasters(ESM::ESMReader &esm);
+
+        /// Load the record \a esm is at, after its header was read.
+        void loadRecord(ESM::ESMReader &esm, ESM::NAME n, ESM::Dialogue*& dialogue);
+
         ESM::NPC mPlayerTemplate;
 
         unsigned int mDynamicCount;
@@ -158,8 +191,20 @@ namespace MWWorld
             mNpcs.insert(mPlayerTemplate);
         }
 
+        /// Load all records of a content file. Equivalent to stage followed by merge.
         void load(ESM::ESMReader &esm, Loading::Listener* listener);
 
+        /// First phase of loading a content file: decode the records into \a staged, without changing the store.
+        /// Records that depend on the state of the store (e.g. dialogue infos), or that keep referring to the reader
+        /// (e.g. cells and land), are only located here and loaded by merge.
+        /// @note Thread safe, so several content files may be staged at once, each with its own reader.
+        void stage(ESM::ESMReader &esm, StagedContentFile& staged) const;
+
+        /// Second phase of loading a content file: add the staged records to the store. Content files must be merged
+        /// in load order, so that records of later files override those of earlier ones.
+        /// @param esm The reader the file was staged with. Must have been added to the global reader list.
+        void merge(ESM::ESMReader &esm, StagedContentFile& staged, Loading::Listener* listener);
+
         template <class T>
         const Store<T> &get() const {
             throw std::runtime_error("Storage for this type not exist");
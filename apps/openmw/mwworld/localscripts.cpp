@@ -1,7 +1,10 @@
 #include "localscripts.hpp"
 
+#include <algorithm>
 #include <iostream>
 
+#include <components/settings/settings.hpp>
+
 #include "esmstore.hpp"
 #include "cellstore.hpp"
 
@@ -53,42 +56,92 @@ namespace
     }
 }
 
-MWWorld::LocalScripts::LocalScripts (const MWWorld::ESMStore& store) : mStore (store) {}
+MWWorld::LocalScripts::LocalScripts (const MWWorld::ESMStore& store)
+: mStore (store), mStartTick (0), mDuration (0.f), mNumRun (0), mNumDeferred (0)
+{
+    mDistantDistance = Settings::Manager::getFloat ("distant script distance", "Scripts");
+    mDistantInterval = Settings::Manager::getFloat ("distant script interval", "Scripts");
+    mMaxDelay = Settings::Manager::getFloat ("max distant script delay", "Scripts");
+    mBudget = Settings::Manager::getFloat ("local script budget", "Scripts");
+}
 
 void MWWorld::LocalScripts::setIgnore (const Ptr& ptr)
 {
     mIgnore = ptr;
 }
 
-void MWWorld::LocalScripts::startIteration()
+void MWWorld::LocalScripts::startIteration (float duration, const osg::Vec3f& playerPos)
 {
+    for (std::list<Script>::iterator iter = mScripts.begin(); iter!=mScripts.end(); ++iter)
+        iter->mTimeSinceRun += duration;
+
     mIter = mScripts.begin();
+    mPlayerPos = playerPos;
+    mDuration = duration;
+    mStartTick = osg::Timer::instance()->tick();
+    mNumRun = 0;
+    mNumDeferred = 0;
 }
 
-bool MWWorld::LocalScripts::isFinished() const
+bool MWWorld::LocalScripts::isDeferred (const Script& script) const
 {
-    if (mIter==mScripts.end())
+    if (mDistantDistance <= 0.f || script.mTimeSinceRun >= mMaxDelay)
+        return false;
+
+    // Not in the scene, e.g. in a container
+    if (!script.mPtr.getRefData().getBaseNode())
+        return false;
+
+    osg::Vec3f pos = script.mPtr.getRefData().getPosition().asVec3();
+    if ((pos - mPlayerPos).length2() <= mDistantDistance * mDistantDistance)
+        return false;
+
+    if (script.mTimeSinceRun < mDistantInterval)
         return true;
 
-    if (!mIgnore.isEmpty() && mIter->second==mIgnore)
+    return mBudget > 0.f && osg::Timer::instance()->delta_m (mStartTick, osg::Timer::instance()->tick()) > mBudget;
+}
+
+bool MWWorld::LocalScripts::isFinished()
+{
+    while (mIter!=mScripts.end())
     {
-        std::list<std::pair<std::string, Ptr> >::iterator iter = mIter;
-        return ++iter==mScripts.end();
+        if (!mIgnore.isEmpty() && mIter->mPtr==mIgnore)
+            ++mIter;
+        else if (isDeferred (*mIter))
+        {
+            ++mNumDeferred;
+            ++mIter;
+        }
+        else
+            return false;
     }
 
-    return false;
+    return true;
 }
 
-std::pair<std::string, MWWorld::Ptr> MWWorld::LocalScripts::getNext()
+std::pair<std::string, MWWorld::Ptr> MWWorld::LocalScripts::getNext (float& secondsPassed)
 {
-    assert (!isFinished());
+    assert (mIter!=mScripts.end());
 
-    std::list<std::pair<std::string, Ptr> >::iterator iter = mIter++;
+    Script& script = *mIter++;
 
-    if (mIgnore.isEmpty() || iter->second!=mIgnore)
-        return *iter;
+    // Scripts added during this iteration have not seen the duration yet
+    secondsPassed = std::max (script.mTimeSinceRun, mDuration);
+    script.mTimeSinceRun = 0.f;
+    ++mNumRun;
+
+    return std::make_pair (script.mName, script.mPtr);
+}
 
-    return getNext();
+unsigned int MWWorld::LocalScripts::getNumRun() const
+{
+    return mNumRun;
+}
+
+unsigned int MWWorld::LocalScripts::getNumDeferred() const
+{
+    return mNumDeferred;
 }
 
 void MWWorld::LocalScripts::add (const std::string& scriptName, const Ptr& ptr)
@@ -99,7 +152,11 @@ void MWWorld::LocalScripts::add (const std::string& scriptName, const Ptr& ptr)
         {
             ptr.getRefData().setLocals (*script);
 
-            mScripts.push_back (std::make_pair (scriptName, ptr));
+            Script entry;
+            entry.mName = scriptName;
+            entry.mPtr = ptr;
+            entry.mTimeSinceRun = 0.f;
+            mScripts.push_back (entry);
         }
         catch (const std::exception& exception)
         {
@@ -145,11 +202,11 @@ void MWWorld::LocalScripts::clear()
 
 void MWWorld::LocalScripts::clearCell (CellStore *cell)
 {
-    std::list<std::pair<std::string, Ptr> >::iterator iter = mScripts.begin();
+    std::list<Script>::iterator iter = mScripts.begin();
 
     while (iter!=mScripts.end())
     {
-        if (iter->second.mCell==cell)
+        if (iter->mPtr.mCell==cell)
         {
             if (iter==mIter)
                ++mIter;
@@ -163,9 +220,9 @@ void MWWorld::LocalScripts::clearCell (CellStore *cell)
 
 void MWWorld::LocalScripts::remove (RefData *ref)
 {
-    for (std::list<std::pair<std::string, Ptr> >::iterator iter = mScripts.begin();
+    for (std::list<Script>::iterator iter = mScripts.begin();
         iter!=mScripts.end(); ++iter)
-        if (&(iter->second.getRefData()) == ref)
+        if (&(iter->mPtr.getRefData()) == ref)
         {
             if (iter==mIter)
                 ++mIter;
@@ -177,9 +234,9 @@ void MWWorld::LocalScripts::remove (RefData *ref)
 
 void MWWorld::LocalScripts::remove (const Ptr& ptr)
 {
-    for (std::list<std::pair<std::string, Ptr> >::iterator iter = mScripts.begin();
+    for (std::list<Script>::iterator iter = mScripts.begin();
         iter!=mScripts.end(); ++iter)
-        if (iter->second==ptr)
+        if (iter->mPtr==ptr)
         {
             if (iter==mIter)
                 ++mIter;
@@ -4,6 +4,9 @@
 #include <list>
 #include <string>
 
+#include <osg/Timer>
+#include <osg/Vec3f>
+
 #include "ptr.hpp"
 
 namespace MWWorld
@@ -13,13 +16,39 @@ namespace MWWorld
     class RefData;
 
     /// \brief List of active local scripts
+    ///
+    /// Scripts of references in the scene that are further than a given distance from the player are only
+    /// run at an interval, and are postponed while the local scripts of the frame exceed their time budget,
+    /// unless they have already waited for the maximum delay.
     class LocalScripts
     {
-            std::list<std::pair<std::string, Ptr> > mScripts;
-            std::list<std::pair<std::string, Ptr> >::iterator mIter;
+            struct Script
+            {
+                std::string mName;
+                Ptr mPtr;
+                float mTimeSinceRun;
+            };
+
+            std::list<Script> mScripts;
+            std::list<Script>::iterator mIter;
             MWWorld::Ptr mIgnore;
             const MWWorld::ESMStore& mStore;
 
+            osg::Vec3f mPlayerPos;
+            osg::Timer_t mStartTick;
+            float mDuration;
+
+            float mDistantDistance;
+            float mDistantInterval;
+            float mMaxDelay;
+            float mBudget;
+
+            unsigned int mNumRun;
+            unsigned int mNumDeferred;
+
+            bool isDeferred (const Script& script) const;
+            ///< Skip \a script in this iteration?
+
         public:
 
             LocalScripts (const MWWorld::ESMStore& store);
@@ -28,14 +57,22 @@ namespace MWWorld
             ///< Mark a single reference for ignoring during iteration over local scripts (will revoke
             /// previous ignores).
 
-            void startIteration();
+            void startIteration (float duration, const osg::Vec3f& playerPos);
             ///< Set the iterator to the begin of the script list.
+            /// \param duration Time passed since the last iteration.
 
-            bool isFinished() const;
-            ///< Is iteration finished?
+            bool isFinished();
+            ///< Is iteration finished? Skips the scripts that are deferred.
 
-            std::pair<std::string, Ptr> getNext();
+            std::pair<std::string, Ptr> getNext (float& secondsPassed);
             ///< Get next local script (must not be called if isFinished())
+            /// \param secondsPassed Set to the time since the script last ran.
+
+            unsigned int getNumRun() const;
+            ///< Number of scripts returned by the last iteration.
+
+            unsigned int getNumDeferred() const;
+            ///< Number of scripts deferred by the last iteration.
 
             void add (const std::string& scriptName, const Ptr& ptr);
             ///< Add script to collection of active local scripts.
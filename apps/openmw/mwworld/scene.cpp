@@ -3,6 +3,8 @@
 #include <limits>
 #include <iostream>
 
+#include <osg/Timer>
+
 #include <components/loadinglistener/loadinglistener.hpp>
 #include <components/misc/resourcehelpers.hpp>
 #include <components/settings/settings.hpp>
@@ -24,10 +26,27 @@
 #include "class.hpp"
 #include "cellfunctors.hpp"
 #include "cellstore.hpp"
+#include "cellpreloader.hpp"
 
 namespace
 {
 
+    /// Distance from the center of the cell grid at which the grid is moved. 1/2 cell size + threshold.
+    const float sMaxGridDistance = 8192/2 + 1024;
+
+    struct ListTeleportDoorsFunctor
+    {
+        std::vector<MWWorld::Ptr> mDoors;
+
+        bool operator() (const MWWorld::Ptr& ptr)
+        {
+            if (ptr.getTypeName() == typeid(ESM::Door).name() && ptr.getCellRef().getTeleport()
+                    && !ptr.getRefData().isDeleted() && ptr.getRefData().isEnabled())
+                mDoors.push_back(ptr);
+            return true;
+        }
+    };
+
     void addObject(const MWWorld::Ptr& ptr, MWPhysics::PhysicsSystem& physics,
                    MWRender::RenderingManager& rendering)
     {
@@ -190,6 +209,19 @@ namespace MWWorld
             }
         }
 
+        if (mPreloadEnabled)
+        {
+            mPreloadTimer += duration;
+            // No need to check every frame
+            if (mPreloadTimer > 0.1f)
+            {
+                preloadCells(mPreloadTimer);
+                mPreloadTimer = 0.f;
+            }
+
+            mPreloader->updateCache(osg::Timer::instance()->time_s());
+        }
+
         mRendering.update (duration, paused);
     }
 
@@ -263,6 +295,8 @@ namespace MWWorld
             /// \todo rescale depending on the state of a new GMST
             insertCell (*cell, true, loadingListener);
 
+            MWBase::Environment::get().getSoundManager()->preloadSounds(cell);
+
             mRendering.addCell(cell);
             bool waterEnabled = cell->getCell()->hasWater() || cell->isExterior();
             float waterLevel = cell->isExterior() ? -1.f : cell->getWaterLevel();
@@ -291,6 +325,10 @@ namespace MWWorld
             unloadCell (active++);
         assert(mActiveCells.empty());
         mCurrentCell = NULL;
+
+        // The CellStores may be about to go away
+        if (mPreloader.get())
+            mPreloader->clear();
     }
 
     void Scene::playerMoved(const osg::Vec3f &pos)
@@ -303,9 +341,8 @@ namespace MWWorld
         getGridCenter(cellX, cellY);
         float centerX, centerY;
         MWBase::Environment::get().getWorld()->indexToPosition(cellX, cellY, centerX, centerY, true);
-        const float maxDistance = 8192/2 + 1024; // 1/2 cell size + threshold
         float distance = std::max(std::abs(centerX-pos.x()), std::abs(centerY-pos.y()));
-        if (distance > maxDistance)
+        if (distance > sMaxGridDistance)
         {
             int newX, newY;
             MWBase::Environment::get().getWorld()->positionToIndex(pos.x(), pos.y(), newX, newY);
@@ -436,9 +473,23 @@ namespace MWWorld
         MWBase::Environment::get().getWorld()->adjustSky();
     }
 
-    Scene::Scene (MWRender::RenderingManager& rendering, MWPhysics::PhysicsSystem *physics)
+    Scene::Scene (MWRender::RenderingManager& rendering, MWPhysics::PhysicsSystem *physics, SceneUtil::WorkQueue* workQueue)
     : mCurrentCell (0), mCellChanged (false), mPhysics(physics), mRendering(rendering), mNeedMapUpdate(false)
+    , mPreloadTimer(0.f)
     {
+        mPreloadEnabled = Settings::Manager::getBool("preload enabled", "Cells");
+        mPreloadExteriorGrid = Settings::Manager::getBool("preload exterior grid", "Cells");
+        mPreloadDoors = Settings::Manager::getBool("preload doors", "Cells");
+        mPreloadDistance = Settings::Manager::getFloat("preload distance", "Cells");
+        mPredictionTime = Settings::Manager::getFloat("preload prediction time", "Cells");
+
+        if (mPreloadEnabled)
+        {
+            mPreloader.reset(new CellPreloader(rendering.getResourceSystem(), physics->getShapeManager(), rendering.getTerrain(),
+                                               workQueue));
+            mPreloader->setExpiryDelay(Settings::Manager::getFloat("preload cell expiry delay", "Cells"));
+            mPreloader->setMemoryBudget(static_cast<size_t>(Settings::Manager::getInt("preload memory budget", "Cells")) * 1024 * 1024);
+        }
     }
 
     Scene::~Scene()
@@ -587,6 +638,114 @@ namespace MWWorld
         return false;
     }
 
+    void Scene::preloadCells(float dt)
+    {
+        MWWorld::Ptr player = MWBase::Environment::get().getWorld()->getPlayerPtr();
+        if (!mCurrentCell || player.isEmpty())
+            return;
+
+        osg::Vec3f playerPos = player.getRefData().getPosition().asVec3();
+        osg::Vec3f moved = playerPos - mLastPlayerPos;
+        mLastPlayerPos = playerPos;
+
+        // Moving further than a cell is a teleport, not something to extrapolate from
+        osg::Vec3f predictedPos = playerPos;
+        if (moved.length2() < 8192.f*8192.f)
+            predictedPos += moved / dt * mPredictionTime;
+
+        if (mCurrentCell->isExterior() && mPreloadExteriorGrid)
+            preloadExteriorGrid(playerPos, predictedPos);
+
+        if (mPreloadDoors)
+            preloadTeleportDoorDestinations(playerPos, predictedPos);
+    }
+
+    void Scene::preloadTeleportDoorDestinations(const osg::Vec3f &playerPos, const osg::Vec3f &predictedPos)
+    {
+        MWBase::World* world = MWBase::Environment::get().getWorld();
+
+        for (CellStoreCollection::const_iterator iter (mActiveCells.begin()); iter!=mActiveCells.end(); ++iter)
+        {
+            ListTeleportDoorsFunctor functor;
+            (*iter)->forEachConst(functor);
+
+            for (std::vector<MWWorld::Ptr>::const_iterator it = functor.mDoors.begin(); it != functor.mDoors.end(); ++it)
+            {
+                osg::Vec3f doorPos = it->getRefData().getPosition().asVec3();
+                if ((doorPos - playerPos).length2() > mPreloadDistance * mPreloadDistance
+                        && (doorPos - predictedPos).length2() > mPreloadDistance * mPreloadDistance)
+                    continue;
+
+                try
+                {
+                    if (it->getCellRef().getDestCell().empty())
+                    {
+                        ESM::Position dest = it->getCellRef().getDoorDest();
+                        int cellX, cellY;
+                        world->positionToIndex(dest.pos[0], dest.pos[1], cellX, cellY);
+                        preloadCellGrid(cellX, cellY);
+                    }
+                    else
+                        preloadCell(world->getInterior(it->getCellRef().getDestCell()));
+                }
+                catch (std::exception&)
+                {
+                    // ignore error for now, would spam the log too much
+                    // the error will be reported when the door is actually used
+                }
+            }
+        }
+    }
+
+    void Scene::preloadExteriorGrid(const osg::Vec3f &playerPos, const osg::Vec3f &predictedPos)
+    {
+        if (mActiveCells.empty())
+            return;
+
+        int cellX, cellY;
+        getGridCenter(cellX, cellY);
+        float centerX, centerY;
+        MWBase::Environment::get().getWorld()->indexToPosition(cellX, cellY, centerX, centerY, true);
+
+        // Once the player is closer than the preload distance to the point where the grid is moved (see playerMoved),
+        // preload the grid it will be moved to
+        const float threshold = sMaxGridDistance - mPreloadDistance;
+        const osg::Vec3f positions[2] = { playerPos, predictedPos };
+        for (int i=0; i<2; ++i)
+        {
+            float dx = positions[i].x() - centerX;
+            float dy = positions[i].y() - centerY;
+            int newX = cellX;
+            int newY = cellY;
+            if (std::abs(dx) > threshold)
+                newX += (dx > 0) ? 1 : -1;
+            if (std::abs(dy) > threshold)
+                newY += (dy > 0) ? 1 : -1;
+
+            if (newX != cellX || newY != cellY)
+                preloadCellGrid(newX, newY);
+        }
+    }
+
+    void Scene::preloadCellGrid(int cellX, int cellY)
+    {
+        const int halfGridSize = Settings::Manager::getInt("exterior cell load distance", "Cells");
+        for (int x=cellX-halfGridSize; x<=cellX+halfGridSize; ++x)
+        {
+            for (int y=cellY-halfGridSize; y<=cellY+halfGridSize; ++y)
+                preloadCell(MWBase::Environment::get().getWorld()->getExterior(x, y));
+        }
+    }
+
+    void Scene::preloadCell(CellStore *cell)
+    {
+        // Resources of active cells are already in use, nothing to gain
+        if (mActiveCells.find(cell) != mActiveCells.end())
+            return;
+
+        mPreloader->preload(cell, osg::Timer::instance()->time_s());
+    }
+
     Ptr Scene::searchPtrViaActorId (int actorId)
     {
         for (CellStoreCollection::const_iterator iter (mActiveCells.begin());
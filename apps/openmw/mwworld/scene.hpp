@@ -3,15 +3,13 @@
 
 //#include "../mwrender/renderingmanager.hpp"
 
+#include <osg/Vec3f>
+
 #include "ptr.hpp"
 #include "globals.hpp"
 
 #include <set>
-
-namespace osg
-{
-    class Vec3f;
-}
+#include <memory>
 
 namespace ESM
 {
@@ -39,10 +37,16 @@ namespace MWPhysics
     class PhysicsSystem;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 namespace MWWorld
 {
     class Player;
     class CellStore;
+    class CellPreloader;
 
     class Scene
     {
@@ -60,8 +64,24 @@ namespace MWWorld
 
             bool mNeedMapUpdate;
 
+            std::auto_ptr<CellPreloader> mPreloader;
+            float mPreloadTimer;
+            bool mPreloadEnabled;
+            bool mPreloadExteriorGrid;
+            bool mPreloadDoors;
+            float mPreloadDistance;
+            float mPredictionTime;
+            osg::Vec3f mLastPlayerPos;
+
             void insertCell (CellStore &cell, bool rescale, Loading::Listener* loadingListener);
 
+            /// Preload the cells the player is likely to enter next, based on the player's position and velocity.
+            void preloadCells(float dt);
+            void preloadTeleportDoorDestinations(const osg::Vec3f& playerPos, const osg::Vec3f& predictedPos);
+            void preloadExteriorGrid(const osg::Vec3f& playerPos, const osg::Vec3f& predictedPos);
+            void preloadCellGrid(int cellX, int cellY);
+            void preloadCell(CellStore* cell);
+
             // Load and unload cells as necessary to create a cell grid with "X" and "Y" in the center
             void changeCellGrid (int X, int Y);
 
@@ -69,7 +89,8 @@ namespace MWWorld
 
         public:
 
-            Scene (MWRender::RenderingManager& rendering, MWPhysics::PhysicsSystem *physics);
+            /// @param workQueue Shared with the rest of the engine, used to preload cells.
+            Scene (MWRender::RenderingManager& rendering, MWPhysics::PhysicsSystem *physics, SceneUtil::WorkQueue* workQueue);
 
             ~Scene();
 
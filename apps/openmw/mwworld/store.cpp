@@ -190,6 +190,32 @@ namespace MWWorld
         inserted.first->second.load(esm);
     }
     template<typename T>
+    bool Store<T>::isStageable() const
+    {
+        return true;
+    }
+    template<typename T>
+    StagedRecord *Store<T>::decode(ESM::ESMReader &esm, const std::string &id) const
+    {
+        TypedStagedRecord<T>* staged = new TypedStagedRecord<T>;
+        staged->mRecord.mId = Misc::StringUtils::lowerCase(id);
+        staged->mRecord.load(esm);
+        return staged;
+    }
+    template<typename T>
+    bool Store<T>::merge(const StagedRecord &record)
+    {
+        const T& item = static_cast<const TypedStagedRecord<T>&>(record).mRecord;
+
+        // Do not replace an existing record, see load
+        std::pair<typename Static::iterator, bool> inserted = mStatic.insert(std::make_pair(item.mId, item));
+        if (!inserted.second)
+            return false;
+
+        mShared.push_back(&inserted.first->second);
+        return true;
+    }
+    template<typename T>
     void Store<T>::setUp()
     {
     }
@@ -1025,6 +1051,13 @@ namespace MWWorld
         it->second.load(esm);
     }
 
+    template <>
+    inline bool Store<ESM::Dialogue>::isStageable() const
+    {
+        // Dialogues are loaded on top of the existing record, to keep the infos of previous content files
+        return false;
+    }
+
 
     // Script
     //=========================================================================
@@ -1042,6 +1075,15 @@ namespace MWWorld
             inserted.first->second = scpt;
     }
 
+    template <>
+    inline StagedRecord *Store<ESM::Script>::decode(ESM::ESMReader &esm, const std::string &id) const
+    {
+        TypedStagedRecord<ESM::Script>* staged = new TypedStagedRecord<ESM::Script>;
+        staged->mRecord.load(esm);
+        Misc::StringUtils::toLower(staged->mRecord.mId);
+        return staged;
+    }
+
 
     // StartScript
     //=========================================================================
@@ -1058,6 +1100,15 @@ namespace MWWorld
         else
             inserted.first->second = s;
     }
+
+    template <>
+    inline StagedRecord *Store<ESM::StartScript>::decode(ESM::ESMReader &esm, const std::string &id) const
+    {
+        TypedStagedRecord<ESM::StartScript>* staged = new TypedStagedRecord<ESM::StartScript>;
+        staged->mRecord.load(esm);
+        Misc::StringUtils::toLower(staged->mRecord.mId);
+        return staged;
+    }
 }
 
 template class MWWorld::Store<ESM::Activator>;
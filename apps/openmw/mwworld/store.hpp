@@ -19,6 +19,18 @@ namespace Loading
 
 namespace MWWorld
 {
+    /// A record decoded by StoreBase::decode, waiting to be merged into its store.
+    struct StagedRecord
+    {
+        virtual ~StagedRecord() {}
+    };
+
+    template <class T>
+    struct TypedStagedRecord : public StagedRecord
+    {
+        T mRecord;
+    };
+
     struct StoreBase
     {
         virtual ~StoreBase() {}
@@ -30,6 +42,18 @@ namespace MWWorld
         virtual int getDynamicSize() const { return 0; }
         virtual void load(ESM::ESMReader &esm, const std::string &id) = 0;
 
+        /// Can records of this store be decoded with decode() and added later with merge(), instead of using load()?
+        virtual bool isStageable() const { return false; }
+
+        /// Decode the current record without changing the store, so that several content files can be decoded at once.
+        /// @note Only supported if isStageable(). Thread safe.
+        virtual StagedRecord* decode(ESM::ESMReader &esm, const std::string &id) const { return NULL; }
+
+        /// Add a record returned by decode(), with the same effect load() would have had.
+        /// @return false if a record with the same id exists already. Records are loaded on top of the existing
+        /// record, keeping the fields they leave out, so the caller has to load it with load() instead.
+        virtual bool merge(const StagedRecord& record) { return false; }
+
         virtual bool eraseStatic(const std::string &id) {return false;}
         virtual void clearDynamic() {}
 
@@ -183,6 +207,10 @@ namespace MWWorld
         void load(ESM::ESMReader &esm, const std::string &id);
         void write(ESM::ESMWriter& writer, Loading::Listener& progress) const;
         void read(ESM::ESMReader& reader, const std::string& id);
+
+        virtual bool isStageable() const;
+        virtual StagedRecord* decode(ESM::ESMReader &esm, const std::string &id) const;
+        virtual bool merge(const StagedRecord& record);
     };
 
     template <>
@@ -8,6 +8,8 @@
 #include <tr1/unordered_map>
 #endif
 
+#include <set>
+
 #include <osg/Group>
 #include <osg/ComputeBoundsVisitor>
 #include <osg/PositionAttitudeTransform>
@@ -107,6 +109,17 @@ namespace MWWorld
             }
         }
 
+        void finish()
+        {
+            // Several extensions may share a loader, finish each one only once
+            std::set<ContentLoader*> finished;
+            for (LoadersContainer::iterator it = mLoaders.begin(); it != mLoaders.end(); ++it)
+            {
+                if (finished.insert(it->second).second)
+                    it->second->finish();
+            }
+        }
+
         private:
           typedef std::tr1::unordered_map<std::string, ContentLoader*> LoadersContainer;
           LoadersContainer mLoaders;
@@ -153,7 +166,8 @@ namespace MWWorld
         const Files::Collections& fileCollections,
         const std::vector<std::string>& contentFiles,
         ToUTF8::Utf8Encoder* encoder, const std::map<std::string,std::string>& fallbackMap,
-        int activationDistanceOverride, const std::string& startCell, const std::string& startupScript)
+        int activationDistanceOverride, const std::string& startCell, const std::string& startupScript,
+        SceneUtil::WorkQueue* workQueue)
     : mResourceSystem(resourceSystem), mFallback(fallbackMap), mPlayer (0), mLocalScripts (mStore),
       mSky (true), mCells (mStore, mEsm),
       mGodMode(false), mScriptsEnabled(true), mContentFiles (contentFiles),
@@ -161,16 +175,16 @@ namespace MWWorld
       mStartCell (startCell), mTeleportEnabled(true),
       mLevitationEnabled(true), mGoToJail(false), mDaysInPrison(0)
     {
-        mPhysics = new MWPhysics::PhysicsSystem(resourceSystem, rootNode);
+        mPhysics = new MWPhysics::PhysicsSystem(resourceSystem, rootNode, workQueue);
         mProjectileManager.reset(new ProjectileManager(rootNode, resourceSystem, mPhysics));
-        mRendering = new MWRender::RenderingManager(viewer, rootNode, resourceSystem, &mFallback);
+        mRendering = new MWRender::RenderingManager(viewer, rootNode, resourceSystem, &mFallback, workQueue);
 
         mEsm.resize(contentFiles.size());
         Loading::Listener* listener = MWBase::Environment::get().getWindowManager()->getLoadingScreen();
         listener->loadingOn();
 
         GameContentLoader gameContentLoader(*listener);
-        EsmLoader esmLoader(mStore, mEsm, encoder, *listener);
+        EsmLoader esmLoader(mStore, mEsm, encoder, *listener, workQueue);
 
         gameContentLoader.addLoader(".esm", &esmLoader);
         gameContentLoader.addLoader(".esp", &esmLoader);
@@ -195,7 +209,7 @@ namespace MWWorld
 
         mWeatherManager = new MWWorld::WeatherManager(*mRendering, mFallback, mStore);
 
-        mWorldScene = new Scene(*mRendering, mPhysics);
+        mWorldScene = new Scene(*mRendering, mPhysics, workQueue);
     }
 
     void World::startNewGame (bool bypass)
@@ -1359,7 +1373,23 @@ namespace MWWorld
 
         mProjectileManager->update(duration);
 
-        const MWPhysics::PtrVelocityList &results = mPhysics->applyQueuedMovement(duration);
+        // With async simulation, the movement was already applied by finishPhysics
+        if (!mPhysics->isSimulationAsync())
+            moveActors(mPhysics->applyQueuedMovement(duration));
+
+        const MWPhysics::PtrVelocityList &positions = mPhysics->getInterpolatedPositions();
+        for(MWPhysics::PtrVelocityList::const_iterator iter(positions.begin());iter != positions.end();++iter)
+        {
+            osg::PositionAttitudeTransform* node = iter->first.getRefData().getBaseNode();
+            if (node && node->getPosition() != iter->second)
+                mRendering->moveObject(iter->first, iter->second);
+        }
+
+        mPhysics->debugDraw();
+    }
+
+    void World::moveActors(const MWPhysics::PtrVelocityList& results)
+    {
         MWPhysics::PtrVelocityList::const_iterator player(results.end());
         for(MWPhysics::PtrVelocityList::const_iterator iter(results.begin());iter != results.end();++iter)
         {
@@ -1373,8 +1403,17 @@ namespace MWWorld
         }
         if(player != results.end())
             moveObjectImp(player->first, player->second.x(), player->second.y(), player->second.z());
+    }
 
-        mPhysics->debugDraw();
+    void World::finishPhysics()
+    {
+        moveActors(mPhysics->finishQueuedMovement());
+    }
+
+    void World::reportStats(unsigned int frameNumber, osg::Stats& stats) const
+    {
+        mPhysics->reportStats(frameNumber, stats);
+        mRendering->reportStats(frameNumber, stats);
     }
 
     bool World::castRay (float x1, float y1, float z1, float x2, float y2, float z2)
@@ -1547,6 +1586,10 @@ namespace MWWorld
         updateSoundListener();
 
         updatePlayer(paused);
+
+        // Simulate while the frame is rendered. Nothing else uses the world until finishPhysics is called.
+        if (!paused && mPhysics->isSimulationAsync())
+            mPhysics->startQueuedMovement(duration);
     }
 
     void World::updatePlayer(bool paused)
@@ -2285,6 +2328,31 @@ namespace MWWorld
         return mPhysics->getLineOfSight(actor, targetActor);
     }
 
+    void World::getLOS(const std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& actors, std::vector<bool>& out)
+    {
+        std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> > check;
+        std::vector<size_t> checkIndices;
+        for (size_t i=0; i<actors.size(); ++i)
+        {
+            const MWWorld::Ptr& actor = actors[i].first;
+            const MWWorld::Ptr& targetActor = actors[i].second;
+            if (!targetActor.getRefData().isEnabled() || !actor.getRefData().isEnabled())
+                continue; // cannot get LOS unless both NPC's are enabled
+            if (!targetActor.getRefData().getBaseNode() || !actor.getRefData().getBaseNode())
+                continue; // not in active cell
+
+            check.push_back(actors[i]);
+            checkIndices.push_back(i);
+        }
+
+        std::vector<bool> results;
+        mPhysics->getLinesOfSight(check, results);
+
+        out.assign(actors.size(), false);
+        for (size_t i=0; i<results.size(); ++i)
+            out[checkIndices[i]] = results[i];
+    }
+
     float World::getDistToNearestRayHit(const osg::Vec3f& from, const osg::Vec3f& dir, float maxDist)
     {
         osg::Vec3f to (dir);
@@ -2555,6 +2623,8 @@ namespace MWWorld
                 throw std::runtime_error(msg.str());
             }
         }
+
+        contentLoader.finish();
     }
 
     bool World::startSpellCast(const Ptr &actor)
@@ -57,6 +57,11 @@ namespace ToUTF8
     class Utf8Encoder;
 }
 
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
 struct ContentLoader;
 
 namespace MWWorld
@@ -133,6 +138,9 @@ namespace MWWorld
             void doPhysics(float duration);
             ///< Run physics simulation and modify \a world accordingly.
 
+            void moveActors(const MWPhysics::PtrVelocityList& results);
+            ///< Move the actors to the positions the physics simulation came up with.
+
             void ensureNeededRecords();
 
             /**
@@ -167,7 +175,8 @@ namespace MWWorld
                 const Files::Collections& fileCollections,
                 const std::vector<std::string>& contentFiles,
                 ToUTF8::Utf8Encoder* encoder, const std::map<std::string,std::string>& fallbackMap,
-                int activationDistanceOverride, const std::string& startCell, const std::string& startupScript);
+                int activationDistanceOverride, const std::string& startCell, const std::string& startupScript,
+                SceneUtil::WorkQueue* workQueue);
 
             virtual ~World();
 
@@ -434,6 +443,12 @@ namespace MWWorld
 
             virtual void update (float duration, bool paused);
 
+            virtual void finishPhysics();
+            ///< Wait for the physics simulation started by the last update to finish, and move the actors accordingly.
+            /// Must be called before anything else in the frame uses the world.
+
+            virtual void reportStats (unsigned int frameNumber, osg::Stats& stats) const;
+
             virtual MWWorld::Ptr placeObject (const MWWorld::Ptr& object, float cursorX, float cursorY, int amount);
             ///< copy and place an object into the gameworld at the specified cursor position
             /// @param object
@@ -510,6 +525,9 @@ namespace MWWorld
             virtual bool getLOS(const MWWorld::Ptr& actor,const MWWorld::Ptr& targetActor);
             ///< get Line of Sight (morrowind stupid implementation)
 
+            virtual void getLOS(const std::vector<std::pair<MWWorld::Ptr, MWWorld::Ptr> >& actors, std::vector<bool>& out);
+            ///< get Line of Sight for many pairs of actors at once, which is faster than one at a time
+
             virtual float getDistToNearestRayHit(const osg::Vec3f& from, const osg::Vec3f& dir, float maxDist);
 
             virtual void enableActorCollision(const MWWorld::Ptr& actor, bool enable);
@@ -0,0 +1,599 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "components/compiler/context.hpp"
+#include "components/compiler/extensions.hpp"
+#include "components/compiler/extensions0.hpp"
+#include "components/compiler/fileparser.hpp"
+#include "components/compiler/locals.hpp"
+#include "components/compiler/optimizer.hpp"
+#include "components/compiler/scanner.hpp"
+#include "components/compiler/streamerrorhandler.hpp"
+#include "components/esm/esmreader.hpp"
+#include "components/esm/loadglob.hpp"
+#include "components/esm/loadscpt.hpp"
+#include "components/interpreter/context.hpp"
+#include "components/interpreter/installopcodes.hpp"
+#include "components/interpreter/interpreter.hpp"
+#include "components/interpreter/opcodes.hpp"
+#include "components/interpreter/runtime.hpp"
+#include "components/misc/stringops.hpp"
+
+namespace
+{
+    /// Scripts that run longer than this many context calls are considered stuck in a loop.
+    const int sMaxCalls = 100000;
+
+    /// Frames each script is run for, keeping its locals in between.
+    const int sNumFrames = 4;
+
+    std::string toString(float value)
+    {
+        std::ostringstream stream;
+        stream << std::setprecision(9) << value;
+        return stream.str();
+    }
+
+    /// Globals and IDs the scripts may use.
+    struct Environment
+    {
+        std::map<std::string, char> mGlobals;
+        std::set<std::string> mIds;
+        Compiler::Extensions mExtensions;
+
+        Environment()
+        {
+            Compiler::registerExtensions(mExtensions);
+        }
+    };
+
+    class TestCompilerContext : public Compiler::Context
+    {
+    public:
+        TestCompilerContext(const Environment& environment)
+            : mEnvironment(environment)
+        {
+            setExtensions(&environment.mExtensions);
+        }
+
+        virtual bool canDeclareLocals() const { return true; }
+
+        virtual char getGlobalType (const std::string& name) const
+        {
+            std::map<std::string, char>::const_iterator found = mEnvironment.mGlobals.find(Misc::StringUtils::lowerCase(name));
+            return found != mEnvironment.mGlobals.end() ? found->second : ' ';
+        }
+
+        virtual std::pair<char, bool> getMemberType (const std::string& name, const std::string& id) const
+        {
+            return std::make_pair(' ', false);
+        }
+
+        virtual bool isId (const std::string& name) const
+        {
+            return mEnvironment.mIds.count(Misc::StringUtils::lowerCase(name)) != 0;
+        }
+
+        virtual bool isJournalId (const std::string& name) const { return false; }
+
+    private:
+        const Environment& mEnvironment;
+    };
+
+    /// Records everything a script does to the outside world, and answers its queries with values that change from
+    /// call to call, so that both branches of conditions get exercised.
+    class RecordingContext : public Interpreter::Context
+    {
+    public:
+        RecordingContext(const Compiler::Locals& locals, const Environment& environment)
+            : mShorts(locals.get('s').size(), 0)
+            , mLongs(locals.get('l').size(), 0)
+            , mFloats(locals.get('f').size(), 0.f)
+            , mEnvironment(environment)
+            , mCalls(0)
+        {
+        }
+
+        void record(const std::string& event) const
+        {
+            if (++mCalls > sMaxCalls)
+                throw std::runtime_error("script is stuck in a loop");
+            mTrace.push_back(event);
+        }
+
+        int nextInt() const
+        {
+            record("query");
+            return mCalls % 3;
+        }
+
+        float nextFloat() const
+        {
+            record("query");
+            return (mCalls % 5) * 0.75f;
+        }
+
+        virtual int getLocalShort (int index) const { record("getLocalShort"); return mShorts.at(index); }
+        virtual int getLocalLong (int index) const { record("getLocalLong"); return mLongs.at(index); }
+        virtual float getLocalFloat (int index) const { record("getLocalFloat"); return mFloats.at(index); }
+        virtual void setLocalShort (int index, int value) { record("setLocalShort"); mShorts.at(index) = value; }
+        virtual void setLocalLong (int index, int value) { record("setLocalLong"); mLongs.at(index) = value; }
+        virtual void setLocalFloat (int index, float value) { record("setLocalFloat"); mFloats.at(index) = value; }
+
+        virtual void messageBox (const std::string& message, const std::vector<std::string>& buttons)
+        {
+            std::string event = "messageBox " + message;
+            for (std::vector<std::string>::const_iterator it = buttons.begin(); it != buttons.end(); ++it)
+                event += " [" + *it + "]";
+            record(event);
+        }
+
+        virtual void report (const std::string& message) { record("report " + message); }
+        virtual bool menuMode() { return nextInt() == 0; }
+
+        virtual int getGlobalShort (const std::string& name) const { record("getGlobal " + name); return mGlobalInts[name]; }
+        virtual int getGlobalLong (const std::string& name) const { record("getGlobal " + name); return mGlobalInts[name]; }
+        virtual float getGlobalFloat (const std::string& name) const { record("getGlobal " + name); return mGlobalFloats[name]; }
+
+        virtual void setGlobalShort (const std::string& name, int value)
+        {
+            record("setGlobal " + name + " " + toString(static_cast<float>(value)));
+            mGlobalInts[name] = value;
+        }
+
+        virtual void setGlobalLong (const std::string& name, int value)
+        {
+            record("setGlobal " + name + " " + toString(static_cast<float>(value)));
+            mGlobalInts[name] = value;
+        }
+
+        virtual void setGlobalFloat (const std::string& name, float value)
+        {
+            record("setGlobal " + name + " " + toString(value));
+            mGlobalFloats[name] = value;
+        }
+
+        virtual std::vector<std::string> getGlobals () const
+        {
+            std::vector<std::string> globals;
+            for (std::map<std::string, char>::const_iterator it = mEnvironment.mGlobals.begin(); it != mEnvironment.mGlobals.end(); ++it)
+                globals.push_back(it->first);
+            return globals;
+        }
+
+        virtual char getGlobalType (const std::string& name) const
+        {
+            std::map<std::string, char>::const_iterator found = mEnvironment.mGlobals.find(Misc::StringUtils::lowerCase(name));
+            return found != mEnvironment.mGlobals.end() ? found->second : ' ';
+        }
+
+        virtual std::string getActionBinding(const std::string& action) const { record("getActionBinding " + action); return "key"; }
+        virtual std::string getNPCName() const { record("getNPCName"); return "npc"; }
+        virtual std::string getNPCRace() const { record("getNPCRace"); return "race"; }
+        virtual std::string getNPCClass() const { record("getNPCClass"); return "class"; }
+        virtual std::string getNPCFaction() const { record("getNPCFaction"); return "faction"; }
+        virtual std::string getNPCRank() const { record("getNPCRank"); return "rank"; }
+        virtual std::string getPCName() const { record("getPCName"); return "pc"; }
+        virtual std::string getPCRace() const { record("getPCRace"); return "race"; }
+        virtual std::string getPCClass() const { record("getPCClass"); return "class"; }
+        virtual std::string getPCRank() const { record("getPCRank"); return "rank"; }
+        virtual std::string getPCNextRank() const { record("getPCNextRank"); return "rank"; }
+        virtual int getPCBounty() const { return nextInt(); }
+        virtual std::string getCurrentCellName() const { record("getCurrentCellName"); return "cell"; }
+        virtual bool isScriptRunning (const std::string& name) const { record("isScriptRunning " + name); return mCalls % 2 != 0; }
+        virtual void startScript (const std::string& name, const std::string& targetId) { record("startScript " + name + " " + targetId); }
+        virtual void stopScript (const std::string& name) { record("stopScript " + name); }
+        virtual float getDistance (const std::string& name, const std::string& id) const { record("getDistance " + name + " " + id); return nextFloat() * 1000; }
+        virtual float getSecondsPassed() const { record("getSecondsPassed"); return 0.016f; }
+        virtual bool isDisabled (const std::string& id) const { record("isDisabled " + id); return nextInt() == 1; }
+        virtual void enable (const std::string& id) { record("enable " + id); }
+        virtual void disable (const std::string& id) { record("disable " + id); }
+        virtual int getMemberShort (const std::string& id, const std::string& name, bool global) const { record("getMember " + id + "." + name); return nextInt(); }
+        virtual int getMemberLong (const std::string& id, const std::string& name, bool global) const { record("getMember " + id + "." + name); return nextInt(); }
+        virtual float getMemberFloat (const std::string& id, const std::string& name, bool global) const { record("getMember " + id + "." + name); return nextFloat(); }
+        virtual void setMemberShort (const std::string& id, const std::string& name, int value, bool global) { record("setMember " + id + "." + name + " " + toString(static_cast<float>(value))); }
+        virtual void setMemberLong (const std::string& id, const std::string& name, int value, bool global) { record("setMember " + id + "." + name + " " + toString(static_cast<float>(value))); }
+        virtual void setMemberFloat (const std::string& id, const std::string& name, float value, bool global) { record("setMember " + id + "." + name + " " + toString(value)); }
+        virtual std::string getTargetId() const { record("getTargetId"); return "target"; }
+
+        std::vector<int> mShorts;
+        std::vector<int> mLongs;
+        std::vector<float> mFloats;
+
+        mutable std::vector<std::string> mTrace;
+
+    private:
+        const Environment& mEnvironment;
+        mutable std::map<std::string, int> mGlobalInts;
+        mutable std::map<std::string, float> mGlobalFloats;
+        mutable int mCalls;
+    };
+
+    /// Stands in for the extension opcodes implemented by the game: pops the arguments the compiler pushed, records
+    /// them, and pushes a result for functions.
+    class StubOpcode : public Interpreter::Opcode0, public Interpreter::Opcode1
+    {
+    public:
+        StubOpcode(const Compiler::Extensions::Opcode& opcode)
+            : mOpcode(opcode)
+            , mRequired(opcode.mExplicit ? 1 : 0)
+        {
+            for (std::string::const_iterator it = opcode.mArguments.begin(); it != opcode.mArguments.end() && *it != '/'; ++it)
+            {
+                if (*it != 'x' && *it != 'X' && *it != 'z' && *it != 'j')
+                    ++mRequired;
+            }
+        }
+
+        virtual void execute (Interpreter::Runtime& runtime)
+        {
+            execute(runtime, 0);
+        }
+
+        virtual void execute (Interpreter::Runtime& runtime, unsigned int optional)
+        {
+            const RecordingContext& context = static_cast<const RecordingContext&>(runtime.getContext());
+
+            std::ostringstream event;
+            event << "opcode " << std::hex << mOpcode.mCode << std::dec;
+            for (unsigned int i=0; i<mRequired+optional; ++i)
+            {
+                event << ' ' << runtime[0].mInteger;
+                runtime.pop();
+            }
+            context.record(event.str());
+
+            if (mOpcode.mReturn == 'f')
+                runtime.push(context.nextFloat());
+            else if (mOpcode.mReturn != 0)
+                runtime.push(static_cast<Interpreter::Type_Integer>(context.nextInt()));
+        }
+
+    private:
+        Compiler::Extensions::Opcode mOpcode;
+        unsigned int mRequired;
+    };
+
+    void installStubOpcodes(Interpreter::Interpreter& interpreter, const Compiler::Extensions& extensions)
+    {
+        std::vector<Compiler::Extensions::Opcode> opcodes;
+        extensions.listOpcodes(opcodes);
+
+        std::set<int> installed;
+        for (std::vector<Compiler::Extensions::Opcode>::const_iterator it = opcodes.begin(); it != opcodes.end(); ++it)
+        {
+            if (!installed.insert(it->mCode).second)
+                continue;
+
+            if (it->mSegment == 3)
+                interpreter.installSegment3(it->mCode, new StubOpcode(*it));
+            else
+                interpreter.installSegment5(it->mCode, new StubOpcode(*it));
+        }
+    }
+
+    struct CompiledScript
+    {
+        std::string mName;
+        std::vector<Interpreter::Type_Code> mCode;
+        Compiler::Locals mLocals;
+    };
+
+    bool compile(const std::string& name, const std::string& text, const Environment& environment, CompiledScript& script)
+    {
+        TestCompilerContext context(environment);
+        std::ostringstream errors;
+        Compiler::StreamErrorHandler errorHandler(errors);
+        Compiler::FileParser parser(errorHandler, context);
+
+        try
+        {
+            std::istringstream input(text);
+            Compiler::Scanner scanner(errorHandler, input, &environment.mExtensions);
+            scanner.scan(parser);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        if (!errorHandler.isGood())
+            return false;
+
+        script.mName = name;
+        parser.getCode(script.mCode);
+        script.mLocals = parser.getLocals();
+        return true;
+    }
+
+    /// Observable behaviour of a script over several frames.
+    struct Result
+    {
+        std::vector<std::string> mTrace;
+        std::vector<int> mShorts;
+        std::vector<int> mLongs;
+        std::vector<float> mFloats;
+        std::string mError;
+        unsigned long long mInstructions;
+    };
+
+    void run(const CompiledScript& script, const Environment& environment, Result& result)
+    {
+        Interpreter::Interpreter interpreter;
+        Interpreter::installOpcodes(interpreter);
+        installStubOpcodes(interpreter, environment.mExtensions);
+
+        RecordingContext context(script.mLocals, environment);
+
+        // for the Random instruction
+        std::srand(0);
+
+        try
+        {
+            for (int frame=0; frame<sNumFrames; ++frame)
+                interpreter.run(&script.mCode[0], script.mCode.size(), context);
+        }
+        catch (const std::exception& e)
+        {
+            result.mError = e.what();
+        }
+
+        result.mTrace.swap(context.mTrace);
+        result.mShorts = context.mShorts;
+        result.mLongs = context.mLongs;
+        result.mFloats = context.mFloats;
+        result.mInstructions = interpreter.getInstructionCount();
+    }
+
+    /// Run \a script with and without optimization, expect the same behaviour, and add the instructions executed
+    /// to \a instructions and \a optimizedInstructions.
+    void expectSameBehaviour(const CompiledScript& script, const Environment& environment,
+                             unsigned long long& instructions, unsigned long long& optimizedInstructions)
+    {
+        CompiledScript optimized = script;
+        Compiler::optimize(optimized.mCode);
+
+        Result expected;
+        run(script, environment, expected);
+
+        Result actual;
+        run(optimized, environment, actual);
+
+        EXPECT_EQ(expected.mError, actual.mError) << script.mName;
+        EXPECT_EQ(expected.mShorts, actual.mShorts) << script.mName;
+        EXPECT_EQ(expected.mLongs, actual.mLongs) << script.mName;
+        ASSERT_EQ(expected.mFloats.size(), actual.mFloats.size()) << script.mName;
+        for (size_t i=0; i<expected.mFloats.size(); ++i)
+            EXPECT_EQ(0, std::memcmp(&expected.mFloats[i], &actual.mFloats[i], sizeof(float))) << script.mName;
+        EXPECT_EQ(expected.mTrace, actual.mTrace) << script.mName;
+        EXPECT_LE(actual.mInstructions, expected.mInstructions) << script.mName;
+
+        instructions += expected.mInstructions;
+        optimizedInstructions += actual.mInstructions;
+    }
+
+    const char* sSampleScripts[] = {
+        "begin constants\n"
+        "short s\n"
+        "long l\n"
+        "float f\n"
+        "set s to 2 * 3 + 4\n"
+        "set l to 100000 * 1000 - 7 / 2\n"
+        "set f to -1.5 * 2 + 10 / 4\n"
+        "set f to f + ( 3 - 1.25 ) * -2\n"
+        "set l to -2147483647 - 1\n"
+        "set s to 7 / -2 + ( 1 == 1 ) + ( 2.5 >= 3 ) + ( 3 != 3 ) + ( 1.5 < 2 )\n"
+        "end constants\n",
+
+        "begin branches\n"
+        "short state\n"
+        "float timer\n"
+        "if ( 1 )\n"
+        "    set state to state + 1\n"
+        "elseif ( 0 )\n"
+        "    set state to 100\n"
+        "endif\n"
+        "if ( 0 )\n"
+        "    messagebox \"never\"\n"
+        "elseif ( 2 > 3 )\n"
+        "    messagebox \"never either\"\n"
+        "else\n"
+        "    messagebox \"always %g\" state\n"
+        "endif\n"
+        "while ( 0 )\n"
+        "    set state to -1\n"
+        "endwhile\n"
+        "if ( state == 2 )\n"
+        "    return\n"
+        "endif\n"
+        "set timer to timer + GetSecondsPassed\n"
+        "if ( timer > 1 + 0.5 * 2 )\n"
+        "    set timer to 0\n"
+        "endif\n"
+        "end branches\n",
+
+        "begin loops\n"
+        "short i\n"
+        "short j\n"
+        "long sum\n"
+        "set i to 0\n"
+        "while ( i < 10 * 2 )\n"
+        "    set j to 0\n"
+        "    while ( j < 5 )\n"
+        "        if ( ( i + j ) > 10 )\n"
+        "            set sum to sum + i * j\n"
+        "        elseif ( i == j )\n"
+        "            set sum to sum - 1\n"
+        "        else\n"
+        "            set sum to sum + 1\n"
+        "        endif\n"
+        "        set j to j + 1\n"
+        "    endwhile\n"
+        "    set i to i + 1\n"
+        "endwhile\n"
+        "end loops\n",
+
+        "begin extensions\n"
+        "short doOnce\n"
+        "float distance\n"
+        "float roll\n"
+        "if ( doOnce == 0 )\n"
+        "    set doOnce to 1\n"
+        "    StartScript loops\n"
+        "    player->additem \"gold_001\" 10 * 5\n"
+        "    return\n"
+        "endif\n"
+        "set distance to GetDistance player\n"
+        "if ( distance < 500 * 2 )\n"
+        "    if ( player->GetItemCount \"gold_001\" > 40 + 2 )\n"
+        "        set doOnce to doOnce + 1\n"
+        "    endif\n"
+        "endif\n"
+        "set roll to Random 100\n"
+        "if ( roll > 50 )\n"
+        "    set roll to GetSquareRoot 16\n"
+        "endif\n"
+        "if ( GameHour > 12 )\n"
+        "    set GameHour to GameHour - 0.5\n"
+        "endif\n"
+        "Disable\n"
+        "end extensions\n",
+
+        "begin errors\n"
+        "short count\n"
+        "set count to count + 1\n"
+        "if ( count > 2 )\n"
+        "    set count to count / 0\n"
+        "endif\n"
+        "end errors\n",
+    };
+
+    void initSampleEnvironment(Environment& environment)
+    {
+        environment.mGlobals["gamehour"] = 'f';
+        environment.mIds.insert("player");
+        environment.mIds.insert("gold_001");
+    }
+
+    /// Read the scripts, globals and IDs from a content file.
+    void readContentFile(const std::string& file, Environment& environment, std::vector<ESM::Script>& scripts)
+    {
+        ESM::ESMReader esm;
+        esm.open(file);
+
+        while (esm.hasMoreRecs())
+        {
+            ESM::NAME name = esm.getRecName();
+            esm.getRecHeader();
+
+            if (name == "SCPT")
+            {
+                ESM::Script script;
+                script.load(esm);
+                scripts.push_back(script);
+                environment.mIds.insert(Misc::StringUtils::lowerCase(script.mId));
+            }
+            else if (esm.isNextSub("NAME"))
+            {
+                std::string id = Misc::StringUtils::lowerCase(esm.getHString());
+                environment.mIds.insert(id);
+
+                if (name == "GLOB")
+                {
+                    ESM::Global global;
+                    global.load(esm);
+                    ESM::VarType type = global.mValue.getType();
+                    environment.mGlobals[id] = type == ESM::VT_Short ? 's' : (type == ESM::VT_Float ? 'f' : 'l');
+                }
+            }
+
+            esm.skipRecord();
+        }
+    }
+}
+
+struct OptimizerTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        initSampleEnvironment(mEnvironment);
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    Environment mEnvironment;
+};
+
+TEST_F(OptimizerTest, folds_constants)
+{
+    CompiledScript script;
+    ASSERT_TRUE(compile("constants", sSampleScripts[0], mEnvironment, script));
+
+    CompiledScript optimized = script;
+    int removed = Compiler::optimize(optimized.mCode);
+
+    ASSERT_GT(removed, 0);
+    ASSERT_EQ(static_cast<int>(script.mCode[0]) - removed, static_cast<int>(optimized.mCode[0]));
+
+    Result result;
+    run(optimized, mEnvironment, result);
+
+    ASSERT_EQ(result.mError, "");
+    ASSERT_EQ(result.mShorts[0], 7 / -2 + 1 + 0 + 0 + 1);
+    ASSERT_EQ(result.mLongs[0], -2147483647 - 1);
+    ASSERT_FLOAT_EQ(result.mFloats[0], -1.5f * 2 + 10 / 4 + (3 - 1.25f) * -2);
+}
+
+TEST_F(OptimizerTest, keeps_sample_script_behaviour)
+{
+    unsigned long long instructions = 0;
+    unsigned long long optimizedInstructions = 0;
+
+    for (size_t i=0; i<sizeof(sSampleScripts)/sizeof(sSampleScripts[0]); ++i)
+    {
+        CompiledScript script;
+        ASSERT_TRUE(compile("sample", sSampleScripts[i], mEnvironment, script)) << sSampleScripts[i];
+        expectSameBehaviour(script, mEnvironment, instructions, optimizedInstructions);
+    }
+
+    ASSERT_LT(optimizedInstructions, instructions);
+}
+
+// Compares the optimized and unoptimized execution of every script in the content file named by the
+// OPENMW_TEST_CONTENT_FILE environment variable, e.g. Morrowind.esm. Does nothing if it is not set.
+TEST_F(OptimizerTest, keeps_content_file_script_behaviour)
+{
+    const char* file = std::getenv("OPENMW_TEST_CONTENT_FILE");
+    if (!file)
+        return;
+
+    Environment environment;
+    std::vector<ESM::Script> scripts;
+    readContentFile(file, environment, scripts);
+
+    int compiled = 0;
+    unsigned long long instructions = 0;
+    unsigned long long optimizedInstructions = 0;
+    for (std::vector<ESM::Script>::const_iterator it = scripts.begin(); it != scripts.end(); ++it)
+    {
+        CompiledScript script;
+        if (!compile(it->mId, it->mScriptText, environment, script))
+            continue;
+
+        ++compiled;
+        expectSameBehaviour(script, environment, instructions, optimizedInstructions);
+    }
+
+    ASSERT_GT(compiled, 0);
+}
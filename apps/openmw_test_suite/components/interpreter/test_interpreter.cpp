@@ -0,0 +1,319 @@
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <osg/Timer>
+
+#include "components/compiler/context.hpp"
+#include "components/compiler/fileparser.hpp"
+#include "components/compiler/locals.hpp"
+#include "components/compiler/scanner.hpp"
+#include "components/compiler/streamerrorhandler.hpp"
+#include "components/interpreter/context.hpp"
+#include "components/interpreter/installopcodes.hpp"
+#include "components/interpreter/interpreter.hpp"
+#include "components/interpreter/opcodes.hpp"
+
+namespace
+{
+    class TestCompilerContext : public Compiler::Context
+    {
+    public:
+        virtual bool canDeclareLocals() const { return true; }
+        virtual char getGlobalType (const std::string& name) const { return ' '; }
+        virtual std::pair<char, bool> getMemberType (const std::string& name, const std::string& id) const
+        {
+            return std::make_pair(' ', false);
+        }
+        virtual bool isId (const std::string& name) const { return false; }
+        virtual bool isJournalId (const std::string& name) const { return false; }
+    };
+
+    /// Only provides local variables, which is all the test scripts use.
+    class TestInterpreterContext : public Interpreter::Context
+    {
+    public:
+        TestInterpreterContext(const Compiler::Locals& locals)
+            : mShorts(locals.get('s').size(), 0)
+            , mLongs(locals.get('l').size(), 0)
+            , mFloats(locals.get('f').size(), 0.f)
+        {
+        }
+
+        virtual int getLocalShort (int index) const { return mShorts[index]; }
+        virtual int getLocalLong (int index) const { return mLongs[index]; }
+        virtual float getLocalFloat (int index) const { return mFloats[index]; }
+        virtual void setLocalShort (int index, int value) { mShorts[index] = value; }
+        virtual void setLocalLong (int index, int value) { mLongs[index] = value; }
+        virtual void setLocalFloat (int index, float value) { mFloats[index] = value; }
+
+        virtual void messageBox (const std::string& message, const std::vector<std::string>& buttons) {}
+        virtual void report (const std::string& message) {}
+        virtual bool menuMode() { return false; }
+        virtual int getGlobalShort (const std::string& name) const { return 0; }
+        virtual int getGlobalLong (const std::string& name) const { return 0; }
+        virtual float getGlobalFloat (const std::string& name) const { return 0.f; }
+        virtual void setGlobalShort (const std::string& name, int value) {}
+        virtual void setGlobalLong (const std::string& name, int value) {}
+        virtual void setGlobalFloat (const std::string& name, float value) {}
+        virtual std::vector<std::string> getGlobals () const { return std::vector<std::string>(); }
+        virtual char getGlobalType (const std::string& name) const { return ' '; }
+        virtual std::string getActionBinding(const std::string& action) const { return ""; }
+        virtual std::string getNPCName() const { return ""; }
+        virtual std::string getNPCRace() const { return ""; }
+        virtual std::string getNPCClass() const { return ""; }
+        virtual std::string getNPCFaction() const { return ""; }
+        virtual std::string getNPCRank() const { return ""; }
+        virtual std::string getPCName() const { return ""; }
+        virtual std::string getPCRace() const { return ""; }
+        virtual std::string getPCClass() const { return ""; }
+        virtual std::string getPCRank() const { return ""; }
+        virtual std::string getPCNextRank() const { return ""; }
+        virtual int getPCBounty() const { return 0; }
+        virtual std::string getCurrentCellName() const { return ""; }
+        virtual bool isScriptRunning (const std::string& name) const { return false; }
+        virtual void startScript (const std::string& name, const std::string& targetId) {}
+        virtual void stopScript (const std::string& name) {}
+        virtual float getDistance (const std::string& name, const std::string& id) const { return 0.f; }
+        virtual float getSecondsPassed() const { return 0.f; }
+        virtual bool isDisabled (const std::string& id) const { return false; }
+        virtual void enable (const std::string& id) {}
+        virtual void disable (const std::string& id) {}
+        virtual int getMemberShort (const std::string& id, const std::string& name, bool global) const { return 0; }
+        virtual int getMemberLong (const std::string& id, const std::string& name, bool global) const { return 0; }
+        virtual float getMemberFloat (const std::string& id, const std::string& name, bool global) const { return 0.f; }
+        virtual void setMemberShort (const std::string& id, const std::string& name, int value, bool global) {}
+        virtual void setMemberLong (const std::string& id, const std::string& name, int value, bool global) {}
+        virtual void setMemberFloat (const std::string& id, const std::string& name, float value, bool global) {}
+        virtual std::string getTargetId() const { return ""; }
+
+        std::vector<int> mShorts;
+        std::vector<int> mLongs;
+        std::vector<float> mFloats;
+    };
+
+    class NullOpcode : public Interpreter::Opcode0
+    {
+    public:
+        virtual void execute (Interpreter::Runtime& runtime) {}
+    };
+
+    struct CompiledScript
+    {
+        std::vector<Interpreter::Type_Code> mCode;
+        Compiler::Locals mLocals;
+    };
+
+    void compile(const std::string& text, CompiledScript& script)
+    {
+        TestCompilerContext context;
+        std::ostringstream errors;
+        Compiler::StreamErrorHandler errorHandler(errors);
+        Compiler::FileParser parser(errorHandler, context);
+
+        std::istringstream input(text);
+        Compiler::Scanner scanner(errorHandler, input);
+        scanner.scan(parser);
+
+        ASSERT_TRUE (errorHandler.isGood()) << errors.str();
+
+        parser.getCode(script.mCode);
+        script.mLocals = parser.getLocals();
+    }
+
+    // Loops and arithmetic on locals, the bulk of what typical local scripts execute
+    const char* sCounterScript =
+        "begin counter\n"
+        "short i\n"
+        "long sum\n"
+        "float f\n"
+        "set i to 0\n"
+        "while ( i < 1000 )\n"
+        "    set sum to sum + i * 2\n"
+        "    if ( sum > 100000 )\n"
+        "        set sum to sum - 100000\n"
+        "    endif\n"
+        "    set f to f + 0.5\n"
+        "    set i to i + 1\n"
+        "endwhile\n"
+        "end counter\n";
+
+    const char* sBranchScript =
+        "begin branches\n"
+        "short state\n"
+        "short count\n"
+        "float timer\n"
+        "while ( count < 500 )\n"
+        "    set timer to timer + 0.016\n"
+        "    if ( state == 0 )\n"
+        "        if ( timer > 1 )\n"
+        "            set state to 1\n"
+        "            set timer to 0\n"
+        "        endif\n"
+        "    elseif ( state == 1 )\n"
+        "        set state to 2\n"
+        "    else\n"
+        "        set state to 0\n"
+        "    endif\n"
+        "    set count to count + 1\n"
+        "endwhile\n"
+        "end branches\n";
+}
+
+struct InterpreterTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(InterpreterTest, runs_compiled_script)
+{
+    CompiledScript script;
+    compile(sCounterScript, script);
+
+    Interpreter::Interpreter interpreter;
+    Interpreter::installOpcodes(interpreter);
+
+    TestInterpreterContext context(script.mLocals);
+    interpreter.run(&script.mCode[0], script.mCode.size(), context);
+
+    int sum = 0;
+    for (int i=0; i<1000; ++i)
+    {
+        sum += i * 2;
+        if (sum > 100000)
+            sum -= 100000;
+    }
+
+    ASSERT_EQ (context.mShorts[0], 1000);
+    ASSERT_EQ (context.mLongs[0], sum);
+    ASSERT_FLOAT_EQ (context.mFloats[0], 500.f);
+    ASSERT_GT (interpreter.getInstructionCount(), 1000u);
+}
+
+TEST_F(InterpreterTest, finds_opcodes_in_separate_ranges)
+{
+    Interpreter::Interpreter interpreter;
+    Interpreter::installOpcodes(interpreter);
+    interpreter.installSegment5 (0x2000000, new NullOpcode);
+    interpreter.installSegment5 (0x2000300, new NullOpcode);
+
+    // Call both extension opcodes
+    Interpreter::Type_Code code[] = { 2, 0, 0, 0, 0xc8000000 | 0x2000000, 0xc8000000 | 0x2000300, 0xc8000000 | 0x2000200 };
+
+    CompiledScript script;
+    TestInterpreterContext context(script.mLocals);
+    interpreter.run(code, 6, context);
+    ASSERT_EQ (interpreter.getInstructionCount(), 2u);
+
+    // 0x2000200 lies in the range, but has not been installed
+    code[0] = 3;
+    ASSERT_THROW (interpreter.run(code, 7, context), std::runtime_error);
+}
+
+TEST_F(InterpreterTest, finds_opcodes_inserted_out_of_order)
+{
+    Interpreter::OpcodeTable<Interpreter::Opcode0> table;
+    std::vector<Interpreter::Opcode0*> opcodes;
+
+    // The first range grows across the ranges inserted after it
+    int codes[] = { 0, 99, 400, 350, 500, 200, 1000, 700, 2000, 1500, 0x2000000, 1800 };
+    for (size_t i=0; i<sizeof (codes)/sizeof (codes[0]); ++i)
+    {
+        opcodes.push_back(new NullOpcode);
+        table.insert(codes[i], opcodes.back());
+    }
+
+    for (size_t i=0; i<sizeof (codes)/sizeof (codes[0]); ++i)
+        ASSERT_EQ (table.find(codes[i]), opcodes[i]) << codes[i];
+
+    ASSERT_EQ (table.find(100), static_cast<Interpreter::Opcode0*>(0));
+    ASSERT_EQ (table.find(-1), static_cast<Interpreter::Opcode0*>(0));
+    ASSERT_EQ (table.find(0x2000001), static_cast<Interpreter::Opcode0*>(0));
+}
+
+// Reports the interpreter throughput, and compares the opcode lookup of the dispatch table against the std::map it
+// replaced, for the opcodes the test scripts execute. Run with --gtest_also_run_disabled_tests
+TEST_F(InterpreterTest, DISABLED_dispatch_benchmark)
+{
+    const int numRuns = 200;
+
+    const char* texts[] = { sCounterScript, sBranchScript };
+    std::vector<CompiledScript> scripts(2);
+    for (int i=0; i<2; ++i)
+        compile(texts[i], scripts[i]);
+
+    Interpreter::Interpreter interpreter;
+    Interpreter::installOpcodes(interpreter);
+
+    osg::Timer timer;
+    timer.setStartTick();
+    for (int run=0; run<numRuns; ++run)
+    {
+        for (std::vector<CompiledScript>::iterator it = scripts.begin(); it != scripts.end(); ++it)
+        {
+            TestInterpreterContext context(it->mLocals);
+            interpreter.run(&it->mCode[0], it->mCode.size(), context);
+        }
+    }
+    double runTime = timer.time_s();
+    unsigned long long instructions = interpreter.getInstructionCount();
+
+    // Segment 5 lookups only, where most opcodes (and all extensions) live
+    std::vector<int> opcodes;
+    for (std::vector<CompiledScript>::iterator it = scripts.begin(); it != scripts.end(); ++it)
+    {
+        int numOpcodes = static_cast<int>(it->mCode[0]);
+        for (int i=0; i<numOpcodes; ++i)
+        {
+            Interpreter::Type_Code code = it->mCode[4+i];
+            if ((code>>26) == 0x32)
+                opcodes.push_back(code & 0x3ffffff);
+        }
+    }
+    ASSERT_FALSE (opcodes.empty());
+
+    Interpreter::OpcodeTable<Interpreter::Opcode0> table;
+    std::map<int, Interpreter::Opcode0*> map;
+    NullOpcode nullOpcode;
+    for (int i=0; i<200; ++i)
+    {
+        table.insert(i, new NullOpcode);
+        map[i] = &nullOpcode;
+    }
+    for (int i=0x2000000; i<0x2000400; ++i)
+    {
+        table.insert(i, new NullOpcode);
+        map[i] = &nullOpcode;
+    }
+
+    const int numLookups = 5000000;
+    int found = 0;
+
+    timer.setStartTick();
+    for (int i=0; i<numLookups; ++i)
+        found += map.find(opcodes[i % opcodes.size()]) != map.end();
+    double mapTime = timer.time_m();
+
+    timer.setStartTick();
+    for (int i=0; i<numLookups; ++i)
+        found += table.find(opcodes[i % opcodes.size()]) != 0;
+    double tableTime = timer.time_m();
+
+    ASSERT_EQ (found, 2*numLookups);
+
+    std::cout << instructions << " instructions in " << runTime*1000 << " ms, "
+              << static_cast<double>(instructions) / runTime / 1000000 << " million instructions/s" << std::endl;
+    std::cout << numLookups << " opcode lookups: std::map " << mapTime << " ms, dispatch table "
+              << tableTime << " ms" << std::endl;
+}
@@ -0,0 +1,16 @@
+#include <gtest/gtest.h>
+#include "components/misc/hash.hpp"
+
+TEST(MiscHashTest, fnv1a_matches_reference_values)
+{
+    ASSERT_EQ(Misc::fnv1aHash(""), 0xcbf29ce484222325ULL);
+    ASSERT_EQ(Misc::fnv1aHash("a"), 0xaf63dc4c8601ec8cULL);
+    ASSERT_EQ(Misc::fnv1aHash("foobar"), 0x85944171f73967e8ULL);
+}
+
+TEST(MiscHashTest, fnv1a_hashes_all_bytes)
+{
+    const char data[] = { 'a', '\0', 'b' };
+    ASSERT_NE(Misc::fnv1aHash(data, 3), Misc::fnv1aHash("a"));
+    ASSERT_EQ(Misc::fnv1aHash(data, 1), Misc::fnv1aHash("a"));
+}
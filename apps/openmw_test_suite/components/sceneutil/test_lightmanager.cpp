@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <osg/Camera>
+#include <osg/Stats>
+#include <osg/Timer>
+
+#include "components/sceneutil/lightmanager.hpp"
+
+namespace
+{
+    float random(float min, float max)
+    {
+        return min + (max - min) * (std::rand() / static_cast<float>(RAND_MAX));
+    }
+
+    /// Torches and lanterns scattered over a few exterior cells.
+    void addLights(SceneUtil::LightManager& lightManager, std::vector<osg::ref_ptr<SceneUtil::LightSource> >& lightSources, int numLights)
+    {
+        for (int i=0; i<numLights; ++i)
+        {
+            osg::ref_ptr<SceneUtil::LightSource> lightSource = new SceneUtil::LightSource;
+            lightSource->setLight(new osg::Light);
+            lightSource->setRadius(random(100.f, 600.f));
+            lightSources.push_back(lightSource);
+
+            lightManager.addLight(lightSource, osg::Matrix::translate(random(-16384.f, 16384.f), random(-16384.f, 16384.f), random(0.f, 2000.f)));
+        }
+    }
+
+    /// Bounds of drawables in front of the camera, in view space.
+    std::vector<osg::BoundingSphere> getNodeBounds(int numNodes)
+    {
+        std::vector<osg::BoundingSphere> bounds;
+        for (int i=0; i<numNodes; ++i)
+            bounds.push_back(osg::BoundingSphere(osg::Vec3f(random(-16384.f, 16384.f), random(-2000.f, 2000.f), random(-32768.f, 0.f)), random(10.f, 300.f)));
+        return bounds;
+    }
+
+    void intersectAll(const SceneUtil::LightManager::LightGrid& lightGrid, const osg::BoundingSphere& bound, SceneUtil::LightManager::LightList& lightList)
+    {
+        const std::vector<SceneUtil::LightManager::LightSourceViewBound>& lights = lightGrid.getLights();
+        for (unsigned int i=0; i<lights.size(); ++i)
+        {
+            if (lights[i].mViewBound.intersects(bound))
+                lightList.push_back(&lights[i]);
+        }
+    }
+
+    osg::ref_ptr<osg::Camera> createCamera(const osg::Vec3f& eye)
+    {
+        osg::ref_ptr<osg::Camera> camera = new osg::Camera;
+        camera->setViewMatrixAsLookAt(eye, eye + osg::Vec3f(0, 1, 0), osg::Vec3f(0, 0, 1));
+        return camera;
+    }
+}
+
+struct LightManagerTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        std::srand(1);
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(LightManagerTest, finds_same_lights_as_testing_every_light)
+{
+    osg::ref_ptr<SceneUtil::LightManager> lightManager = new SceneUtil::LightManager;
+    std::vector<osg::ref_ptr<SceneUtil::LightSource> > lightSources;
+    addLights(*lightManager, lightSources, 300);
+
+    osg::ref_ptr<osg::Camera> camera = createCamera(osg::Vec3f(0, -16384.f, 500.f));
+    SceneUtil::LightManager::LightGrid& lightGrid = lightManager->getLightGrid(camera);
+    ASSERT_EQ(lightGrid.getLights().size(), 300u);
+
+    std::vector<osg::BoundingSphere> bounds = getNodeBounds(2000);
+    int found = 0;
+    for (unsigned int i=0; i<bounds.size(); ++i)
+    {
+        SceneUtil::LightManager::LightList expected;
+        intersectAll(lightGrid, bounds[i], expected);
+
+        SceneUtil::LightManager::LightList lightList;
+        lightGrid.intersect(bounds[i], lightList);
+
+        ASSERT_EQ(lightList, expected) << i;
+        found += lightList.size();
+    }
+    ASSERT_GT(found, 0);
+}
+
+TEST_F(LightManagerTest, keeps_light_bounds_per_camera)
+{
+    osg::ref_ptr<SceneUtil::LightManager> lightManager = new SceneUtil::LightManager;
+    std::vector<osg::ref_ptr<SceneUtil::LightSource> > lightSources;
+    addLights(*lightManager, lightSources, 10);
+
+    osg::ref_ptr<osg::Camera> first = createCamera(osg::Vec3f(0, 0, 0));
+    osg::ref_ptr<osg::Camera> second = createCamera(osg::Vec3f(1000.f, 0, 0));
+
+    osg::Vec3f firstCenter = lightManager->getLightGrid(first).getLights()[0].mViewBound.center();
+    osg::Vec3f secondCenter = lightManager->getLightGrid(second).getLights()[0].mViewBound.center();
+    ASSERT_FLOAT_EQ(firstCenter.x() - secondCenter.x(), 1000.f);
+
+    // The second camera must not have replaced the bounds of the first
+    ASSERT_EQ(lightManager->getLightGrid(first).getLights()[0].mViewBound.center(), firstCenter);
+
+    // A new frame collects the lights again
+    lightManager->update();
+    ASSERT_TRUE(lightManager->getLightGrid(first).getLights().empty());
+}
+
+TEST_F(LightManagerTest, reuses_and_drops_light_list_statesets)
+{
+    osg::ref_ptr<SceneUtil::LightManager> lightManager = new SceneUtil::LightManager;
+    lightManager->setStartLight(1);
+    std::vector<osg::ref_ptr<SceneUtil::LightSource> > lightSources;
+    addLights(*lightManager, lightSources, 10);
+
+    osg::ref_ptr<osg::Camera> camera = createCamera(osg::Vec3f(0, 0, 0));
+    // Copied, the light grid goes away once the camera stops rendering
+    std::vector<SceneUtil::LightManager::LightSourceViewBound> lights = lightManager->getLightGrid(camera).getLights();
+
+    SceneUtil::LightManager::LightList threeLights;
+    for (int i=0; i<3; ++i)
+        threeLights.push_back(&lights[i]);
+    osg::ref_ptr<osg::StateSet> stateset = lightManager->getLightListStateSet(threeLights);
+
+    // Same lights in another order
+    SceneUtil::LightManager::LightList reversed (threeLights.rbegin(), threeLights.rend());
+    ASSERT_EQ(lightManager->getLightListStateSet(reversed), stateset);
+
+    // Fewer lights
+    SceneUtil::LightManager::LightList twoLights (threeLights.begin(), threeLights.begin() + 2);
+    ASSERT_EQ(lightManager->getLightListStateSet(twoLights), stateset);
+
+    // Another light
+    SceneUtil::LightManager::LightList otherLight (1, &lights[3]);
+    ASSERT_NE(lightManager->getLightListStateSet(otherLight), stateset);
+
+    // Not more than 7 lights, with the sun as light 0
+    SceneUtil::LightManager::LightList allLights;
+    for (int i=0; i<8; ++i)
+        allLights.push_back(&lights[i]);
+    osg::ref_ptr<osg::StateSet> allStateset = lightManager->getLightListStateSet(allLights);
+    SceneUtil::LightManager::LightList lastLight (1, &lights[7]);
+    ASSERT_NE(lightManager->getLightListStateSet(lastLight), allStateset);
+
+    osg::ref_ptr<osg::Stats> stats = new osg::Stats("test");
+    lightManager->reportStats(0, *stats);
+    double value;
+    ASSERT_TRUE(stats->getAttribute(0, "light_statesets_hit", value));
+    ASSERT_EQ(value, 1.0);
+    ASSERT_TRUE(stats->getAttribute(0, "light_statesets_superset", value));
+    ASSERT_EQ(value, 1.0);
+    ASSERT_TRUE(stats->getAttribute(0, "light_statesets_missed", value));
+    ASSERT_EQ(value, 4.0);
+    ASSERT_TRUE(stats->getAttribute(0, "light_statesets_alive", value));
+    ASSERT_EQ(value, 4.0);
+
+    // Kept while in use, dropped once unused for a while
+    for (int i=0; i<200; ++i)
+    {
+        lightManager->update();
+        lightManager->getLightListStateSet(otherLight);
+    }
+    lightManager->reportStats(1, *stats);
+    ASSERT_TRUE(stats->getAttribute(1, "light_statesets_alive", value));
+    ASSERT_EQ(value, 1.0);
+}
+
+TEST_F(LightManagerTest, does_not_reuse_statesets_of_removed_lights)
+{
+    osg::ref_ptr<SceneUtil::LightManager> lightManager = new SceneUtil::LightManager;
+    std::vector<osg::ref_ptr<SceneUtil::LightSource> > lightSources;
+    addLights(*lightManager, lightSources, 3);
+
+    osg::ref_ptr<osg::Camera> camera = createCamera(osg::Vec3f(0, 0, 0));
+    std::vector<SceneUtil::LightManager::LightSourceViewBound> lights = lightManager->getLightGrid(camera).getLights();
+
+    SceneUtil::LightManager::LightList threeLights;
+    for (int i=0; i<3; ++i)
+        threeLights.push_back(&lights[i]);
+    osg::ref_ptr<osg::StateSet> stateset = lightManager->getLightListStateSet(threeLights);
+
+    // The third light is gone in the next frame, e.g. its cell was unloaded
+    lightManager->update();
+    for (int i=0; i<2; ++i)
+        lightManager->addLight(lightSources[i], osg::Matrix::identity());
+
+    SceneUtil::LightManager::LightList twoLights (threeLights.begin(), threeLights.begin() + 2);
+    ASSERT_NE(lightManager->getLightListStateSet(twoLights), stateset);
+}
+
+// Finds the lights of thousands of drawables among hundreds of lights, with the grid and by testing every light
+TEST_F(LightManagerTest, DISABLED_light_grid_benchmark)
+{
+    const int numLights = 500;
+    const int numNodes = 5000;
+    const int numFrames = 20;
+
+    osg::ref_ptr<SceneUtil::LightManager> lightManager = new SceneUtil::LightManager;
+    std::vector<osg::ref_ptr<SceneUtil::LightSource> > lightSources;
+    addLights(*lightManager, lightSources, numLights);
+
+    osg::ref_ptr<osg::Camera> camera = createCamera(osg::Vec3f(0, -16384.f, 500.f));
+    std::vector<osg::BoundingSphere> bounds = getNodeBounds(numNodes);
+    SceneUtil::LightManager::LightList lightList;
+    size_t allFound = 0;
+    size_t gridFound = 0;
+
+    osg::Timer timer;
+    timer.setStartTick();
+    for (int frame=0; frame<numFrames; ++frame)
+    {
+        SceneUtil::LightManager::LightGrid& lightGrid = lightManager->getLightGrid(camera);
+        for (int i=0; i<numNodes; ++i)
+        {
+            lightList.clear();
+            intersectAll(lightGrid, bounds[i], lightList);
+            allFound += lightList.size();
+        }
+    }
+    double allTime = timer.time_m();
+
+    timer.setStartTick();
+    for (int frame=0; frame<numFrames; ++frame)
+    {
+        // Rebuilt every frame, like in the game
+        SceneUtil::LightManager::LightGrid lightGrid;
+        lightGrid.build(lightManager->getLights(), camera->getViewMatrix());
+        for (int i=0; i<numNodes; ++i)
+        {
+            lightList.clear();
+            lightGrid.intersect(bounds[i], lightList);
+            gridFound += lightList.size();
+        }
+    }
+    double gridTime = timer.time_m();
+
+    ASSERT_EQ(gridFound, allFound);
+
+    std::cout << numLights << " lights, " << numNodes << " drawables, " << numFrames << " frames: testing every light "
+              << allTime << " ms, light grid " << gridTime << " ms" << std::endl;
+}
@@ -0,0 +1,301 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <osg/FrameStamp>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/NodeVisitor>
+#include <osg/Timer>
+
+#include "components/sceneutil/riggeometry.hpp"
+#include "components/sceneutil/skeleton.hpp"
+#include "components/sceneutil/workqueue.hpp"
+
+namespace
+{
+    const int sNumBones = 20;
+
+    std::string getBoneName(int index)
+    {
+        std::ostringstream stream;
+        stream << "Bone" << index;
+        return stream.str();
+    }
+
+    osg::Matrixf getBoneMatrix(int index, float time)
+    {
+        return osg::Matrixf::rotate(0.1f * index + time, osg::Vec3f(0, 0, 1)) * osg::Matrixf::translate(1.f, 0.5f * index, 0.f);
+    }
+
+    osg::Matrixf getInvBindMatrix(int index)
+    {
+        return osg::Matrixf::translate(-1.f, 0.f, -0.25f * index);
+    }
+
+    /// A skeleton with a chain of bones, and any number of meshes skinned to it.
+    struct Character
+    {
+        osg::ref_ptr<SceneUtil::Skeleton> mSkeleton;
+        std::vector<osg::MatrixTransform*> mBones;
+        osg::ref_ptr<osg::Geode> mGeode;
+        osg::ref_ptr<osg::Geometry> mSource;
+        osg::ref_ptr<SceneUtil::RigGeometry> mRig;
+
+        Character(int numVertices)
+            : mSkeleton(new SceneUtil::Skeleton)
+            , mGeode(new osg::Geode)
+            , mSource(new osg::Geometry)
+            , mRig(new SceneUtil::RigGeometry)
+        {
+            osg::Group* parent = mSkeleton;
+            for (int i=0; i<sNumBones; ++i)
+            {
+                osg::MatrixTransform* bone = new osg::MatrixTransform(getBoneMatrix(i, 0.f));
+                bone->setName(getBoneName(i));
+                parent->addChild(bone);
+                mBones.push_back(bone);
+                parent = bone;
+            }
+
+            osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+            osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
+            for (int i=0; i<numVertices; ++i)
+            {
+                vertices->push_back(osg::Vec3f(std::sin(i * 0.1f), std::cos(i * 0.1f), i * 0.01f));
+                normals->push_back(osg::Vec3f(std::cos(i * 0.1f), std::sin(i * 0.1f), 0.f));
+            }
+            mSource->setVertexArray(vertices);
+            mSource->setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
+            mSource->addPrimitiveSet(new osg::DrawArrays(GL_POINTS, 0, numVertices));
+
+            // Each vertex is influenced by two neighbouring bones
+            osg::ref_ptr<SceneUtil::RigGeometry::InfluenceMap> influences = new SceneUtil::RigGeometry::InfluenceMap;
+            for (int i=0; i<sNumBones; ++i)
+            {
+                SceneUtil::RigGeometry::BoneInfluence& influence = influences->mMap[getBoneName(i)];
+                influence.mInvBindMatrix = getInvBindMatrix(i);
+                influence.mBoundSphere = osg::BoundingSpheref(osg::Vec3f(), 2.f);
+            }
+            for (int i=0; i<numVertices; ++i)
+            {
+                influences->mMap[getBoneName(i % sNumBones)].mWeights[i] = 0.75f;
+                influences->mMap[getBoneName((i + 1) % sNumBones)].mWeights[i] = 0.25f;
+            }
+
+            mRig->setInfluenceMap(influences);
+            mRig->setSourceGeometry(mSource);
+
+            mGeode->addDrawable(mRig);
+            mBones.back()->addChild(mGeode);
+        }
+
+        void animate(float time)
+        {
+            for (int i=0; i<sNumBones; ++i)
+                mBones[i]->setMatrix(getBoneMatrix(i, time));
+        }
+
+        void update(unsigned int frameNumber)
+        {
+            osg::ref_ptr<osg::FrameStamp> frameStamp = new osg::FrameStamp;
+            frameStamp->setFrameNumber(frameNumber);
+
+            osg::NodeVisitor nv;
+            nv.setFrameStamp(frameStamp);
+            nv.pushOntoNodePath(mSkeleton);
+            nv.pushOntoNodePath(mGeode);
+
+            mRig->update(&nv);
+        }
+
+        /// Skin the source vertices the straightforward way.
+        void skinReference(float time, osg::Vec3Array& vertices, osg::Vec3Array& normals) const
+        {
+            std::vector<osg::Matrixf> skinMatrices;
+            osg::Matrixf boneMatrix;
+            for (int i=0; i<sNumBones; ++i)
+            {
+                boneMatrix = getBoneMatrix(i, time) * boneMatrix;
+                skinMatrices.push_back(getInvBindMatrix(i) * boneMatrix);
+            }
+
+            const osg::Vec3Array& sourceVertices = *static_cast<const osg::Vec3Array*>(mSource->getVertexArray());
+            const osg::Vec3Array& sourceNormals = *static_cast<const osg::Vec3Array*>(mSource->getNormalArray());
+            vertices.resize(sourceVertices.size());
+            normals.resize(sourceNormals.size());
+            for (unsigned int i=0; i<sourceVertices.size(); ++i)
+            {
+                const osg::Matrixf& first = skinMatrices[i % sNumBones];
+                const osg::Matrixf& second = skinMatrices[(i + 1) % sNumBones];
+                vertices[i] = sourceVertices[i] * first * 0.75f + sourceVertices[i] * second * 0.25f;
+                normals[i] = osg::Matrixf::transform3x3(sourceNormals[i], first) * 0.75f
+                        + osg::Matrixf::transform3x3(sourceNormals[i], second) * 0.25f;
+            }
+        }
+
+        const osg::Vec3Array& getVertices() const
+        {
+            return *static_cast<const osg::Vec3Array*>(mRig->getVertexArray());
+        }
+
+        const osg::Vec3Array& getNormals() const
+        {
+            return *static_cast<const osg::Vec3Array*>(mRig->getNormalArray());
+        }
+    };
+
+    void expectNear(const osg::Vec3Array& expected, const osg::Vec3Array& actual)
+    {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (unsigned int i=0; i<expected.size(); ++i)
+        {
+            EXPECT_NEAR(expected[i].x(), actual[i].x(), 1e-3f) << i;
+            EXPECT_NEAR(expected[i].y(), actual[i].y(), 1e-3f) << i;
+            EXPECT_NEAR(expected[i].z(), actual[i].z(), 1e-3f) << i;
+        }
+    }
+}
+
+struct RigGeometryTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+        SceneUtil::RigGeometry::setWorkQueue(NULL);
+    }
+};
+
+TEST_F(RigGeometryTest, skins_vertices_and_normals)
+{
+    Character character(500);
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
+
+    character.update(1);
+    character.skinReference(0.f, *vertices, *normals);
+    expectNear(*vertices, character.getVertices());
+    expectNear(*normals, character.getNormals());
+
+    character.animate(0.5f);
+    character.update(2);
+    character.skinReference(0.5f, *vertices, *normals);
+    expectNear(*vertices, character.getVertices());
+    expectNear(*normals, character.getNormals());
+}
+
+TEST_F(RigGeometryTest, skips_unchanged_pose)
+{
+    Character character(100);
+    character.update(1);
+
+    // Not skinned again while the bones stay where they are
+    osg::Vec3Array& vertices = const_cast<osg::Vec3Array&>(character.getVertices());
+    vertices[0] = osg::Vec3f(1000.f, 1000.f, 1000.f);
+    character.update(2);
+    ASSERT_EQ(character.getVertices()[0], osg::Vec3f(1000.f, 1000.f, 1000.f));
+
+    character.animate(0.25f);
+    character.update(3);
+    ASSERT_NE(character.getVertices()[0], osg::Vec3f(1000.f, 1000.f, 1000.f));
+}
+
+TEST_F(RigGeometryTest, counts_skins_and_skips_inactive_skeleton)
+{
+    Character character(100);
+    SceneUtil::RigGeometry::resetSkinCount();
+
+    character.update(1);
+    ASSERT_EQ(SceneUtil::RigGeometry::resetSkinCount(), 1u);
+
+    // Distant animations deactivate their skeleton on the frames their bones are not updated
+    character.mSkeleton->setActive(false);
+    character.animate(0.5f);
+    character.update(2);
+    ASSERT_EQ(SceneUtil::RigGeometry::resetSkinCount(), 0u);
+
+    character.mSkeleton->setActive(true);
+    character.update(3);
+    ASSERT_EQ(SceneUtil::RigGeometry::resetSkinCount(), 1u);
+}
+
+TEST_F(RigGeometryTest, skins_on_work_queue)
+{
+    SceneUtil::WorkQueue workQueue(2);
+    SceneUtil::RigGeometry::setWorkQueue(&workQueue);
+
+    Character character(500);
+    character.animate(0.75f);
+    character.update(1);
+    character.mRig->waitTillSkinned();
+
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
+    character.skinReference(0.75f, *vertices, *normals);
+    expectNear(*vertices, character.getVertices());
+    expectNear(*normals, character.getNormals());
+
+    SceneUtil::RigGeometry::setWorkQueue(NULL);
+}
+
+// Skins a crowd of characters for a number of frames, in the cull traversal and on a WorkQueue
+TEST_F(RigGeometryTest, DISABLED_skinning_benchmark)
+{
+    const int numCharacters = 50;
+    const int numVertices = 2000;
+    const int numFrames = 50;
+
+    std::vector<Character*> characters;
+    for (int i=0; i<numCharacters; ++i)
+        characters.push_back(new Character(numVertices));
+
+    unsigned int frameNumber = 0;
+    osg::Timer timer;
+
+    timer.setStartTick();
+    for (int frame=0; frame<numFrames; ++frame)
+    {
+        ++frameNumber;
+        for (int i=0; i<numCharacters; ++i)
+        {
+            characters[i]->animate(frame * 0.01f);
+            characters[i]->update(frameNumber);
+        }
+    }
+    double serialTime = timer.time_m();
+
+    SceneUtil::WorkQueue workQueue;
+    SceneUtil::RigGeometry::setWorkQueue(&workQueue);
+
+    timer.setStartTick();
+    for (int frame=0; frame<numFrames; ++frame)
+    {
+        ++frameNumber;
+        for (int i=0; i<numCharacters; ++i)
+        {
+            characters[i]->animate(frame * 0.01f + 1.f);
+            characters[i]->update(frameNumber);
+        }
+        for (int i=0; i<numCharacters; ++i)
+            characters[i]->mRig->waitTillSkinned();
+    }
+    double parallelTime = timer.time_m();
+
+    SceneUtil::RigGeometry::setWorkQueue(NULL);
+
+    for (int i=0; i<numCharacters; ++i)
+        delete characters[i];
+
+    double vertices = static_cast<double>(numCharacters) * numVertices * numFrames;
+    std::cout << numCharacters << " characters of " << numVertices << " vertices, " << numFrames << " frames: "
+              << serialTime << " ms in the cull traversal (" << vertices / serialTime / 1000 << " million vertices/s), "
+              << parallelTime << " ms on " << workQueue.getNumThreads() << " worker threads ("
+              << vertices / parallelTime / 1000 << " million vertices/s)" << std::endl;
+}
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Thread>
+
+#include "components/sceneutil/workqueue.hpp"
+
+namespace
+{
+
+    /// Counts how often it was run, and how many items were freed.
+    class CountingItem : public SceneUtil::WorkItem
+    {
+    public:
+        CountingItem(OpenThreads::Atomic& runs, OpenThreads::Atomic& deleted)
+            : mRuns(runs)
+            , mDeleted(deleted)
+        {
+        }
+
+        ~CountingItem()
+        {
+            ++mDeleted;
+        }
+
+        virtual void doWork()
+        {
+            ++mRuns;
+            mTicket->signalDone();
+        }
+
+    private:
+        OpenThreads::Atomic& mRuns;
+        OpenThreads::Atomic& mDeleted;
+    };
+
+    /// Checks that all of its dependencies are done by the time it runs.
+    class CheckDependenciesItem : public SceneUtil::WorkItem
+    {
+    public:
+        CheckDependenciesItem(const SceneUtil::WorkTicketGroup& group, OpenThreads::Atomic& failures)
+            : mGroup(group)
+            , mFailures(failures)
+        {
+            addDependencies(group);
+        }
+
+        virtual void doWork()
+        {
+            if (!mGroup.isDone())
+                ++mFailures;
+            mTicket->signalDone();
+        }
+
+    private:
+        SceneUtil::WorkTicketGroup mGroup;
+        OpenThreads::Atomic& mFailures;
+    };
+
+    /// Blocks its worker thread until \a gate is done.
+    class BlockingItem : public SceneUtil::WorkItem
+    {
+    public:
+        BlockingItem(osg::ref_ptr<SceneUtil::WorkTicket> gate)
+            : mGate(gate)
+        {
+        }
+
+        virtual void doWork()
+        {
+            mGate->waitTillDone();
+            mTicket->signalDone();
+        }
+
+    private:
+        osg::ref_ptr<SceneUtil::WorkTicket> mGate;
+    };
+
+    /// Adds items to the queue from its worker thread, which go to that thread's own queue, and waits for them without
+    /// running them itself. They can only be completed by other workers stealing them.
+    class SpawningItem : public SceneUtil::WorkItem
+    {
+    public:
+        SpawningItem(SceneUtil::WorkQueue& queue, OpenThreads::Atomic& runs, OpenThreads::Atomic& deleted,
+                     OpenThreads::Atomic& stolen)
+            : mQueue(queue)
+            , mRuns(runs)
+            , mDeleted(deleted)
+            , mStolen(stolen)
+        {
+        }
+
+        virtual void doWork()
+        {
+            SceneUtil::WorkTicketGroup group;
+            for (int i=0; i<16; ++i)
+                group.add(mQueue.addWorkItem(new CountingItem(mRuns, mDeleted)));
+
+            // Give up after a few seconds rather than hang the test
+            for (int i=0; i<5000 && !group.isDone(); ++i)
+                OpenThreads::Thread::microSleep(1000);
+
+            if (group.isDone())
+                ++mStolen;
+            mTicket->signalDone();
+        }
+
+    private:
+        SceneUtil::WorkQueue& mQueue;
+        OpenThreads::Atomic& mRuns;
+        OpenThreads::Atomic& mDeleted;
+        OpenThreads::Atomic& mStolen;
+    };
+
+}
+
+TEST(WorkQueueTest, runs_all_items)
+{
+    OpenThreads::Atomic runs(0), deleted(0);
+    {
+        SceneUtil::WorkQueue queue(4);
+        SceneUtil::WorkTicketGroup group;
+        for (int i=0; i<1000; ++i)
+            group.add(queue.addWorkItem(new CountingItem(runs, deleted), SceneUtil::WorkQueue::Priority(i % 3)));
+        group.waitTillDone();
+
+        ASSERT_TRUE (group.isDone());
+        ASSERT_EQ (static_cast<unsigned int>(runs), 1000u);
+    }
+    ASSERT_EQ (static_cast<unsigned int>(deleted), 1000u);
+}
+
+TEST(WorkQueueTest, holds_back_items_until_dependencies_are_done)
+{
+    OpenThreads::Atomic runs(0), deleted(0);
+    SceneUtil::WorkQueue queue(2);
+
+    osg::ref_ptr<SceneUtil::WorkTicket> gate (new SceneUtil::WorkTicket);
+    SceneUtil::WorkItem* item = new CountingItem(runs, deleted);
+    item->addDependency(gate);
+    osg::ref_ptr<SceneUtil::WorkTicket> ticket = queue.addWorkItem(item);
+
+    OpenThreads::Thread::microSleep(20000);
+    ASSERT_FALSE (ticket->isDone());
+    ASSERT_EQ (static_cast<unsigned int>(runs), 0u);
+
+    gate->signalDone();
+    ticket->waitTillDone();
+    ASSERT_EQ (static_cast<unsigned int>(runs), 1u);
+}
+
+TEST(WorkQueueTest, runs_items_whose_dependencies_are_already_done)
+{
+    OpenThreads::Atomic runs(0), deleted(0);
+    SceneUtil::WorkQueue queue(2);
+
+    osg::ref_ptr<SceneUtil::WorkTicket> done (new SceneUtil::WorkTicket);
+    done->signalDone();
+    SceneUtil::WorkItem* item = new CountingItem(runs, deleted);
+    item->addDependency(done);
+    queue.addWorkItem(item)->waitTillDone();
+
+    ASSERT_EQ (static_cast<unsigned int>(runs), 1u);
+}
+
+TEST(WorkQueueTest, starts_continuations_after_their_whole_group)
+{
+    OpenThreads::Atomic runs(0), deleted(0), failures(0);
+    SceneUtil::WorkQueue queue(4);
+
+    osg::ref_ptr<SceneUtil::WorkTicket> gate (new SceneUtil::WorkTicket);
+    SceneUtil::WorkTicketGroup group;
+    for (int i=0; i<8; ++i)
+        group.add(queue.addWorkItem(new BlockingItem(gate)));
+    for (int i=0; i<8; ++i)
+        group.add(queue.addWorkItem(new CountingItem(runs, deleted)));
+
+    // Chain continuations on each other, the last one only runs once everything before it is done
+    SceneUtil::WorkTicketGroup chain = group;
+    for (int i=0; i<4; ++i)
+        chain.add(queue.addWorkItem(new CheckDependenciesItem(chain, failures)));
+
+    ASSERT_FALSE (group.isDone());
+    ASSERT_FALSE (chain.isDone());
+
+    gate->signalDone();
+    chain.waitTillDone();
+
+    ASSERT_TRUE (group.isDone());
+    ASSERT_EQ (static_cast<unsigned int>(failures), 0u);
+    ASSERT_EQ (static_cast<unsigned int>(runs), 8u);
+}
+
+TEST(WorkQueueTest, frees_items_whose_dependencies_never_finish)
+{
+    OpenThreads::Atomic runs(0), deleted(0);
+    osg::ref_ptr<SceneUtil::WorkTicket> never (new SceneUtil::WorkTicket);
+    {
+        SceneUtil::WorkQueue queue(2);
+        for (int i=0; i<4; ++i)
+        {
+            SceneUtil::WorkItem* item = new CountingItem(runs, deleted);
+            item->addDependency(never);
+            queue.addWorkItem(item);
+        }
+    }
+    ASSERT_EQ (static_cast<unsigned int>(runs), 0u);
+    ASSERT_EQ (static_cast<unsigned int>(deleted), 4u);
+
+    // The destroyed queue must no longer be notified
+    never->signalDone();
+}
+
+TEST(WorkQueueTest, idle_workers_steal_from_busy_ones)
+{
+    OpenThreads::Atomic runs(0), deleted(0), stolen(0);
+    SceneUtil::WorkQueue queue(2);
+
+    queue.addWorkItem(new SpawningItem(queue, runs, deleted, stolen))->waitTillDone();
+
+    ASSERT_EQ (static_cast<unsigned int>(stolen), 1u);
+    ASSERT_EQ (static_cast<unsigned int>(runs), 16u);
+}
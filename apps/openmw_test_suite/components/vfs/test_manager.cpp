@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <osg/Timer>
+
+#include "components/vfs/manager.hpp"
+#include "components/vfs/archive.hpp"
+#include "components/misc/stringops.hpp"
+
+namespace
+{
+    class TestFile : public VFS::File
+    {
+    public:
+        virtual Files::IStreamPtr open()
+        {
+            return Files::IStreamPtr(new std::istringstream(mContent));
+        }
+
+        std::string mContent;
+    };
+
+    class TestArchive : public VFS::Archive
+    {
+    public:
+        void addFile(const std::string& name, const std::string& content)
+        {
+            mFiles[name].mContent = content;
+        }
+
+        virtual void listResources(std::map<std::string, VFS::File*>& out, char (*normalize_function) (char))
+        {
+            for (std::map<std::string, TestFile>::iterator it = mFiles.begin(); it != mFiles.end(); ++it)
+            {
+                std::string ent = it->first;
+                std::transform(ent.begin(), ent.end(), ent.begin(), normalize_function);
+                out[ent] = &it->second;
+            }
+        }
+
+        std::map<std::string, TestFile> mFiles;
+    };
+
+    std::string read(Files::IStreamPtr stream)
+    {
+        std::string content;
+        *stream >> content;
+        return content;
+    }
+
+    std::string makeName(int i)
+    {
+        std::ostringstream stream;
+        stream << "Meshes\\x\\Ex_Hlaalu_Bridge_" << i << ".NIF";
+        return stream.str();
+    }
+}
+
+struct VFSManagerTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(VFSManagerTest, lookup_is_case_and_slash_insensitive)
+{
+    VFS::Manager manager(false);
+    TestArchive* archive = new TestArchive;
+    archive->addFile("Meshes\\Foo.NIF", "foo");
+    archive->addFile("textures/bar.dds", "bar");
+    manager.addArchive(archive);
+    manager.buildIndex();
+
+    ASSERT_TRUE (manager.exists("meshes/foo.nif"));
+    ASSERT_TRUE (manager.exists("MESHES\\FOO.NIF"));
+    ASSERT_TRUE (manager.exists("Textures\\Bar.dds"));
+    ASSERT_FALSE (manager.exists("meshes/bar.nif"));
+    ASSERT_FALSE (manager.exists(""));
+
+    ASSERT_EQ (read(manager.get("meshes/foo.nif")), "foo");
+    ASSERT_EQ (read(manager.get(manager.makeKey("TEXTURES/BAR.DDS"))), "bar");
+    ASSERT_THROW (manager.get("meshes/missing.nif"), std::runtime_error);
+}
+
+TEST_F(VFSManagerTest, strict_lookup_is_case_sensitive)
+{
+    VFS::Manager manager(true);
+    TestArchive* archive = new TestArchive;
+    archive->addFile("Meshes\\Foo.NIF", "foo");
+    manager.addArchive(archive);
+    manager.buildIndex();
+
+    ASSERT_TRUE (manager.exists("Meshes/Foo.NIF"));
+    ASSERT_FALSE (manager.exists("meshes/foo.nif"));
+}
+
+TEST_F(VFSManagerTest, last_archive_has_priority)
+{
+    VFS::Manager manager(false);
+    TestArchive* first = new TestArchive;
+    first->addFile("meshes/foo.nif", "first");
+    first->addFile("meshes/bar.nif", "first");
+    TestArchive* second = new TestArchive;
+    second->addFile("Meshes/Foo.nif", "second");
+    manager.addArchive(first);
+    manager.addArchive(second);
+    manager.buildIndex();
+
+    ASSERT_EQ (read(manager.get("meshes/foo.nif")), "second");
+    ASSERT_EQ (read(manager.get("meshes/bar.nif")), "first");
+    ASSERT_EQ (manager.getIndex().size(), 2u);
+}
+
+TEST_F(VFSManagerTest, finds_all_files_of_large_index)
+{
+    VFS::Manager manager(false);
+    TestArchive* archive = new TestArchive;
+    for (int i=0; i<10000; ++i)
+        archive->addFile(makeName(i), "x");
+    manager.addArchive(archive);
+    manager.buildIndex();
+
+    for (int i=0; i<10000; ++i)
+        ASSERT_TRUE (manager.exists(makeName(i)));
+    for (int i=10000; i<11000; ++i)
+        ASSERT_FALSE (manager.exists(makeName(i)));
+}
+
+TEST_F(VFSManagerTest, keys_of_the_same_file_compare_equal)
+{
+    VFS::Manager manager(false);
+
+    VFS::FileKey a = manager.makeKey("Meshes\\Foo.nif");
+    VFS::FileKey b = manager.makeKey("meshes/foo.nif");
+    VFS::FileKey c = manager.makeKey("meshes/bar.nif");
+
+    ASSERT_TRUE (a == b);
+    ASSERT_FALSE (a < b);
+    ASSERT_FALSE (b < a);
+    ASSERT_FALSE (a == c);
+    ASSERT_TRUE ((a < c) != (c < a));
+
+    std::map<VFS::FileKey, int> map;
+    map[a] = 1;
+    map[c] = 2;
+    ASSERT_EQ (map[b], 1);
+    ASSERT_EQ (map.size(), 2u);
+}
+
+// Compares the lookup throughput of the hash index against the sorted std::map it replaced
+TEST_F(VFSManagerTest, DISABLED_lookup_benchmark)
+{
+    const int numFiles = 100000;
+    const int numLookups = 200000;
+
+    VFS::Manager manager(false);
+    TestArchive* archive = new TestArchive;
+    std::vector<std::string> names;
+    for (int i=0; i<numFiles; ++i)
+    {
+        names.push_back(makeName(i));
+        archive->addFile(names.back(), "x");
+    }
+    manager.addArchive(archive);
+    manager.buildIndex();
+
+    std::vector<VFS::FileKey> keys;
+    for (int i=0; i<numFiles; ++i)
+        keys.push_back(manager.makeKey(names[i]));
+
+    const std::map<std::string, VFS::File*>& index = manager.getIndex();
+
+    osg::Timer timer;
+    int found = 0;
+
+    timer.setStartTick();
+    for (int i=0; i<numLookups; ++i)
+    {
+        std::string normalized = names[(i*7919u) % numFiles];
+        std::replace(normalized.begin(), normalized.end(), '\\', '/');
+        Misc::StringUtils::toLower(normalized);
+        found += index.find(normalized) != index.end();
+    }
+    double mapTime = timer.time_m();
+
+    timer.setStartTick();
+    for (int i=0; i<numLookups; ++i)
+        found += manager.exists(names[(i*7919u) % numFiles]);
+    double hashTime = timer.time_m();
+
+    timer.setStartTick();
+    for (int i=0; i<numLookups; ++i)
+        found += manager.exists(keys[(i*7919u) % numFiles]);
+    double keyTime = timer.time_m();
+
+    ASSERT_EQ (found, 3*numLookups);
+
+    std::cout << numLookups << " lookups in " << numFiles << " files: std::map " << mapTime << " ms, hash index "
+              << hashTime << " ms, hash index with cached keys " << keyTime << " ms" << std::endl;
+}
@@ -1,6 +1,32 @@
 #include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include <osg/Timer>
+
 #include "apps/openmw/mwdialogue/keywordsearch.hpp"
 
+namespace
+{
+    const char* sWords[] = {
+        "the", "dwemer", "ruins", "of", "vivec", "temple", "tribunal", "house", "hlaalu", "redoran", "telvanni",
+        "ashlanders", "blight", "corprus", "dagoth", "ur", "red", "mountain", "nerevarine", "prophecy", "guild",
+        "mages", "fighters", "thieves", "morag", "tong", "balmora", "caius", "cosades", "little", "secret",
+        "latest", "rumors", "someone", "in", "particular", "specific", "place", "my", "trade", "services", 0
+    };
+
+    std::string getWord()
+    {
+        static int numWords = 0;
+        if (numWords == 0)
+            while (sWords[numWords])
+                ++numWords;
+        return sWords[std::rand() % numWords];
+    }
+}
+
 struct KeywordSearchTest : public ::testing::Test
 {
   protected:
@@ -65,3 +91,115 @@ TEST_F(KeywordSearchTest, keyword_test_conflict_resolution3)
     ASSERT_TRUE (matches.size() == 1);
     ASSERT_TRUE (std::string(matches.front().mBeg, matches.front().mEnd) == "bar lock");
 }
+
+TEST_F(KeywordSearchTest, keyword_test_longer_variation)
+{
+    // keywords that are a prefix of another keyword are still found
+    MWDialogue::KeywordSearch<std::string, int> search;
+    search.seed("dwemer ruins", 1);
+    search.seed("dwemer", 2);
+
+    std::string text = "Dwemer ruins of the dwemer";
+
+    std::vector<MWDialogue::KeywordSearch<std::string, int>::Match> matches;
+    search.highlightKeywords(text.begin(), text.end(), matches);
+
+    ASSERT_EQ (matches.size(), 2u);
+    ASSERT_EQ (std::string(matches[0].mBeg, matches[0].mEnd), "Dwemer ruins");
+    ASSERT_EQ (matches[0].mValue, 1);
+    ASSERT_EQ (std::string(matches[1].mBeg, matches[1].mEnd), "dwemer");
+    ASSERT_EQ (matches[1].mValue, 2);
+}
+
+TEST_F(KeywordSearchTest, keyword_test_word_start)
+{
+    // keywords must start a word, but may end within one
+    MWDialogue::KeywordSearch<std::string, int> search;
+    search.seed("mage", 0);
+
+    std::string text = "Image of a mages guild";
+
+    std::vector<MWDialogue::KeywordSearch<std::string, int>::Match> matches;
+    search.highlightKeywords(text.begin(), text.end(), matches);
+
+    ASSERT_EQ (matches.size(), 1u);
+    ASSERT_EQ (matches[0].mBeg - text.begin(), 11);
+    ASSERT_EQ (std::string(matches[0].mBeg, matches[0].mEnd), "mage");
+}
+
+TEST_F(KeywordSearchTest, keyword_test_contains_keyword)
+{
+    MWDialogue::KeywordSearch<std::string, int> search;
+    search.seed("latest rumors", 3);
+
+    int value = 0;
+    ASSERT_TRUE (search.containsKeyword("Latest Rumors", value));
+    ASSERT_EQ (value, 3);
+    ASSERT_FALSE (search.containsKeyword("latest", value));
+    ASSERT_THROW (search.seed("LATEST RUMORS", 4), std::runtime_error);
+
+    // the automaton is rebuilt once the keywords change
+    std::string text = "latest rumors";
+    std::vector<MWDialogue::KeywordSearch<std::string, int>::Match> matches;
+    search.highlightKeywords(text.begin(), text.end(), matches);
+    ASSERT_EQ (matches.size(), 1u);
+
+    search.clear();
+    search.seed("rumors", 5);
+    matches.clear();
+    search.highlightKeywords(text.begin(), text.end(), matches);
+    ASSERT_EQ (matches.size(), 1u);
+    ASSERT_EQ (std::string(matches[0].mBeg, matches[0].mEnd), "rumors");
+    ASSERT_EQ (matches[0].mValue, 5);
+}
+
+// Highlights the known topics of a long journal, page by page
+TEST_F(KeywordSearchTest, DISABLED_keyword_search_benchmark)
+{
+    const int numKeywords = 1000;
+    const int numPages = 2000;
+    const int wordsPerPage = 300;
+
+    std::srand(1);
+
+    MWDialogue::KeywordSearch<std::string, int> search;
+    for (int i=0; i<numKeywords; ++i)
+    {
+        std::string keyword = getWord();
+        for (int words = std::rand() % 3; words > 0; --words)
+            keyword += " " + getWord();
+
+        int value;
+        if (!search.containsKeyword(keyword, value))
+            search.seed(keyword, i);
+    }
+
+    std::vector<std::string> pages;
+    size_t size = 0;
+    for (int i=0; i<numPages; ++i)
+    {
+        std::ostringstream page;
+        for (int j=0; j<wordsPerPage; ++j)
+            page << getWord() << (j % 12 == 11 ? ". " : " ");
+        pages.push_back(page.str());
+        size += pages.back().size();
+    }
+
+    std::vector<MWDialogue::KeywordSearch<std::string, int>::Match> matches;
+    size_t found = 0;
+
+    osg::Timer timer;
+    timer.setStartTick();
+    for (int i=0; i<numPages; ++i)
+    {
+        matches.clear();
+        search.highlightKeywords(pages[i].begin(), pages[i].end(), matches);
+        found += matches.size();
+    }
+    double time = timer.time_m();
+
+    ASSERT_GT (found, 0u);
+
+    std::cout << numKeywords << " keywords, " << numPages << " pages of " << size / numPages << " characters: "
+              << time << " ms (" << size / time / 1000 << " MB/s), " << found << " matches" << std::endl;
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include <boost/make_shared.hpp>
+
+#include <components/esm/esmreader.hpp>
+#include <components/esm/esmwriter.hpp>
+#include <components/loadinglistener/loadinglistener.hpp>
+
+#include "apps/openmw/mwworld/esmstore.hpp"
+
+namespace
+{
+    class NullListener : public Loading::Listener
+    {
+    public:
+        virtual void setLabel (const std::string& label) {}
+        virtual void loadingOn() {}
+        virtual void loadingOff() {}
+        virtual void indicateProgress () {}
+        virtual void setProgressRange (size_t range) {}
+        virtual void setProgress (size_t value) {}
+        virtual void increaseProgress (size_t increase) {}
+    };
+
+    ESM::Activator makeActivator(const std::string& id, const std::string& model, const std::string& name,
+                                 const std::string& script)
+    {
+        ESM::Activator activator;
+        activator.mId = id;
+        activator.mModel = model;
+        activator.mName = name;
+        activator.mScript = script;
+        return activator;
+    }
+
+    /// A content file with the given activators.
+    std::string writeContentFile(const std::vector<ESM::Activator>& activators)
+    {
+        std::ostringstream stream;
+
+        ESM::ESMWriter writer;
+        writer.setVersion();
+        writer.setType(0);
+        writer.setAuthor("");
+        writer.setDescription("");
+        writer.setRecordCount(activators.size());
+        writer.setFormat(0);
+        writer.save(stream);
+
+        for (std::vector<ESM::Activator>::const_iterator it = activators.begin(); it != activators.end(); ++it)
+        {
+            writer.startRecord(ESM::REC_ACTI);
+            writer.writeHNString("NAME", it->mId);
+            it->save(writer);
+            writer.endRecord(ESM::REC_ACTI);
+        }
+
+        writer.close();
+        return stream.str();
+    }
+
+    /// The master defines two activators, the plugin overrides one without a name and script and adds another.
+    void writeContentFiles(std::vector<std::string>& files)
+    {
+        std::vector<ESM::Activator> master;
+        master.push_back(makeActivator("lever", "lever.nif", "Lever", "leverScript"));
+        master.push_back(makeActivator("chest", "chest.nif", "Chest", ""));
+        files.push_back(writeContentFile(master));
+
+        std::vector<ESM::Activator> plugin;
+        plugin.push_back(makeActivator("lever", "lever_new.nif", "", ""));
+        plugin.push_back(makeActivator("wheel", "wheel.nif", "Wheel", "wheelScript"));
+        files.push_back(writeContentFile(plugin));
+    }
+
+    void openContentFiles(const std::vector<std::string>& files, std::vector<ESM::ESMReader>& readers)
+    {
+        readers.resize(files.size());
+        for (size_t i=0; i<files.size(); ++i)
+        {
+            std::ostringstream name;
+            name << "file" << i << ".esp";
+            readers[i].setIndex(i);
+            readers[i].setGlobalReaderList(&readers);
+            readers[i].open(boost::make_shared<std::istringstream>(files[i]), name.str());
+        }
+    }
+
+    void expectOverridden(const MWWorld::ESMStore& store)
+    {
+        const MWWorld::Store<ESM::Activator>& activators = store.get<ESM::Activator>();
+        ASSERT_EQ(activators.getSize(), 3u);
+
+        // Loaded on top of the master record, keeping what the plugin leaves out
+        const ESM::Activator* lever = activators.find("lever");
+        EXPECT_EQ(lever->mModel, "lever_new.nif");
+        EXPECT_EQ(lever->mName, "Lever");
+        EXPECT_EQ(lever->mScript, "leverScript");
+
+        EXPECT_EQ(activators.find("chest")->mModel, "chest.nif");
+        EXPECT_EQ(activators.find("wheel")->mScript, "wheelScript");
+
+        EXPECT_EQ(store.find("wheel"), static_cast<int>(ESM::REC_ACTI));
+    }
+}
+
+struct ESMStoreTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        writeContentFiles(mFiles);
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    std::vector<std::string> mFiles;
+    NullListener mListener;
+};
+
+TEST_F(ESMStoreTest, loads_override_on_top_of_master_record)
+{
+    std::vector<ESM::ESMReader> readers;
+    openContentFiles(mFiles, readers);
+
+    MWWorld::ESMStore store;
+    for (size_t i=0; i<readers.size(); ++i)
+        store.load(readers[i], &mListener);
+
+    expectOverridden(store);
+}
+
+TEST_F(ESMStoreTest, merges_staged_override_on_top_of_master_record)
+{
+    std::vector<ESM::ESMReader> readers;
+    openContentFiles(mFiles, readers);
+
+    // All files are staged before the first one is merged, like EsmLoader does
+    std::vector<MWWorld::StagedContentFile*> staged;
+    MWWorld::ESMStore store;
+    for (size_t i=0; i<readers.size(); ++i)
+    {
+        staged.push_back(new MWWorld::StagedContentFile);
+        store.stage(readers[i], *staged.back());
+    }
+
+    for (size_t i=0; i<readers.size(); ++i)
+    {
+        store.merge(readers[i], *staged[i], &mListener);
+        delete staged[i];
+    }
+
+    expectOverridden(store);
+}
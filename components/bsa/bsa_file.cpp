@@ -24,6 +24,9 @@
 #include "bsa_file.hpp"
 
 #include <stdexcept>
+#include <iostream>
+#include <cassert>
+#include <cstring>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -33,6 +36,29 @@
 using namespace std;
 using namespace Bsa;
 
+namespace
+{
+    /// Normalize a file name character for hashing and comparison
+    inline unsigned char normalizeChar(char c)
+    {
+        if (c == '/')
+            return '\\';
+        if (c >= 'A' && c <= 'Z')
+            return c - 'A' + 'a';
+        return static_cast<unsigned char>(c);
+    }
+
+    bool pathEqual(const char *s1, const char *s2)
+    {
+        for (; *s1 && *s2; ++s1, ++s2)
+        {
+            if (normalizeChar(*s1) != normalizeChar(*s2))
+                return false;
+        }
+        return *s1 == *s2;
+    }
+}
+
 
 /// Error handling
 void BSAFile::fail(const string &msg)
@@ -64,7 +90,8 @@ void BSAFile::readHeader()
      *
      * ---------- end of directory block -------------
      *
-     * - 8*filenum - hash table block, we currently ignore this
+     * - 8*filenum - hash table block, one 64 bit name hash per file,
+     *   in the same order as the directory records
      *
      * ----------- start of data buffer --------------
      *
@@ -125,9 +152,13 @@ void BSAFile::readHeader()
     // Check our position
     assert(input.tellg() == std::streampos(12+dirsize));
 
+    // Read the hash table
+    std::vector<uint32_t> hashes(2*filenum);
+    if (filenum > 0)
+        input.read(reinterpret_cast<char*>(&hashes[0]), 8*filenum);
+
     // Calculate the offset of the data buffer. All file offsets are
     // relative to this. 12 header bytes + directory + hash table
-    // (skipped)
     size_t fileDataOffset = 12 + dirsize + 8*filenum;
 
     // Set up the the FileStruct table
@@ -137,28 +168,105 @@ void BSAFile::readHeader()
         FileStruct &fs = files[i];
         fs.fileSize = offsets[i*2];
         fs.offset = offsets[i*2+1] + fileDataOffset;
+        fs.hash = hashes[i*2] | (uint64_t(hashes[i*2+1]) << 32);
         fs.name = &stringBuf[offsets[2*filenum+i]];
 
         if(fs.offset + fs.fileSize > fsize)
             fail("Archive contains offsets outside itself");
+    }
 
-        // Add the file name to the lookup
-        lookup[fs.name] = i;
+    // Size the lookup table to at most half full, so probe sequences stay short
+    size_t tableSize = 1;
+    while (tableSize < filenum*2)
+        tableSize *= 2;
+    lookup.assign(tableSize, -1);
+    size_t wrongHashes = 0;
+    for(size_t i=0;i<filenum;i++)
+    {
+        if (!addToLookup(i))
+            ++wrongHashes;
     }
 
+    // Archives written by some third party tools carry wrong hashes, so lookups would not find those files
+    if (wrongHashes)
+        std::cerr << "Warning: " << wrongHashes << " files with wrong hashes in " << filename << std::endl;
+
     isLoaded = true;
 }
 
+uint64_t BSAFile::getHash(const char *name)
+{
+    size_t len = strlen(name);
+    size_t half = len/2;
+
+    // The first half of the name is XORed into the low word...
+    uint32_t low = 0;
+    unsigned int shift = 0;
+    size_t i = 0;
+    for (; i<half; ++i)
+    {
+        low ^= uint32_t(normalizeChar(name[i])) << (shift & 0x1F);
+        shift += 8;
+    }
+
+    // ...and the second half into the high word, rotating it right as we go
+    uint32_t high = 0;
+    shift = 0;
+    for (; i<len; ++i)
+    {
+        uint32_t temp = uint32_t(normalizeChar(name[i])) << (shift & 0x1F);
+        high ^= temp;
+        unsigned int rotate = temp & 0x1F;
+        if (rotate != 0)
+            high = (high >> rotate) | (high << (32 - rotate));
+        shift += 8;
+    }
+
+    return low | (uint64_t(high) << 32);
+}
+
+bool BSAFile::addToLookup(int index)
+{
+    FileStruct &fs = files[index];
+
+    uint64_t hash = getHash(fs.name);
+    bool hashValid = (fs.hash == hash);
+    fs.hash = hash;
+
+    size_t mask = lookup.size() - 1;
+    for (size_t slot = fs.hash & mask; ; slot = (slot + 1) & mask)
+    {
+        if (lookup[slot] == -1)
+        {
+            lookup[slot] = index;
+            break;
+        }
+        // The last of several files with the same name wins, as with the old map based lookup
+        if (pathEqual(files[lookup[slot]].name, fs.name))
+        {
+            lookup[slot] = index;
+            break;
+        }
+    }
+    return hashValid;
+}
+
 /// Get the index of a given file name, or -1 if not found
 int BSAFile::getIndex(const char *str) const
 {
-    Lookup::const_iterator it = lookup.find(str);
-    if(it == lookup.end())
+    if (lookup.empty())
         return -1;
 
-    int res = it->second;
-    assert(res >= 0 && (size_t)res < files.size());
-    return res;
+    uint64_t hash = getHash(str);
+    size_t mask = lookup.size() - 1;
+    for (size_t slot = hash & mask; lookup[slot] != -1; slot = (slot + 1) & mask)
+    {
+        int res = lookup[slot];
+        assert(res >= 0 && (size_t)res < files.size());
+        if (files[res].hash == hash && pathEqual(files[res].name, str))
+            return res;
+    }
+    return -1;
 }
 
 /// Open an archive file.
@@ -166,6 +274,16 @@ void BSAFile::open(const string &file)
 {
     filename = file;
     readHeader();
+
+    try
+    {
+        mapping.reset(new Files::MemoryMappedFile(filename));
+    }
+    catch (std::exception& e)
+    {
+        // Not fatal, e.g. when running out of address space; files are then read through regular streams
+        std::cerr << "Warning: " << e.what() << " Reading from the archive without memory mapping." << std::endl;
+    }
 }
 
 Files::IStreamPtr BSAFile::getFile(const char *file)
@@ -175,12 +293,12 @@ Files::IStreamPtr BSAFile::getFile(const char *file)
     if(i == -1)
         fail("File not found: " + string(file));
 
-    const FileStruct &fs = files[i];
-
-    return Files::openConstrainedFileStream (filename.c_str (), fs.offset, fs.fileSize);
+    return getFile(&files[i]);
 }
 
 Files::IStreamPtr BSAFile::getFile(const FileStruct *file)
 {
+    if (mapping)
+        return Files::openMemoryMappedStream (mapping, file->offset, file->fileSize);
     return Files::openConstrainedFileStream (filename.c_str (), file->offset, file->fileSize);
 }
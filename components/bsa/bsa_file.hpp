@@ -27,11 +27,9 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
-#include <map>
-
-#include <components/misc/stringops.hpp>
 
 #include <components/files/constrainedfilestream.hpp>
+#include <components/files/memorymappedfile.hpp>
 
 
 namespace Bsa
@@ -51,6 +49,9 @@ public:
         // (which is what is stored in the archive.)
         uint32_t fileSize, offset;
 
+        // Hash of the file name, as stored in the archive
+        uint64_t hash;
+
         // Zero-terminated file name
         const char *name;
     };
@@ -69,19 +70,15 @@ private:
     /// Used for error messages
     std::string filename;
 
-    /// Case insensitive string comparison
-    struct iltstr
-    {
-        bool operator()(const char *s1, const char *s2) const
-        { return Misc::StringUtils::ciLess(s1, s2); }
-    };
-
-    /** A map used for fast file name lookup. The value is the index into
-        the files[] vector above. The iltstr ensures that file name
-        checks are case insensitive.
+    /** Open addressing hash table used for fast file name lookup,
+        indexed by the file name hashes. The values are indices into the
+        files[] vector above, or -1 for empty slots. The size is a power
+        of two.
     */
-    typedef std::map<const char*, int, iltstr> Lookup;
-    Lookup lookup;
+    std::vector<int> lookup;
+
+    /// The whole archive mapped into memory, or empty if mapping failed
+    Files::MemoryMappedFilePtr mapping;
 
     /// Error handling
     void fail(const std::string &msg);
@@ -92,7 +89,15 @@ private:
     /// Get the index of a given file name, or -1 if not found
     int getIndex(const char *str) const;
 
+    /// Add the file at the given index to the lookup table
+    /// @return false if the hash stored in the archive was wrong, and had to be replaced
+    bool addToLookup(int index);
+
 public:
+    /// Calculate the hash of a file name the way Morrowind does. The name
+    /// is case insensitive and '/' is treated as '\\'.
+    static uint64_t getHash(const char *name);
+
     /* -----------------------------------
      * BSA management methods
      * -----------------------------------
@@ -116,6 +121,8 @@ public:
 
     /** Open a file contained in the archive. Throws an exception if the
         file doesn't exist.
+        @note If the archive could be memory mapped, the returned stream
+        reads straight from the mapping without copying.
     */
     Files::IStreamPtr getFile(const char *file);
 
@@ -1,8 +1,11 @@
 #include "extensions.hpp"
 
 #include <cassert>
+#include <sstream>
 #include <stdexcept>
 
+#include <components/misc/hash.hpp>
+
 #include "generator.hpp"
 #include "literals.hpp"
 
@@ -10,6 +13,24 @@ namespace Compiler
 {
     Extensions::Extensions() : mNextKeywordIndex (-1) {}
 
+    uint64_t Extensions::getHash() const
+    {
+        std::ostringstream stream;
+
+        for (std::map<std::string, int>::const_iterator iter (mKeywords.begin()); iter!=mKeywords.end(); ++iter)
+            stream << iter->first << ' ' << iter->second << '\n';
+
+        for (std::map<int, Function>::const_iterator iter (mFunctions.begin()); iter!=mFunctions.end(); ++iter)
+            stream << iter->first << ' ' << iter->second.mReturn << ' ' << iter->second.mArguments << ' '
+                << iter->second.mCode << ' ' << iter->second.mCodeExplicit << ' ' << iter->second.mSegment << '\n';
+
+        for (std::map<int, Instruction>::const_iterator iter (mInstructions.begin()); iter!=mInstructions.end(); ++iter)
+            stream << iter->first << ' ' << iter->second.mArguments << ' '
+                << iter->second.mCode << ' ' << iter->second.mCodeExplicit << ' ' << iter->second.mSegment << '\n';
+
+        return Misc::fnv1aHash (stream.str());
+    }
+
     int Extensions::searchKeyword (const std::string& keyword) const
     {
         std::map<std::string, int>::const_iterator iter = mKeywords.find (keyword);
@@ -213,4 +234,45 @@ namespace Compiler
             iter!=mKeywords.end(); ++iter)
             keywords.push_back (iter->first);
     }
+
+    void Extensions::listOpcodes (std::vector<Opcode>& opcodes) const
+    {
+        for (std::map<int, Function>::const_iterator iter (mFunctions.begin());
+            iter!=mFunctions.end(); ++iter)
+        {
+            Opcode opcode;
+            opcode.mCode = iter->second.mCode;
+            opcode.mSegment = iter->second.mSegment;
+            opcode.mExplicit = false;
+            opcode.mReturn = iter->second.mReturn;
+            opcode.mArguments = iter->second.mArguments;
+            opcodes.push_back (opcode);
+
+            if (iter->second.mCodeExplicit!=-1)
+            {
+                opcode.mCode = iter->second.mCodeExplicit;
+                opcode.mExplicit = true;
+                opcodes.push_back (opcode);
+            }
+        }
+
+        for (std::map<int, Instruction>::const_iterator iter (mInstructions.begin());
+            iter!=mInstructions.end(); ++iter)
+        {
+            Opcode opcode;
+            opcode.mCode = iter->second.mCode;
+            opcode.mSegment = iter->second.mSegment;
+            opcode.mExplicit = false;
+            opcode.mReturn = 0;
+            opcode.mArguments = iter->second.mArguments;
+            opcodes.push_back (opcode);
+
+            if (iter->second.mCodeExplicit!=-1)
+            {
+                opcode.mCode = iter->second.mCodeExplicit;
+                opcode.mExplicit = true;
+                opcodes.push_back (opcode);
+            }
+        }
+    }
 }
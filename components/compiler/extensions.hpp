@@ -5,6 +5,8 @@
 #include <map>
 #include <vector>
 
+#include <stdint.h>
+
 #include <components/interpreter/types.hpp>
 
 namespace Compiler
@@ -38,6 +40,18 @@ namespace Compiler
     /// \brief Collection of compiler extensions
     class Extensions
     {
+        public:
+
+            struct Opcode
+            {
+                int mCode;
+                int mSegment;
+                bool mExplicit; ///< takes an explicit reference
+                ScriptReturn mReturn; ///< 0 for instructions
+                ScriptArgs mArguments;
+            };
+
+        private:
 
             struct Function
             {
@@ -99,6 +113,10 @@ namespace Compiler
             /// - if explicit references are not supported, segment5codeExplicit must be set to -1
             /// \note Currently only segment 3 and segment 5 opcodes are supported.
 
+            uint64_t getHash() const;
+            ///< Hash of all registered keywords, with their arguments and opcodes. Code compiled with
+            /// extensions of a different hash may use different opcodes.
+
             void generateFunctionCode (int keyword, std::vector<Interpreter::Type_Code>& code,
                 Literals& literals, const std::string& id, int optionalArguments) const;
             ///< Append code for function to \a code.
@@ -109,6 +127,11 @@ namespace Compiler
 
             void listKeywords (std::vector<std::string>& keywords) const;
             ///< Append all known keywords to \a kaywords.
+
+            void listOpcodes (std::vector<Opcode>& opcodes) const;
+            ///< Append the opcodes of all functions and instructions to \a opcodes, including
+            /// the opcodes for explicit references. Opcodes shared by several keywords are
+            /// listed once for each keyword.
     };
 }
 
@@ -0,0 +1,633 @@
+#include "optimizer.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "generator.hpp"
+
+namespace
+{
+    typedef Interpreter::Type_Code Code;
+    typedef Interpreter::Type_Data Data;
+
+    // segment 5 opcodes the optimizer knows about (see components/interpreter/docs/vmformat.txt)
+    enum
+    {
+        Op_IntToFloat = 3,
+        Op_FetchIntLiteral = 4,
+        Op_FetchFloatLiteral = 5,
+        Op_FloatToInt = 6,
+        Op_NegateInt = 7,
+        Op_NegateFloat = 8,
+        Op_AddInt = 9,
+        Op_AddFloat = 10,
+        Op_SubInt = 11,
+        Op_SubFloat = 12,
+        Op_MulInt = 13,
+        Op_MulFloat = 14,
+        Op_DivInt = 15,
+        Op_DivFloat = 16,
+        Op_IntToFloat1 = 17,
+        Op_FloatToInt1 = 18,
+        Op_SquareRoot = 19,
+        Op_Return = 20,
+        Op_SkipZero = 24,
+        Op_SkipNonZero = 25,
+        Op_EqualInt = 26,
+        Op_GreaterOrEqualFloat = 37
+    };
+
+    Interpreter::Type_Integer toInt (Data data)
+    {
+        Interpreter::Type_Integer value;
+        std::memcpy (&value, &data, sizeof (value));
+        return value;
+    }
+
+    Interpreter::Type_Float toFloat (Data data)
+    {
+        Interpreter::Type_Float value;
+        std::memcpy (&value, &data, sizeof (value));
+        return value;
+    }
+
+    Data fromInt (Interpreter::Type_Integer value)
+    {
+        Data data;
+        std::memcpy (&data, &value, sizeof (data));
+        return data;
+    }
+
+    Data fromFloat (Interpreter::Type_Float value)
+    {
+        Data data;
+        std::memcpy (&data, &value, sizeof (data));
+        return data;
+    }
+
+    /// Stack values are untyped 32 bit words, so are the constants the optimizer tracks. The
+    /// consuming opcode decides how they are interpreted.
+    bool foldUnary (int opcode, Data value, Data& result)
+    {
+        switch (opcode)
+        {
+            case Op_IntToFloat:
+
+                result = fromFloat (static_cast<Interpreter::Type_Float> (toInt (value)));
+                return true;
+
+            case Op_FloatToInt:
+            {
+                Interpreter::Type_Float source = toFloat (value);
+
+                // out of range conversions are undefined, leave them to the runtime
+                if (!(source>-2147483648.0f && source<2147483648.0f))
+                    return false;
+
+                result = fromInt (static_cast<Interpreter::Type_Integer> (source));
+                return true;
+            }
+
+            case Op_NegateInt:
+
+                result = 0u - value;
+                return true;
+
+            case Op_NegateFloat:
+
+                result = fromFloat (-toFloat (value));
+                return true;
+
+            case Op_SquareRoot:
+            {
+                Interpreter::Type_Float source = toFloat (value);
+
+                // keep the runtime error
+                if (!(source>=0))
+                    return false;
+
+                result = fromFloat (std::sqrt (source));
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    template<typename T>
+    Data compare (int opcode, T left, T right)
+    {
+        bool result = false;
+
+        switch (opcode % 6)
+        {
+            case 2: result = left==right; break;
+            case 3: result = left!=right; break;
+            case 4: result = left<right; break;
+            case 5: result = left<=right; break;
+            case 0: result = left>right; break;
+            case 1: result = left>=right; break;
+        }
+
+        return result ? 1 : 0;
+    }
+
+    bool foldBinary (int opcode, Data left, Data right, Data& result)
+    {
+        Interpreter::Type_Float leftFloat = toFloat (left);
+        Interpreter::Type_Float rightFloat = toFloat (right);
+
+        switch (opcode)
+        {
+            // integer arithmetic wraps, as it does on all platforms the runtime runs on
+            case Op_AddInt: result = left + right; return true;
+            case Op_SubInt: result = left - right; return true;
+            case Op_MulInt: result = left * right; return true;
+
+            case Op_DivInt:
+
+                // keep the runtime error, and don't trap on overflow
+                if (right==0 || (toInt (left)==-2147483647-1 && toInt (right)==-1))
+                    return false;
+
+                result = fromInt (toInt (left) / toInt (right));
+                return true;
+
+            case Op_AddFloat: result = fromFloat (leftFloat + rightFloat); return true;
+            case Op_SubFloat: result = fromFloat (leftFloat - rightFloat); return true;
+            case Op_MulFloat: result = fromFloat (leftFloat * rightFloat); return true;
+
+            case Op_DivFloat:
+
+                if (rightFloat==0)
+                    return false;
+
+                result = fromFloat (leftFloat / rightFloat);
+                return true;
+        }
+
+        if (opcode>=Op_EqualInt && opcode<Op_EqualInt+6)
+        {
+            result = compare (opcode, toInt (left), toInt (right));
+            return true;
+        }
+
+        if (opcode>=Op_EqualInt+6 && opcode<=Op_GreaterOrEqualFloat)
+        {
+            result = compare (opcode, leftFloat, rightFloat);
+            return true;
+        }
+
+        return false;
+    }
+
+    struct Instruction
+    {
+        Code mCode;
+        int mTarget; // index of the jump target, -1 if this is not a jump
+
+        Instruction (Code code, int target = -1) : mCode (code), mTarget (target) {}
+    };
+
+    typedef std::vector<Instruction> Instructions;
+
+    class Optimizer
+    {
+            Instructions mCode;
+            std::vector<Data> mIntegers;
+            std::vector<Data> mFloats;
+            std::vector<Code> mStrings;
+
+            std::vector<bool> mLeader; // can be reached other than from the previous instruction
+            std::vector<bool> mPinned; // directly follows a skip, so must stay a single instruction
+
+            std::vector<Instructions> mSlots; // replacement of each instruction during a pass
+            bool mChanged;
+
+            static bool isSegment5 (Code code, int opcode)
+            {
+                return code==Compiler::Generator::segment5 (opcode);
+            }
+
+            static bool isPushInt (Code code)
+            {
+                return (code>>24)==0;
+            }
+
+            static bool isSkip (Code code)
+            {
+                return isSegment5 (code, Op_SkipZero) || isSegment5 (code, Op_SkipNonZero);
+            }
+
+            static int getSegment5 (Code code)
+            {
+                return (code>>26)==0x32 ? static_cast<int> (code & 0x3ffffff) : -1;
+            }
+
+            /// Return the number of instructions pushing a constant at \a index (0 if there is
+            /// none).
+            int getConstant (int index, Data& value) const
+            {
+                Code code = mCode[index].mCode;
+
+                if (!isPushInt (code))
+                    return 0;
+
+                Code arg = code & 0xffffff;
+
+                if (index+1<static_cast<int> (mCode.size()) && !mLeader[index+1])
+                {
+                    Code next = mCode[index+1].mCode;
+
+                    if (isSegment5 (next, Op_FetchIntLiteral) || isSegment5 (next, Op_FetchFloatLiteral))
+                    {
+                        const std::vector<Data>& literals =
+                            isSegment5 (next, Op_FetchIntLiteral) ? mIntegers : mFloats;
+
+                        if (arg>=literals.size())
+                            return 0;
+
+                        value = literals[arg];
+                        return 2;
+                    }
+                }
+
+                value = arg;
+                return 1;
+            }
+
+            void pushConstant (Instructions& code, Data value)
+            {
+                if (value<=0xffffff)
+                {
+                    code.push_back (Compiler::Generator::segment0 (0, value));
+                    return;
+                }
+
+                // the bit pattern is all that matters, so floats end up in the integer block too
+                std::vector<Data>::iterator iter = std::find (mIntegers.begin(), mIntegers.end(), value);
+                int index = static_cast<int> (iter-mIntegers.begin());
+
+                if (iter==mIntegers.end())
+                    mIntegers.push_back (value);
+
+                code.push_back (Compiler::Generator::segment0 (0, index));
+                code.push_back (Compiler::Generator::segment5 (Op_FetchIntLiteral));
+            }
+
+            /// Replace the instructions [\a begin, \a end) with \a code.
+            void replace (int begin, int end, const Instructions& code)
+            {
+                mSlots[begin] = code;
+
+                for (int i=begin+1; i<end; ++i)
+                    mSlots[i].clear();
+
+                mChanged = true;
+            }
+
+            void analyse()
+            {
+                int size = static_cast<int> (mCode.size());
+
+                mLeader.assign (size+2, false);
+                mPinned.assign (size+2, false);
+
+                for (int i=0; i<size; ++i)
+                {
+                    if (mCode[i].mTarget!=-1)
+                        mLeader[mCode[i].mTarget] = true;
+                    else if (isSkip (mCode[i].mCode))
+                    {
+                        mPinned[i+1] = true;
+                        mLeader[i+2] = true;
+                    }
+                }
+
+                mSlots.resize (size);
+
+                for (int i=0; i<size; ++i)
+                    mSlots[i].assign (1, mCode[i]);
+
+                mChanged = false;
+            }
+
+            /// Replace the instructions with their slots, and update the jump targets.
+            void apply()
+            {
+                int size = static_cast<int> (mCode.size());
+
+                std::vector<int> newIndex (size+1, 0);
+
+                for (int i=0; i<size; ++i)
+                    newIndex[i+1] = newIndex[i] + static_cast<int> (mSlots[i].size());
+
+                Instructions code;
+
+                for (int i=0; i<size; ++i)
+                    for (Instructions::const_iterator iter (mSlots[i].begin()); iter!=mSlots[i].end(); ++iter)
+                    {
+                        code.push_back (*iter);
+
+                        if (iter->mTarget!=-1)
+                            code.back().mTarget = newIndex[iter->mTarget];
+                    }
+
+                mCode.swap (code);
+            }
+
+            void foldConstants()
+            {
+                int size = static_cast<int> (mCode.size());
+
+                for (int i=0; i<size; ++i)
+                {
+                    if (mPinned[i])
+                        continue;
+
+                    Data left = 0;
+                    int leftSize = getConstant (i, left);
+
+                    if (!leftSize)
+                        continue;
+
+                    int next = i + leftSize;
+
+                    if (next<size && !mLeader[next])
+                    {
+                        Code code = mCode[next].mCode;
+                        Data result = 0;
+
+                        if (foldUnary (getSegment5 (code), left, result))
+                        {
+                            Instructions replacement;
+                            pushConstant (replacement, result);
+                            replace (i, next+1, replacement);
+                            i = next;
+                            continue;
+                        }
+
+                        if (isSkip (code))
+                        {
+                            bool skip = isSegment5 (code, Op_SkipZero) ? left==0 : left!=0;
+
+                            if (!skip)
+                            {
+                                replace (i, next+1, Instructions());
+                                i = next;
+                                continue;
+                            }
+                            else if (next+1<size && !mLeader[next+1])
+                            {
+                                replace (i, next+2, Instructions());
+                                i = next+1;
+                                continue;
+                            }
+                        }
+
+                        Data right = 0;
+                        int rightSize = getConstant (next, right);
+                        int op = next + rightSize;
+
+                        if (rightSize && op<size && !mLeader[op])
+                        {
+                            int opcode = getSegment5 (mCode[op].mCode);
+
+                            if (foldBinary (opcode, left, right, result))
+                            {
+                                Instructions replacement;
+                                pushConstant (replacement, result);
+                                replace (i, op+1, replacement);
+                                i = op;
+                                continue;
+                            }
+
+                            if (opcode==Op_IntToFloat1 || opcode==Op_FloatToInt1)
+                            {
+                                if (foldUnary (opcode==Op_IntToFloat1 ? Op_IntToFloat : Op_FloatToInt,
+                                    left, result))
+                                {
+                                    Instructions replacement;
+                                    pushConstant (replacement, result);
+                                    pushConstant (replacement, right);
+                                    replace (i, op+1, replacement);
+                                    i = op;
+                                    continue;
+                                }
+                            }
+                        }
+                    }
+
+                    if (leftSize==2 && left<=0xffffff)
+                    {
+                        Instructions replacement;
+                        pushConstant (replacement, left);
+                        replace (i, i+2, replacement);
+                        ++i;
+                    }
+                }
+            }
+
+            void threadJumps()
+            {
+                int size = static_cast<int> (mCode.size());
+
+                for (int i=0; i<size; ++i)
+                {
+                    int target = mCode[i].mTarget;
+
+                    if (target==-1)
+                        continue;
+
+                    // follow chains of jumps, but not around a loop
+                    int steps = 0;
+
+                    while (target<size && mCode[target].mTarget!=-1 && target!=i && steps<size)
+                    {
+                        target = mCode[target].mTarget;
+                        ++steps;
+                    }
+
+                    if (target<size && mCode[target].mTarget!=-1)
+                        continue;
+
+                    if (target==size || isSegment5 (mCode[target].mCode, Op_Return))
+                    {
+                        // leaving the code ends the script just like a return does
+                        replace (i, i+1,
+                            Instructions (1, Compiler::Generator::segment5 (Op_Return)));
+                    }
+                    else if (target==i+1 && !mPinned[i])
+                    {
+                        replace (i, i+1, Instructions());
+                    }
+                    else if (target!=mCode[i].mTarget)
+                    {
+                        mSlots[i][0].mTarget = target;
+                        mChanged = true;
+                    }
+                }
+            }
+
+            void removeUnreachable()
+            {
+                int size = static_cast<int> (mCode.size());
+
+                std::vector<bool> reachable (size, false);
+                std::vector<int> stack;
+
+                if (size)
+                    stack.push_back (0);
+
+                while (!stack.empty())
+                {
+                    int index = stack.back();
+                    stack.pop_back();
+
+                    if (index>=size || reachable[index])
+                        continue;
+
+                    reachable[index] = true;
+
+                    const Instruction& instruction = mCode[index];
+
+                    if (instruction.mTarget!=-1)
+                        stack.push_back (instruction.mTarget);
+                    else if (isSegment5 (instruction.mCode, Op_Return))
+                        continue;
+                    else
+                    {
+                        stack.push_back (index+1);
+
+                        if (isSkip (instruction.mCode))
+                            stack.push_back (index+2);
+                    }
+                }
+
+                for (int i=0; i<size; ++i)
+                    if (!reachable[i])
+                        replace (i, i+1, Instructions());
+            }
+
+        public:
+
+            bool decode (const std::vector<Code>& code)
+            {
+                if (code.size()<4)
+                    return false;
+
+                Code size = code[0];
+
+                if (4+static_cast<std::size_t> (size)+code[1]+code[2]+code[3]!=code.size())
+                    return false;
+
+                std::vector<Code>::const_iterator iter = code.begin()+4;
+
+                for (Code i=0; i<size; ++i, ++iter)
+                {
+                    int target = -1;
+
+                    if ((*iter>>30)==0 && (*iter>>24)!=0)
+                    {
+                        int op = *iter>>24;
+                        int offset = *iter & 0xffffff;
+
+                        if ((op!=1 && op!=2) || offset==0)
+                            return false;
+
+                        target = op==1 ? i+offset : static_cast<int> (i)-offset;
+
+                        if (target<0 || target>static_cast<int> (size))
+                            return false;
+                    }
+
+                    mCode.push_back (Instruction (*iter, target));
+                }
+
+                mIntegers.assign (iter, iter+code[1]);
+                iter += code[1];
+                mFloats.assign (iter, iter+code[2]);
+                iter += code[2];
+                mStrings.assign (iter, code.end());
+
+                return true;
+            }
+
+            void optimize()
+            {
+                // each pass can enable the others, but none of them undoes what another did
+                for (int pass=0; pass<100; ++pass)
+                {
+                    bool changed = false;
+
+                    analyse();
+                    foldConstants();
+                    changed = changed || mChanged;
+                    apply();
+
+                    analyse();
+                    threadJumps();
+                    changed = changed || mChanged;
+                    apply();
+
+                    analyse();
+                    removeUnreachable();
+                    changed = changed || mChanged;
+                    apply();
+
+                    if (!changed)
+                        break;
+                }
+            }
+
+            void encode (std::vector<Code>& code) const
+            {
+                code.clear();
+
+                code.push_back (static_cast<Code> (mCode.size()));
+                code.push_back (static_cast<Code> (mIntegers.size()));
+                code.push_back (static_cast<Code> (mFloats.size()));
+                code.push_back (static_cast<Code> (mStrings.size()));
+
+                for (int i=0; i<static_cast<int> (mCode.size()); ++i)
+                {
+                    int target = mCode[i].mTarget;
+
+                    if (target==-1)
+                        code.push_back (mCode[i].mCode);
+                    else if (target>i)
+                        code.push_back (Compiler::Generator::segment0 (1, target-i));
+                    else
+                        code.push_back (Compiler::Generator::segment0 (2, i-target));
+                }
+
+                code.insert (code.end(), mIntegers.begin(), mIntegers.end());
+                code.insert (code.end(), mFloats.begin(), mFloats.end());
+                code.insert (code.end(), mStrings.begin(), mStrings.end());
+            }
+
+            int getSize() const
+            {
+                return static_cast<int> (mCode.size());
+            }
+    };
+}
+
+namespace Compiler
+{
+    int optimize (std::vector<Interpreter::Type_Code>& code)
+    {
+        Optimizer optimizer;
+
+        if (!optimizer.decode (code))
+            return 0;
+
+        int size = optimizer.getSize();
+
+        optimizer.optimize();
+        optimizer.encode (code);
+
+        return size - optimizer.getSize();
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef COMPILER_OPTIMIZER_H_INCLUDED
+#define COMPILER_OPTIMIZER_H_INCLUDED
+
+#include <vector>
+
+#include <components/interpreter/types.hpp>
+
+namespace Compiler
+{
+    int optimize (std::vector<Interpreter::Type_Code>& code);
+    ///< Rewrite compiled \a code (header, instructions and literals, as returned by
+    /// Output::getCode) into an equivalent program that executes fewer instructions:
+    /// - constant expressions are folded and small literals are pushed directly
+    /// - conditional skips on constants are resolved
+    /// - jumps to jumps are threaded, jumps to the next instruction are removed
+    /// - unreachable instructions are removed
+    ///
+    /// Extension opcodes are never touched. Code that can not be decoded is left unchanged.
+    /// \return number of instructions removed
+}
+
+#endif
@@ -15,12 +15,15 @@ using namespace Misc;
 ESM_Context ESMReader::getContext()
 {
     // Update the file position before returning
-    mCtx.filePos = mEsm->tellg();
+    mCtx.filePos = getFileOffset();
     return mCtx;
 }
 
 ESMReader::ESMReader()
     : mIdx(0)
+    , mData(NULL)
+    , mPos(0)
+    , mUseMemoryMapping(false)
     , mRecordFlags(0)
     , mBuffer(50*1024)
     , mGlobalReaderList(NULL)
@@ -44,12 +47,18 @@ void ESMReader::restoreContext(const ESM_Context &rc)
     mCtx = rc;
 
     // Make sure we seek to the right place
-    mEsm->seekg(mCtx.filePos);
+    if (mData)
+        mPos = mCtx.filePos;
+    else
+        mEsm->seekg(mCtx.filePos);
 }
 
 void ESMReader::close()
 {
     mEsm.reset();
+    mMapping.reset();
+    mData = NULL;
+    mPos = 0;
     mCtx.filename.clear();
     mCtx.leftFile = 0;
     mCtx.leftRec = 0;
@@ -71,13 +80,34 @@ void ESMReader::openRaw(Files::IStreamPtr _esm, const std::string& name)
 
 void ESMReader::openRaw(const std::string& filename)
 {
-    openRaw(Files::openConstrainedFileStream(filename.c_str()), filename);
+    if (!mUseMemoryMapping)
+    {
+        openRaw(Files::openConstrainedFileStream(filename.c_str()), filename);
+        return;
+    }
+
+    close();
+    mMapping.reset(new Files::MemoryMappedFile(filename));
+    mData = mMapping->getData();
+    mPos = 0;
+    mCtx.filename = filename;
+    mCtx.leftFile = mFileSize = mMapping->getSize();
 }
 
 void ESMReader::open(Files::IStreamPtr _esm, const std::string &name)
 {
     openRaw(_esm, name);
+    loadHeader();
+}
 
+void ESMReader::open(const std::string &file)
+{
+    openRaw(file);
+    loadHeader();
+}
+
+void ESMReader::loadHeader()
+{
     if (getRecName() != "TES3")
         fail("Not a valid Morrowind file");
 
@@ -86,11 +116,6 @@ void ESMReader::open(Files::IStreamPtr _esm, const std::string &name)
     mHeader.load (*this);
 }
 
-void ESMReader::open(const std::string &file)
-{
-    open (Files::openConstrainedFileStream (file.c_str ()), file);
-}
-
 int64_t ESMReader::getHNLong(const char *name)
 {
     int64_t val;
@@ -151,6 +176,19 @@ void ESMReader::getHNExact(void*p, int size, const char* name)
     getHExact(p, size);
 }
 
+const char* ESMReader::getHView(uint32_t& size)
+{
+    getSubHeader();
+    size = mCtx.leftSub;
+    if (mData)
+        return readMapped(size);
+
+    if (mBuffer.size() < size)
+        mBuffer.resize(size);
+    getExact(&mBuffer[0], size);
+    return &mBuffer[0];
+}
+
 // Get the next subrecord name and check if it matches the parameter
 void ESMReader::getSubNameIs(const char* name)
 {
@@ -307,6 +345,12 @@ void ESMReader::getRecHeader(uint32_t &flags)
 
 void ESMReader::getExact(void*x, int size)
 {
+    if (mData)
+    {
+        memcpy(x, readMapped(size), size);
+        return;
+    }
+
     try
     {
         mEsm->read((char*)x, size);
@@ -317,9 +361,31 @@ void ESMReader::getExact(void*x, int size)
     }
 }
 
+const char* ESMReader::readMapped(size_t size)
+{
+    if (size > mFileSize - mPos)
+        fail("Read error: unexpected end of file");
+    const char* data = mData + mPos;
+    mPos += size;
+    return data;
+}
+
 std::string ESMReader::getString(int size)
 {
     size_t s = size;
+    const char* mapped = NULL;
+    if (mData)
+    {
+        // Strings are usually zero terminated in the file, so they can be converted in place. Only unterminated
+        // strings need to be copied, as the encoder expects a terminator.
+        mapped = readMapped(s);
+        size_t length = strnlen(mapped, s);
+        if (!mEncoder)
+            return std::string(mapped, length);
+        if (length < s)
+            return mEncoder->getUtf8(mapped, length);
+    }
+
     if (mBuffer.size() <= s)
         // Add some extra padding to reduce the chance of having to resize
         // again later.
@@ -330,7 +396,10 @@ std::string ESMReader::getString(int size)
 
     // read ESM data
     char *ptr = &mBuffer[0];
-    getExact(ptr, size);
+    if (mapped)
+        memcpy(ptr, mapped, s);
+    else
+        getExact(ptr, size);
 
     size = strnlen(ptr, size);
 
@@ -351,7 +420,9 @@ void ESMReader::fail(const std::string &msg)
     ss << "\n  File: " << mCtx.filename;
     ss << "\n  Record: " << mCtx.recName.toString();
     ss << "\n  Subrecord: " << mCtx.subName.toString();
-    if (mEsm.get())
+    if (mData)
+        ss << "\n  Offset: 0x" << hex << mPos;
+    else if (mEsm.get())
         ss << "\n  Offset: 0x" << hex << mEsm->tellg();
     throw std::runtime_error(ss.str());
 }
@@ -363,12 +434,17 @@ void ESMReader::setEncoder(ToUTF8::Utf8Encoder* encoder)
 
 size_t ESMReader::getFileOffset()
 {
+    if (mData)
+        return mPos;
     return mEsm->tellg();
 }
 
 void ESMReader::skip(int bytes)
 {
-    mEsm->seekg(getFileOffset()+bytes);
+    if (mData)
+        readMapped(bytes);
+    else
+        mEsm->seekg(getFileOffset()+bytes);
 }
 
 }
@@ -8,6 +8,7 @@
 #include <sstream>
 
 #include <components/files/constrainedfilestream.hpp>
+#include <components/files/memorymappedfile.hpp>
 
 #include <components/misc/stringops.hpp>
 
@@ -73,6 +74,14 @@ public:
 
   void openRaw(const std::string &filename);
 
+  /// Open files by name through a read-only memory mapping, rather than a file stream. Records are then parsed
+  /// directly from the mapping, and restoring a context only has to move the read position.
+  /// @note Affects files opened after the call, including those reopened by restoreContext().
+  void setUseMemoryMapping(bool enabled) { mUseMemoryMapping = enabled; }
+
+  /// Is the current file read from a memory mapping?
+  bool isMapped() const { return mData != NULL; }
+
   /// Get the current position in the file. Make sure that the file has been opened!
   size_t getFileOffset();
 
@@ -167,6 +176,12 @@ public:
   // Read the given number of bytes from a named subrecord
   void getHNExact(void*p, int size, const char* name);
 
+  /// Read a sub-record header (but not the name) and return a view of the sub-record data, which is consumed.
+  /// @param size Set to the size of the data.
+  /// @note If the file is mapped, the view points into the mapping and stays valid while the file is open. Otherwise
+  /// it points into an internal buffer that is only valid until the next read.
+  const char* getHView(uint32_t& size);
+
   /*************************************************************************
    *
    *  Low level sub-record methods
@@ -266,8 +281,20 @@ public:
   size_t getFileSize() const { return mFileSize; }
 
 private:
+  /// Check for and parse the TES3 header record.
+  void loadHeader();
+
+  /// Get a view of the next \a size bytes of the mapping and move past them.
+  const char* readMapped(size_t size);
+
   Files::IStreamPtr mEsm;
 
+  // Memory mapped backend; if mData is set, everything is read from it instead of mEsm
+  Files::MemoryMappedFilePtr mMapping;
+  const char* mData;
+  size_t mPos;
+  bool mUseMemoryMapping;
+
   ESM_Context mCtx;
 
   unsigned int mRecordFlags;
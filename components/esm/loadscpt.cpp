@@ -15,31 +15,29 @@ namespace ESM
     {
         int s = mData.mStringTableSize;
 
-        std::vector<char> tmp (s);
         // not using getHExact, vanilla doesn't seem to mind unused bytes at the end
-        esm.getSubHeader();
-        int left = esm.getSubSize();
-        if (left < s)
+        uint32_t left;
+        const char* table = esm.getHView(left);
+        if (left < static_cast<uint32_t>(s))
             esm.fail("SCVR string list is smaller than specified");
-        esm.getExact(&tmp[0], s);
-        if (left > s)
-            esm.skip(left-s); // skip the leftover junk
 
         // Set up the list of variable names
         mVarNames.resize(mData.mNumShorts + mData.mNumLongs + mData.mNumFloats);
 
-        // The tmp buffer is a null-byte separated string list, we
+        // The table is a null-byte separated string list, we
         // just have to pick out one string at a time.
-        char* str = &tmp[0];
+        const char* end = table + s;
+        const char* str = table;
         for (size_t i = 0; i < mVarNames.size(); i++)
         {
             // Support '\r' terminated strings like vanilla.  See Bug #1324.
-            char *termsym = strchr(str, '\r');
-            if(termsym) *termsym = '\0';
-            mVarNames[i] = std::string(str);
-            str += mVarNames[i].size() + 1;
+            const char* termsym = str;
+            while (termsym < end && *termsym != '\0' && *termsym != '\r')
+                ++termsym;
+            mVarNames[i].assign(str, termsym);
+            str = termsym + 1;
 
-            if (str - &tmp[0] > s)
+            if (str - table > s)
             {
                 // Apparently SCVR subrecord is not used and variable names are
                 // determined on the fly from the script text.  Therefore don't throw
@@ -7,6 +7,8 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <OpenThreads/ScopedLock>
+
 #include <components/misc/resourcehelpers.hpp>
 #include <components/vfs/manager.hpp>
 
@@ -452,6 +454,8 @@ namespace ESMTerrain
 
     Terrain::LayerInfo Storage::getLayerInfo(const std::string& texture)
     {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mLayerInfoMutex);
+
         // Already have this cached?
         std::map<std::string, Terrain::LayerInfo>::iterator found = mLayerInfoMap.find(texture);
         if (found != mLayerInfoMap.end())
@@ -490,6 +494,15 @@ namespace ESMTerrain
         return info;
     }
 
+    void Storage::loadCellData(int cellX, int cellY)
+    {
+        for (int y = cellY-1; y <= cellY+1; ++y)
+        {
+            for (int x = cellX-1; x <= cellX+1; ++x)
+                getLand(x, y);
+        }
+    }
+
     Terrain::LayerInfo Storage::getDefaultLayer()
     {
         Terrain::LayerInfo info;
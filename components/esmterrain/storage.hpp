@@ -1,6 +1,8 @@
 #ifndef COMPONENTS_ESM_TERRAIN_STORAGE_H
 #define COMPONENTS_ESM_TERRAIN_STORAGE_H
 
+#include <OpenThreads/Mutex>
+
 #include <components/terrain/storage.hpp>
 
 #include <components/esm/loadland.hpp>
@@ -73,6 +75,10 @@ namespace ESMTerrain
 
         virtual float getHeightAt (const osg::Vec3f& worldPos);
 
+        /// Loads the land data of the cell and its neighbours, which are used to blend normals and colours at the
+        /// cell borders.
+        virtual void loadCellData(int cellX, int cellY);
+
         virtual Terrain::LayerInfo getDefaultLayer();
 
         /// Get the transformation factor for mapping cell units to world units.
@@ -100,6 +106,7 @@ namespace ESMTerrain
         std::string getTextureName (UniqueTextureId id);
 
         std::map<std::string, Terrain::LayerInfo> mLayerInfoMap;
+        OpenThreads::Mutex mLayerInfoMutex;
 
         Terrain::LayerInfo getLayerInfo(const std::string& texture);
     };
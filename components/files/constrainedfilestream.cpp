@@ -18,6 +18,9 @@ namespace Files
         size_t mOrigin;
         size_t mSize;
 
+        // position of the file, relative to mOrigin. This is where the buffered data ends.
+        size_t mFilePos;
+
         LowLevelFile mFile;
 
         char mBuffer[sBufferSize];
@@ -34,16 +37,18 @@ namespace Files
             setg(0,0,0);
 
             mOrigin = start;
+            mFilePos = 0;
         }
 
         virtual int_type underflow()
         {
             if(gptr() == egptr())
             {
-                size_t toRead = std::min((mOrigin+mSize)-(mFile.tell()), sBufferSize);
+                size_t toRead = std::min(mSize - mFilePos, sBufferSize);
                 // Read in the next chunk of data, and set the read pointers on success
                 // Failure will throw exception in LowLevelFile
                 size_t got = mFile.read(mBuffer, toRead);
+                mFilePos += got;
                 setg(&mBuffer[0], &mBuffer[0], &mBuffer[0]+got);
             }
             if(gptr() == egptr())
@@ -65,7 +70,7 @@ namespace Files
                     newPos = offset;
                     break;
                 case std::ios_base::cur:
-                    newPos = (mFile.tell() - mOrigin - (egptr() - gptr())) + offset;
+                    newPos = (mFilePos - (egptr() - gptr())) + offset;
                     break;
                 case std::ios_base::end:
                     newPos = mSize + offset;
@@ -74,15 +79,7 @@ namespace Files
                     return traits_type::eof();
             }
 
-            if (newPos > mSize)
-                return traits_type::eof();
-
-            mFile.seek(mOrigin+newPos);
-
-            // Clear read pointers so underflow() gets called on the next read attempt.
-            setg(0, 0, 0);
-
-            return newPos;
+            return seekTo(newPos);
         }
 
         virtual pos_type seekpos(pos_type pos, std::ios_base::openmode mode)
@@ -90,16 +87,31 @@ namespace Files
             if((mode&std::ios_base::out) || !(mode&std::ios_base::in))
                 return traits_type::eof();
 
-            if ((size_t)pos > mSize)
+            return seekTo(pos);
+        }
+
+    private:
+        pos_type seekTo(size_t newPos)
+        {
+            if (newPos > mSize)
                 return traits_type::eof();
 
-            mFile.seek(mOrigin + pos);
+            // Positions within the buffered data, including tellg(), do not need to touch the file
+            size_t bufferStart = mFilePos - (egptr() - eback());
+            if (eback() && newPos >= bufferStart && newPos <= mFilePos)
+            {
+                setg(eback(), eback() + (newPos - bufferStart), egptr());
+                return newPos;
+            }
+
+            mFile.seek(mOrigin+newPos);
+            mFilePos = newPos;
 
             // Clear read pointers so underflow() gets called on the next read attempt.
             setg(0, 0, 0);
-            return pos;
-        }
 
+            return newPos;
+        }
     };
 
     ConstrainedFileStream::ConstrainedFileStream(const char *filename, size_t start, size_t length)
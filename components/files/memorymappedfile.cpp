@@ -0,0 +1,171 @@
+#include "memorymappedfile.hpp"
+
+#include <stdexcept>
+#include <sstream>
+
+#include "memorystream.hpp"
+
+#if FILE_API == FILE_API_POSIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace
+{
+
+    void fail(const std::string& filename)
+    {
+        std::ostringstream os;
+        os << "Failed to map '" << filename << "' into memory.";
+        throw std::runtime_error (os.str ());
+    }
+
+    /// Holds on to the mapping for as long as the stream reading from it exists.
+    struct IMemoryMappedStream : Files::IMemStream
+    {
+        IMemoryMappedStream(Files::MemoryMappedFilePtr file, size_t start, size_t length)
+            : Files::MemBuf(file->getData() + start, length)
+            , Files::IMemStream(file->getData() + start, length)
+            , mFile(file)
+        {
+        }
+
+        Files::MemoryMappedFilePtr mFile;
+    };
+
+}
+
+namespace Files
+{
+
+#if FILE_API == FILE_API_STDIO
+
+    MemoryMappedFile::MemoryMappedFile(const std::string &filename)
+        : mData(NULL)
+        , mSize(0)
+    {
+        LowLevelFile file;
+        file.open(filename.c_str());
+        mBuffer.resize(file.size());
+        if (!mBuffer.empty())
+        {
+            if (file.read(&mBuffer[0], mBuffer.size()) != mBuffer.size())
+                fail(filename);
+            mData = &mBuffer[0];
+        }
+        mSize = mBuffer.size();
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+    }
+
+#elif FILE_API == FILE_API_POSIX
+
+    MemoryMappedFile::MemoryMappedFile(const std::string &filename)
+        : mData(NULL)
+        , mSize(0)
+        , mMapping(MAP_FAILED)
+    {
+        int handle = ::open(filename.c_str(), O_RDONLY);
+        if (handle == -1)
+            fail(filename);
+
+        struct stat info;
+        if (::fstat(handle, &info) != 0)
+        {
+            ::close(handle);
+            fail(filename);
+        }
+
+        mSize = info.st_size;
+        if (mSize > 0)
+            mMapping = ::mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, handle, 0);
+
+        // The mapping stays valid after the file is closed
+        ::close(handle);
+
+        if (mSize > 0 && mMapping == MAP_FAILED)
+            fail(filename);
+
+        if (mSize > 0)
+            mData = static_cast<const char*>(mMapping);
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        if (mMapping != MAP_FAILED)
+            ::munmap(mMapping, mSize);
+    }
+
+#elif FILE_API == FILE_API_WIN32
+
+    MemoryMappedFile::MemoryMappedFile(const std::string &filename)
+        : mData(NULL)
+        , mSize(0)
+        , mFile(INVALID_HANDLE_VALUE)
+        , mMapping(NULL)
+    {
+        mFile = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (mFile == INVALID_HANDLE_VALUE)
+            fail(filename);
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(mFile, &size))
+        {
+            ::CloseHandle(mFile);
+            fail(filename);
+        }
+        mSize = static_cast<size_t>(size.QuadPart);
+
+        if (mSize > 0)
+        {
+            mMapping = ::CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mMapping == NULL)
+            {
+                ::CloseHandle(mFile);
+                fail(filename);
+            }
+
+            mData = static_cast<const char*>(::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+            if (mData == NULL)
+            {
+                ::CloseHandle(mMapping);
+                ::CloseHandle(mFile);
+                fail(filename);
+            }
+        }
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        if (mData != NULL)
+            ::UnmapViewOfFile(mData);
+        if (mMapping != NULL)
+            ::CloseHandle(mMapping);
+        ::CloseHandle(mFile);
+    }
+
+#endif
+
+    const char* MemoryMappedFile::getData() const
+    {
+        return mData;
+    }
+
+    size_t MemoryMappedFile::getSize() const
+    {
+        return mSize;
+    }
+
+    IStreamPtr openMemoryMappedStream(MemoryMappedFilePtr file, size_t start, size_t length)
+    {
+        if (start > file->getSize() || length > file->getSize() - start)
+            throw std::runtime_error("Memory mapped stream exceeds the mapped file");
+        return IStreamPtr(new IMemoryMappedStream(file, start, length));
+    }
+
+}
@@ -0,0 +1,52 @@
+#ifndef OPENMW_COMPONENTS_FILES_MEMORYMAPPEDFILE_H
+#define OPENMW_COMPONENTS_FILES_MEMORYMAPPEDFILE_H
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "lowlevelfile.hpp"
+#include "constrainedfilestream.hpp"
+
+namespace Files
+{
+
+    /// @brief Maps a whole file read-only into memory.
+    /// @par On platforms without memory mapping support, the file is read into memory instead.
+    class MemoryMappedFile
+    {
+    public:
+        /// @note Throws std::runtime_error if the file can not be opened or mapped.
+        MemoryMappedFile(const std::string& filename);
+        ~MemoryMappedFile();
+
+        const char* getData() const;
+
+        size_t getSize() const;
+
+    private:
+        const char* mData;
+        size_t mSize;
+
+#if FILE_API == FILE_API_STDIO
+        std::vector<char> mBuffer;
+#elif FILE_API == FILE_API_POSIX
+        void* mMapping;
+#elif FILE_API == FILE_API_WIN32
+        HANDLE mFile;
+        HANDLE mMapping;
+#endif
+
+        MemoryMappedFile(const MemoryMappedFile&);
+        void operator = (const MemoryMappedFile&);
+    };
+
+    typedef boost::shared_ptr<const MemoryMappedFile> MemoryMappedFilePtr;
+
+    /// Open a stream reading directly from a region of a mapped file, without copying. The stream keeps the mapping alive.
+    IStreamPtr openMemoryMappedStream(MemoryMappedFilePtr file, size_t start, size_t length);
+
+}
+
+#endif
@@ -14,6 +14,39 @@ namespace Files
             char* nonconstBuffer = (const_cast<char*>(buffer));
             this->setg(nonconstBuffer, nonconstBuffer, nonconstBuffer + size);
         }
+
+        virtual pos_type seekoff(off_type offset, std::ios_base::seekdir whence, std::ios_base::openmode mode)
+        {
+            if ((mode&std::ios_base::out) || !(mode&std::ios_base::in))
+                return pos_type(off_type(-1));
+
+            char* newPos;
+            switch (whence)
+            {
+                case std::ios_base::beg:
+                    newPos = eback() + offset;
+                    break;
+                case std::ios_base::cur:
+                    newPos = gptr() + offset;
+                    break;
+                case std::ios_base::end:
+                    newPos = egptr() + offset;
+                    break;
+                default:
+                    return pos_type(off_type(-1));
+            }
+
+            if (newPos < eback() || newPos > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), newPos, egptr());
+            return pos_type(newPos - eback());
+        }
+
+        virtual pos_type seekpos(pos_type pos, std::ios_base::openmode mode)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, mode);
+        }
     };
 
     /// @brief A variant of std::istream that reads from a constant in-memory buffer.
@@ -1,7 +1,7 @@
 #ifndef INTERPRETER_INTERPRETER_H_INCLUDED
 #define INTERPRETER_INTERPRETER_H_INCLUDED
 
-#include <map>
+#include <vector>
 
 #include "runtime.hpp"
 #include "types.hpp"
@@ -12,15 +12,118 @@ namespace Interpreter
     class Opcode1;
     class Opcode2;
 
+    /// Directly indexed table of the opcodes of one segment.
+    ///
+    /// Opcodes are allocated in a few contiguous ranges (e.g. the built-in ones from 0 and the
+    /// extensions from 0x2000000), so instead of one array over the whole opcode space, the table
+    /// keeps one array per range. The ranges are kept sorted and apart from each other, so
+    /// every opcode has exactly one slot. Owns the opcodes.
+    template<typename T>
+    class OpcodeTable
+    {
+            struct Range
+            {
+                int mFirst;
+                std::vector<T *> mOpcodes;
+            };
+
+            std::vector<Range> mRanges;
+
+            // not implemented
+            OpcodeTable (const OpcodeTable&);
+            OpcodeTable& operator= (const OpcodeTable&);
+
+            /// Opcodes at most this far apart share a range, the unused entries in between are NULL.
+            static const int sMaxGap = 256;
+
+            static int getEnd (const Range& range)
+            {
+                return range.mFirst + static_cast<int> (range.mOpcodes.size());
+            }
+
+            /// Append the range following \a iter to it.
+            void merge (typename std::vector<Range>::iterator iter)
+            {
+                typename std::vector<Range>::iterator next = iter+1;
+                iter->mOpcodes.resize (next->mFirst-iter->mFirst, 0);
+                iter->mOpcodes.insert (iter->mOpcodes.end(), next->mOpcodes.begin(), next->mOpcodes.end());
+                mRanges.erase (next);
+            }
+
+        public:
+
+            OpcodeTable() {}
+
+            ~OpcodeTable()
+            {
+                for (typename std::vector<Range>::iterator iter (mRanges.begin()); iter!=mRanges.end(); ++iter)
+                    for (typename std::vector<T *>::iterator iter2 (iter->mOpcodes.begin());
+                        iter2!=iter->mOpcodes.end(); ++iter2)
+                        delete *iter2;
+            }
+
+            T *find (int code) const
+            {
+                for (typename std::vector<Range>::const_iterator iter (mRanges.begin()); iter!=mRanges.end(); ++iter)
+                {
+                    if (code<iter->mFirst)
+                        break;
+
+                    unsigned int index = static_cast<unsigned int> (code - iter->mFirst);
+                    if (index<iter->mOpcodes.size())
+                        return iter->mOpcodes[index];
+                }
+
+                return 0;
+            }
+
+            void insert (int code, T *opcode)
+            {
+                // The ranges are sorted and more than sMaxGap apart, join the first one within reach of code
+                typename std::vector<Range>::iterator iter (mRanges.begin());
+                for (; iter!=mRanges.end(); ++iter)
+                    if (code<getEnd (*iter)+sMaxGap)
+                        break;
+
+                if (iter==mRanges.end() || code<iter->mFirst-sMaxGap)
+                {
+                    iter = mRanges.insert (iter, Range());
+                    iter->mFirst = code;
+                }
+                else if (code<iter->mFirst)
+                {
+                    iter->mOpcodes.insert (iter->mOpcodes.begin(), iter->mFirst-code, static_cast<T *> (0));
+                    iter->mFirst = code;
+                }
+
+                unsigned int index = code - iter->mFirst;
+                if (index>=iter->mOpcodes.size())
+                    iter->mOpcodes.resize (index+1, 0);
+
+                iter->mOpcodes[index] = opcode;
+
+                // The range might have grown into reach of its neighbours
+                if (iter!=mRanges.begin() && iter->mFirst<getEnd (*(iter-1))+sMaxGap)
+                {
+                    --iter;
+                    merge (iter);
+                }
+
+                if (iter+1!=mRanges.end() && (iter+1)->mFirst<getEnd (*iter)+sMaxGap)
+                    merge (iter);
+            }
+    };
+
     class Interpreter
     {
             Runtime mRuntime;
-            std::map<int, Opcode1 *> mSegment0;
-            std::map<int, Opcode2 *> mSegment1;
-            std::map<int, Opcode1 *> mSegment2;
-            std::map<int, Opcode1 *> mSegment3;
-            std::map<int, Opcode2 *> mSegment4;
-            std::map<int, Opcode0 *> mSegment5;
+            OpcodeTable<Opcode1> mSegment0;
+            OpcodeTable<Opcode2> mSegment1;
+            OpcodeTable<Opcode1> mSegment2;
+            OpcodeTable<Opcode1> mSegment3;
+            OpcodeTable<Opcode2> mSegment4;
+            OpcodeTable<Opcode0> mSegment5;
+            unsigned long long mInstructionCount;
 
             // not implemented
             Interpreter (const Interpreter&);
@@ -57,6 +160,9 @@ namespace Interpreter
             ///< ownership of \a opcode is transferred to *this.
 
             void run (const Type_Code *code, int codeSize, Context& context);
+
+            unsigned long long getInstructionCount() const;
+            ///< Number of instructions executed since this interpreter was created.
     };
 }
 
@@ -0,0 +1,30 @@
+#ifndef OPENMW_COMPONENTS_MISC_HASH_H
+#define OPENMW_COMPONENTS_MISC_HASH_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+namespace Misc
+{
+
+/// 64 bit FNV-1a hash of \a size bytes at \a data. Fast and well distributed, but not suitable against deliberate collisions.
+inline uint64_t fnv1aHash(const char* data, std::size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i=0; i<size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1aHash(const std::string& text)
+{
+    return fnv1aHash(text.data(), text.size());
+}
+
+}
+
+#endif
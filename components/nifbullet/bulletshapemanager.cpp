@@ -8,7 +8,7 @@ namespace NifBullet
 {
 
 BulletShapeManager::BulletShapeManager(const VFS::Manager* vfs)
-    : mVFS(vfs)
+    : Resource::ResourceManager(vfs)
 {
 
 }
@@ -18,30 +18,46 @@ BulletShapeManager::~BulletShapeManager()
 
 }
 
-osg::ref_ptr<BulletShapeInstance> BulletShapeManager::createInstance(const std::string &name)
+osg::ref_ptr<BulletShape> BulletShapeManager::getShape(const std::string &name)
+{
+    return getShape(mVFS->makeKey(name));
+}
+
+osg::ref_ptr<BulletShape> BulletShapeManager::getShape(const VFS::FileKey &key)
 {
-    std::string normalized = name;
-    mVFS->normalizeFilename(normalized);
+    const std::string& normalized = key.getName();
 
-    osg::ref_ptr<BulletShape> shape;
-    Index::iterator it = mIndex.find(normalized);
-    if (it == mIndex.end())
-    {
-        Files::IStreamPtr file = mVFS->get(normalized);
+    osg::ref_ptr<osg::Referenced> cached = mCache.getRefFromObjectCache(key);
+    if (cached)
+        return static_cast<BulletShape*>(cached.get());
 
-        // TODO: add support for non-NIF formats
+    Files::IStreamPtr file = mVFS->get(key);
 
-        BulletNifLoader loader;
-        // might be worth sharing NIFFiles with SceneManager in some way
-        shape = loader.load(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)));
+    // TODO: add support for non-NIF formats
 
-        mIndex[normalized] = shape;
-    }
-    else
-        shape = it->second;
+    BulletNifLoader loader;
+    // might be worth sharing NIFFiles with SceneManager in some way
+    osg::ref_ptr<BulletShape> shape = loader.load(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)));
 
+    cached = mCache.addEntryToObjectCache(key, shape);
+    return static_cast<BulletShape*>(cached.get());
+}
+
+osg::ref_ptr<BulletShapeInstance> BulletShapeManager::createInstance(const std::string &name)
+{
+    osg::ref_ptr<BulletShape> shape = getShape(name);
     osg::ref_ptr<BulletShapeInstance> instance = shape->makeInstance();
     return instance;
 }
 
+void BulletShapeManager::updateCache(double referenceTime)
+{
+    mCache.update(referenceTime, referenceTime - mExpiryDelay);
+}
+
+unsigned int BulletShapeManager::getCacheSize() const
+{
+    return mCache.getCacheSize();
+}
+
 }
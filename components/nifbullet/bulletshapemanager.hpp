@@ -1,20 +1,13 @@
 #ifndef OPENMW_COMPONENTS_BULLETSHAPEMANAGER_H
 #define OPENMW_COMPONENTS_BULLETSHAPEMANAGER_H
 
-#include <map>
 #include <string>
 
 #include <osg/ref_ptr>
 
-namespace VFS
-{
-    class Manager;
-}
-
-namespace Resource
-{
-    class SceneManager;
-}
+#include <components/vfs/filekey.hpp>
+#include <components/resource/resourcemanager.hpp>
+#include <components/resource/objectcache.hpp>
 
 namespace NifBullet
 {
@@ -22,19 +15,32 @@ namespace NifBullet
     class BulletShape;
     class BulletShapeInstance;
 
-    class BulletShapeManager
+    /// @brief Handles loading and caching of collision shapes.
+    /// @note Thread safe, so shapes may be loaded from background threads.
+    class BulletShapeManager : public Resource::ResourceManager
     {
     public:
         BulletShapeManager(const VFS::Manager* vfs);
         ~BulletShapeManager();
 
+        /// Get the shared, read-only shape for the given mesh, loading it if necessary.
+        osg::ref_ptr<BulletShape> getShape(const std::string& name);
+
+        /// @see getShape
+        /// @note Use this overload when looking up the same file repeatedly, see VFS::Manager::makeKey.
+        osg::ref_ptr<BulletShape> getShape(const VFS::FileKey& key);
+
         osg::ref_ptr<BulletShapeInstance> createInstance(const std::string& name);
 
-    private:
-        const VFS::Manager* mVFS;
+        virtual void updateCache(double referenceTime);
+
+        /// @note Shapes are small compared to meshes and textures, so they are not size bounded and only expire.
+        virtual void setMemoryBudget(size_t budget) {}
 
-        typedef std::map<std::string, osg::ref_ptr<BulletShape> > Index;
-        Index mIndex;
+        unsigned int getCacheSize() const;
+
+    private:
+        Resource::GenericObjectCache<VFS::FileKey> mCache;
     };
 
 }
@@ -237,11 +237,11 @@ void GeomMorpherController::update(osg::NodeVisitor *nv, osg::Drawable *drawable
                     val = interpKey((*it)->mKeys, input);
                 val = std::max(0.f, std::min(1.f, val));
 
-                morphGeom->setWeight(i, val);
+                // setWeight() dirties the geometry, even for the same weight
+                if (morphGeom->getMorphTarget(i).getWeight() != val)
+                    morphGeom->setWeight(i, val);
             }
         }
-
-        morphGeom->transformSoftwareMethod();
     }
 }
 
@@ -106,6 +106,8 @@ namespace NifOsg
 
         META_Object(NifOsg, GeomMorpherController)
 
+        /// Set the morph weights. The vertices are morphed later by the cull callback of the geometry, and only if it
+        /// is in view and the weights changed.
         virtual void update(osg::NodeVisitor* nv, osg::Drawable* drawable);
 
     private:
@@ -0,0 +1,228 @@
+#ifndef OPENMW_COMPONENTS_RESOURCE_OBJECTCACHE_H
+#define OPENMW_COMPONENTS_RESOURCE_OBJECTCACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
+namespace Resource
+{
+
+    /// @brief Cache for loaded resources, keyed by \a KeyType.
+    /// @par Objects that are still referenced from outside the cache, or that have instances registered with addInstance(),
+    /// are kept. Other objects are removed once they have not been used for a while, or earlier, least recently used
+    /// first, if the cache exceeds its memory budget.
+    /// @note Thread safe.
+    template <typename KeyType>
+    class GenericObjectCache
+    {
+    public:
+        GenericObjectCache()
+            : mCurrentTime(0.0)
+            , mMemoryBudget(0)
+            , mMemoryUsage(0)
+        {
+        }
+
+        /// Add an object to the cache. If an entry with this key exists already, e.g. because another thread loaded the
+        /// same resource meanwhile, the existing object is kept.
+        /// @param size Estimated memory used by the object, in bytes.
+        /// @return The cached object.
+        osg::ref_ptr<osg::Referenced> addEntryToObjectCache(const KeyType& key, osg::Referenced* object, size_t size = 0)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            typename ObjectCacheMap::iterator found = mObjectCache.find(key);
+            if (found != mObjectCache.end())
+            {
+                found->second.mLastUsed = mCurrentTime;
+                return found->second.mObject;
+            }
+
+            Entry entry;
+            entry.mObject = object;
+            entry.mLastUsed = mCurrentTime;
+            entry.mSize = size;
+            mObjectCache.insert(std::make_pair(key, entry));
+            mMemoryUsage += size;
+            return object;
+        }
+
+        /// Get an object from the cache and mark it as used, or NULL if it is not cached.
+        osg::ref_ptr<osg::Referenced> getRefFromObjectCache(const KeyType& key)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            typename ObjectCacheMap::iterator found = mObjectCache.find(key);
+            if (found == mObjectCache.end())
+                return NULL;
+            found->second.mLastUsed = mCurrentTime;
+            return found->second.mObject;
+        }
+
+        /// Keep the object of \a key cached for as long as \a instance exists. For copies of the object that do not
+        /// reference it, e.g. cloned scene graphs.
+        void addInstance(const KeyType& key, osg::Referenced* instance)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            typename ObjectCacheMap::iterator found = mObjectCache.find(key);
+            if (found != mObjectCache.end())
+            {
+                // Only look for deleted instances when the list would grow, which keeps it at most twice as long as the
+                // number of live instances without scanning it on every call
+                std::vector<osg::observer_ptr<osg::Referenced> >& instances = found->second.mInstances;
+                if (instances.size() == instances.capacity())
+                    removeDeletedInstances(found->second);
+                instances.push_back(instance);
+            }
+        }
+
+        /// Mark objects that are referenced from outside the cache as used at \a referenceTime, then remove the
+        /// unreferenced objects that were last used before \a expiryTime. Finally, remove unreferenced objects in least
+        /// recently used order while the cache exceeds its memory budget.
+        /// @return The number of objects removed.
+        unsigned int update(double referenceTime, double expiryTime)
+        {
+            // Release the objects after unlocking, destroying them may take a while
+            std::vector<osg::ref_ptr<osg::Referenced> > removed;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+                mCurrentTime = referenceTime;
+
+                for (typename ObjectCacheMap::iterator it = mObjectCache.begin(); it != mObjectCache.end();)
+                {
+                    if (isReferenced(it->second))
+                        it->second.mLastUsed = referenceTime;
+                    else if (it->second.mLastUsed < expiryTime)
+                    {
+                        removed.push_back(it->second.mObject);
+                        mMemoryUsage -= it->second.mSize;
+                        mObjectCache.erase(it++);
+                        continue;
+                    }
+                    ++it;
+                }
+
+                if (mMemoryBudget > 0 && mMemoryUsage > mMemoryBudget)
+                {
+                    typedef std::multimap<double, typename ObjectCacheMap::iterator> LastUsedMap;
+                    LastUsedMap candidates;
+                    for (typename ObjectCacheMap::iterator it = mObjectCache.begin(); it != mObjectCache.end(); ++it)
+                    {
+                        if (!isReferenced(it->second))
+                            candidates.insert(std::make_pair(it->second.mLastUsed, it));
+                    }
+
+                    for (typename LastUsedMap::iterator it = candidates.begin(); it != candidates.end() && mMemoryUsage > mMemoryBudget; ++it)
+                    {
+                        removed.push_back(it->second->second.mObject);
+                        mMemoryUsage -= it->second->second.mSize;
+                        mObjectCache.erase(it->second);
+                    }
+                }
+            }
+            return removed.size();
+        }
+
+        void removeFromObjectCache(const KeyType& key)
+        {
+            osg::ref_ptr<osg::Referenced> removed;
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            typename ObjectCacheMap::iterator found = mObjectCache.find(key);
+            if (found != mObjectCache.end())
+            {
+                removed = found->second.mObject;
+                mMemoryUsage -= found->second.mSize;
+                mObjectCache.erase(found);
+            }
+        }
+
+        void clear()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            mObjectCache.clear();
+            mMemoryUsage = 0;
+        }
+
+        /// @param budget Memory the cached objects may use, in bytes. 0 for no limit.
+        void setMemoryBudget(size_t budget)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            mMemoryBudget = budget;
+        }
+
+        unsigned int getCacheSize() const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            return mObjectCache.size();
+        }
+
+        /// Estimated memory used by the cached objects, in bytes.
+        size_t getMemoryUsage() const
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            return mMemoryUsage;
+        }
+
+        /// Call \a functor(const KeyType&, osg::Referenced*) for each cached object.
+        /// @note The cache is locked meanwhile, so the functor must not use it.
+        template <class Functor>
+        void call(Functor& functor)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+            for (typename ObjectCacheMap::iterator it = mObjectCache.begin(); it != mObjectCache.end(); ++it)
+                functor(it->first, it->second.mObject.get());
+        }
+
+    private:
+        struct Entry
+        {
+            osg::ref_ptr<osg::Referenced> mObject;
+            double mLastUsed;
+            size_t mSize;
+            std::vector<osg::observer_ptr<osg::Referenced> > mInstances;
+        };
+
+        /// Is the object of \a entry used outside of the cache? Forgets the instances that were deleted.
+        static bool isReferenced(Entry& entry)
+        {
+            removeDeletedInstances(entry);
+            return entry.mObject->referenceCount() > 1 || !entry.mInstances.empty();
+        }
+
+        /// Forget the instances of \a entry that were deleted.
+        static void removeDeletedInstances(Entry& entry)
+        {
+            for (unsigned int i=0; i<entry.mInstances.size(); )
+            {
+                if (entry.mInstances[i].valid())
+                    ++i;
+                else
+                {
+                    entry.mInstances[i] = entry.mInstances.back();
+                    entry.mInstances.pop_back();
+                }
+            }
+        }
+
+        typedef std::map<KeyType, Entry> ObjectCacheMap;
+        ObjectCacheMap mObjectCache;
+
+        double mCurrentTime;
+        size_t mMemoryBudget;
+        size_t mMemoryUsage;
+
+        mutable OpenThreads::Mutex mMutex;
+
+        GenericObjectCache(const GenericObjectCache&);
+        void operator = (const GenericObjectCache&);
+    };
+
+}
+
+#endif
@@ -0,0 +1,26 @@
+#include "resourcemanager.hpp"
+
+namespace Resource
+{
+
+    ResourceManager::ResourceManager(const VFS::Manager *vfs)
+        : mVFS(vfs)
+        , mExpiryDelay(0.0)
+    {
+    }
+
+    ResourceManager::~ResourceManager()
+    {
+    }
+
+    void ResourceManager::setExpiryDelay(double expiryDelay)
+    {
+        mExpiryDelay = expiryDelay;
+    }
+
+    const VFS::Manager* ResourceManager::getVFS() const
+    {
+        return mVFS;
+    }
+
+}
@@ -0,0 +1,41 @@
+#ifndef OPENMW_COMPONENTS_RESOURCE_MANAGER_H
+#define OPENMW_COMPONENTS_RESOURCE_MANAGER_H
+
+#include <cstddef>
+
+namespace VFS
+{
+    class Manager;
+}
+
+namespace Resource
+{
+
+    /// @brief Base class for managers that cache loaded resources.
+    class ResourceManager
+    {
+    public:
+        ResourceManager(const VFS::Manager* vfs);
+        virtual ~ResourceManager();
+
+        /// Remove cached resources that have not been referenced for longer than the expiry delay, and then the least
+        /// recently used ones until the memory budget is met.
+        /// @param referenceTime The current time, in seconds.
+        virtual void updateCache(double referenceTime) = 0;
+
+        /// How long to keep unreferenced resources in the cache, in seconds.
+        void setExpiryDelay(double expiryDelay);
+
+        /// Memory the cached resources may use, in bytes. 0 for no limit.
+        virtual void setMemoryBudget(size_t budget) = 0;
+
+        const VFS::Manager* getVFS() const;
+
+    protected:
+        const VFS::Manager* mVFS;
+        double mExpiryDelay;
+    };
+
+}
+
+#endif
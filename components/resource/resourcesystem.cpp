@@ -1,5 +1,7 @@
 #include "resourcesystem.hpp"
 
+#include <algorithm>
+
 #include "scenemanager.hpp"
 #include "texturemanager.hpp"
 
@@ -8,9 +10,13 @@ namespace Resource
 
     ResourceSystem::ResourceSystem(const VFS::Manager *vfs)
         : mVFS(vfs)
+        , mExpiryDelay(0.0)
     {
         mTextureManager.reset(new TextureManager(vfs));
         mSceneManager.reset(new SceneManager(vfs, mTextureManager.get()));
+
+        addResourceManager(mTextureManager.get());
+        addResourceManager(mSceneManager.get());
     }
 
     ResourceSystem::~ResourceSystem()
@@ -28,6 +34,32 @@ namespace Resource
         return mTextureManager.get();
     }
 
+    void ResourceSystem::updateCache(double referenceTime)
+    {
+        for (std::vector<ResourceManager*>::iterator it = mResourceManagers.begin(); it != mResourceManagers.end(); ++it)
+            (*it)->updateCache(referenceTime);
+    }
+
+    void ResourceSystem::setExpiryDelay(double expiryDelay)
+    {
+        mExpiryDelay = expiryDelay;
+        for (std::vector<ResourceManager*>::iterator it = mResourceManagers.begin(); it != mResourceManagers.end(); ++it)
+            (*it)->setExpiryDelay(expiryDelay);
+    }
+
+    void ResourceSystem::addResourceManager(ResourceManager *resourceMgr)
+    {
+        resourceMgr->setExpiryDelay(mExpiryDelay);
+        mResourceManagers.push_back(resourceMgr);
+    }
+
+    void ResourceSystem::removeResourceManager(ResourceManager *resourceMgr)
+    {
+        std::vector<ResourceManager*>::iterator found = std::find(mResourceManagers.begin(), mResourceManagers.end(), resourceMgr);
+        if (found != mResourceManagers.end())
+            mResourceManagers.erase(found);
+    }
+
     const VFS::Manager* ResourceSystem::getVFS() const
     {
         return mVFS;
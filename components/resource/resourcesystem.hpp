@@ -2,6 +2,7 @@
 #define OPENMW_COMPONENTS_RESOURCE_RESOURCESYSTEM_H
 
 #include <memory>
+#include <vector>
 
 namespace VFS
 {
@@ -13,6 +14,7 @@ namespace Resource
 
     class SceneManager;
     class TextureManager;
+    class ResourceManager;
 
     /// @brief Wrapper class that constructs and provides access to the various resource subsystems.
     /// @par Resource subsystems can be used with multiple OpenGL contexts, just like the OSG equivalents, but
@@ -26,12 +28,33 @@ namespace Resource
         SceneManager* getSceneManager();
         TextureManager* getTextureManager();
 
+        /// Indicates to each resource manager to clear the cache, i.e. to drop cached objects that are no longer
+        /// referenced and have not been used for longer than the expiry delay, or exceed the memory budget.
+        /// @param referenceTime The current time, in seconds.
+        /// @note May be called from any thread if you do not add or remove resource managers at that point.
+        void updateCache(double referenceTime);
+
+        /// How long to keep unreferenced resources in the caches, in seconds.
+        void setExpiryDelay(double expiryDelay);
+
+        /// Add a resource manager to the list of managers to update in updateCache. The ResourceSystem does not take
+        /// ownership of the manager. The expiry delay already set is applied to the manager.
+        void addResourceManager(ResourceManager* resourceMgr);
+
+        void removeResourceManager(ResourceManager* resourceMgr);
+
         const VFS::Manager* getVFS() const;
 
     private:
         std::auto_ptr<SceneManager> mSceneManager;
         std::auto_ptr<TextureManager> mTextureManager;
 
+        // Store the base classes separately to get convenient access to the common interface
+        // Here users can register their own resourcemanager as well
+        std::vector<ResourceManager*> mResourceManagers;
+
+        double mExpiryDelay;
+
         const VFS::Manager* mVFS;
 
         ResourceSystem(const ResourceSystem&);
@@ -18,6 +18,7 @@
 
 #include <components/sceneutil/clone.hpp>
 #include <components/sceneutil/util.hpp>
+#include <components/sceneutil/visitor.hpp>
 
 namespace
 {
@@ -82,7 +83,7 @@ namespace Resource
 {
 
     SceneManager::SceneManager(const VFS::Manager *vfs, Resource::TextureManager* textureManager)
-        : mVFS(vfs)
+        : ResourceManager(vfs)
         , mTextureManager(textureManager)
     {
     }
@@ -94,44 +95,55 @@ namespace Resource
 
     osg::ref_ptr<const osg::Node> SceneManager::getTemplate(const std::string &name)
     {
-        std::string normalized = name;
-        mVFS->normalizeFilename(normalized);
+        return getTemplate(mVFS->makeKey(name));
+    }
+
+    osg::ref_ptr<const osg::Node> SceneManager::getTemplate(const VFS::FileKey &key)
+    {
+        const std::string& normalized = key.getName();
 
-        Index::iterator it = mIndex.find(normalized);
-        if (it == mIndex.end())
+        osg::ref_ptr<osg::Referenced> cached = mCache.getRefFromObjectCache(key);
+        if (cached)
+            return static_cast<const osg::Node*>(cached.get());
+
+        // Load without holding the lock, so that other threads can keep using the cache meanwhile
+        // TODO: add support for non-NIF formats
+        osg::ref_ptr<osg::Node> loaded;
+        try
         {
-            // TODO: add support for non-NIF formats
-            osg::ref_ptr<osg::Node> loaded;
-            try
-            {
-                Files::IStreamPtr file = mVFS->get(normalized);
+            Files::IStreamPtr file = mVFS->get(key);
 
-                loaded = NifOsg::Loader::load(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)), mTextureManager);
-            }
-            catch (std::exception& e)
-            {
-                std::cerr << "Failed to load '" << name << "': " << e.what() << ", using marker_error.nif instead" << std::endl;
-                Files::IStreamPtr file = mVFS->get("meshes/marker_error.nif");
-                loaded = NifOsg::Loader::load(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)), mTextureManager);
-            }
+            loaded = NifOsg::Loader::load(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)), mTextureManager);
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Failed to load '" << normalized << "': " << e.what() << ", using marker_error.nif instead" << std::endl;
+            Files::IStreamPtr file = mVFS->get("meshes/marker_error.nif");
+            loaded = NifOsg::Loader::load(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)), mTextureManager);
+        }
 
-            osgDB::Registry::instance()->getOrCreateSharedStateManager()->share(loaded.get());
-            // TODO: run SharedStateManager::prune on unload
+        osgDB::Registry::instance()->getOrCreateSharedStateManager()->share(loaded.get());
 
-            if (mIncrementalCompileOperation)
-                mIncrementalCompileOperation->add(loaded);
+        // Textures are accounted for by the TextureManager
+        SceneUtil::EstimateMemoryVisitor estimate(false);
+        loaded->accept(estimate);
 
-            mIndex[normalized] = loaded;
-            return loaded;
-        }
-        else
-            return it->second;
+        // Another thread may have loaded the same file meanwhile; keep the first one so that all users share it
+        cached = mCache.addEntryToObjectCache(key, loaded, estimate.mSize);
+        if (cached == loaded && mIncrementalCompileOperation)
+            mIncrementalCompileOperation->add(loaded);
+
+        return static_cast<const osg::Node*>(cached.get());
     }
 
     osg::ref_ptr<osg::Node> SceneManager::createInstance(const std::string &name)
     {
-        osg::ref_ptr<const osg::Node> scene = getTemplate(name);
+        VFS::FileKey key = mVFS->makeKey(name);
+        osg::ref_ptr<const osg::Node> scene = getTemplate(key);
         osg::ref_ptr<osg::Node> cloned = osg::clone(scene.get(), SceneUtil::CopyOp());
+
+        // The clone does not reference the template, but shares most of its data
+        mCache.addInstance(key, cloned);
         return cloned;
     }
 
@@ -144,22 +156,20 @@ namespace Resource
 
     osg::ref_ptr<const NifOsg::KeyframeHolder> SceneManager::getKeyframes(const std::string &name)
     {
-        std::string normalized = name;
-        mVFS->normalizeFilename(normalized);
+        VFS::FileKey key = mVFS->makeKey(name);
+        const std::string& normalized = key.getName();
 
-        KeyframeIndex::iterator it = mKeyframeIndex.find(normalized);
-        if (it == mKeyframeIndex.end())
-        {
-            Files::IStreamPtr file = mVFS->get(normalized);
+        osg::ref_ptr<osg::Referenced> cached = mKeyframeCache.getRefFromObjectCache(key);
+        if (cached)
+            return static_cast<const NifOsg::KeyframeHolder*>(cached.get());
 
-            osg::ref_ptr<NifOsg::KeyframeHolder> loaded (new NifOsg::KeyframeHolder);
-            NifOsg::Loader::loadKf(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)), *loaded.get());
+        Files::IStreamPtr file = mVFS->get(key);
 
-            mKeyframeIndex[normalized] = loaded;
-            return loaded;
-        }
-        else
-            return it->second;
+        osg::ref_ptr<NifOsg::KeyframeHolder> loaded (new NifOsg::KeyframeHolder);
+        NifOsg::Loader::loadKf(Nif::NIFFilePtr(new Nif::NIFFile(file, normalized)), *loaded.get());
+
+        cached = mKeyframeCache.addEntryToObjectCache(key, loaded);
+        return static_cast<const NifOsg::KeyframeHolder*>(cached.get());
     }
 
     void SceneManager::attachTo(osg::Node *instance, osg::Group *parentNode) const
@@ -168,12 +178,25 @@ namespace Resource
         notifyAttached(instance);
     }
 
-    void SceneManager::releaseGLObjects(osg::State *state)
+    namespace
     {
-        for (Index::iterator it = mIndex.begin(); it != mIndex.end(); ++it)
+        struct ReleaseGLObjectsFunctor
         {
-            it->second->releaseGLObjects(state);
-        }
+            ReleaseGLObjectsFunctor(osg::State* state) : mState(state) {}
+
+            void operator() (const VFS::FileKey& key, osg::Referenced* object)
+            {
+                static_cast<osg::Node*>(object)->releaseGLObjects(mState);
+            }
+
+            osg::State* mState;
+        };
+    }
+
+    void SceneManager::releaseGLObjects(osg::State *state)
+    {
+        ReleaseGLObjectsFunctor functor(state);
+        mCache.call(functor);
     }
 
     void SceneManager::setIncrementalCompileOperation(osgUtil::IncrementalCompileOperation *ico)
@@ -187,14 +210,34 @@ namespace Resource
         node->accept(visitor);
     }
 
-    const VFS::Manager* SceneManager::getVFS() const
+    Resource::TextureManager* SceneManager::getTextureManager()
     {
-        return mVFS;
+        return mTextureManager;
     }
 
-    Resource::TextureManager* SceneManager::getTextureManager()
+    void SceneManager::updateCache(double referenceTime)
     {
-        return mTextureManager;
+        unsigned int removed = mCache.update(referenceTime, referenceTime - mExpiryDelay);
+        mKeyframeCache.update(referenceTime, referenceTime - mExpiryDelay);
+
+        // Unshare state that was only used by the removed templates
+        if (removed > 0)
+            osgDB::Registry::instance()->getOrCreateSharedStateManager()->prune();
+    }
+
+    void SceneManager::setMemoryBudget(size_t budget)
+    {
+        mCache.setMemoryBudget(budget);
+    }
+
+    unsigned int SceneManager::getCacheSize() const
+    {
+        return mCache.getCacheSize() + mKeyframeCache.getCacheSize();
+    }
+
+    size_t SceneManager::getCacheMemoryUsage() const
+    {
+        return mCache.getMemoryUsage();
     }
 
 }
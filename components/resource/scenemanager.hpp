@@ -2,21 +2,20 @@
 #define OPENMW_COMPONENTS_RESOURCE_SCENEMANAGER_H
 
 #include <string>
-#include <map>
 
 #include <osg/ref_ptr>
 #include <osg/Node>
 
+#include <components/vfs/filekey.hpp>
+
+#include "resourcemanager.hpp"
+#include "objectcache.hpp"
+
 namespace Resource
 {
     class TextureManager;
 }
 
-namespace VFS
-{
-    class Manager;
-}
-
 namespace NifOsg
 {
     class KeyframeHolder;
@@ -31,7 +30,8 @@ namespace Resource
 {
 
     /// @brief Handles loading and caching of scenes, e.g. NIF files
-    class SceneManager
+    /// @note getTemplate and getKeyframes are thread safe, so templates may be loaded from background threads.
+    class SceneManager : public ResourceManager
     {
     public:
         SceneManager(const VFS::Manager* vfs, Resource::TextureManager* textureManager);
@@ -42,6 +42,10 @@ namespace Resource
         ///  If even the error marker mesh can not be found, an exception is thrown.
         osg::ref_ptr<const osg::Node> getTemplate(const std::string& name);
 
+        /// @see getTemplate
+        /// @note Use this overload when looking up the same file repeatedly, see VFS::Manager::makeKey.
+        osg::ref_ptr<const osg::Node> getTemplate(const VFS::FileKey& key);
+
         /// Create an instance of the given scene template
         /// @see getTemplate
         osg::ref_ptr<osg::Node> createInstance(const std::string& name);
@@ -69,22 +73,27 @@ namespace Resource
         /// @note If you used SceneManager::attachTo, this was called automatically.
         void notifyAttached(osg::Node* node) const;
 
-        const VFS::Manager* getVFS() const;
-
         Resource::TextureManager* getTextureManager();
 
+        virtual void updateCache(double referenceTime);
+
+        /// @note The budget applies to scene templates; keyframes are small and only expire.
+        virtual void setMemoryBudget(size_t budget);
+
+        /// Number of scene templates and keyframe sets in the cache.
+        unsigned int getCacheSize() const;
+
+        /// Estimated memory used by the cached scene templates, in bytes.
+        size_t getCacheMemoryUsage() const;
+
     private:
-        const VFS::Manager* mVFS;
         Resource::TextureManager* mTextureManager;
 
         osg::ref_ptr<osgUtil::IncrementalCompileOperation> mIncrementalCompileOperation;
 
-        // observer_ptr?
-        typedef std::map<std::string, osg::ref_ptr<const osg::Node> > Index;
-        Index mIndex;
+        GenericObjectCache<VFS::FileKey> mCache;
 
-        typedef std::map<std::string, osg::ref_ptr<const NifOsg::KeyframeHolder> > KeyframeIndex;
-        KeyframeIndex mKeyframeIndex;
+        GenericObjectCache<VFS::FileKey> mKeyframeCache;
 
         SceneManager(const SceneManager&);
         void operator = (const SceneManager&);
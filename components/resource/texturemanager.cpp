@@ -45,7 +45,7 @@ namespace Resource
 {
 
     TextureManager::TextureManager(const VFS::Manager *vfs)
-        : mVFS(vfs)
+        : ResourceManager(vfs)
         , mMinFilter(osg::Texture::LINEAR_MIPMAP_LINEAR)
         , mMagFilter(osg::Texture::LINEAR)
         , mMaxAnisotropy(1)
@@ -65,50 +65,64 @@ namespace Resource
         mUnRefImageDataAfterApply = unref;
     }
 
-    void TextureManager::setFilterSettings(osg::Texture::FilterMode minFilter, osg::Texture::FilterMode magFilter, int maxAnisotropy)
+    namespace
     {
-        mMinFilter = minFilter;
-        mMagFilter = magFilter;
-        mMaxAnisotropy = std::max(1, maxAnisotropy);
-
-        for (std::map<MapKey, osg::ref_ptr<osg::Texture2D> >::iterator it = mTextures.begin(); it != mTextures.end(); ++it)
+        struct UpdateFilterSettingsFunctor
         {
-            osg::ref_ptr<osg::Texture2D> tex = it->second;
+            UpdateFilterSettingsFunctor(osg::Texture::FilterMode minFilter, osg::Texture::FilterMode magFilter, int maxAnisotropy)
+                : mMinFilter(minFilter)
+                , mMagFilter(magFilter)
+                , mMaxAnisotropy(maxAnisotropy)
+            {
+            }
 
-            // Keep mip-mapping disabled if the texture creator explicitely requested no mipmapping.
-            osg::Texture::FilterMode oldMin = tex->getFilter(osg::Texture::MIN_FILTER);
-            if (oldMin == osg::Texture::LINEAR || oldMin == osg::Texture::NEAREST)
+            template <typename KeyType>
+            void operator() (const KeyType& key, osg::Referenced* object)
             {
-                osg::Texture::FilterMode newMin = osg::Texture::LINEAR;
-                switch (mMinFilter)
+                osg::Texture2D* tex = static_cast<osg::Texture2D*>(object);
+
+                // Keep mip-mapping disabled if the texture creator explicitely requested no mipmapping.
+                osg::Texture::FilterMode oldMin = tex->getFilter(osg::Texture::MIN_FILTER);
+                if (oldMin == osg::Texture::LINEAR || oldMin == osg::Texture::NEAREST)
                 {
-                case osg::Texture::LINEAR:
-                case osg::Texture::LINEAR_MIPMAP_LINEAR:
-                case osg::Texture::LINEAR_MIPMAP_NEAREST:
-                    newMin = osg::Texture::LINEAR;
-                    break;
-                case osg::Texture::NEAREST:
-                case osg::Texture::NEAREST_MIPMAP_LINEAR:
-                case osg::Texture::NEAREST_MIPMAP_NEAREST:
-                    newMin = osg::Texture::NEAREST;
-                    break;
+                    osg::Texture::FilterMode newMin = osg::Texture::LINEAR;
+                    switch (mMinFilter)
+                    {
+                    case osg::Texture::LINEAR:
+                    case osg::Texture::LINEAR_MIPMAP_LINEAR:
+                    case osg::Texture::LINEAR_MIPMAP_NEAREST:
+                        newMin = osg::Texture::LINEAR;
+                        break;
+                    case osg::Texture::NEAREST:
+                    case osg::Texture::NEAREST_MIPMAP_LINEAR:
+                    case osg::Texture::NEAREST_MIPMAP_NEAREST:
+                        newMin = osg::Texture::NEAREST;
+                        break;
+                    }
+                    tex->setFilter(osg::Texture::MIN_FILTER, newMin);
                 }
-                tex->setFilter(osg::Texture::MIN_FILTER, newMin);
+                else
+                    tex->setFilter(osg::Texture::MIN_FILTER, mMinFilter);
+
+                tex->setFilter(osg::Texture::MAG_FILTER, mMagFilter);
+                tex->setMaxAnisotropy(static_cast<float>(mMaxAnisotropy));
             }
-            else
-                tex->setFilter(osg::Texture::MIN_FILTER, mMinFilter);
 
-            tex->setFilter(osg::Texture::MAG_FILTER, mMagFilter);
-            tex->setMaxAnisotropy(static_cast<float>(mMaxAnisotropy));
-        }
+            osg::Texture::FilterMode mMinFilter;
+            osg::Texture::FilterMode mMagFilter;
+            int mMaxAnisotropy;
+        };
     }
 
-    /*
-    osg::ref_ptr<osg::Image> TextureManager::getImage(const std::string &filename)
+    void TextureManager::setFilterSettings(osg::Texture::FilterMode minFilter, osg::Texture::FilterMode magFilter, int maxAnisotropy)
     {
+        mMinFilter = minFilter;
+        mMagFilter = magFilter;
+        mMaxAnisotropy = std::max(1, maxAnisotropy);
 
+        UpdateFilterSettingsFunctor functor(mMinFilter, mMagFilter, mMaxAnisotropy);
+        mCache.call(functor);
     }
-    */
 
     bool checkSupported(osg::Image* image, const std::string& filename)
     {
@@ -143,76 +157,85 @@ namespace Resource
         return true;
     }
 
-    osg::ref_ptr<osg::Texture2D> TextureManager::getTexture2D(const std::string &filename, osg::Texture::WrapMode wrapS, osg::Texture::WrapMode wrapT)
+    osg::ref_ptr<osg::Image> TextureManager::getImage(const std::string &filename)
     {
-        std::string normalized = filename;
-        mVFS->normalizeFilename(normalized);
-        MapKey key = std::make_pair(std::make_pair(wrapS, wrapT), normalized);
-        std::map<MapKey, osg::ref_ptr<osg::Texture2D> >::iterator found = mTextures.find(key);
-        if (found != mTextures.end())
+        return getImage(mVFS->makeKey(filename));
+    }
+
+    osg::ref_ptr<osg::Image> TextureManager::getImage(const VFS::FileKey &fileKey)
+    {
+        const std::string& normalized = fileKey.getName();
+
+        Files::IStreamPtr stream;
+        try
         {
-            return found->second;
+            stream = mVFS->get(fileKey);
         }
-        else
+        catch (std::exception& e)
         {
-            Files::IStreamPtr stream;
-            try
-            {
-                stream = mVFS->get(normalized.c_str());
-            }
-            catch (std::exception& e)
-            {
-                std::cerr << "Failed to open texture: " << e.what() << std::endl;
-                return mWarningTexture;
-            }
-
-            osg::ref_ptr<osgDB::Options> opts (new osgDB::Options);
-            opts->setOptionString("dds_dxt1_detect_rgba"); // tx_creature_werewolf.dds isn't loading in the correct format without this option
-            size_t extPos = normalized.find_last_of('.');
-            std::string ext;
-            if (extPos != std::string::npos && extPos+1 < normalized.size())
-                ext = normalized.substr(extPos+1);
-            osgDB::ReaderWriter* reader = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
-            if (!reader)
-            {
-                std::cerr << "Error loading " << filename << ": no readerwriter for '" << ext << "' found" << std::endl;
-                return mWarningTexture;
-            }
+            std::cerr << "Failed to open texture: " << e.what() << std::endl;
+            return NULL;
+        }
 
-            osgDB::ReaderWriter::ReadResult result = reader->readImage(*stream, opts);
-            if (!result.success())
-            {
-                std::cerr << "Error loading " << filename << ": " << result.message() << " code " << result.status() << std::endl;
-                return mWarningTexture;
-            }
+        osg::ref_ptr<osgDB::Options> opts (new osgDB::Options);
+        opts->setOptionString("dds_dxt1_detect_rgba"); // tx_creature_werewolf.dds isn't loading in the correct format without this option
+        size_t extPos = normalized.find_last_of('.');
+        std::string ext;
+        if (extPos != std::string::npos && extPos+1 < normalized.size())
+            ext = normalized.substr(extPos+1);
+        osgDB::ReaderWriter* reader = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+        if (!reader)
+        {
+            std::cerr << "Error loading " << normalized << ": no readerwriter for '" << ext << "' found" << std::endl;
+            return NULL;
+        }
 
-            osg::Image* image = result.getImage();
-            if (!checkSupported(image, filename))
-            {
-                return mWarningTexture;
-            }
+        osgDB::ReaderWriter::ReadResult result = reader->readImage(*stream, opts);
+        if (!result.success())
+        {
+            std::cerr << "Error loading " << normalized << ": " << result.message() << " code " << result.status() << std::endl;
+            return NULL;
+        }
 
-            // We need to flip images, because the Morrowind texture coordinates use the DirectX convention (top-left image origin),
-            // but OpenGL uses bottom left as the image origin.
-            // For some reason this doesn't concern DDS textures, which are already flipped when loaded.
-            if (ext != "dds")
-            {
-                image->flipVertical();
-            }
+        osg::ref_ptr<osg::Image> image = result.getImage();
 
-            osg::ref_ptr<osg::Texture2D> texture(new osg::Texture2D);
-            texture->setImage(image);
-            texture->setWrap(osg::Texture::WRAP_S, wrapS);
-            texture->setWrap(osg::Texture::WRAP_T, wrapT);
-            texture->setFilter(osg::Texture::MIN_FILTER, mMinFilter);
-            texture->setFilter(osg::Texture::MAG_FILTER, mMagFilter);
-            texture->setMaxAnisotropy(mMaxAnisotropy);
+        // We need to flip images, because the Morrowind texture coordinates use the DirectX convention (top-left image origin),
+        // but OpenGL uses bottom left as the image origin.
+        // For some reason this doesn't concern DDS textures, which are already flipped when loaded.
+        if (ext != "dds")
+        {
+            image->flipVertical();
+        }
 
-            texture->setUnRefImageDataAfterApply(mUnRefImageDataAfterApply);
+        return image;
+    }
 
-            mTextures.insert(std::make_pair(key, texture));
-            return texture;
-        }
+    osg::ref_ptr<osg::Texture2D> TextureManager::getTexture2D(const std::string &filename, osg::Texture::WrapMode wrapS, osg::Texture::WrapMode wrapT)
+    {
+        VFS::FileKey fileKey = mVFS->makeKey(filename);
+        MapKey key = std::make_pair(std::make_pair(wrapS, wrapT), fileKey);
+        osg::ref_ptr<osg::Referenced> cached = mCache.getRefFromObjectCache(key);
+        if (cached)
+            return static_cast<osg::Texture2D*>(cached.get());
+
+        // Decode the image without holding the lock, so that other threads can keep using the cache meanwhile
+        osg::ref_ptr<osg::Image> image = getImage(fileKey);
+        if (!image || !checkSupported(image, filename))
+            return mWarningTexture;
+
+        osg::ref_ptr<osg::Texture2D> texture(new osg::Texture2D);
+        texture->setImage(image);
+        texture->setWrap(osg::Texture::WRAP_S, wrapS);
+        texture->setWrap(osg::Texture::WRAP_T, wrapT);
+        texture->setFilter(osg::Texture::MIN_FILTER, mMinFilter);
+        texture->setFilter(osg::Texture::MAG_FILTER, mMagFilter);
+        texture->setMaxAnisotropy(mMaxAnisotropy);
+
+        texture->setUnRefImageDataAfterApply(mUnRefImageDataAfterApply);
+
+        // Another thread may have loaded the same texture meanwhile; keep the first one so that all users share it
+        cached = mCache.addEntryToObjectCache(key, texture, image->getTotalSizeInBytes());
+        return static_cast<osg::Texture2D*>(cached.get());
     }
 
     osg::Texture2D* TextureManager::getWarningTexture()
@@ -220,4 +243,24 @@ namespace Resource
         return mWarningTexture.get();
     }
 
+    void TextureManager::updateCache(double referenceTime)
+    {
+        mCache.update(referenceTime, referenceTime - mExpiryDelay);
+    }
+
+    void TextureManager::setMemoryBudget(size_t budget)
+    {
+        mCache.setMemoryBudget(budget);
+    }
+
+    unsigned int TextureManager::getCacheSize() const
+    {
+        return mCache.getCacheSize();
+    }
+
+    size_t TextureManager::getCacheMemoryUsage() const
+    {
+        return mCache.getMemoryUsage();
+    }
+
 }
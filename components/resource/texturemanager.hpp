@@ -8,16 +8,17 @@
 #include <osg/Image>
 #include <osg/Texture2D>
 
-namespace VFS
-{
-    class Manager;
-}
+#include <components/vfs/filekey.hpp>
+
+#include "resourcemanager.hpp"
+#include "objectcache.hpp"
 
 namespace Resource
 {
 
     /// @brief Handles loading/caching of Images and Texture StateAttributes.
-    class TextureManager
+    /// @note getTexture2D is thread safe, so textures may be loaded from background threads.
+    class TextureManager : public ResourceManager
     {
     public:
         TextureManager(const VFS::Manager* vfs);
@@ -33,25 +34,32 @@ namespace Resource
         /// Create or retrieve a Texture2D using the specified image filename, and wrap parameters.
         osg::ref_ptr<osg::Texture2D> getTexture2D(const std::string& filename, osg::Texture::WrapMode wrapS, osg::Texture::WrapMode wrapT);
 
-        /// Create or retrieve an Image
-        //osg::ref_ptr<osg::Image> getImage(const std::string& filename);
-
-        const VFS::Manager* getVFS() { return mVFS; }
+        /// Decode an image, e.g. to read its pixels on the CPU. Unlike textures, images are not cached.
+        /// @note Thread safe.
+        /// @return NULL if the image could not be loaded.
+        osg::ref_ptr<osg::Image> getImage(const std::string& filename);
 
         osg::Texture2D* getWarningTexture();
 
+        virtual void updateCache(double referenceTime);
+
+        virtual void setMemoryBudget(size_t budget);
+
+        unsigned int getCacheSize() const;
+
+        /// Memory used by the image data of the cached textures, in bytes.
+        size_t getCacheMemoryUsage() const;
+
     private:
-        const VFS::Manager* mVFS;
+        osg::ref_ptr<osg::Image> getImage(const VFS::FileKey& key);
 
         osg::Texture::FilterMode mMinFilter;
         osg::Texture::FilterMode mMagFilter;
         int mMaxAnisotropy;
 
-        typedef std::pair<std::pair<int, int>, std::string> MapKey;
-
-        std::map<std::string, osg::observer_ptr<osg::Image> > mImages;
+        typedef std::pair<std::pair<int, int>, VFS::FileKey> MapKey;
 
-        std::map<MapKey, osg::ref_ptr<osg::Texture2D> > mTextures;
+        GenericObjectCache<MapKey> mCache;
 
         osg::ref_ptr<osg::Texture2D> mWarningTexture;
 
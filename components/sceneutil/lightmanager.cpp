@@ -1,15 +1,26 @@
 #include "lightmanager.hpp"
 
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include <osg/NodeVisitor>
 #include <osg/Geode>
+#include <osg/Stats>
 
 #include <osgUtil/CullVisitor>
 
 #include <components/sceneutil/util.hpp>
 
-#include <boost/functional/hash.hpp>
+namespace
+{
+    // Light list StateSets not used for this many frames are dropped
+    const unsigned int sMaxUnusedFrames = 64;
+
+    // Beyond this many light list StateSets, those not used in the last frame are dropped
+    const size_t sMaxStateSets = 5000;
+}
 
 namespace SceneUtil
 {
@@ -126,7 +137,11 @@ namespace SceneUtil
     };
 
     LightManager::LightManager()
-        : mLightsInViewSpace(false)
+        : mLightIdsUpToDate(false)
+        , mFrameNumber(0)
+        , mNumHits(0)
+        , mNumSupersetHits(0)
+        , mNumMisses(0)
         , mStartLight(0)
     {
         setUpdateCallback(new LightManagerUpdateCallback);
@@ -134,7 +149,11 @@ namespace SceneUtil
 
     LightManager::LightManager(const LightManager &copy, const osg::CopyOp &copyop)
         : osg::Group(copy, copyop)
-        , mLightsInViewSpace(false)
+        , mLightIdsUpToDate(false)
+        , mFrameNumber(0)
+        , mNumHits(0)
+        , mNumSupersetHits(0)
+        , mNumMisses(0)
         , mStartLight(copy.mStartLight)
     {
 
@@ -142,12 +161,27 @@ namespace SceneUtil
 
     void LightManager::update()
     {
-        mLightsInViewSpace = false;
         mLights.clear();
+        mLightIdsUpToDate = false;
 
-        // do an occasional cleanup for orphaned lights
-        if (mStateSetCache.size() > 5000)
-            mStateSetCache.clear();
+        for (CameraLightsMap::iterator it = mCameraLights.begin(); it != mCameraLights.end(); )
+        {
+            if (!it->second.mUpToDate)
+                mCameraLights.erase(it++);
+            else
+            {
+                it->second.mUpToDate = false;
+                ++it;
+            }
+        }
+
+        ++mFrameNumber;
+        mNumHits = mNumSupersetHits = mNumMisses = 0;
+
+        if (mStateSetCache.size() > sMaxStateSets)
+            removeUnusedStateSets(mFrameNumber - 1);
+        else if (mFrameNumber % sMaxUnusedFrames == 0)
+            removeUnusedStateSets(mFrameNumber - sMaxUnusedFrames);
     }
 
     void LightManager::addLight(LightSource* lightSource, osg::Matrix worldMat)
@@ -159,36 +193,164 @@ namespace SceneUtil
                                                         worldMat.getTrans().y(),
                                                         worldMat.getTrans().z(), 1.f));
         mLights.push_back(l);
+        mLightIdsUpToDate = false;
     }
 
-    void LightManager::prepareForCamera(osg::Camera *cam)
+    LightManager::LightGrid& LightManager::getLightGrid(osg::Camera *cam)
     {
-        // later on we need to store this per camera
-        if (!mLightsInViewSpace)
+        CameraLights& cameraLights = mCameraLights[cam];
+        if (!cameraLights.mUpToDate)
         {
-            for (std::vector<LightSourceTransform>::iterator it = mLights.begin(); it != mLights.end(); ++it)
+            cameraLights.mGrid.build(mLights, cam->getViewMatrix());
+            cameraLights.mUpToDate = true;
+        }
+        return cameraLights.mGrid;
+    }
+
+    LightManager::LightGrid::LightGrid()
+        : mMinX(0.f), mMinZ(0.f), mMaxX(0.f), mMaxZ(0.f)
+        , mInvCellSizeX(0.f), mInvCellSizeZ(0.f)
+        , mNumCellsX(0), mNumCellsZ(0)
+        , mStamp(0)
+    {
+    }
+
+    void LightManager::LightGrid::build(const std::vector<LightSourceTransform>& lights, const osg::Matrix& viewMatrix)
+    {
+        mLights.resize(lights.size());
+        mCellOffsets.clear();
+        mCellLights.clear();
+        mStamps.assign(lights.size(), 0);
+        mStamp = 0;
+        mNumCellsX = mNumCellsZ = 0;
+        if (lights.empty())
+            return;
+
+        mMinX = mMinZ = std::numeric_limits<float>::max();
+        mMaxX = mMaxZ = -std::numeric_limits<float>::max();
+        for (unsigned int i=0; i<lights.size(); ++i)
+        {
+            const LightSourceTransform& l = lights[i];
+            LightSourceViewBound& viewBound = mLights[i];
+            viewBound.mLightSource = l.mLightSource;
+            viewBound.mViewBound = osg::BoundingSphere(osg::Vec3f(0,0,0), l.mLightSource->getRadius());
+            transformBoundingSphere(l.mWorldMatrix * viewMatrix, viewBound.mViewBound);
+
+            const osg::Vec3f& center = viewBound.mViewBound.center();
+            float radius = viewBound.mViewBound.radius();
+            mMinX = std::min(mMinX, center.x() - radius);
+            mMinZ = std::min(mMinZ, center.z() - radius);
+            mMaxX = std::max(mMaxX, center.x() + radius);
+            mMaxZ = std::max(mMaxZ, center.z() + radius);
+        }
+
+        // About one light per cell, if they were spread evenly
+        static const int sMaxCells = 64;
+        int numCells = std::max(1, std::min(sMaxCells, static_cast<int>(std::sqrt(static_cast<float>(lights.size())))));
+        mNumCellsX = mNumCellsZ = numCells;
+        mInvCellSizeX = numCells / std::max(mMaxX - mMinX, 1.f);
+        mInvCellSizeZ = numCells / std::max(mMaxZ - mMinZ, 1.f);
+
+        // Count the lights per cell, then sort them into their cells
+        mCellOffsets.assign(mNumCellsX * mNumCellsZ + 1, 0);
+        for (unsigned int i=0; i<mLights.size(); ++i)
+        {
+            int x0, z0, x1, z1;
+            getCells(mLights[i].mViewBound, x0, z0, x1, z1);
+            for (int z=z0; z<=z1; ++z)
+                for (int x=x0; x<=x1; ++x)
+                    ++mCellOffsets[z * mNumCellsX + x + 1];
+        }
+        for (unsigned int i=1; i<mCellOffsets.size(); ++i)
+            mCellOffsets[i] += mCellOffsets[i-1];
+
+        mCellLights.resize(mCellOffsets.back());
+        std::vector<unsigned int> next (mCellOffsets.begin(), mCellOffsets.end() - 1);
+        for (unsigned int i=0; i<mLights.size(); ++i)
+        {
+            int x0, z0, x1, z1;
+            getCells(mLights[i].mViewBound, x0, z0, x1, z1);
+            for (int z=z0; z<=z1; ++z)
+                for (int x=x0; x<=x1; ++x)
+                    mCellLights[next[z * mNumCellsX + x]++] = i;
+        }
+    }
+
+    void LightManager::LightGrid::getCells(const osg::BoundingSphere& viewBound, int& x0, int& z0, int& x1, int& z1) const
+    {
+        const osg::Vec3f& center = viewBound.center();
+        float radius = viewBound.radius();
+        x0 = std::max(0, static_cast<int>((center.x() - radius - mMinX) * mInvCellSizeX));
+        z0 = std::max(0, static_cast<int>((center.z() - radius - mMinZ) * mInvCellSizeZ));
+        x1 = std::min(mNumCellsX - 1, static_cast<int>((center.x() + radius - mMinX) * mInvCellSizeX));
+        z1 = std::min(mNumCellsZ - 1, static_cast<int>((center.z() + radius - mMinZ) * mInvCellSizeZ));
+    }
+
+    void LightManager::LightGrid::intersect(const osg::BoundingSphere& viewBound, LightList& lightList)
+    {
+        if (mLights.empty() || !viewBound.valid())
+            return;
+
+        const osg::Vec3f& center = viewBound.center();
+        float radius = viewBound.radius();
+        if (center.x() + radius < mMinX || center.x() - radius > mMaxX
+                || center.z() + radius < mMinZ || center.z() - radius > mMaxZ)
+            return;
+
+        int x0, z0, x1, z1;
+        getCells(viewBound, x0, z0, x1, z1);
+
+        if (++mStamp == 0)
+        {
+            std::fill(mStamps.begin(), mStamps.end(), 0);
+            mStamp = 1;
+        }
+
+        size_t first = lightList.size();
+        for (int z=z0; z<=z1; ++z)
+        {
+            for (int x=x0; x<=x1; ++x)
             {
-                LightSourceTransform& l = *it;
-                osg::Matrix worldViewMat = l.mWorldMatrix * cam->getViewMatrix();
-                l.mViewBound = osg::BoundingSphere(osg::Vec3f(0,0,0), l.mLightSource->getRadius());
-                transformBoundingSphere(worldViewMat, l.mViewBound);
+                int cell = z * mNumCellsX + x;
+                for (unsigned int i=mCellOffsets[cell]; i<mCellOffsets[cell+1]; ++i)
+                {
+                    unsigned int light = mCellLights[i];
+                    if (mStamps[light] == mStamp)
+                        continue;
+                    mStamps[light] = mStamp;
+
+                    if (mLights[light].mViewBound.intersects(viewBound))
+                        lightList.push_back(&mLights[light]);
+                }
             }
-            mLightsInViewSpace = true;
         }
+
+        // Each cell lists its lights in order, but several cells do not
+        if (x0 != x1 || z0 != z1)
+            std::sort(lightList.begin() + first, lightList.end());
+    }
+
+    const std::vector<LightManager::LightSourceViewBound>& LightManager::LightGrid::getLights() const
+    {
+        return mLights;
     }
 
     osg::ref_ptr<osg::StateSet> LightManager::getLightListStateSet(const LightList &lightList)
     {
-        // possible optimization: return a StateSet containing all requested lights plus some extra lights (if a suitable one exists)
-        size_t hash = 0;
+        std::vector<int> lightIds;
+        lightIds.reserve(lightList.size());
         for (unsigned int i=0; i<lightList.size();++i)
-            boost::hash_combine(hash, lightList[i]->mLightSource->getId());
+            lightIds.push_back(lightList[i]->mLightSource->getId());
+        std::sort(lightIds.begin(), lightIds.end());
 
-        LightStateSetMap::iterator found = mStateSetCache.find(hash);
+        LightStateSetMap::iterator found = mStateSetCache.find(lightIds);
         if (found != mStateSetCache.end())
-            return found->second;
+            ++mNumHits;
+        else if ((found = findSuperset(lightIds)) != mStateSetCache.end())
+            ++mNumSupersetHits;
         else
         {
+            ++mNumMisses;
 
             std::vector<osg::ref_ptr<osg::Light> > lights;
             for (unsigned int i=0; i<lightList.size();++i)
@@ -202,11 +364,91 @@ namespace SceneUtil
             stateset->setAttribute(attr, osg::StateAttribute::ON);
             stateset->setAssociatedModes(attr, osg::StateAttribute::ON);
 
-            mStateSetCache.insert(std::make_pair(hash, stateset));
-            return stateset;
+            CachedStateSet cached;
+            cached.mStateSet = stateset;
+            found = mStateSetCache.insert(std::make_pair(lightIds, cached)).first;
+            for (unsigned int i=0; i<lightIds.size(); ++i)
+                mStateSetIndex[lightIds[i]].push_back(found);
+        }
+
+        found->second.mLastUsedFrame = mFrameNumber;
+        return found->second.mStateSet;
+    }
+
+    LightManager::LightStateSetMap::iterator LightManager::findSuperset(const std::vector<int>& lightIds)
+    {
+        // A StateSet with all of the lights is among those with the light used by the fewest StateSets
+        const std::vector<LightStateSetMap::iterator>* candidates = NULL;
+        for (unsigned int i=0; i<lightIds.size(); ++i)
+        {
+            LightStateSetIndex::const_iterator found = mStateSetIndex.find(lightIds[i]);
+            if (found == mStateSetIndex.end())
+                return mStateSetCache.end();
+            if (!candidates || found->second.size() < candidates->size())
+                candidates = &found->second;
+        }
+        if (!candidates)
+            return mStateSetCache.end();
+
+        if (!mLightIdsUpToDate)
+        {
+            mLightIds.clear();
+            for (unsigned int i=0; i<mLights.size(); ++i)
+                mLightIds.push_back(mLights[i].mLightSource->getId());
+            std::sort(mLightIds.begin(), mLightIds.end());
+            mLightIdsUpToDate = true;
+        }
+
+        // Of those within the light limit, take the one with the fewest extra lights. The extra lights must still be
+        // in the scene, a StateSet can outlive its lights (e.g. of an unloaded cell or a disabled object).
+        unsigned int maxLights = static_cast<unsigned int>(8 - mStartLight);
+        LightStateSetMap::iterator best = mStateSetCache.end();
+        for (unsigned int i=0; i<candidates->size(); ++i)
+        {
+            LightStateSetMap::iterator candidate = (*candidates)[i];
+            const std::vector<int>& candidateIds = candidate->first;
+            if (candidateIds.size() > maxLights)
+                continue;
+            if (best != mStateSetCache.end() && candidateIds.size() >= best->first.size())
+                continue;
+            if (std::includes(candidateIds.begin(), candidateIds.end(), lightIds.begin(), lightIds.end())
+                    && std::includes(mLightIds.begin(), mLightIds.end(), candidateIds.begin(), candidateIds.end()))
+                best = candidate;
+        }
+        return best;
+    }
+
+    void LightManager::removeUnusedStateSets(unsigned int minLastUsedFrame)
+    {
+        for (LightStateSetMap::iterator it = mStateSetCache.begin(); it != mStateSetCache.end(); )
+        {
+            if (it->second.mLastUsedFrame >= minLastUsedFrame)
+            {
+                ++it;
+                continue;
+            }
+
+            const std::vector<int>& lightIds = it->first;
+            for (unsigned int i=0; i<lightIds.size(); ++i)
+            {
+                LightStateSetIndex::iterator found = mStateSetIndex.find(lightIds[i]);
+                std::vector<LightStateSetMap::iterator>& stateSets = found->second;
+                stateSets.erase(std::find(stateSets.begin(), stateSets.end(), it));
+                if (stateSets.empty())
+                    mStateSetIndex.erase(found);
+            }
+            mStateSetCache.erase(it++);
         }
     }
 
+    void LightManager::reportStats(unsigned int frameNumber, osg::Stats &stats) const
+    {
+        stats.setAttribute(frameNumber, "light_statesets_hit", mNumHits);
+        stats.setAttribute(frameNumber, "light_statesets_superset", mNumSupersetHits);
+        stats.setAttribute(frameNumber, "light_statesets_missed", mNumMisses);
+        stats.setAttribute(frameNumber, "light_statesets_alive", mStateSetCache.size());
+    }
+
     const std::vector<LightManager::LightSourceTransform>& LightManager::getLights() const
     {
         return mLights;
@@ -241,7 +483,7 @@ namespace SceneUtil
     }
 
 
-    bool sortLights (const LightManager::LightSourceTransform* left, const LightManager::LightSourceTransform* right)
+    bool sortLights (const LightManager::LightSourceViewBound* left, const LightManager::LightSourceViewBound* right)
     {
         return left->mViewBound.center().length2() - left->mViewBound.radius2()/4.f < right->mViewBound.center().length2() - right->mViewBound.radius2()/4.f;
     }
@@ -273,28 +515,17 @@ namespace SceneUtil
             }
         }
 
-        mLightManager->prepareForCamera(cv->getCurrentCamera());
-
-        // Possible optimizations:
-        // - cull list of lights by the camera frustum
-        // - organize lights in a quad tree
-
-        const std::vector<LightManager::LightSourceTransform>& lights = mLightManager->getLights();
+        LightManager::LightGrid& lightGrid = mLightManager->getLightGrid(cv->getCurrentCamera());
 
-        if (lights.size())
+        if (lightGrid.getLights().size())
         {
             // we do the intersections in view space
             osg::BoundingSphere nodeBound = node->getBound();
             osg::Matrixf mat = *cv->getModelViewMatrix();
             transformBoundingSphere(mat, nodeBound);
 
-            std::vector<const LightManager::LightSourceTransform*> lightList;
-            for (unsigned int i=0; i<lights.size(); ++i)
-            {
-                const LightManager::LightSourceTransform& l = lights[i];
-                if (l.mViewBound.intersects(nodeBound))
-                    lightList.push_back(&l);
-            }
+            LightManager::LightList lightList;
+            lightGrid.intersect(nodeBound, lightList);
 
             if (lightList.empty())
             {
@@ -6,6 +6,11 @@
 #include <osg/Group>
 #include <osg/NodeVisitor>
 
+namespace osg
+{
+    class Stats;
+}
+
 namespace SceneUtil
 {
 
@@ -74,21 +79,68 @@ namespace SceneUtil
         // Called automatically by the LightSource's UpdateCallback
         void addLight(LightSource* lightSource, osg::Matrix worldMat);
 
-        void prepareForCamera(osg::Camera* cam);
-
         struct LightSourceTransform
         {
             LightSource* mLightSource;
             osg::Matrix mWorldMatrix;
-            osg::BoundingSphere mViewBound;
         };
 
         const std::vector<LightSourceTransform>& getLights() const;
 
-        typedef std::vector<const LightSourceTransform*> LightList;
+        struct LightSourceViewBound
+        {
+            LightSource* mLightSource;
+            osg::BoundingSphere mViewBound;
+        };
+
+        typedef std::vector<const LightSourceViewBound*> LightList;
+
+        /// @brief The lights of a frame in the view space of one camera, indexed by a uniform grid over the view space
+        /// x and z axes, so that finding the lights of a node only tests the lights near it.
+        class LightGrid
+        {
+        public:
+            LightGrid();
+
+            /// Compute the view space bounds of \a lights and sort them into the grid.
+            void build(const std::vector<LightSourceTransform>& lights, const osg::Matrix& viewMatrix);
+
+            /// Append the lights intersecting \a viewBound to \a lightList, in the order of getLights().
+            void intersect(const osg::BoundingSphere& viewBound, LightList& lightList);
+
+            const std::vector<LightSourceViewBound>& getLights() const;
+
+        private:
+            std::vector<LightSourceViewBound> mLights;
+
+            float mMinX, mMinZ, mMaxX, mMaxZ;
+            float mInvCellSizeX, mInvCellSizeZ;
+            int mNumCellsX, mNumCellsZ;
+
+            // The lights in cell i are [mCellOffsets[i], mCellOffsets[i+1]) of mCellLights, as indices into mLights
+            std::vector<unsigned int> mCellOffsets;
+            std::vector<unsigned int> mCellLights;
+
+            // A light that spans several cells is tested once per intersect(), when its stamp is not the current one
+            std::vector<unsigned int> mStamps;
+            unsigned int mStamp;
 
+            void getCells(const osg::BoundingSphere& viewBound, int& x0, int& z0, int& x1, int& z1) const;
+        };
+
+        /// Return the lights of the current frame in the view space of \a cam. The grid is built by the first call for
+        /// each camera in a frame, so cameras with different views do not overwrite each other's light bounds.
+        /// Only valid during the cull traversal.
+        LightGrid& getLightGrid(osg::Camera* cam);
+
+        /// Return a StateSet applying the lights in \a lightList. If none was made for these lights yet, one made for
+        /// the same lights plus a few others is preferred over a new StateSet, to keep the number of different StateSets
+        /// to sort by low. StateSets that were not used for a while are dropped by update().
         osg::ref_ptr<osg::StateSet> getLightListStateSet(const LightList& lightList);
 
+        /// Report the use of the light list StateSet cache in the last frame.
+        void reportStats(unsigned int frameNumber, osg::Stats& stats) const;
+
         /// Set the first light index that should be used by this manager, typically the number of directional lights in the scene.
         void setStartLight(int start);
 
@@ -98,12 +150,50 @@ namespace SceneUtil
         // Lights collected from the scene graph. Only valid during the cull traversal.
         std::vector<LightSourceTransform> mLights;
 
-        bool mLightsInViewSpace;
+        // Sorted ids of mLights, built by findSuperset when needed
+        std::vector<int> mLightIds;
+        bool mLightIdsUpToDate;
+
+        struct CameraLights
+        {
+            CameraLights() : mUpToDate(false) {}
+
+            LightGrid mGrid;
+
+            // Built in the current frame
+            bool mUpToDate;
+        };
+
+        // Cameras that were not used in the last frame are removed by update()
+        typedef std::map<osg::Camera*, CameraLights> CameraLightsMap;
+        CameraLightsMap mCameraLights;
 
-        // < Light list hash , StateSet >
-        typedef std::map<size_t, osg::ref_ptr<osg::StateSet> > LightStateSetMap;
+        struct CachedStateSet
+        {
+            osg::ref_ptr<osg::StateSet> mStateSet;
+            unsigned int mLastUsedFrame;
+        };
+
+        // < Sorted light ids , StateSet >
+        typedef std::map<std::vector<int>, CachedStateSet> LightStateSetMap;
         LightStateSetMap mStateSetCache;
 
+        // < Light id , cached StateSets applying the light >
+        typedef std::map<int, std::vector<LightStateSetMap::iterator> > LightStateSetIndex;
+        LightStateSetIndex mStateSetIndex;
+
+        // Counts the calls of update()
+        unsigned int mFrameNumber;
+
+        // StateSets found for the exact lights, found for more lights, and newly made, since the last update()
+        unsigned int mNumHits;
+        unsigned int mNumSupersetHits;
+        unsigned int mNumMisses;
+
+        LightStateSetMap::iterator findSuperset(const std::vector<int>& lightIds);
+
+        void removeUnusedStateSets(unsigned int minLastUsedFrame);
+
         int mStartLight;
     };
 
@@ -5,10 +5,22 @@
 
 #include <cstdlib>
 
+#include <OpenThreads/Atomic>
+
 #include <osg/MatrixTransform>
 
+#include <osgUtil/CullVisitor>
+
 #include "skeleton.hpp"
 #include "util.hpp"
+#include "workqueue.hpp"
+
+namespace
+{
+    SceneUtil::WorkQueue* sWorkQueue = NULL;
+
+    OpenThreads::Atomic sSkinCount;
+}
 
 namespace SceneUtil
 {
@@ -58,8 +70,64 @@ public:
     }
 };
 
+/// Skinning of a RigGeometry for one palette, done by whichever thread claims it first: a worker, or the thread that
+/// needs the result, so that it does not wait for the item to be picked up behind other work.
+class SkinningJob : public osg::Referenced
+{
+public:
+    SkinningJob(RigGeometry* rig)
+        : mRig(rig)
+        , mClaims(0)
+        , mDone(new WorkTicket)
+    {
+    }
+
+    /// Skin, unless another thread has claimed the job already.
+    void run()
+    {
+        if (++mClaims != 1)
+            return;
+        mRig->skin();
+        mDone->signalDone();
+    }
+
+    /// Skin on the calling thread if no other thread has claimed the job yet, otherwise wait until it is done.
+    void finish()
+    {
+        run();
+        mDone->waitTillDone();
+    }
+
+private:
+    RigGeometry* mRig;
+    OpenThreads::Atomic mClaims;
+    osg::ref_ptr<WorkTicket> mDone;
+};
+
+class SkinningWorkItem : public WorkItem
+{
+public:
+    SkinningWorkItem(RigGeometry* rig, SkinningJob* job)
+        : mRig(rig)
+        , mJob(job)
+    {
+    }
+
+    virtual void doWork()
+    {
+        mJob->run();
+        mTicket->signalDone();
+    }
+
+private:
+    // Keeps the geometry alive while the job is queued
+    osg::ref_ptr<RigGeometry> mRig;
+    osg::ref_ptr<SkinningJob> mJob;
+};
+
 RigGeometry::RigGeometry()
     : mSkeleton(NULL)
+    , mSkinDirty(true)
     , mFirstFrame(true)
     , mBoundsFirstFrame(true)
 {
@@ -72,6 +140,7 @@ RigGeometry::RigGeometry(const RigGeometry &copy, const osg::CopyOp &copyop)
     : osg::Geometry(copy, copyop)
     , mSkeleton(NULL)
     , mInfluenceMap(copy.mInfluenceMap)
+    , mSkinDirty(true)
     , mFirstFrame(copy.mFirstFrame)
     , mBoundsFirstFrame(copy.mBoundsFirstFrame)
 {
@@ -142,7 +211,9 @@ bool RigGeometry::initFromParentSkeleton(osg::NodeVisitor* nv)
         return false;
     }
 
-    typedef std::map<unsigned short, std::vector<BoneWeight> > Vertex2BoneMap;
+    // <bone index, weight> of each vertex
+    typedef std::vector<std::pair<unsigned short, float> > Influences;
+    typedef std::map<unsigned short, Influences> Vertex2BoneMap;
     Vertex2BoneMap vertex2BoneMap;
     for (std::map<std::string, BoneInfluence>::const_iterator it = mInfluenceMap->mMap.begin(); it != mInfluenceMap->mMap.end(); ++it)
     {
@@ -155,47 +226,115 @@ bool RigGeometry::initFromParentSkeleton(osg::NodeVisitor* nv)
 
         mBoneSphereMap[bone] = it->second.mBoundSphere;
 
-        const BoneInfluence& bi = it->second;
+        unsigned short boneIndex = static_cast<unsigned short>(mBones.size());
+        mBones.push_back(bone);
+        mInvBindMatrices.push_back(it->second.mInvBindMatrix);
 
         const std::map<unsigned short, float>& weights = it->second.mWeights;
         for (std::map<unsigned short, float>::const_iterator weightIt = weights.begin(); weightIt != weights.end(); ++weightIt)
-        {
-            std::vector<BoneWeight>& vec = vertex2BoneMap[weightIt->first];
+            vertex2BoneMap[weightIt->first].push_back(std::make_pair(boneIndex, weightIt->second));
+    }
 
-            BoneWeight b = std::make_pair(std::make_pair(bone, bi.mInvBindMatrix), weightIt->second);
+    typedef std::map<Influences, std::vector<unsigned short> > Bone2VertexMap;
+    Bone2VertexMap bone2VertexMap;
+    for (Vertex2BoneMap::iterator it = vertex2BoneMap.begin(); it != vertex2BoneMap.end(); it++)
+        bone2VertexMap[it->second].push_back(it->first);
 
-            vec.push_back(b);
+    for (Bone2VertexMap::const_iterator it = bone2VertexMap.begin(); it != bone2VertexMap.end(); ++it)
+    {
+        mInfluenceOffsets.push_back(mInfluenceBones.size());
+        for (Influences::const_iterator influenceIt = it->first.begin(); influenceIt != it->first.end(); ++influenceIt)
+        {
+            mInfluenceBones.push_back(influenceIt->first);
+            mInfluenceWeights.push_back(influenceIt->second);
         }
+
+        mVertexOffsets.push_back(mVertices.size());
+        mVertices.insert(mVertices.end(), it->second.begin(), it->second.end());
     }
+    mInfluenceOffsets.push_back(mInfluenceBones.size());
+    mVertexOffsets.push_back(mVertices.size());
 
-    for (Vertex2BoneMap::iterator it = vertex2BoneMap.begin(); it != vertex2BoneMap.end(); it++)
+    return true;
+}
+
+bool RigGeometry::updatePalette(const osg::Matrixf& geomToSkel)
+{
+    // Blending the bone matrices and then applying geomToSkel is the same as blending the bone matrices with
+    // geomToSkel already applied, except for the translation of geomToSkel, which is applied once regardless of whether
+    // the weights add up to 1.
+    osg::Vec3f translation = geomToSkel.getTrans();
+    osg::Matrixf linear = geomToSkel;
+    linear.setTrans(0, 0, 0);
+
+    bool changed = translation != mGeomToSkelTranslation;
+    mGeomToSkelTranslation = translation;
+
+    mPalette.resize(mBones.size() * 12);
+    for (unsigned int i=0; i<mBones.size(); ++i)
     {
-        mBone2VertexMap[it->second].push_back(it->first);
+        osg::Matrixf matrix = mInvBindMatrices[i] * mBones[i]->mMatrixInSkeletonSpace * linear;
+        const float* ptr = matrix.ptr();
+
+        // rows 0 to 3, columns 0 to 2
+        float* palette = &mPalette[i * 12];
+        for (int row=0; row<4; ++row)
+        {
+            for (int column=0; column<3; ++column)
+            {
+                float value = ptr[row * 4 + column];
+                changed = changed || palette[row * 3 + column] != value;
+                palette[row * 3 + column] = value;
+            }
+        }
     }
 
-    return true;
+    return changed;
 }
 
-void accummulateMatrix(const osg::Matrixf& invBindMatrix, const osg::Matrixf& matrix, float weight, osg::Matrixf& result)
+void RigGeometry::skin()
 {
-    osg::Matrixf m = invBindMatrix * matrix;
-    float* ptr = m.ptr();
-    float* ptrresult = result.ptr();
-    ptrresult[0] += ptr[0] * weight;
-    ptrresult[1] += ptr[1] * weight;
-    ptrresult[2] += ptr[2] * weight;
-
-    ptrresult[4] += ptr[4] * weight;
-    ptrresult[5] += ptr[5] * weight;
-    ptrresult[6] += ptr[6] * weight;
-
-    ptrresult[8] += ptr[8] * weight;
-    ptrresult[9] += ptr[9] * weight;
-    ptrresult[10] += ptr[10] * weight;
-
-    ptrresult[12] += ptr[12] * weight;
-    ptrresult[13] += ptr[13] * weight;
-    ptrresult[14] += ptr[14] * weight;
+    const osg::Vec3Array& positionSrc = *static_cast<osg::Vec3Array*>(mSourceGeometry->getVertexArray());
+    const osg::Vec3Array& normalSrc = *static_cast<osg::Vec3Array*>(mSourceGeometry->getNormalArray());
+
+    osg::Vec3Array& positionDst = *static_cast<osg::Vec3Array*>(getVertexArray());
+    osg::Vec3Array& normalDst = *static_cast<osg::Vec3Array*>(getNormalArray());
+
+    const float* palette = mPalette.empty() ? NULL : &mPalette[0];
+
+    for (unsigned int group=0; group+1<mInfluenceOffsets.size(); ++group)
+    {
+        // Written as plain loops over contiguous floats, so that the compiler can vectorize them
+        float m[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        for (unsigned int i=mInfluenceOffsets[group]; i<mInfluenceOffsets[group+1]; ++i)
+        {
+            const float* boneMatrix = palette + mInfluenceBones[i] * 12;
+            const float weight = mInfluenceWeights[i];
+            for (int j=0; j<12; ++j)
+                m[j] += boneMatrix[j] * weight;
+        }
+        m[9] += mGeomToSkelTranslation.x();
+        m[10] += mGeomToSkelTranslation.y();
+        m[11] += mGeomToSkelTranslation.z();
+
+        for (unsigned int i=mVertexOffsets[group]; i<mVertexOffsets[group+1]; ++i)
+        {
+            unsigned short vertex = mVertices[i];
+
+            const osg::Vec3f& position = positionSrc[vertex];
+            positionDst[vertex].set(position.x() * m[0] + position.y() * m[3] + position.z() * m[6] + m[9],
+                                    position.x() * m[1] + position.y() * m[4] + position.z() * m[7] + m[10],
+                                    position.x() * m[2] + position.y() * m[5] + position.z() * m[8] + m[11]);
+
+            const osg::Vec3f& normal = normalSrc[vertex];
+            normalDst[vertex].set(normal.x() * m[0] + normal.y() * m[3] + normal.z() * m[6],
+                                  normal.x() * m[1] + normal.y() * m[4] + normal.z() * m[7],
+                                  normal.x() * m[2] + normal.y() * m[5] + normal.z() * m[8]);
+        }
+    }
+
+    positionDst.dirty();
+    normalDst.dirty();
 }
 
 void RigGeometry::update(osg::NodeVisitor* nv)
@@ -206,48 +345,58 @@ void RigGeometry::update(osg::NodeVisitor* nv)
             return;
     }
 
-    if (!mSkeleton->getActive() && !mFirstFrame)
+    if (!mSkeleton->getActive() && !mFirstFrame && !mSkinDirty)
         return;
     mFirstFrame = false;
 
-    mSkeleton->updateBoneMatrices(nv);
+    // Another camera may have started skinning this geometry already
+    waitTillSkinned();
 
-    osg::Matrixf geomToSkel = getGeomToSkelMatrix(nv);
+    mSkeleton->updateBoneMatrices(nv);
 
-    // skinning
-    osg::Vec3Array* positionSrc = static_cast<osg::Vec3Array*>(mSourceGeometry->getVertexArray());
-    osg::Vec3Array* normalSrc = static_cast<osg::Vec3Array*>(mSourceGeometry->getNormalArray());
+    if (!updatePalette(getGeomToSkelMatrix(nv)) && !mSkinDirty)
+        return;
 
-    osg::Vec3Array* positionDst = static_cast<osg::Vec3Array*>(getVertexArray());
-    osg::Vec3Array* normalDst = static_cast<osg::Vec3Array*>(getNormalArray());
+    // Leave the vertices as they are while they can not be seen, the cull visitor is going to skip this geometry.
+    // The bounds are those computed by updateBounds() for the current bone matrices.
+    osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+    if (cv && _boundingBox.valid() && cv->isCulled(_boundingBox))
+    {
+        mSkinDirty = true;
+        return;
+    }
+    mSkinDirty = false;
 
-    for (Bone2VertexMap::const_iterator it = mBone2VertexMap.begin(); it != mBone2VertexMap.end(); ++it)
+    ++sSkinCount;
+    if (sWorkQueue)
     {
-        osg::Matrixf resultMat  (0, 0, 0, 0,
-                                0, 0, 0, 0,
-                                0, 0, 0, 0,
-                                0, 0, 0, 1);
+        mSkinJob = new SkinningJob(this);
+        sWorkQueue->addWorkItem(new SkinningWorkItem(this, mSkinJob), WorkQueue::Priority_High);
+    }
+    else
+        skin();
+}
 
-        for (std::vector<BoneWeight>::const_iterator weightIt = it->first.begin(); weightIt != it->first.end(); ++weightIt)
-        {
-            Bone* bone = weightIt->first.first;
-            const osg::Matrix& invBindMatrix = weightIt->first.second;
-            float weight = weightIt->second;
-            const osg::Matrixf& boneMatrix = bone->mMatrixInSkeletonSpace;
-            accummulateMatrix(invBindMatrix, boneMatrix, weight, resultMat);
-        }
-        resultMat = resultMat * geomToSkel;
+void RigGeometry::waitTillSkinned() const
+{
+    if (mSkinJob)
+        mSkinJob->finish();
+}
 
-        for (std::vector<unsigned short>::const_iterator vertexIt = it->second.begin(); vertexIt != it->second.end(); ++vertexIt)
-        {
-            unsigned short vertex = *vertexIt;
-            (*positionDst)[vertex] = resultMat.preMult((*positionSrc)[vertex]);
-            (*normalDst)[vertex] = osg::Matrix::transform3x3((*normalSrc)[vertex], resultMat);
-        }
-    }
+void RigGeometry::drawImplementation(osg::RenderInfo& renderInfo) const
+{
+    waitTillSkinned();
+    osg::Geometry::drawImplementation(renderInfo);
+}
 
-    positionDst->dirty();
-    normalDst->dirty();
+void RigGeometry::setWorkQueue(WorkQueue* workQueue)
+{
+    sWorkQueue = workQueue;
+}
+
+unsigned int RigGeometry::resetSkinCount()
+{
+    return sSkinCount.exchange(0);
 }
 
 void RigGeometry::updateBounds(osg::NodeVisitor *nv)
@@ -9,8 +9,13 @@ namespace SceneUtil
 
     class Skeleton;
     class Bone;
+    class WorkQueue;
+    class SkinningJob;
 
     /// @brief Mesh skinning implementation.
+    /// @par The vertices are skinned on the CPU, in the cull traversal, or on a WorkQueue if one is set, in which case
+    /// drawing waits for the skinning to finish, or skins them itself if no worker got to it yet. Skinning is skipped while the geometry is outside the view frustum, or
+    /// when neither the bones nor the attachment have moved since it was last skinned.
     /// @note A RigGeometry may be attached directly to a Skeleton, or somewhere below a Skeleton.
     /// Note though that the RigGeometry ignores any transforms below the Skeleton, so the attachment point is not that important.
     class RigGeometry : public osg::Geometry
@@ -44,21 +49,51 @@ namespace SceneUtil
         // Called automatically by our UpdateCallback
         void updateBounds(osg::NodeVisitor* nv);
 
+        /// Block until the skinning started by the last update() is done, skinning on the calling thread if no worker
+        /// has started yet. Called automatically before drawing.
+        void waitTillSkinned() const;
+
+        virtual void drawImplementation(osg::RenderInfo& renderInfo) const;
+
+        /// Skin on \a workQueue from now on, or in the cull traversal if NULL. The queue must outlive all RigGeometries
+        /// using it, or be unset before it is destroyed.
+        static void setWorkQueue(WorkQueue* workQueue);
+
+        /// Return the number of times any RigGeometry was skinned since the last call.
+        static unsigned int resetSkinCount();
+
     private:
+        friend class SkinningJob;
+
         osg::ref_ptr<osg::Geometry> mSourceGeometry;
         Skeleton* mSkeleton;
 
         osg::ref_ptr<InfluenceMap> mInfluenceMap;
 
-        typedef std::pair<Bone*, osg::Matrixf> BoneBindMatrixPair;
+        /// The bones influencing this geometry, and their inverse bind matrices.
+        std::vector<Bone*> mBones;
+        std::vector<osg::Matrixf> mInvBindMatrices;
 
-        typedef std::pair<BoneBindMatrixPair, float> BoneWeight;
+        // Vertices influenced by the same bones with the same weights are skinned together. Group i is influenced by
+        // the bones [mInfluenceOffsets[i], mInfluenceOffsets[i+1]) of mInfluenceBones, which are indices into mBones,
+        // with the weights at the same positions in mInfluenceWeights. Its vertices are
+        // [mVertexOffsets[i], mVertexOffsets[i+1]) of mVertices.
+        std::vector<unsigned int> mInfluenceOffsets;
+        std::vector<unsigned short> mInfluenceBones;
+        std::vector<float> mInfluenceWeights;
+        std::vector<unsigned int> mVertexOffsets;
+        std::vector<unsigned short> mVertices;
 
-        typedef std::vector<unsigned short> VertexList;
+        /// Affine part of each bone's inverse bind matrix * bone matrix * geometry to skeleton matrix, without the
+        /// translation of the latter, as 12 floats per bone.
+        std::vector<float> mPalette;
+        /// Translation of the geometry to skeleton matrix.
+        osg::Vec3f mGeomToSkelTranslation;
 
-        typedef std::map<std::vector<BoneWeight>, VertexList> Bone2VertexMap;
+        /// The vertices do not match the current palette, e.g. because they were not skinned while off screen.
+        bool mSkinDirty;
 
-        Bone2VertexMap mBone2VertexMap;
+        osg::ref_ptr<SkinningJob> mSkinJob;
 
         typedef std::map<Bone*, osg::BoundingSpheref> BoneSphereMap;
 
@@ -70,6 +105,13 @@ namespace SceneUtil
         bool initFromParentSkeleton(osg::NodeVisitor* nv);
 
         osg::Matrixf getGeomToSkelMatrix(osg::NodeVisitor* nv);
+
+        /// Compute the palette for the current bone matrices.
+        /// @return false if it is the same as before.
+        bool updatePalette(const osg::Matrixf& geomToSkel);
+
+        /// Skin the vertices and normals with the current palette. Thread safe, as long as the palette does not change.
+        void skin();
     };
 
 }
@@ -1,7 +1,13 @@
 #ifndef OPENMW_COMPONENTS_SCENEUTIL_VISITOR_H
 #define OPENMW_COMPONENTS_SCENEUTIL_VISITOR_H
 
+#include <set>
+
 #include <osg/NodeVisitor>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Texture>
+#include <osg/Image>
 
 #include <components/misc/stringops.hpp>
 
@@ -33,6 +39,86 @@ namespace SceneUtil
         osg::Group* mFoundNode;
     };
 
+    /// Sums up the memory used by vertex data and texture images in a scene graph. Data shared between several
+    /// nodes is only counted once.
+    class EstimateMemoryVisitor : public osg::NodeVisitor
+    {
+    public:
+        /// @param countTextures Include texture images? Not wanted for data whose textures are accounted for elsewhere.
+        EstimateMemoryVisitor(bool countTextures = true)
+            : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN)
+            , mSize(0)
+            , mCountTextures(countTextures)
+        {
+        }
+
+        virtual void apply(osg::Node& node)
+        {
+            if (node.getStateSet())
+                applyStateSet(*node.getStateSet());
+            traverse(node);
+        }
+
+        virtual void apply(osg::Geode& geode)
+        {
+            if (geode.getStateSet())
+                applyStateSet(*geode.getStateSet());
+
+            for (unsigned int i=0; i<geode.getNumDrawables(); ++i)
+            {
+                osg::Drawable* drawable = geode.getDrawable(i);
+                if (drawable->getStateSet())
+                    applyStateSet(*drawable->getStateSet());
+
+                osg::Geometry* geom = drawable->asGeometry();
+                if (!geom)
+                    continue;
+                addArray(geom->getVertexArray());
+                addArray(geom->getNormalArray());
+                addArray(geom->getColorArray());
+                for (unsigned int j=0; j<geom->getNumTexCoordArrays(); ++j)
+                    addArray(geom->getTexCoordArray(j));
+                for (unsigned int j=0; j<geom->getNumPrimitiveSets(); ++j)
+                {
+                    if (mCounted.insert(geom->getPrimitiveSet(j)).second)
+                        mSize += geom->getPrimitiveSet(j)->getTotalDataSize();
+                }
+            }
+        }
+
+        void applyStateSet(osg::StateSet& stateset)
+        {
+            if (!mCountTextures)
+                return;
+
+            for (unsigned int i=0; i<stateset.getTextureAttributeList().size(); ++i)
+            {
+                const osg::Texture* texture = dynamic_cast<const osg::Texture*>(
+                            stateset.getTextureAttribute(i, osg::StateAttribute::TEXTURE));
+                if (!texture)
+                    continue;
+                for (unsigned int j=0; j<texture->getNumImages(); ++j)
+                {
+                    const osg::Image* image = texture->getImage(j);
+                    if (image && mCounted.insert(image).second)
+                        mSize += image->getTotalSizeInBytes();
+                }
+            }
+        }
+
+        void addArray(const osg::Array* array)
+        {
+            if (array && mCounted.insert(array).second)
+                mSize += array->getTotalDataSize();
+        }
+
+        size_t mSize;
+
+    private:
+        bool mCountTextures;
+        std::set<const osg::Object*> mCounted;
+    };
+
 }
 
 #endif
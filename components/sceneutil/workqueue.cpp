@@ -1,8 +1,17 @@
 #include "workqueue.hpp"
 
+#include <algorithm>
+
+#include <OpenThreads/ScopedLock>
+
 namespace SceneUtil
 {
 
+WorkTicket::WorkTicket()
+    : mDone(0)
+{
+}
+
 void WorkTicket::waitTillDone()
 {
     if (mDone > 0)
@@ -15,17 +24,83 @@ void WorkTicket::waitTillDone()
     }
 }
 
+bool WorkTicket::isDone() const
+{
+    return mDone > 0;
+}
+
 void WorkTicket::signalDone()
 {
+    std::vector<Continuation> continuations;
     {
         OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
-        mDone.exchange(1);
+        if (mDone.exchange(1) != 0)
+            return;
+        continuations.swap(mContinuations);
     }
     mCondition.broadcast();
+
+    for (std::vector<Continuation>::iterator it = continuations.begin(); it != continuations.end(); ++it)
+        it->mQueue->dependencyDone(it->mItem);
+}
+
+bool WorkTicket::addContinuation(WorkItem *item, WorkQueue *queue)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    if (mDone > 0)
+        return false;
+    Continuation continuation;
+    continuation.mItem = item;
+    continuation.mQueue = queue;
+    mContinuations.push_back(continuation);
+    return true;
+}
+
+void WorkTicket::removeContinuation(WorkItem *item)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    for (std::vector<Continuation>::iterator it = mContinuations.begin(); it != mContinuations.end();)
+    {
+        if (it->mItem == item)
+            it = mContinuations.erase(it);
+        else
+            ++it;
+    }
+}
+
+void WorkTicketGroup::add(osg::ref_ptr<WorkTicket> ticket)
+{
+    mTickets.push_back(ticket);
+}
+
+void WorkTicketGroup::clear()
+{
+    mTickets.clear();
+}
+
+void WorkTicketGroup::waitTillDone()
+{
+    for (std::vector<osg::ref_ptr<WorkTicket> >::iterator it = mTickets.begin(); it != mTickets.end(); ++it)
+        (*it)->waitTillDone();
+}
+
+bool WorkTicketGroup::isDone() const
+{
+    for (std::vector<osg::ref_ptr<WorkTicket> >::const_iterator it = mTickets.begin(); it != mTickets.end(); ++it)
+        if (!(*it)->isDone())
+            return false;
+    return true;
+}
+
+const std::vector<osg::ref_ptr<WorkTicket> >& WorkTicketGroup::getTickets() const
+{
+    return mTickets;
 }
 
 WorkItem::WorkItem()
     : mTicket(new WorkTicket)
+    , mPendingDependencies(0)
+    , mPriority(WorkQueue::Priority_Normal)
 {
     mTicket->setThreadSafeRefUnref(true);
 }
@@ -44,79 +119,214 @@ osg::ref_ptr<WorkTicket> WorkItem::getTicket()
     return mTicket;
 }
 
+void WorkItem::addDependency(osg::ref_ptr<WorkTicket> ticket)
+{
+    mDependencies.push_back(ticket);
+}
+
+void WorkItem::addDependencies(const WorkTicketGroup &group)
+{
+    const std::vector<osg::ref_ptr<WorkTicket> >& tickets = group.getTickets();
+    mDependencies.insert(mDependencies.end(), tickets.begin(), tickets.end());
+}
+
 WorkQueue::WorkQueue(int workerThreads)
-    : mIsReleased(false)
+    : mIsReleased(0)
+    , mNumQueued(0)
+    , mNextThread(0)
+    , mNumSleeping(0)
 {
+    if (workerThreads <= 0)
+        workerThreads = std::max(1, OpenThreads::GetNumberOfProcessors() - 1);
+
+    // Create all threads before starting any, as running threads look at each other's queues
     for (int i=0; i<workerThreads; ++i)
-    {
-        WorkThread* thread = new WorkThread(this);
-        mThreads.push_back(thread);
-        thread->startThread();
-    }
+        mThreads.push_back(new WorkThread(this, i));
+
+    for (unsigned int i=0; i<mThreads.size(); ++i)
+        mThreads[i]->startThread();
 }
 
 WorkQueue::~WorkQueue()
 {
     {
         OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
-        while (mQueue.size())
-        {
-            WorkItem* item = mQueue.front();
-            delete item;
-            mQueue.pop();
-        }
-        mIsReleased = true;
+        mIsReleased.exchange(1);
         mCondition.broadcast();
     }
 
     for (unsigned int i=0; i<mThreads.size(); ++i)
-    {
         mThreads[i]->join();
+
+    // Only free the threads (and any items left in their queues) once all of them have stopped stealing from each other
+    for (unsigned int i=0; i<mThreads.size(); ++i)
         delete mThreads[i];
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mDeferredMutex);
+    for (std::set<WorkItem*>::iterator it = mDeferred.begin(); it != mDeferred.end(); ++it)
+    {
+        WorkItem* item = *it;
+        for (std::vector<osg::ref_ptr<WorkTicket> >::iterator dep = item->mDependencies.begin(); dep != item->mDependencies.end(); ++dep)
+            (*dep)->removeContinuation(item);
+        delete item;
     }
+    mDeferred.clear();
 }
 
-osg::ref_ptr<WorkTicket> WorkQueue::addWorkItem(WorkItem *item)
+osg::ref_ptr<WorkTicket> WorkQueue::addWorkItem(WorkItem *item, Priority priority)
 {
     osg::ref_ptr<WorkTicket> ticket = item->getTicket();
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
-    mQueue.push(item);
-    mCondition.signal();
+    item->mPriority = priority;
+
+    if (item->mDependencies.empty())
+    {
+        schedule(item);
+        return ticket;
+    }
+
+    // Hold one extra count while registering, so the item can not be started (and freed) before we are done with it
+    item->mPendingDependencies.exchange(item->mDependencies.size() + 1);
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mDeferredMutex);
+        mDeferred.insert(item);
+    }
+
+    for (std::vector<osg::ref_ptr<WorkTicket> >::iterator it = item->mDependencies.begin(); it != item->mDependencies.end(); ++it)
+    {
+        if (!(*it)->addContinuation(item, this))
+            dependencyDone(item);
+    }
+    dependencyDone(item);
+
     return ticket;
 }
 
-WorkItem *WorkQueue::removeWorkItem()
+unsigned int WorkQueue::getNumThreads() const
+{
+    return mThreads.size();
+}
+
+void WorkQueue::schedule(WorkItem *item)
 {
+    // Work spawned from one of our own threads goes to that thread's queue, other work is spread over all threads
+    WorkThread* target = dynamic_cast<WorkThread*>(OpenThreads::Thread::CurrentThread());
+    if (!target || target->getWorkQueue() != this)
+        target = mThreads[(++mNextThread) % mThreads.size()];
+
+    ++mNumQueued;
+    target->push(item, item->mPriority);
+
+    // Workers count themselves as sleeping before they check mNumQueued, so either they see the new item, or we see them
+    if (mNumSleeping == 0)
+        return;
+
     OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
-    while (!mQueue.size() && !mIsReleased)
+    mCondition.signal();
+}
+
+void WorkQueue::dependencyDone(WorkItem *item)
+{
+    if (--item->mPendingDependencies != 0)
+        return;
+
     {
-        mCondition.wait(&mMutex);
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mDeferredMutex);
+        mDeferred.erase(item);
     }
-    if (mQueue.size())
+    schedule(item);
+}
+
+WorkItem *WorkQueue::findWorkItem(WorkThread* thread)
+{
+    const unsigned int numThreads = mThreads.size();
+    for (int priority=0; priority<NumPriorities; ++priority)
     {
-        WorkItem* item = mQueue.front();
-        mQueue.pop();
-        return item;
+        for (unsigned int i=0; i<numThreads; ++i)
+        {
+            WorkItem* item = mThreads[(thread->getIndex() + i) % numThreads]->pop(priority);
+            if (item)
+            {
+                --mNumQueued;
+                return item;
+            }
+        }
     }
-    else
-        return NULL;
+    return NULL;
 }
 
-WorkThread::WorkThread(WorkQueue *workQueue)
+WorkItem *WorkQueue::removeWorkItem(WorkThread* thread)
+{
+    while (true)
+    {
+        if (mIsReleased > 0)
+            return NULL;
+
+        if (WorkItem* item = findWorkItem(thread))
+            return item;
+
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+        // Count ourselves as sleeping before checking for new items, see schedule()
+        ++mNumSleeping;
+        if (mNumQueued == 0 && mIsReleased == 0)
+            mCondition.wait(&mMutex);
+        --mNumSleeping;
+    }
+}
+
+WorkThread::WorkThread(WorkQueue *workQueue, unsigned int index)
     : mWorkQueue(workQueue)
+    , mIndex(index)
 {
 }
 
+WorkThread::~WorkThread()
+{
+    for (int i=0; i<WorkQueue::NumPriorities; ++i)
+    {
+        for (std::deque<WorkItem*>::iterator it = mQueue[i].begin(); it != mQueue[i].end(); ++it)
+            delete *it;
+        mQueue[i].clear();
+    }
+}
+
 void WorkThread::run()
 {
     while (true)
     {
-        WorkItem* item = mWorkQueue->removeWorkItem();
+        WorkItem* item = mWorkQueue->removeWorkItem(this);
         if (!item)
             return;
         item->doWork();
+        // In case a derived doWork() did not signal the ticket itself
+        item->getTicket()->signalDone();
         delete item;
     }
 }
 
+void WorkThread::push(WorkItem *item, int priority)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    mQueue[priority].push_back(item);
+}
+
+WorkItem *WorkThread::pop(int priority)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    if (mQueue[priority].empty())
+        return NULL;
+    WorkItem* item = mQueue[priority].front();
+    mQueue[priority].pop_front();
+    return item;
+}
+
+WorkQueue *WorkThread::getWorkQueue() const
+{
+    return mWorkQueue;
+}
+
+unsigned int WorkThread::getIndex() const
+{
+    return mIndex;
+}
+
 }
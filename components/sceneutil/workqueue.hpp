@@ -9,24 +9,72 @@
 #include <osg/Referenced>
 #include <osg/ref_ptr>
 
-#include <queue>
+#include <deque>
+#include <set>
+#include <vector>
 
 namespace SceneUtil
 {
 
+    class WorkItem;
+    class WorkQueue;
+    class WorkThread;
+
     class WorkTicket : public osg::Referenced
     {
     public:
+        WorkTicket();
+
         void waitTillDone();
 
+        /// Returns true if the work has been completed. Does not block.
+        bool isDone() const;
+
+        /// Mark the work as done, waking up all waiting threads and scheduling any work items that depend on this ticket.
+        /// @note Calling this more than once has no further effect.
         void signalDone();
 
     private:
+        friend class WorkQueue;
+
+        /// Have \a queue schedule \a item once this ticket is done.
+        /// @return false if the ticket is already done, in which case nothing is registered.
+        bool addContinuation(WorkItem* item, WorkQueue* queue);
+
+        void removeContinuation(WorkItem* item);
+
+        struct Continuation
+        {
+            WorkItem* mItem;
+            WorkQueue* mQueue;
+        };
+        std::vector<Continuation> mContinuations;
+
         OpenThreads::Atomic mDone;
         OpenThreads::Mutex mMutex;
         OpenThreads::Condition mCondition;
     };
 
+    /// @brief A set of WorkTickets that can be waited on as a whole.
+    class WorkTicketGroup
+    {
+    public:
+        void add(osg::ref_ptr<WorkTicket> ticket);
+
+        void clear();
+
+        /// Block until all tickets in the group are done.
+        void waitTillDone();
+
+        /// Returns true if all tickets in the group are done. Does not block.
+        bool isDone() const;
+
+        const std::vector<osg::ref_ptr<WorkTicket> >& getTickets() const;
+
+    private:
+        std::vector<osg::ref_ptr<WorkTicket> > mTickets;
+    };
+
     class WorkItem
     {
     public:
@@ -39,52 +87,114 @@ namespace SceneUtil
 
         osg::ref_ptr<WorkTicket> getTicket();
 
-    protected:
-        osg::ref_ptr<WorkTicket> mTicket;
-    };
-
-    class WorkQueue;
+        /// Do not start this item before the work associated with \a ticket is done.
+        /// @note Must be called before the item is added to a WorkQueue.
+        void addDependency(osg::ref_ptr<WorkTicket> ticket);
 
-    class WorkThread : public OpenThreads::Thread
-    {
-    public:
-        WorkThread(WorkQueue* workQueue);
+        /// Do not start this item before all work in \a group is done.
+        /// @note Must be called before the item is added to a WorkQueue.
+        void addDependencies(const WorkTicketGroup& group);
 
-        virtual void run();
+    protected:
+        osg::ref_ptr<WorkTicket> mTicket;
 
     private:
-        WorkQueue* mWorkQueue;
+        friend class WorkQueue;
+
+        std::vector<osg::ref_ptr<WorkTicket> > mDependencies;
+        OpenThreads::Atomic mPendingDependencies;
+        int mPriority;
     };
 
     /// @brief A work queue that users can push work items onto, to be completed by one or more background threads.
+    /// @par Each worker thread owns one queue per priority. Items are distributed over the workers' queues, and idle workers
+    /// steal work from the others, so that submitting and completing work rarely contends on a single lock.
     class WorkQueue
     {
     public:
-        WorkQueue(int numWorkerThreads=1);
+        enum Priority
+        {
+            Priority_High = 0,
+            Priority_Normal,
+            Priority_Low,
+
+            NumPriorities
+        };
+
+        /// @param numWorkerThreads Number of background threads to run. If zero, one thread per available processor
+        /// is used, minus one for the main thread.
+        WorkQueue(int numWorkerThreads=0);
         ~WorkQueue();
 
-        /// Add a new work item to the back of the queue.
+        /// Add a new work item to the queue. Work items of a higher priority are always started first. If the item has
+        /// dependencies, it is held back until all of them are done.
         /// @par The returned WorkTicket may be used by the caller to wait until the work is complete.
-        osg::ref_ptr<WorkTicket> addWorkItem(WorkItem* item);
+        /// @note The queue takes ownership of the item.
+        osg::ref_ptr<WorkTicket> addWorkItem(WorkItem* item, Priority priority=Priority_Normal);
+
+        unsigned int getNumThreads() const;
+
+    private:
+        friend class WorkThread;
+        friend class WorkTicket;
 
-        /// Get the next work item from the front of the queue. If the queue is empty, waits until a new item is added.
-        /// If the workqueue is in the process of being destroyed, may return NULL.
+        /// Make an item available to the worker threads.
+        void schedule(WorkItem* item);
+
+        /// Called when one of the dependencies of \a item is done.
+        void dependencyDone(WorkItem* item);
+
+        /// Get the next work item for \a thread, stealing from the other threads if its own queue is empty.
+        /// If there is no work, waits until a new item is added.
+        /// If the workqueue is in the process of being destroyed, returns NULL.
         /// @note The caller must free the returned WorkItem
-        WorkItem* removeWorkItem();
+        WorkItem* removeWorkItem(WorkThread* thread);
 
-        void runThread();
+        WorkItem* findWorkItem(WorkThread* thread);
 
-    private:
-        bool mIsReleased;
-        std::queue<WorkItem*> mQueue;
+        std::vector<WorkThread*> mThreads;
 
+        OpenThreads::Atomic mIsReleased;
+        OpenThreads::Atomic mNumQueued;
+        OpenThreads::Atomic mNextThread;
+
+        /// Guards sleeping and waking of idle worker threads.
         OpenThreads::Mutex mMutex;
         OpenThreads::Condition mCondition;
+        /// Number of idle worker threads, so that submitting work only takes mMutex when there is a thread to wake.
+        OpenThreads::Atomic mNumSleeping;
 
-        std::vector<WorkThread*> mThreads;
+        /// Items waiting on their dependencies.
+        std::set<WorkItem*> mDeferred;
+        OpenThreads::Mutex mDeferredMutex;
     };
 
+    class WorkThread : public OpenThreads::Thread
+    {
+    public:
+        WorkThread(WorkQueue* workQueue, unsigned int index);
+        ~WorkThread();
+
+        virtual void run();
+
+        /// Add an item to the back of this thread's queue. Thread safe.
+        void push(WorkItem* item, int priority);
+
+        /// Take the oldest item of the given priority from this thread's queue, or NULL if empty.
+        /// Thread safe; other workers use this to steal work.
+        WorkItem* pop(int priority);
+
+        WorkQueue* getWorkQueue() const;
 
+        unsigned int getIndex() const;
+
+    private:
+        WorkQueue* mWorkQueue;
+        unsigned int mIndex;
+
+        std::deque<WorkItem*> mQueue[WorkQueue::NumPriorities];
+        OpenThreads::Mutex mMutex;
+    };
 
 }
 
@@ -4,6 +4,8 @@
 
 #include <osg/PrimitiveSet>
 
+#include <OpenThreads/ScopedLock>
+
 #include "defs.hpp"
 
 namespace
@@ -178,6 +180,7 @@ namespace Terrain
 
     osg::ref_ptr<osg::Vec2Array> BufferCache::getUVBuffer()
     {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
         if (mUvBufferMap.find(mNumVerts) != mUvBufferMap.end())
         {
             return mUvBufferMap[mNumVerts];
@@ -208,6 +211,7 @@ namespace Terrain
     {
         unsigned int verts = mNumVerts;
 
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
         if (mIndexBufferMap.find(flags) != mIndexBufferMap.end())
         {
             return mIndexBufferMap[flags];
@@ -4,12 +4,15 @@
 #include <osg/ref_ptr>
 #include <osg/Array>
 
+#include <OpenThreads/Mutex>
+
 #include <map>
 
 namespace Terrain
 {
 
     /// @brief Implements creation and caching of vertex buffers for terrain chunks.
+    /// @note Thread safe.
     class BufferCache
     {
     public:
@@ -30,6 +33,8 @@ namespace Terrain
 
         std::map<int, osg::ref_ptr<osg::Vec2Array> > mUvBufferMap;
 
+        OpenThreads::Mutex mMutex;
+
         unsigned int mNumVerts;
     };
 
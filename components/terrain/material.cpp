@@ -11,7 +11,8 @@ namespace Terrain
 {
 
     FixedFunctionTechnique::FixedFunctionTechnique(const std::vector<osg::ref_ptr<osg::Texture2D> >& layers,
-                                                   const std::vector<osg::ref_ptr<osg::Texture2D> >& blendmaps)
+                                                   const std::vector<osg::ref_ptr<osg::Texture2D> >& blendmaps,
+                                                   float layerScale)
     {
         bool firstLayer = true;
         int i=0;
@@ -57,8 +58,7 @@ namespace Terrain
             stateset->setTextureAttributeAndModes(texunit, tex.get());
 
             osg::ref_ptr<osg::TexMat> texMat (new osg::TexMat);
-            float scale = 16.f;
-            texMat->setMatrix(osg::Matrix::scale(osg::Vec3f(scale,scale,1.f)));
+            texMat->setMatrix(osg::Matrix::scale(osg::Vec3f(layerScale,layerScale,1.f)));
             stateset->setTextureAttributeAndModes(texunit, texMat, osg::StateAttribute::ON);
 
             firstLayer = false;
@@ -67,9 +67,11 @@ namespace Terrain
         }
     }
 
-    Effect::Effect(const std::vector<osg::ref_ptr<osg::Texture2D> > &layers, const std::vector<osg::ref_ptr<osg::Texture2D> > &blendmaps)
+    Effect::Effect(const std::vector<osg::ref_ptr<osg::Texture2D> > &layers, const std::vector<osg::ref_ptr<osg::Texture2D> > &blendmaps,
+                   float layerScale)
         : mLayers(layers)
         , mBlendmaps(blendmaps)
+        , mLayerScale(layerScale)
     {
         osg::ref_ptr<osg::Material> material (new osg::Material);
         material->setColorMode(osg::Material::AMBIENT_AND_DIFFUSE);
@@ -80,7 +82,7 @@ namespace Terrain
 
     bool Effect::define_techniques()
     {
-        addTechnique(new FixedFunctionTechnique(mLayers, mBlendmaps));
+        addTechnique(new FixedFunctionTechnique(mLayers, mBlendmaps, mLayerScale));
 
         return true;
     }
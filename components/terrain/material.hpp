@@ -19,7 +19,8 @@ namespace Terrain
     public:
         FixedFunctionTechnique(
                 const std::vector<osg::ref_ptr<osg::Texture2D> >& layers,
-                const std::vector<osg::ref_ptr<osg::Texture2D> >& blendmaps);
+                const std::vector<osg::ref_ptr<osg::Texture2D> >& blendmaps,
+                float layerScale);
 
     protected:
         virtual void define_passes() {}
@@ -28,9 +29,11 @@ namespace Terrain
     class Effect : public osgFX::Effect
     {
     public:
+        /// @param layerScale How often the layer textures repeat across the chunk.
         Effect(
                 const std::vector<osg::ref_ptr<osg::Texture2D> >& layers,
-                const std::vector<osg::ref_ptr<osg::Texture2D> >& blendmaps);
+                const std::vector<osg::ref_ptr<osg::Texture2D> >& blendmaps,
+                float layerScale = 16.f);
 
         virtual bool define_techniques();
 
@@ -50,6 +53,7 @@ namespace Terrain
     private:
         std::vector<osg::ref_ptr<osg::Texture2D> > mLayers;
         std::vector<osg::ref_ptr<osg::Texture2D> > mBlendmaps;
+        float mLayerScale;
     };
 
 }
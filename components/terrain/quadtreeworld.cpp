@@ -0,0 +1,680 @@
+#include "quadtreeworld.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+#include <osg/PositionAttitudeTransform>
+#include <osg/Geometry>
+#include <osg/Geode>
+#include <osg/KdTree>
+#include <osg/Texture2D>
+#include <osg/Version>
+
+#include <osgUtil/CullVisitor>
+#include <osgUtil/IncrementalCompileOperation>
+
+#include <OpenThreads/ScopedLock>
+
+#include <components/resource/resourcesystem.hpp>
+#include <components/resource/texturemanager.hpp>
+
+#include <components/sceneutil/lightmanager.hpp>
+#include <components/sceneutil/workqueue.hpp>
+
+#include "material.hpp"
+#include "storage.hpp"
+
+namespace
+{
+    class StaticBoundingBoxCallback : public osg::Drawable::ComputeBoundingBoxCallback
+    {
+    public:
+        StaticBoundingBoxCallback(const osg::BoundingBox& bounds)
+            : mBoundingBox(bounds)
+        {
+        }
+
+        virtual osg::BoundingBox computeBound(const osg::Drawable&) const
+        {
+            return mBoundingBox;
+        }
+
+    private:
+        osg::BoundingBox mBoundingBox;
+    };
+
+    float getDistance(const osg::BoundingBox& box, const osg::Vec3f& point)
+    {
+        osg::Vec3f closest (osg::clampBetween(point.x(), box.xMin(), box.xMax()),
+                            osg::clampBetween(point.y(), box.yMin(), box.yMax()),
+                            osg::clampBetween(point.z(), box.zMin(), box.zMax()));
+        return (closest - point).length();
+    }
+
+    /// Sample a blendmap with bilinear filtering, like the texture made from it would be.
+    /// @param x, y position in the cell, from 0 to 1
+    float sampleBlendmap(const osg::Image* image, float x, float y)
+    {
+        // The terrain material maps the cell corners to the centers of the corner texels
+        x *= image->s()-1;
+        y *= image->t()-1;
+        int x0 = static_cast<int>(x);
+        int y0 = static_cast<int>(y);
+        int x1 = std::min(x0+1, image->s()-1);
+        int y1 = std::min(y0+1, image->t()-1);
+        float fx = x - x0;
+        float fy = y - y0;
+
+        float bottom = *image->data(x0, y0) * (1.f-fx) + *image->data(x1, y0) * fx;
+        float top = *image->data(x0, y1) * (1.f-fx) + *image->data(x1, y1) * fx;
+        return (bottom * (1.f-fy) + top * fy) / 255.f;
+    }
+
+    /// How long to keep chunks that are no longer displayed, in seconds.
+    const double sChunkExpiryDelay = 5.0;
+}
+
+namespace Terrain
+{
+
+/// The scene graph of a chunk, which may still be being built on a worker thread.
+class QuadTreeChunk : public osg::Referenced
+{
+public:
+    QuadTreeChunk()
+        : mLastUsed(0.0)
+        , mLayerScale(1.f)
+    {
+    }
+
+    bool isDone() const
+    {
+        return mTicket->isDone();
+    }
+
+    /// Get the chunk with its edges stitched to larger neighbours.
+    /// @param lodFlags LOD deltas to the neighbours, see BufferCache::getIndexBuffer.
+    /// @return NULL if building the chunk failed.
+    /// @note Only to be called once the chunk is done.
+    osg::ref_ptr<osg::Node> getNode(unsigned int lodFlags, BufferCache& cache)
+    {
+        if (!mGeometry)
+            return NULL;
+
+        std::map<unsigned int, osg::ref_ptr<osg::Node> >::iterator found = mNodes.find(lodFlags);
+        if (found != mNodes.end())
+            return found->second;
+
+        // Share the vertex data, only the index buffer differs
+        osg::ref_ptr<osg::Geometry> geometry (new osg::Geometry(*mGeometry, osg::CopyOp::SHALLOW_COPY));
+        geometry->setPrimitiveSet(0, cache.getIndexBuffer(lodFlags));
+
+        osg::ref_ptr<osg::Geode> geode (new osg::Geode);
+        geode->addDrawable(geometry);
+
+        osg::ref_ptr<osg::Node> node = createNode(geode);
+        mNodes[lodFlags] = node;
+        return node;
+    }
+
+    osg::ref_ptr<osg::Node> createNode(osg::Geode* geode)
+    {
+        osg::ref_ptr<osg::PositionAttitudeTransform> transform (new osg::PositionAttitudeTransform);
+        transform->setPosition(mPosition);
+
+        osg::ref_ptr<osgFX::Effect> effect (new Terrain::Effect(mLayerTextures, mBlendmapTextures, mLayerScale));
+        effect->addCullCallback(new SceneUtil::LightListCallback);
+
+        effect->addChild(geode);
+        transform->addChild(effect);
+        return transform;
+    }
+
+    osg::ref_ptr<SceneUtil::WorkTicket> mTicket;
+
+    /// Reference time of the last cull traversal that needed this chunk.
+    double mLastUsed;
+
+    /// @note Written by the worker thread, only to be read once the chunk is done.
+    osg::Vec3f mPosition;
+    osg::ref_ptr<osg::Geometry> mGeometry;
+    std::vector<osg::ref_ptr<osg::Texture2D> > mLayerTextures;
+    std::vector<osg::ref_ptr<osg::Texture2D> > mBlendmapTextures;
+    float mLayerScale;
+
+    /// The scene graphs created so far, by LOD flags.
+    std::map<unsigned int, osg::ref_ptr<osg::Node> > mNodes;
+};
+
+class QuadTreeNode
+{
+public:
+    QuadTreeNode(float size, const osg::Vec2f& center)
+        : mSize(size)
+        , mCenter(center)
+    {
+        for (int i=0; i<4; ++i)
+            mChildren[i] = NULL;
+    }
+
+    ~QuadTreeNode()
+    {
+        for (int i=0; i<4; ++i)
+            delete mChildren[i];
+    }
+
+    /// Get the child that covers \a point, which must be inside this node. NULL if there is no terrain there.
+    QuadTreeNode* getChild(const osg::Vec2f& point) const
+    {
+        return mChildren[(point.x() >= mCenter.x() ? 1 : 0) | (point.y() >= mCenter.y() ? 2 : 0)];
+    }
+
+    /// Size in cell units.
+    float mSize;
+
+    /// Center in cell units.
+    osg::Vec2f mCenter;
+
+    /// Bounds in world units.
+    osg::BoundingBox mBounds;
+
+    /// Indexed by quadrant: bit 0 set for the east half, bit 1 set for the north half. NULL if there is no terrain there.
+    QuadTreeNode* mChildren[4];
+
+    /// NULL if the chunk is not needed at the moment.
+    osg::ref_ptr<QuadTreeChunk> mChunk;
+};
+
+/// Scene graph node that culls the quad tree.
+class QuadTreeRootNode : public osg::Node
+{
+public:
+    QuadTreeRootNode(QuadTreeWorld* world, const osg::BoundingBox& bounds)
+        : mWorld(world)
+        , mBounds(bounds)
+    {
+    }
+
+    virtual osg::BoundingSphere computeBound() const
+    {
+        return osg::BoundingSphere(mBounds);
+    }
+
+    virtual void traverse(osg::NodeVisitor& nv)
+    {
+        if (!mWorld)
+            return;
+
+        if (nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR)
+            mWorld->cull(static_cast<osgUtil::CullVisitor*>(&nv));
+        else
+            mWorld->traverseDisplayed(nv);
+    }
+
+    /// Called when the world goes away.
+    void detach()
+    {
+        mWorld = NULL;
+    }
+
+private:
+    QuadTreeWorld* mWorld;
+    osg::BoundingBox mBounds;
+};
+
+class BuildQuadTreeChunkItem : public SceneUtil::WorkItem
+{
+public:
+    BuildQuadTreeChunkItem(QuadTreeWorld* world, QuadTreeChunk* chunk, float size, const osg::Vec2f& center)
+        : mWorld(world)
+        , mChunk(chunk)
+        , mSize(size)
+        , mCenter(center)
+    {
+    }
+
+    virtual void doWork()
+    {
+        try
+        {
+            mWorld->buildChunk(mChunk, mSize, mCenter);
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Failed to build terrain chunk at " << mCenter.x() << ", " << mCenter.y() << ": " << e.what() << std::endl;
+        }
+        mTicket->signalDone();
+    }
+
+private:
+    QuadTreeWorld* mWorld;
+    osg::ref_ptr<QuadTreeChunk> mChunk;
+    float mSize;
+    osg::Vec2f mCenter;
+};
+
+QuadTreeWorld::QuadTreeWorld(osg::Group* parent, Resource::ResourceSystem* resourceSystem, osgUtil::IncrementalCompileOperation* ico,
+                             Storage* storage, int nodeMask, SceneUtil::WorkQueue* workQueue)
+    : Terrain::World(parent, resourceSystem, ico, storage, nodeMask)
+    , mWorkQueue(workQueue)
+    , mQuadTree(NULL)
+    , mLastCullTime(0.0)
+    // Larger chunks would have to skip more than a whole cell between two vertices
+    , mMaxChunkSize(static_cast<float>(storage->getCellVertices()-1))
+    , mLodFactor(1.f)
+    , mCompositeMapResolution(256)
+{
+}
+
+QuadTreeWorld::~QuadTreeWorld()
+{
+    if (mRootNode)
+    {
+        mTerrainRoot->removeChild(mRootNode);
+        mRootNode->detach();
+    }
+
+    // The workers refer to this world, so wait for any chunks still being built
+    for (std::vector<QuadTreeNode*>::iterator it = mChunkNodes.begin(); it != mChunkNodes.end(); ++it)
+        (*it)->mChunk->mTicket->waitTillDone();
+
+    delete mQuadTree;
+}
+
+void QuadTreeWorld::setLodFactor(float factor)
+{
+    mLodFactor = factor;
+}
+
+void QuadTreeWorld::setCompositeMapResolution(int resolution)
+{
+    mCompositeMapResolution = std::max(1, resolution);
+}
+
+bool QuadTreeWorld::buildQuadTree(QuadTreeNode* node)
+{
+    float cellWorldSize = mStorage->getCellWorldSize();
+    osg::Vec2f min = (node->mCenter - osg::Vec2f(node->mSize/2.f, node->mSize/2.f)) * cellWorldSize;
+    osg::Vec2f max = (node->mCenter + osg::Vec2f(node->mSize/2.f, node->mSize/2.f)) * cellWorldSize;
+
+    if (node->mSize <= 1.f)
+    {
+        float minHeight, maxHeight;
+        if (!mStorage->getMinMaxHeights(node->mSize, node->mCenter, minHeight, maxHeight))
+            return false;
+        node->mBounds = osg::BoundingBox(osg::Vec3f(min, minHeight), osg::Vec3f(max, maxHeight));
+        return true;
+    }
+
+    float quarter = node->mSize/4.f;
+    for (int i=0; i<4; ++i)
+    {
+        osg::Vec2f center = node->mCenter + osg::Vec2f((i&1) ? quarter : -quarter, (i&2) ? quarter : -quarter);
+        std::auto_ptr<QuadTreeNode> child (new QuadTreeNode(node->mSize/2.f, center));
+        if (!buildQuadTree(child.get()))
+            continue;
+        node->mBounds.expandBy(child->mBounds);
+        node->mChildren[i] = child.release();
+    }
+
+    if (!node->mBounds.valid())
+        return false;
+
+    // The chunk covers the whole node, including any cells without terrain
+    node->mBounds.xMin() = min.x();
+    node->mBounds.yMin() = min.y();
+    node->mBounds.xMax() = max.x();
+    node->mBounds.yMax() = max.y();
+    return true;
+}
+
+void QuadTreeWorld::update()
+{
+    if (!mRootNode)
+    {
+        float minX, maxX, minY, maxY;
+        mStorage->getBounds(minX, maxX, minY, maxY);
+
+        float size = 1.f;
+        while (size < maxX-minX || size < maxY-minY)
+            size *= 2.f;
+
+        std::auto_ptr<QuadTreeNode> quadTree (new QuadTreeNode(size, osg::Vec2f(minX + size/2.f, minY + size/2.f)));
+        // Also loads the land data of all cells, so that the chunks can be built on worker threads
+        if (buildQuadTree(quadTree.get()))
+            mQuadTree = quadTree.release();
+
+        mRootNode = new QuadTreeRootNode(this, mQuadTree ? mQuadTree->mBounds : osg::BoundingBox());
+        mTerrainRoot->addChild(mRootNode);
+        return;
+    }
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    for (unsigned int i=0; i<mChunkNodes.size();)
+    {
+        QuadTreeChunk* chunk = mChunkNodes[i]->mChunk;
+        if (chunk->isDone() && chunk->mLastUsed + sChunkExpiryDelay < mLastCullTime)
+        {
+            mChunkNodes[i]->mChunk = NULL;
+            mChunkNodes[i] = mChunkNodes.back();
+            mChunkNodes.pop_back();
+        }
+        else
+            ++i;
+    }
+}
+
+void QuadTreeWorld::cull(osgUtil::CullVisitor* cv)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    mDisplayed.clear();
+    if (!mQuadTree)
+        return;
+
+    if (cv->getFrameStamp())
+        mLastCullTime = cv->getFrameStamp()->getReferenceTime();
+
+    Selection selection;
+    select(mQuadTree, cv->getViewPointLocal(), cv, selection);
+
+    Selection sorted = selection;
+    std::sort(sorted.begin(), sorted.end());
+
+    unsigned int maxLodDelta = 0;
+    for (float size = 1.f; size < mMaxChunkSize; size *= 2.f)
+        ++maxLodDelta;
+
+    static const osg::Vec2f directions[4] = {
+        osg::Vec2f(0.f, 1.f), // North
+        osg::Vec2f(1.f, 0.f), // East
+        osg::Vec2f(0.f, -1.f), // South
+        osg::Vec2f(-1.f, 0.f) // West
+    };
+
+    for (Selection::iterator it = selection.begin(); it != selection.end(); ++it)
+    {
+        QuadTreeNode* node = *it;
+
+        // Stitch the edges to larger neighbours, so that there are no gaps. Smaller neighbours stitch themselves to us.
+        unsigned int lodFlags = 0;
+        for (int i=0; i<4; ++i)
+        {
+            osg::Vec2f neighbour = node->mCenter + directions[i] * (node->mSize/2.f + 0.5f);
+            float neighbourSize = getSelectedSize(sorted, neighbour);
+            unsigned int lodDelta = 0;
+            for (float size = node->mSize; size < neighbourSize; size *= 2.f)
+                ++lodDelta;
+            lodFlags |= std::min(lodDelta, maxLodDelta) << (4*i);
+        }
+
+        osg::ref_ptr<osg::Node> chunkNode = node->mChunk->getNode(lodFlags, mCache);
+        if (!chunkNode)
+            continue;
+        mDisplayed.push_back(chunkNode);
+        chunkNode->accept(*cv);
+    }
+}
+
+void QuadTreeWorld::traverseDisplayed(osg::NodeVisitor &nv)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mMutex);
+    for (std::vector<osg::ref_ptr<osg::Node> >::iterator it = mDisplayed.begin(); it != mDisplayed.end(); ++it)
+        (*it)->accept(nv);
+}
+
+void QuadTreeWorld::select(QuadTreeNode *node, const osg::Vec3f &eye, osgUtil::CullVisitor *cv, Selection &selection)
+{
+    if (cv->isCulled(node->mBounds))
+        return;
+
+    bool split = node->mSize > mMaxChunkSize
+            || (node->mSize > 1.f && getDistance(node->mBounds, eye) < node->mSize * mStorage->getCellWorldSize() * mLodFactor);
+
+    if (split && node->mSize <= mMaxChunkSize)
+    {
+        // Keep displaying this chunk until all of its visible children are done, so that no holes appear meanwhile
+        bool childrenDone = true;
+        for (int i=0; i<4; ++i)
+        {
+            QuadTreeNode* child = node->mChildren[i];
+            if (child && !cv->isCulled(child->mBounds) && !requestChunk(child, false))
+                childrenDone = false;
+        }
+        if (!childrenDone && requestChunk(node, true))
+        {
+            selection.push_back(node);
+            return;
+        }
+    }
+
+    if (split)
+    {
+        for (int i=0; i<4; ++i)
+        {
+            if (node->mChildren[i])
+                select(node->mChildren[i], eye, cv, selection);
+        }
+    }
+    else if (requestChunk(node, true))
+        selection.push_back(node);
+}
+
+bool QuadTreeWorld::requestChunk(QuadTreeNode *node, bool urgent)
+{
+    if (!node->mChunk)
+    {
+        node->mChunk = new QuadTreeChunk;
+        node->mChunk->mTicket = mWorkQueue->addWorkItem(new BuildQuadTreeChunkItem(this, node->mChunk, node->mSize, node->mCenter),
+                                                        urgent ? SceneUtil::WorkQueue::Priority_High : SceneUtil::WorkQueue::Priority_Normal);
+        mChunkNodes.push_back(node);
+    }
+    node->mChunk->mLastUsed = mLastCullTime;
+    return node->mChunk->isDone();
+}
+
+float QuadTreeWorld::getSelectedSize(const Selection& selection, const osg::Vec2f &point) const
+{
+    osg::Vec2f offset = point - mQuadTree->mCenter;
+    if (std::abs(offset.x()) > mQuadTree->mSize/2.f || std::abs(offset.y()) > mQuadTree->mSize/2.f)
+        return 0.f;
+
+    for (QuadTreeNode* node = mQuadTree; node; node = node->getChild(point))
+    {
+        if (std::binary_search(selection.begin(), selection.end(), node))
+            return node->mSize;
+    }
+    return 0.f;
+}
+
+void QuadTreeWorld::buildChunk(QuadTreeChunk *chunk, float size, const osg::Vec2f &center)
+{
+    // Every chunk has the vertex count of one cell, so each level up skips every other vertex
+    int lodLevel = 0;
+    for (float cells = size; cells > 1.f; cells /= 2.f)
+        ++lodLevel;
+
+    osg::ref_ptr<osg::Vec3Array> positions (new osg::Vec3Array);
+    osg::ref_ptr<osg::Vec3Array> normals (new osg::Vec3Array);
+    osg::ref_ptr<osg::Vec4Array> colors (new osg::Vec4Array);
+
+    osg::ref_ptr<osg::VertexBufferObject> vbo (new osg::VertexBufferObject);
+    positions->setVertexBufferObject(vbo);
+    normals->setVertexBufferObject(vbo);
+    colors->setVertexBufferObject(vbo);
+
+    mStorage->fillVertexBuffers(lodLevel, size, center, positions, normals, colors);
+
+    osg::ref_ptr<osg::Geometry> geometry (new osg::Geometry);
+    geometry->setVertexArray(positions);
+    geometry->setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
+    geometry->setColorArray(colors, osg::Array::BIND_PER_VERTEX);
+    geometry->setUseDisplayList(false);
+    geometry->setUseVertexBufferObjects(true);
+
+    geometry->addPrimitiveSet(mCache.getIndexBuffer(0));
+
+    // we already know the bounding box, so no need to let OSG compute it.
+    float minHeight = std::numeric_limits<float>::max();
+    float maxHeight = -std::numeric_limits<float>::max();
+    for (osg::Vec3Array::const_iterator it = positions->begin(); it != positions->end(); ++it)
+    {
+        minHeight = std::min(minHeight, it->z());
+        maxHeight = std::max(maxHeight, it->z());
+    }
+    float halfSize = 0.5f*size*mStorage->getCellWorldSize();
+    osg::BoundingBox bounds(osg::Vec3f(-halfSize, -halfSize, minHeight), osg::Vec3f(halfSize, halfSize, maxHeight));
+    geometry->setComputeBoundingBoxCallback(new StaticBoundingBoxCallback(bounds));
+
+    // use texture coordinates for both texture units, the layer texture and blend texture
+    for (unsigned int i=0; i<2; ++i)
+        geometry->setTexCoordArray(i, mCache.getUVBuffer());
+
+    osg::ref_ptr<osg::Geode> geode (new osg::Geode);
+    geode->addDrawable(geometry);
+
+    // build a kdtree to speed up intersection tests with the terrain
+    osg::ref_ptr<osg::KdTreeBuilder> kdTreeBuilder (new osg::KdTreeBuilder);
+    geode->accept(*kdTreeBuilder);
+
+    // For compiling textures, I don't think the osgFX::Effect does it correctly
+    osg::ref_ptr<osg::Node> textureCompileDummy (new osg::Node);
+
+    if (size <= 1.f)
+    {
+        std::vector<LayerInfo> layerList;
+        std::vector<osg::ref_ptr<osg::Image> > blendmaps;
+        mStorage->getBlendmaps(size, center, false, blendmaps, layerList);
+
+        for (std::vector<LayerInfo>::const_iterator it = layerList.begin(); it != layerList.end(); ++it)
+        {
+            chunk->mLayerTextures.push_back(mResourceSystem->getTextureManager()->getTexture2D(it->mDiffuseMap, osg::Texture::REPEAT, osg::Texture::REPEAT));
+            textureCompileDummy->getOrCreateStateSet()->setTextureAttributeAndModes(0, chunk->mLayerTextures.back());
+        }
+
+        for (std::vector<osg::ref_ptr<osg::Image> >::const_iterator it = blendmaps.begin(); it != blendmaps.end(); ++it)
+        {
+            osg::ref_ptr<osg::Texture2D> texture (new osg::Texture2D);
+            texture->setImage(*it);
+            texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+            texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+            texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+            texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+            texture->setResizeNonPowerOfTwoHint(false);
+            chunk->mBlendmapTextures.push_back(texture);
+        }
+
+        chunk->mLayerScale = 16.f;
+    }
+    else
+    {
+        osg::ref_ptr<osg::Texture2D> texture (new osg::Texture2D);
+        texture->setImage(createCompositeMap(size, center));
+        texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+        texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+        texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR);
+        texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+        chunk->mLayerTextures.push_back(texture);
+        textureCompileDummy->getOrCreateStateSet()->setTextureAttributeAndModes(0, texture);
+
+        chunk->mLayerScale = 1.f;
+    }
+
+    osg::Vec2f worldCenter = center*mStorage->getCellWorldSize();
+    chunk->mPosition = osg::Vec3f(worldCenter.x(), worldCenter.y(), 0.f);
+    chunk->mGeometry = geometry;
+    chunk->mNodes[0] = chunk->createNode(geode);
+
+    if (mIncrementalCompileOperation)
+    {
+        mIncrementalCompileOperation->add(geode);
+        mIncrementalCompileOperation->add(textureCompileDummy);
+    }
+}
+
+osg::ref_ptr<osg::Image> QuadTreeWorld::createCompositeMap(float size, const osg::Vec2f &center)
+{
+    int cells = static_cast<int>(size);
+    int pixelsPerCell = std::max(1, mCompositeMapResolution / cells);
+    int resolution = pixelsPerCell * cells;
+
+    osg::ref_ptr<osg::Image> image (new osg::Image);
+    image->allocateImage(resolution, resolution, 1, GL_RGB, GL_UNSIGNED_BYTE);
+
+    osg::Vec2f origin = center - osg::Vec2f(size/2.f, size/2.f);
+    for (int cellY=0; cellY<cells; ++cellY)
+    {
+        for (int cellX=0; cellX<cells; ++cellX)
+        {
+            std::vector<LayerInfo> layerList;
+            std::vector<osg::ref_ptr<osg::Image> > blendmaps;
+            mStorage->getBlendmaps(1.f, origin + osg::Vec2f(cellX+0.5f, cellY+0.5f), false, blendmaps, layerList);
+
+            std::vector<osg::Vec4f> layerColours;
+            for (std::vector<LayerInfo>::const_iterator it = layerList.begin(); it != layerList.end(); ++it)
+                layerColours.push_back(getLayerColour(it->mDiffuseMap));
+
+            for (int y=0; y<pixelsPerCell; ++y)
+            {
+                for (int x=0; x<pixelsPerCell; ++x)
+                {
+                    float cellPosX = (x+0.5f) / pixelsPerCell;
+                    float cellPosY = (y+0.5f) / pixelsPerCell;
+
+                    // Blend the layers like the terrain material does, the base layer has no blendmap
+                    osg::Vec4f colour = layerColours[0];
+                    for (unsigned int i=1; i<layerColours.size(); ++i)
+                    {
+                        float alpha = sampleBlendmap(blendmaps[i-1], cellPosX, cellPosY);
+                        colour = colour * (1.f-alpha) + layerColours[i] * alpha;
+                    }
+
+                    unsigned char* pixel = image->data(cellX*pixelsPerCell + x, cellY*pixelsPerCell + y);
+                    for (int c=0; c<3; ++c)
+                        pixel[c] = static_cast<unsigned char>(osg::clampBetween(colour[c], 0.f, 1.f) * 255.f);
+                }
+            }
+        }
+    }
+
+    return image;
+}
+
+osg::Vec4f QuadTreeWorld::getLayerColour(const std::string &texture)
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mLayerColourMutex);
+        std::map<std::string, osg::Vec4f>::const_iterator found = mLayerColours.find(texture);
+        if (found != mLayerColours.end())
+            return found->second;
+    }
+
+    osg::Vec4f colour(1.f, 1.f, 1.f, 1.f);
+    osg::ref_ptr<osg::Image> image = mResourceSystem->getTextureManager()->getImage(texture);
+    // Older OSG versions can not read the pixels of compressed images
+#if OSG_MIN_VERSION_REQUIRED(3,4,0)
+    if (image && image->s() > 0 && image->t() > 0)
+#else
+    if (image && image->s() > 0 && image->t() > 0 && !image->isCompressed())
+#endif
+    {
+        // A coarse grid of samples is plenty for the average
+        const int samples = 16;
+        osg::Vec4f sum;
+        for (int t=0; t<samples; ++t)
+        {
+            for (int s=0; s<samples; ++s)
+                sum += image->getColor((s * image->s()) / samples, (t * image->t()) / samples);
+        }
+        colour = sum / static_cast<float>(samples*samples);
+        colour.a() = 1.f;
+    }
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mLayerColourMutex);
+    mLayerColours[texture] = colour;
+    return colour;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef COMPONENTS_TERRAIN_QUADTREEWORLD_H
+#define COMPONENTS_TERRAIN_QUADTREEWORLD_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <osg/Vec4f>
+
+#include <OpenThreads/Mutex>
+
+#include "world.hpp"
+
+namespace osg
+{
+    class Image;
+    class NodeVisitor;
+}
+
+namespace osgUtil
+{
+    class CullVisitor;
+}
+
+namespace SceneUtil
+{
+    class WorkQueue;
+}
+
+namespace Terrain
+{
+
+    class QuadTreeNode;
+    class QuadTreeChunk;
+    class QuadTreeRootNode;
+
+    /// @brief Terrain implementation that displays the whole landscape, using a quad tree of chunks with a level of
+    /// detail depending on their distance from the viewer.
+    /// @par All chunks have the same number of vertices, so larger chunks are coarser. Chunks larger than one cell use
+    /// a low resolution composite of their layer textures. Chunks are built on a WorkQueue when they are first needed;
+    /// until then, their parent is displayed in their place.
+    /// @note loadCell() and unloadCell() are ignored, since all terrain is displayed at all times.
+    class QuadTreeWorld : public Terrain::World
+    {
+    public:
+        /// @param workQueue Queue to build the chunks on. Must outlive the QuadTreeWorld.
+        QuadTreeWorld(osg::Group* parent, Resource::ResourceSystem* resourceSystem, osgUtil::IncrementalCompileOperation* ico,
+                      Storage* storage, int nodeMask, SceneUtil::WorkQueue* workQueue);
+        ~QuadTreeWorld();
+
+        /// Create the quad tree on the first call. Afterwards, drop chunks that have not been displayed for a while.
+        /// @note The quad tree can not be created earlier, because the storage needs all content files to be loaded.
+        virtual void update();
+
+        /// A chunk of n cells is split into its children when the viewer is closer than n * \a factor cells to it.
+        /// Higher values give more detail, at the cost of more chunks to build and draw.
+        void setLodFactor(float factor);
+
+        /// Size of the composite textures used for chunks larger than one cell, in pixels.
+        void setCompositeMapResolution(int resolution);
+
+    private:
+        friend class QuadTreeRootNode;
+        friend class BuildQuadTreeChunkItem;
+
+        /// Create the nodes of the quad tree below \a node, and compute their bounds.
+        /// @return false if there is no terrain anywhere in \a node.
+        bool buildQuadTree(QuadTreeNode* node);
+
+        /// Pick the chunks to display for this view, and traverse them.
+        void cull(osgUtil::CullVisitor* cv);
+
+        /// Traverse the chunks that were last displayed, e.g. for intersection tests.
+        void traverseDisplayed(osg::NodeVisitor& nv);
+
+        typedef std::vector<QuadTreeNode*> Selection;
+        void select(QuadTreeNode* node, const osg::Vec3f& eye, osgUtil::CullVisitor* cv, Selection& selection);
+
+        /// Is the chunk of \a node done building? If not, have it built.
+        bool requestChunk(QuadTreeNode* node, bool urgent);
+
+        /// Get the size of the selected chunk that covers \a point, in cells. 0 if there is none.
+        /// @param selection Must be sorted.
+        float getSelectedSize(const Selection& selection, const osg::Vec2f& point) const;
+
+        /// Create the scene graph of a chunk. Thread safe.
+        void buildChunk(QuadTreeChunk* chunk, float size, const osg::Vec2f& center);
+
+        /// Blend the average colours of the layer textures into one texture for the whole chunk. Thread safe.
+        osg::ref_ptr<osg::Image> createCompositeMap(float size, const osg::Vec2f& center);
+
+        /// Get the average colour of a layer texture. Thread safe.
+        osg::Vec4f getLayerColour(const std::string& texture);
+
+        SceneUtil::WorkQueue* mWorkQueue;
+
+        osg::ref_ptr<QuadTreeRootNode> mRootNode;
+        QuadTreeNode* mQuadTree;
+
+        /// Nodes that have a chunk, built or not.
+        std::vector<QuadTreeNode*> mChunkNodes;
+
+        /// Chunks displayed by the last cull traversal.
+        std::vector<osg::ref_ptr<osg::Node> > mDisplayed;
+        double mLastCullTime;
+
+        /// Guards the quad tree against concurrent cull traversals.
+        OpenThreads::Mutex mMutex;
+
+        std::map<std::string, osg::Vec4f> mLayerColours;
+        OpenThreads::Mutex mLayerColourMutex;
+
+        /// Largest chunk that can be built with a single level of detail, in cells.
+        float mMaxChunkSize;
+
+        float mLodFactor;
+        int mCompositeMapResolution;
+    };
+
+}
+
+#endif
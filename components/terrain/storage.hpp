@@ -71,6 +71,11 @@ namespace Terrain
 
         virtual float getHeightAt (const osg::Vec3f& worldPos) = 0;
 
+        /// Load the data needed for the terrain of the given cell that can not be loaded from background threads, so
+        /// that the cell's terrain can then be built on a background thread.
+        /// @note Must be called from the main thread.
+        virtual void loadCellData(int cellX, int cellY) {}
+
         virtual LayerInfo getDefaultLayer() = 0;
 
         /// Get the transformation factor for mapping cell units to world units.
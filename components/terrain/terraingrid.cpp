@@ -1,11 +1,13 @@
 #include "terraingrid.hpp"
 
 #include <memory>
+#include <iostream>
 
 #include <components/resource/resourcesystem.hpp>
 #include <components/resource/texturemanager.hpp>
 
 #include <components/sceneutil/lightmanager.hpp>
+#include <components/sceneutil/workqueue.hpp>
 
 #include <osg/PositionAttitudeTransform>
 #include <osg/Geometry>
@@ -16,6 +18,8 @@
 
 #include <osgUtil/IncrementalCompileOperation>
 
+#include <OpenThreads/ScopedLock>
+
 #include "material.hpp"
 #include "storage.hpp"
 
@@ -42,10 +46,67 @@ namespace
 namespace Terrain
 {
 
+/// The terrain of one cell, which may still be being built on a worker thread.
+class TerrainChunk : public osg::Referenced
+{
+public:
+    bool isDone() const
+    {
+        return !mTicket || mTicket->isDone();
+    }
+
+    /// NULL if the chunk was not built in the background.
+    osg::ref_ptr<SceneUtil::WorkTicket> mTicket;
+
+    /// NULL if there is no terrain in the cell.
+    /// @note Written by the worker thread, only to be read once the chunk is done.
+    osg::ref_ptr<osg::Node> mNode;
+};
+
+class BuildChunkItem : public SceneUtil::WorkItem
+{
+public:
+    BuildChunkItem(TerrainGrid* grid, int x, int y, TerrainChunk* chunk)
+        : mGrid(grid)
+        , mX(x)
+        , mY(y)
+        , mChunk(chunk)
+    {
+    }
+
+    virtual void doWork()
+    {
+        try
+        {
+            mChunk->mNode = mGrid->cacheCell(mX, mY);
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Failed to build terrain for cell " << mX << ", " << mY << ": " << e.what() << std::endl;
+        }
+        mTicket->signalDone();
+    }
+
+private:
+    TerrainGrid* mGrid;
+    int mX, mY;
+    osg::ref_ptr<TerrainChunk> mChunk;
+};
+
+class GridElement
+{
+public:
+    osg::ref_ptr<TerrainChunk> mChunk;
+
+    /// Has the chunk been added to the scene yet?
+    bool mAttached;
+};
+
 TerrainGrid::TerrainGrid(osg::Group* parent, Resource::ResourceSystem* resourceSystem, osgUtil::IncrementalCompileOperation* ico,
-                         Storage* storage, int nodeMask)
+                         Storage* storage, int nodeMask, SceneUtil::WorkQueue* workQueue)
     : Terrain::World(parent, resourceSystem, ico, storage, nodeMask)
-    , mKdTreeBuilder(new osg::KdTreeBuilder)
+    , mUnloadedCacheSize(0)
+    , mWorkQueue(workQueue)
 {
 }
 
@@ -55,30 +116,25 @@ TerrainGrid::~TerrainGrid()
     {
         unloadCell(mGrid.begin()->first.first, mGrid.begin()->first.second);
     }
-}
 
-class GridElement
-{
-public:
-    osg::ref_ptr<osg::PositionAttitudeTransform> mNode;
-};
+    // The workers refer to this grid, so wait for any chunks still being built
+    for (UnloadedCache::iterator it = mUnloadedCache.begin(); it != mUnloadedCache.end(); ++it)
+    {
+        if (it->second->mTicket)
+            it->second->mTicket->waitTillDone();
+    }
+}
 
-void TerrainGrid::loadCell(int x, int y)
+osg::ref_ptr<osg::Node> TerrainGrid::buildTerrain(int x, int y)
 {
-    if (mGrid.find(std::make_pair(x, y)) != mGrid.end())
-        return; // already loaded
-
     osg::Vec2f center(x+0.5f, y+0.5f);
     float minH, maxH;
     if (!mStorage->getMinMaxHeights(1, center, minH, maxH))
-        return; // no terrain defined
-
-    std::auto_ptr<GridElement> element (new GridElement);
+        return NULL; // no terrain defined
 
     osg::Vec2f worldCenter = center*mStorage->getCellWorldSize();
-    element->mNode = new osg::PositionAttitudeTransform;
-    element->mNode->setPosition(osg::Vec3f(worldCenter.x(), worldCenter.y(), 0.f));
-    mTerrainRoot->addChild(element->mNode);
+    osg::ref_ptr<osg::PositionAttitudeTransform> transform (new osg::PositionAttitudeTransform);
+    transform->setPosition(osg::Vec3f(worldCenter.x(), worldCenter.y(), 0.f));
 
     osg::ref_ptr<osg::Vec3Array> positions (new osg::Vec3Array);
     osg::ref_ptr<osg::Vec3Array> normals (new osg::Vec3Array);
@@ -115,7 +171,9 @@ void TerrainGrid::loadCell(int x, int y)
 
     // build a kdtree to speed up intersection tests with the terrain
     // Note, the build could be optimized using a custom kdtree builder, since we know that the terrain can be represented by a quadtree
-    geode->accept(*mKdTreeBuilder);
+    // The builder keeps state during traversal, so use a new one for each chunk, as we may be running on several threads.
+    osg::ref_ptr<osg::KdTreeBuilder> kdTreeBuilder (new osg::KdTreeBuilder);
+    geode->accept(*kdTreeBuilder);
 
     std::vector<LayerInfo> layerList;
     std::vector<osg::ref_ptr<osg::Image> > blendmaps;
@@ -155,7 +213,7 @@ void TerrainGrid::loadCell(int x, int y)
     effect->addCullCallback(new SceneUtil::LightListCallback);
 
     effect->addChild(geode);
-    element->mNode->addChild(effect);
+    transform->addChild(effect);
 
     if (mIncrementalCompileOperation)
     {
@@ -163,6 +221,95 @@ void TerrainGrid::loadCell(int x, int y)
         mIncrementalCompileOperation->add(textureCompileDummy);
     }
 
+    return transform;
+}
+
+osg::ref_ptr<osg::Node> TerrainGrid::cacheCell(int x, int y)
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mChunkCacheMutex);
+        ChunkCache::iterator found = mChunkCache.find(std::make_pair(x, y));
+        if (found != mChunkCache.end())
+        {
+            osg::ref_ptr<osg::Node> cached;
+            if (found->second.lock(cached))
+                return cached;
+        }
+    }
+
+    osg::ref_ptr<osg::Node> node = buildTerrain(x, y);
+    if (!node)
+        return NULL;
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mChunkCacheMutex);
+    // Forget chunks that nobody holds on to any more
+    for (ChunkCache::iterator it = mChunkCache.begin(); it != mChunkCache.end();)
+    {
+        if (!it->second.valid())
+            mChunkCache.erase(it++);
+        else
+            ++it;
+    }
+    mChunkCache[std::make_pair(x, y)] = node;
+    return node;
+}
+
+osg::ref_ptr<TerrainChunk> TerrainGrid::takeUnloadedChunk(int x, int y)
+{
+    for (UnloadedCache::iterator it = mUnloadedCache.begin(); it != mUnloadedCache.end(); ++it)
+    {
+        if (it->first == std::make_pair(x, y))
+        {
+            osg::ref_ptr<TerrainChunk> chunk = it->second;
+            mUnloadedCache.erase(it);
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+void TerrainGrid::loadCell(int x, int y)
+{
+    if (mGrid.find(std::make_pair(x, y)) != mGrid.end())
+        return; // already loaded
+
+    osg::ref_ptr<TerrainChunk> chunk = takeUnloadedChunk(x, y);
+    if (!chunk)
+    {
+        chunk = new TerrainChunk;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(mChunkCacheMutex);
+            ChunkCache::iterator found = mChunkCache.find(std::make_pair(x, y));
+            if (found != mChunkCache.end())
+                found->second.lock(chunk->mNode);
+        }
+
+        if (!chunk->mNode)
+        {
+            if (mWorkQueue)
+            {
+                mStorage->loadCellData(x, y);
+                chunk->mTicket = mWorkQueue->addWorkItem(new BuildChunkItem(this, x, y, chunk.get()),
+                                                         SceneUtil::WorkQueue::Priority_High);
+            }
+            else
+            {
+                chunk->mNode = buildTerrain(x, y);
+                if (!chunk->mNode)
+                    return; // no terrain defined
+            }
+        }
+    }
+
+    std::auto_ptr<GridElement> element (new GridElement);
+    element->mChunk = chunk;
+    element->mAttached = false;
+    if (chunk->isDone() && chunk->mNode)
+    {
+        mTerrainRoot->addChild(chunk->mNode);
+        element->mAttached = true;
+    }
+
     mGrid[std::make_pair(x,y)] = element.release();
 }
 
@@ -173,10 +320,44 @@ void TerrainGrid::unloadCell(int x, int y)
         return;
 
     GridElement* element = it->second;
-    mTerrainRoot->removeChild(element->mNode);
+    if (element->mAttached)
+        mTerrainRoot->removeChild(element->mChunk->mNode);
+
+    // Chunks still being built are kept as well, so that their work is not wasted
+    if (mUnloadedCacheSize > 0 || !element->mChunk->isDone())
+    {
+        mUnloadedCache.push_front(std::make_pair(it->first, element->mChunk));
+        while (mUnloadedCache.size() > mUnloadedCacheSize && mUnloadedCache.back().second->isDone())
+            mUnloadedCache.pop_back();
+    }
+
     delete element;
 
     mGrid.erase(it);
 }
 
+void TerrainGrid::update()
+{
+    for (Grid::iterator it = mGrid.begin(); it != mGrid.end(); ++it)
+    {
+        GridElement* element = it->second;
+        if (!element->mAttached && element->mChunk->isDone() && element->mChunk->mNode)
+        {
+            mTerrainRoot->addChild(element->mChunk->mNode);
+            element->mAttached = true;
+        }
+    }
+
+    // Drop chunks that were held on to beyond the cache size only because they were still being built
+    while (mUnloadedCache.size() > mUnloadedCacheSize && mUnloadedCache.back().second->isDone())
+        mUnloadedCache.pop_back();
+}
+
+void TerrainGrid::setUnloadedCacheSize(unsigned int size)
+{
+    mUnloadedCacheSize = size;
+    while (mUnloadedCache.size() > mUnloadedCacheSize && mUnloadedCache.back().second->isDone())
+        mUnloadedCache.pop_back();
+}
+
 }
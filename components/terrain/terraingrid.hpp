@@ -1,35 +1,69 @@
 #ifndef COMPONENTS_TERRAIN_TERRAINGRID_H
 #define COMPONENTS_TERRAIN_TERRAINGRID_H
 
+#include <map>
+#include <list>
+
+#include <osg/observer_ptr>
+
+#include <OpenThreads/Mutex>
+
 #include "world.hpp"
 #include "material.hpp"
 
-namespace osg
+namespace SceneUtil
 {
-    class KdTreeBuilder;
+    class WorkQueue;
 }
 
 namespace Terrain
 {
 
     class GridElement;
+    class TerrainChunk;
 
     /// @brief Simple terrain implementation that loads cells in a grid, with no LOD
     class TerrainGrid : public Terrain::World
     {
     public:
+        /// @param workQueue If set, the terrain of cells passed to loadCell() is built on this queue, and added to the
+        /// scene by update() once done. Otherwise, it is built right away. The queue must outlive the TerrainGrid.
         TerrainGrid(osg::Group* parent, Resource::ResourceSystem* resourceSystem, osgUtil::IncrementalCompileOperation* ico,
-              Storage* storage, int nodeMask);
+              Storage* storage, int nodeMask, SceneUtil::WorkQueue* workQueue = NULL);
         ~TerrainGrid();
 
         virtual void loadCell(int x, int y);
         virtual void unloadCell(int x, int y);
 
+        virtual void update();
+
+        virtual osg::ref_ptr<osg::Node> cacheCell(int x, int y);
+
+        /// Number of unloaded cells to keep the terrain of, so that it need not be rebuilt when the player returns to
+        /// one of them soon.
+        void setUnloadedCacheSize(unsigned int size);
+
     private:
+        /// Create the scene graph for the terrain of one cell. Thread safe.
+        osg::ref_ptr<osg::Node> buildTerrain(int x, int y);
+
+        /// Get the chunk of a cell from the unloaded cache, or NULL if it is not there.
+        osg::ref_ptr<TerrainChunk> takeUnloadedChunk(int x, int y);
+
         typedef std::map<std::pair<int, int>, GridElement*> Grid;
         Grid mGrid;
 
-        osg::ref_ptr<osg::KdTreeBuilder> mKdTreeBuilder;
+        /// Chunks created by cacheCell(), for as long as someone holds on to them.
+        typedef std::map<std::pair<int, int>, osg::observer_ptr<osg::Node> > ChunkCache;
+        ChunkCache mChunkCache;
+        OpenThreads::Mutex mChunkCacheMutex;
+
+        /// Chunks of recently unloaded cells, most recently unloaded first.
+        typedef std::list<std::pair<std::pair<int, int>, osg::ref_ptr<TerrainChunk> > > UnloadedCache;
+        UnloadedCache mUnloadedCache;
+        unsigned int mUnloadedCacheSize;
+
+        SceneUtil::WorkQueue* mWorkQueue;
     };
 
 }
@@ -2,6 +2,7 @@
 #define COMPONENTS_TERRAIN_WORLD_H
 
 #include <osg/ref_ptr>
+#include <osg/Node>
 
 #include "defs.hpp"
 #include "buffercache.hpp"
@@ -45,6 +46,15 @@ namespace Terrain
         virtual void loadCell(int x, int y) {}
         virtual void unloadCell(int x, int y) {}
 
+        /// Add terrain that finished loading in the background to the scene. Call once per frame.
+        virtual void update() {}
+
+        /// Create the terrain for the given cell ahead of a loadCell() call, so that the latter only has to attach it.
+        /// The terrain stays available for loadCell() for as long as the caller holds on to the returned node.
+        /// @note Thread safe, may be called from background threads. The ESM::Land data of the cell must already be loaded.
+        /// @return NULL if the implementation does not support caching or there is no terrain in this cell.
+        virtual osg::ref_ptr<osg::Node> cacheCell(int x, int y) { return NULL; }
+
         Storage* getStorage() { return mStorage; }
 
     protected:
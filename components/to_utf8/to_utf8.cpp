@@ -46,6 +46,7 @@ using namespace ToUTF8;
 
 Utf8Encoder::Utf8Encoder(const FromType sourceEncoding):
     mOutput(50*1024)
+    , mEncoding(sourceEncoding)
 {
     switch (sourceEncoding)
     {
@@ -40,6 +40,10 @@ namespace ToUTF8
                 return getLegacyEnc(str.c_str(), str.size());
             }
 
+            /// The code page this encoder converts from. Since an encoder is not thread safe, use this to set up
+            /// another encoder for use in another thread.
+            FromType getEncoding() const { return mEncoding; }
+
         private:
             void resize(size_t size);
             size_t getLength(const char* input, bool &ascii);
@@ -49,6 +53,7 @@ namespace ToUTF8
 
             std::vector<char> mOutput;
             signed char* translationArray;
+            FromType mEncoding;
     };
 }
 
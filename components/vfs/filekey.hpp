@@ -0,0 +1,43 @@
+#ifndef OPENMW_COMPONENTS_VFS_FILEKEY_H
+#define OPENMW_COMPONENTS_VFS_FILEKEY_H
+
+#include <cstddef>
+#include <string>
+
+namespace VFS
+{
+
+    /// @brief A normalized file name along with its hash. Use Manager::makeKey to create one, and keep it around if the
+    /// same file is looked up repeatedly, to avoid normalizing and hashing the name each time.
+    class FileKey
+    {
+    public:
+        FileKey();
+
+        /// @note \a normalizedName must already be normalized by the Manager it will be used with.
+        explicit FileKey(const std::string& normalizedName);
+
+        const std::string& getName() const { return mName; }
+
+        size_t getHash() const { return mHash; }
+
+        bool operator== (const FileKey& other) const { return mHash == other.mHash && mName == other.mName; }
+        /// @note Orders by hash first, so keys can be compared cheaply when used in a std::map. The order is stable,
+        /// but not alphabetical.
+        bool operator< (const FileKey& other) const
+        {
+            if (mHash != other.mHash)
+                return mHash < other.mHash;
+            return mName < other.mName;
+        }
+
+        static size_t hash(const std::string& normalizedName);
+
+    private:
+        std::string mName;
+        size_t mHash;
+    };
+
+}
+
+#endif
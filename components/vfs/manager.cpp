@@ -3,6 +3,8 @@
 #include <stdexcept>
 #include <locale>
 
+#include <components/misc/hash.hpp>
+
 #include "archive.hpp"
 
 namespace
@@ -29,6 +31,22 @@ namespace
 namespace VFS
 {
 
+    FileKey::FileKey()
+        : mHash(hash(std::string()))
+    {
+    }
+
+    FileKey::FileKey(const std::string &normalizedName)
+        : mName(normalizedName)
+        , mHash(hash(normalizedName))
+    {
+    }
+
+    size_t FileKey::hash(const std::string &normalizedName)
+    {
+        return static_cast<size_t>(Misc::fnv1aHash(normalizedName));
+    }
+
     Manager::Manager(bool strict)
         : mStrict(strict)
     {
@@ -53,30 +71,74 @@ namespace VFS
 
         for (std::vector<Archive*>::const_iterator it = mArchives.begin(); it != mArchives.end(); ++it)
             (*it)->listResources(mIndex, mStrict ? &strict_normalize_char : &nonstrict_normalize_char);
+
+        // Keep the table at most half full, so probe sequences stay short
+        size_t tableSize = 1;
+        while (tableSize < mIndex.size()*2)
+            tableSize *= 2;
+
+        HashEntry empty;
+        empty.mHash = 0;
+        empty.mName = NULL;
+        empty.mFile = NULL;
+        mHashIndex.assign(tableSize, empty);
+
+        const size_t mask = tableSize - 1;
+        for (std::map<std::string, File*>::const_iterator it = mIndex.begin(); it != mIndex.end(); ++it)
+        {
+            HashEntry entry;
+            entry.mHash = FileKey::hash(it->first);
+            entry.mName = &it->first;
+            entry.mFile = it->second;
+
+            size_t slot = entry.mHash & mask;
+            while (mHashIndex[slot].mFile)
+                slot = (slot + 1) & mask;
+            mHashIndex[slot] = entry;
+        }
     }
 
-    Files::IStreamPtr Manager::get(const std::string &name) const
+    File* Manager::find(const FileKey &key) const
     {
-        std::string normalized = name;
-        normalize_path(normalized, mStrict);
+        if (mHashIndex.empty())
+            return NULL;
+
+        const size_t mask = mHashIndex.size() - 1;
+        for (size_t slot = key.getHash() & mask; mHashIndex[slot].mFile; slot = (slot + 1) & mask)
+        {
+            const HashEntry& entry = mHashIndex[slot];
+            if (entry.mHash == key.getHash() && *entry.mName == key.getName())
+                return entry.mFile;
+        }
+        return NULL;
+    }
 
-        return getNormalized(normalized);
+    Files::IStreamPtr Manager::get(const std::string &name) const
+    {
+        return get(makeKey(name));
     }
 
     Files::IStreamPtr Manager::getNormalized(const std::string &normalizedName) const
     {
-        std::map<std::string, File*>::const_iterator found = mIndex.find(normalizedName);
-        if (found == mIndex.end())
-            throw std::runtime_error("Resource '" + normalizedName + "' not found");
-        return found->second->open();
+        return get(FileKey(normalizedName));
+    }
+
+    Files::IStreamPtr Manager::get(const FileKey &key) const
+    {
+        File* file = find(key);
+        if (!file)
+            throw std::runtime_error("Resource '" + key.getName() + "' not found");
+        return file->open();
     }
 
     bool Manager::exists(const std::string &name) const
     {
-        std::string normalized = name;
-        normalize_path(normalized, mStrict);
+        return find(makeKey(name)) != NULL;
+    }
 
-        return mIndex.find(normalized) != mIndex.end();
+    bool Manager::exists(const FileKey &key) const
+    {
+        return find(key) != NULL;
     }
 
     const std::map<std::string, File*>& Manager::getIndex() const
@@ -89,4 +151,11 @@ namespace VFS
         normalize_path(name, mStrict);
     }
 
+    FileKey Manager::makeKey(const std::string &name) const
+    {
+        std::string normalized = name;
+        normalize_path(normalized, mStrict);
+        return FileKey(normalized);
+    }
+
 }
@@ -3,8 +3,11 @@
 
 #include <components/files/constrainedfilestream.hpp>
 
+#include "filekey.hpp"
+
 #include <vector>
 #include <map>
+#include <string>
 
 namespace VFS
 {
@@ -35,12 +38,17 @@ namespace VFS
         /// Does a file with this name exist?
         bool exists(const std::string& name) const;
 
-        /// Get a complete list of files from all archives
+        bool exists(const FileKey& key) const;
+
+        /// Get a complete list of files from all archives, sorted by name.
         const std::map<std::string, File*>& getIndex() const;
 
         /// Normalize the given filename, making slashes/backslashes consistent, and lower-casing if mStrict is false.
         void normalizeFilename(std::string& name) const;
 
+        /// Create a key for looking up the given filename.
+        FileKey makeKey(const std::string& name) const;
+
         /// Retrieve a file by name.
         /// @note Throws an exception if the file can not be found.
         Files::IStreamPtr get(const std::string& name) const;
@@ -49,12 +57,30 @@ namespace VFS
         /// @note Throws an exception if the file can not be found.
         Files::IStreamPtr getNormalized(const std::string& normalizedName) const;
 
+        /// Retrieve a file by key.
+        /// @note Throws an exception if the file can not be found.
+        Files::IStreamPtr get(const FileKey& key) const;
+
     private:
+        /// Look up a file in the hash index, or NULL if not found.
+        File* find(const FileKey& key) const;
+
         bool mStrict;
 
         std::vector<Archive*> mArchives;
 
         std::map<std::string, File*> mIndex;
+
+        struct HashEntry
+        {
+            size_t mHash;
+            const std::string* mName;
+            File* mFile;
+        };
+
+        /// Open addressing hash table over mIndex, with linear probing. The size is a power of two and empty slots have
+        /// a NULL mFile.
+        std::vector<HashEntry> mHashIndex;
     };
 
 }